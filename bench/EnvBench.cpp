@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "tetris_env.h"
+
+// Environment steps per second of the batch environment through its C API, for a few batch sizes
+// and thread counts. Actions are random placements drawn before the clock starts.
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_envbench [--steps <per run>] [--threads <max>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], int& steps, int& maxThreads) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--steps" && hasValue) {
+			steps = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--threads" && hasValue) {
+			maxThreads = std::max(1, atoi(argv[++i]));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[ ]) {
+	int steps = 200;
+	int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency( )));
+	if (!parseArguments(argc, argv, steps, maxThreads)) return 1;
+
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	std::mt19937 random(42);
+	std::printf("%d steps per run, random placements, env steps per second\n", steps);
+	for (size_t count : { 256, 4096, 65536 }) {
+		std::vector<std::vector<uint8_t>> actions(16, std::vector<uint8_t>(count));
+		for (auto& batch : actions)
+			for (auto& action : batch) action = static_cast<uint8_t>(random( ) % 256);
+
+		for (int threads : threadCounts) {
+			TetrisEnv* env = tetris_env_create(count, 1, threads);
+			if (!env) {
+				std::cerr << "Failed to create an environment of " << count << " boards" << std::endl;
+				return 1;
+			}
+			tetris_env_step(env, actions[0].data( ));
+			auto start = std::chrono::steady_clock::now( );
+			for (int step = 0; step < steps; step++) tetris_env_step(env, actions[step % actions.size( )].data( ));
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now( ) - start).count( );
+			double stepsPerSecond = static_cast<double>(count) * steps / seconds;
+
+			std::printf("%6zu boards %3d threads: %12.0f steps/s  %8.1f us per batch step\n",
+				count, threads, stepsPerSecond, seconds * 1e6 / steps);
+			tetris_env_destroy(env);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "AudioMixer.hpp"
+
+// Cost of one AudioMixer::mix call per device buffer at a few voice counts, against the time
+// that buffer lasts at 44.1 kHz stereo
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_mixbench [--frames <per buffer>] [--buffers <count>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], size_t& frames, int& buffers) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--frames" && hasValue) {
+			frames = static_cast<size_t>(std::max(8, atoi(argv[++i])));
+		} else if (arg == "--buffers" && hasValue) {
+			buffers = std::max(1, atoi(argv[++i]));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[ ]) {
+	size_t frames = 2048;
+	int buffers = 2000;
+	if (!parseArguments(argc, argv, frames, buffers)) return 1;
+
+	constexpr int channels = 2;
+	constexpr double rate = 44100.0;
+	const size_t samples = frames * channels;
+
+	// Clips of different lengths so voices end and loop at different points of a buffer
+	std::vector<std::vector<int16_t>> clips(7);
+	for (size_t clip = 0; clip < clips.size( ); clip++) {
+		clips[clip].resize((clip + 1) * 7919 * channels);
+		for (size_t i = 0; i < clips[clip].size( ); i++)
+			clips[clip][i] = static_cast<int16_t>(12000.0 * std::sin(i * (0.01 + clip * 0.003)));
+	}
+
+	std::vector<int16_t> out(samples);
+	double bufferUs = frames / rate * 1e6;
+	std::printf("%zu frames per buffer (%.0f us of audio), %d buffers\n", frames, bufferUs, buffers);
+
+	for (size_t voices : { 8, 32, 128 }) {
+		AudioMixer mixer(voices);
+		for (size_t voice = 0; voice < voices; voice++) {
+			const auto& clip = clips[voice % clips.size( )];
+			mixer.play(static_cast<uint32_t>(voice), { clip.data( ), static_cast<uint32_t>(clip.size( )) }, 0.2f, -1);
+			// The command queue is drained by mix, keep it from filling up
+			if (voice % 128 == 127) mixer.mix(out.data( ), samples);
+		}
+		mixer.mix(out.data( ), samples);
+
+		double worstUs = 0;
+		auto start = std::chrono::steady_clock::now( );
+		for (int buffer = 0; buffer < buffers; buffer++) {
+			std::fill(out.begin( ), out.end( ), int16_t(0));
+			auto bufferStart = std::chrono::steady_clock::now( );
+			mixer.mix(out.data( ), samples);
+			worstUs = std::max(worstUs, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now( ) - bufferStart).count( ));
+		}
+		double totalUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now( ) - start).count( );
+		double meanUs = totalUs / buffers;
+
+		std::printf("%4zu voices: mean %8.2f us  worst %8.2f us  %6.3f%% of the buffer, %.2f ns per voice sample\n",
+			voices, meanUs, worstUs, meanUs / bufferUs * 100.0, meanUs * 1000.0 / (voices * samples));
+	}
+
+	return 0;
+}
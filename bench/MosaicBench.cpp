@@ -0,0 +1,154 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <SDL2/SDL.h>
+}
+
+#include "BoardMosaic.hpp"
+#include "GameBoard.hpp"
+
+// Frame cost of the mosaic viewer against the number of boards on SDL's software renderer: every
+// board is a real GameBoard driven by random input like a self-play run, its snapshot goes into a
+// BoardMosaic, and the composed grid is uploaded and scaled onto an 800x720 target in one copy.
+// Sprites are generated, see RenderBench.
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_mosaicbench [--frames <count>] [--seed <n>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], int& frames, uint32_t& seed) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--frames" && hasValue) {
+			frames = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--seed" && hasValue) {
+			seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+namespace {
+	constexpr int OUTPUT_WIDTH = 800, OUTPUT_HEIGHT = 720;
+	constexpr int BOARD_COUNTS[ ] = { 1, 16, 32, 48, 64 };
+
+	uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) { return r << 24 | g << 16 | b << 8 | a; }
+
+	// A bevelled block, shaded per shape and tinted per color
+	uint16_t addBlock(TileEngine& engine, int shape, int color) {
+		uint32_t pixels[TileEngine::TILE_PIXELS];
+		for (int i = 0; i < TileEngine::TILE_PIXELS; i++) {
+			int x = i % TileEngine::TILE_SIZE, y = i / TileEngine::TILE_SIZE;
+			uint32_t shade = (x == 0 || y == 0) ? 255 : (x == TileEngine::TILE_SIZE - 1 || y == TileEngine::TILE_SIZE - 1) ? 96 : static_cast<uint32_t>(120 + shape * 8);
+			pixels[i] = pack(shade * (color * 37 % 256) / 255, shade * (color * 91 % 256) / 255, shade, 255);
+		}
+		return engine.addTile(pixels);
+	}
+
+	uint16_t addFlat(TileEngine& engine, uint32_t color) {
+		uint32_t pixels[TileEngine::TILE_PIXELS];
+		for (uint32_t& pixel : pixels) pixel = color;
+		return engine.addTile(pixels);
+	}
+
+	struct Timing {
+		double totalUs = 0;
+		double worstUs = 0;
+		uint64_t tiles = 0;
+	};
+}
+
+int main(int argc, char* argv[ ]) {
+	int frames = 2000;
+	uint32_t seed = 1;
+	if (!parseArguments(argc, argv, frames, seed)) return 1;
+
+	using Surface = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+	Surface target(SDL_CreateRGBSurfaceWithFormat(0, OUTPUT_WIDTH, OUTPUT_HEIGHT, 32, SDL_PIXELFORMAT_RGBA8888), SDL_FreeSurface);
+	std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> renderer(target ? SDL_CreateSoftwareRenderer(target.get( )) : nullptr, SDL_DestroyRenderer);
+	if (!renderer) {
+		std::cerr << "Failed to create a software renderer: " << SDL_GetError( ) << std::endl;
+		return 1;
+	}
+
+	std::printf("%d frames per board count, %dx%d output\n", frames, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	std::printf("%-8s %-10s %10s %10s %14s %8s\n", "boards", "pixels", "mean us", "worst us", "tiles/frame", "fps");
+	for (int count : BOARD_COUNTS) {
+		BoardMosaic mosaic(count);
+		TileEngine& engine = mosaic.getEngine( );
+		BoardMosaic::Tiles tiles;
+		tiles.empty = addFlat(engine, pack(248, 248, 248, 255));
+		tiles.gap = addFlat(engine, pack(0, 0, 0, 255));
+		tiles.wall = addFlat(engine, pack(165, 42, 42, 255));
+		tiles.idleWall = addFlat(engine, pack(128, 128, 128, 255));
+		for (int shape = 0; shape < BoardMosaic::SHAPE_COUNT; shape++)
+			for (int color = 0; color < BoardMosaic::PALETTE_SIZE; color++) tiles.cells[shape][color] = addBlock(engine, shape, color);
+		mosaic.setTiles(tiles);
+
+		std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture(
+			SDL_CreateTexture(renderer.get( ), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, engine.getWidth( ), engine.getHeight( )),
+			SDL_DestroyTexture);
+		if (!texture) {
+			std::cerr << "Failed to create the mosaic texture: " << SDL_GetError( ) << std::endl;
+			return 1;
+		}
+
+		// Scaled to fit like Renderer::presentTexture
+		SDL_Rect output{ 0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT };
+		if (OUTPUT_WIDTH * engine.getHeight( ) > OUTPUT_HEIGHT * engine.getWidth( )) output.w = OUTPUT_HEIGHT * engine.getWidth( ) / engine.getHeight( );
+		else output.h = OUTPUT_WIDTH * engine.getHeight( ) / engine.getWidth( );
+
+		std::mt19937 random(seed);
+		std::vector<GameBoard> boards;
+		std::vector<uint8_t> buttons(count, 0);
+		for (int i = 0; i < count; i++) boards.emplace_back(random( ));
+
+		Timing timing;
+		for (int frame = 0; frame < frames; frame++) {
+			// Boards are stepped outside the timed part, the viewer only receives their states
+			for (int i = 0; i < count; i++) {
+				if ((frame + i) % 6 == 0) buttons[i] = static_cast<uint8_t>(random( ) & (INPUT_LEFT | INPUT_RIGHT | INPUT_DROP | INPUT_ROTATE));
+				boards[i].tick(buttons[i]);
+				if (boards[i].isCollision( )) boards[i] = GameBoard(random( ));
+			}
+			std::vector<GameBoard::Snapshot> states;
+			for (const GameBoard& board : boards) states.push_back(board.snapshot( ));
+
+			uint64_t tilesBefore = engine.getStats( ).tilesDrawn;
+			auto start = std::chrono::steady_clock::now( );
+			for (int i = 0; i < count; i++) mosaic.update(i, states[i]);
+			TileEngine::Rect changed = mosaic.compose( );
+			if (changed.w > 0) {
+				SDL_Rect area{ changed.x, changed.y, changed.w, changed.h };
+				SDL_UpdateTexture(texture.get( ), &area, engine.getPixels( ) + changed.y * engine.getWidth( ) + changed.x, engine.getPitch( ));
+			}
+			SDL_SetRenderDrawColor(renderer.get( ), 0, 0, 0, 255);
+			SDL_RenderClear(renderer.get( ));
+			SDL_RenderCopy(renderer.get( ), texture.get( ), nullptr, &output);
+			SDL_RenderPresent(renderer.get( ));
+			double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now( ) - start).count( );
+			timing.totalUs += us;
+			timing.worstUs = std::max(timing.worstUs, us);
+			timing.tiles += engine.getStats( ).tilesDrawn - tilesBefore;
+		}
+
+		double meanUs = timing.totalUs / frames;
+		char pixels[32];
+		std::snprintf(pixels, sizeof(pixels), "%dx%d", engine.getWidth( ), engine.getHeight( ));
+		std::printf("%-8d %-10s %10.1f %10.1f %14.1f %8.0f\n", count, pixels, meanUs, timing.worstUs,
+			static_cast<double>(timing.tiles) / frames, meanUs > 0 ? 1e6 / meanUs : 0.0);
+	}
+	return 0;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <SDL2/SDL.h>
+}
+
+#include "GameBoard.hpp"
+#include "TileEngine.hpp"
+
+// Frame cost of the single player screen on SDL's software renderer: the sprite path with one
+// SDL_RenderCopy per block, at the old window resolution and at the native canvas, against the
+// tile engine composing into a streaming texture. The board is a real GameBoard driven by random
+// input; sprites are generated, and neither path draws text, so the sprite numbers are a lower bound.
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_renderbench [--frames <count>] [--seed <n>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], int& frames, uint32_t& seed) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--frames" && hasValue) {
+			frames = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--seed" && hasValue) {
+			seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+namespace {
+	constexpr int WIDTH = 160, HEIGHT = 144, CELL = 8;
+	constexpr int SHAPES = 8, COLORS = 8;
+	constexpr int SCOREBOARD_WIDTH = 55;
+
+	using Surface = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+	using Texture = std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>;
+
+	uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) { return r << 24 | g << 16 | b << 8 | a; }
+
+	// A bevelled block with a transparent corner, shaded differently per shape
+	uint32_t spritePixel(int shape, int x, int y) {
+		if ((x == 0 && y == 0) || (x == CELL - 1 && y == CELL - 1)) return 0;
+		uint32_t shade = (x == 0 || y == 0) ? 255 : (x == CELL - 1 || y == CELL - 1) ? 96 : static_cast<uint32_t>(160 + shape * 10);
+		return pack(shade, shade, shade, 255);
+	}
+
+	SDL_Color paletteColor(int color) {
+		static const SDL_Color palette[COLORS] = {
+			{ 0, 191, 255, 255 }, { 255, 215, 0, 255 }, { 138, 43, 226, 255 }, { 0, 204, 102, 255 },
+			{ 255, 69, 0, 255 }, { 30, 144, 255, 255 }, { 255, 140, 0, 255 }, { 128, 128, 128, 255 },
+		};
+		return palette[color % COLORS];
+	}
+
+	struct Timing {
+		double totalUs = 0;
+		double worstUs = 0;
+	};
+
+	template <typename F>
+	void timeFrame(Timing& timing, F&& draw) {
+		auto start = std::chrono::steady_clock::now( );
+		draw( );
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now( ) - start).count( );
+		timing.totalUs += us;
+		timing.worstUs = std::max(timing.worstUs, us);
+	}
+
+	// One SDL_RenderCopy per block like Renderer::renderBoard, scaled up by scale
+	class SpritePath {
+	private:
+		Surface target;
+		std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> renderer;
+		std::vector<Texture> blocks;
+		Texture scoreboard;
+		int scale;
+
+		void copy(SDL_Texture* texture, int x, int y, int w, int h, SDL_Color color) {
+			SDL_SetTextureColorMod(texture, color.r, color.g, color.b);
+			SDL_Rect rect{ x * scale, y * scale, w * scale, h * scale };
+			SDL_RenderCopy(renderer.get( ), texture, nullptr, &rect);
+		}
+
+	public:
+		explicit SpritePath(int scale)
+			: target(SDL_CreateRGBSurfaceWithFormat(0, WIDTH * scale, HEIGHT * scale, 32, SDL_PIXELFORMAT_RGBA8888), SDL_FreeSurface),
+			renderer(nullptr, SDL_DestroyRenderer), scoreboard(nullptr, SDL_DestroyTexture), scale(scale) {
+			renderer.reset(SDL_CreateSoftwareRenderer(target.get( )));
+
+			for (int shape = 0; shape <= SHAPES; shape++) {
+				Surface sprite(SDL_CreateRGBSurfaceWithFormat(0, CELL, CELL, 32, SDL_PIXELFORMAT_RGBA8888), SDL_FreeSurface);
+				for (int y = 0; y < CELL; y++)
+					for (int x = 0; x < CELL; x++)
+						static_cast<uint32_t*>(sprite->pixels)[y * (sprite->pitch / 4) + x] = spritePixel(shape, x, y);
+				blocks.emplace_back(SDL_CreateTextureFromSurface(renderer.get( ), sprite.get( )), SDL_DestroyTexture);
+				SDL_SetTextureBlendMode(blocks.back( ).get( ), SDL_BLENDMODE_BLEND);
+			}
+
+			Surface board(SDL_CreateRGBSurfaceWithFormat(0, SCOREBOARD_WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_RGBA8888), SDL_FreeSurface);
+			SDL_FillRect(board.get( ), nullptr, pack(200, 220, 200, 255));
+			scoreboard.reset(SDL_CreateTextureFromSurface(renderer.get( ), board.get( )));
+		}
+
+		bool isReady( ) const { return renderer && scoreboard; }
+
+		void draw(const GameBoard& board) {
+			SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+			SDL_RenderClear(renderer.get( ));
+			SDL_Rect edge{ 0, 0, 7 * scale, HEIGHT * scale };
+			SDL_SetRenderDrawColor(renderer.get( ), 0, 0, 0, 255);
+			SDL_RenderFillRect(renderer.get( ), &edge);
+			copy(scoreboard.get( ), WIDTH - SCOREBOARD_WIDTH, 0, SCOREBOARD_WIDTH, HEIGHT, { 255, 255, 255, 255 });
+
+			SDL_Texture* wall = blocks[SHAPES].get( );
+			for (int y = 0; y <= HEIGHT; y += CELL - 2) {
+				copy(wall, CELL, y, CELL, CELL, { 165, 42, 42, 255 });
+				copy(wall, 12 * CELL, y, CELL, CELL, { 165, 42, 42, 255 });
+			}
+
+			const auto& cells = board.getLockedTetrominos( );
+			const auto& colors = board.getLockedColors( );
+			for (int row = 0; row < GameBoard::height; row++)
+				for (int col = 0; col < GameBoard::width; col++)
+					if (cells[row][col] != 0)
+						copy(blocks[(cells[row][col] - 1) % SHAPES].get( ), (col + 2) * CELL, row * CELL, CELL, CELL, paletteColor(colors[row][col]));
+
+			for (const auto& piece : { board.getCurrentTetromino( ), board.getNextTetromino( ) }) {
+				if (!piece) continue;
+				bool preview = piece == board.getNextTetromino( );
+				int originX = preview ? WIDTH - 28 : 2 * CELL, originY = preview ? HEIGHT - 26 : 0;
+				const auto& shape = piece->getShape( );
+				for (int row = 0; row < static_cast<int>(shape.size( )); row++)
+					for (int col = 0; col < static_cast<int>(shape[row].size( )); col++)
+						if (shape[row][col] != 0)
+							copy(blocks[static_cast<int>(piece->getShapeEnumn( )) % SHAPES].get( ),
+								originX + (piece->getX( ) + col) * CELL, originY + (piece->getY( ) + row) * CELL, CELL, CELL, paletteColor(piece->getColorIndex( )));
+			}
+			SDL_RenderPresent(renderer.get( ));
+		}
+	};
+
+	// The TileRenderer layout on a TileEngine, uploaded to a streaming texture and copied once
+	class TilePath {
+	private:
+		Surface target;
+		std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> renderer;
+		Texture texture;
+		TileEngine engine{ WIDTH / CELL, HEIGHT / CELL };
+		uint16_t blank = 0;
+		uint16_t cellTiles[SHAPES][COLORS] = { };
+		uint16_t pieceTiles[SHAPES][COLORS] = { };
+
+		uint16_t bake(int shape, SDL_Color tint, bool opaque) {
+			uint32_t pixels[TileEngine::TILE_PIXELS];
+			for (int i = 0; i < TileEngine::TILE_PIXELS; i++) {
+				uint32_t pixel = shape < 0 ? pack(248, 248, 248, 255) : spritePixel(shape, i % CELL, i / CELL);
+				uint32_t r = (pixel >> 24) * tint.r / 255, g = (pixel >> 16 & 0xFF) * tint.g / 255, b = (pixel >> 8 & 0xFF) * tint.b / 255;
+				if (opaque && (pixel & 0xFF) == 0) pixels[i] = pack(248, 248, 248, 255);
+				else pixels[i] = (pixel & 0xFF) ? pack(r, g, b, 255) : 0;
+			}
+			return engine.addTile(pixels);
+		}
+
+	public:
+		TilePath( )
+			: target(SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_RGBA8888), SDL_FreeSurface),
+			renderer(nullptr, SDL_DestroyRenderer), texture(nullptr, SDL_DestroyTexture) {
+			renderer.reset(SDL_CreateSoftwareRenderer(target.get( )));
+			texture.reset(SDL_CreateTexture(renderer.get( ), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT));
+
+			blank = bake(-1, { 255, 255, 255, 255 }, true);
+			for (int shape = 0; shape < SHAPES; shape++) {
+				for (int color = 0; color < COLORS; color++) {
+					cellTiles[shape][color] = bake(shape, paletteColor(color), true);
+					pieceTiles[shape][color] = bake(shape, paletteColor(color), false);
+				}
+			}
+			uint16_t wall = bake(SHAPES, { 165, 42, 42, 255 }, true);
+			uint16_t scoreboard = bake(-1, { 200, 220, 200, 255 }, true);
+			uint16_t edge = bake(-1, { 0, 0, 0, 255 }, true);
+			for (int row = 0; row < HEIGHT / CELL; row++) {
+				engine.setTile(0, row, edge);
+				engine.setTile(1, row, wall);
+				engine.setTile(12, row, wall);
+				for (int col = 13; col < WIDTH / CELL; col++) engine.setTile(col, row, scoreboard);
+			}
+		}
+
+		bool isReady( ) const { return renderer && texture; }
+		const TileEngine::Stats& getStats( ) const { return engine.getStats( ); }
+
+		void draw(const GameBoard& board) {
+			const auto& cells = board.getLockedTetrominos( );
+			const auto& colors = board.getLockedColors( );
+			for (int row = 0; row < GameBoard::height; row++)
+				for (int col = 0; col < GameBoard::width; col++)
+					engine.setTile(col + 2, row, cells[row][col] == 0 ? blank : cellTiles[(cells[row][col] - 1) % SHAPES][colors[row][col] % COLORS]);
+
+			engine.clearObjects( );
+			for (const auto& piece : { board.getCurrentTetromino( ), board.getNextTetromino( ) }) {
+				if (!piece) continue;
+				bool preview = piece == board.getNextTetromino( );
+				int originX = preview ? WIDTH - 28 : 2 * CELL, originY = preview ? HEIGHT - 26 : 0;
+				uint16_t tile = pieceTiles[static_cast<int>(piece->getShapeEnumn( )) % SHAPES][piece->getColorIndex( ) % COLORS];
+				const auto& shape = piece->getShape( );
+				for (int row = 0; row < static_cast<int>(shape.size( )); row++)
+					for (int col = 0; col < static_cast<int>(shape[row].size( )); col++)
+						if (shape[row][col] != 0) engine.addObject(tile, originX + (piece->getX( ) + col) * CELL, originY + (piece->getY( ) + row) * CELL);
+			}
+
+			TileEngine::Rect changed = engine.compose( );
+			if (changed.w > 0) {
+				SDL_Rect area{ changed.x, changed.y, changed.w, changed.h };
+				SDL_UpdateTexture(texture.get( ), &area, engine.getPixels( ) + changed.y * WIDTH + changed.x, engine.getPitch( ));
+			}
+			SDL_RenderCopy(renderer.get( ), texture.get( ), nullptr, nullptr);
+			SDL_RenderPresent(renderer.get( ));
+		}
+	};
+}
+
+int main(int argc, char* argv[ ]) {
+	int frames = 20000;
+	uint32_t seed = 1;
+	if (!parseArguments(argc, argv, frames, seed)) return 1;
+
+	SpritePath window(5), canvas(1);
+	TilePath tiles;
+	if (!window.isReady( ) || !canvas.isReady( ) || !tiles.isReady( )) {
+		std::cerr << "Failed to create a software renderer: " << SDL_GetError( ) << std::endl;
+		return 1;
+	}
+
+	// Buttons change every few frames, like a player, so the piece moves and locks at a human pace
+	std::mt19937 random(seed);
+	GameBoard board(seed);
+	uint8_t buttons = 0;
+	Timing windowTiming, canvasTiming, tileTiming;
+	for (int frame = 0; frame < frames; frame++) {
+		if (frame % 6 == 0) buttons = static_cast<uint8_t>(random( ) & (INPUT_LEFT | INPUT_RIGHT | INPUT_DROP | INPUT_ROTATE));
+		board.tick(buttons);
+		if (board.isCollision( )) board = GameBoard(random( ));
+
+		timeFrame(windowTiming, [&] { window.draw(board); });
+		timeFrame(canvasTiming, [&] { canvas.draw(board); });
+		timeFrame(tileTiming, [&] { tiles.draw(board); });
+	}
+
+	std::printf("%d frames\n", frames);
+	std::printf("%-28s %10s %10s\n", "path", "mean us", "worst us");
+	std::printf("%-28s %10.1f %10.1f\n", "sprites 800x720", windowTiming.totalUs / frames, windowTiming.worstUs);
+	std::printf("%-28s %10.1f %10.1f\n", "sprites 160x144", canvasTiming.totalUs / frames, canvasTiming.worstUs);
+	std::printf("%-28s %10.1f %10.1f\n", "tiles 160x144", tileTiming.totalUs / frames, tileTiming.worstUs);
+	const TileEngine::Stats& stats = tiles.getStats( );
+	std::printf("tiles redrawn per frame %.1f of %d, objects %.1f\n",
+		static_cast<double>(stats.tilesDrawn) / frames, (WIDTH / CELL) * (HEIGHT / CELL), static_cast<double>(stats.objectsDrawn) / frames);
+	return 0;
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "StressBoard.hpp"
+
+// How collision, hard drop and line clears scale with the board size on StressBoard, against the
+// layout GameBoard had before it became a template: a vector of byte rows, a full scan for lines
+// and an erase plus insert per cleared row. Every board gets a stack half its height, each row with
+// one hole so nothing clears until the benchmark fills a hole.
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	class RowVectorBoard {
+	private:
+		int width, height;
+		std::vector<std::vector<uint8_t>> cells;
+
+	public:
+		RowVectorBoard(int width, int height) : width(width), height(height), cells(height, std::vector<uint8_t>(width, 0)) { }
+
+		bool collides(const StressBoard::Piece& piece, int x, int y) const {
+			for (int r = 0; r < piece.height; r++)
+				for (int c = 0; c < 8; c++)
+					if ((piece.rows[r] >> c) & 1) {
+						int column = x + c, row = y + r;
+						if (column < 0 || column >= width || row >= height) return true;
+						if (row >= 0 && cells[row][column]) return true;
+					}
+			return false;
+		}
+
+		int dropRow(const StressBoard::Piece& piece, int x, int y) const {
+			while (!collides(piece, x, y + 1)) y++;
+			return y;
+		}
+
+		void lock(const StressBoard::Piece& piece, int x, int y) {
+			for (int r = 0; r < piece.height; r++)
+				for (int c = 0; c < 8; c++)
+					if ((piece.rows[r] >> c) & 1) cells[y + r][x + c] = 1;
+		}
+
+		int clearLines( ) {
+			int cleared = 0;
+			for (int row = 0; row < height; row++) {
+				bool full = true;
+				for (int column = 0; column < width && full; column++) full = cells[row][column] != 0;
+				if (!full) continue;
+				cells.erase(cells.begin( ) + row);
+				cells.insert(cells.begin( ), std::vector<uint8_t>(width, 0));
+				cleared++;
+			}
+			return cleared;
+		}
+	};
+
+	struct Result {
+		double collisionNs = 0, dropNs = 0, clearNs = 0, idleClearNs = 0;
+	};
+
+	// Hole of a stack row, the benchmark fills them bottom up to clear one row at a time
+	int holeOf(int row, int width) { return static_cast<int>((row * 2654435761u) % width); }
+
+	template <typename Board>
+	Result measure(int width, int height, double budgetMs) {
+		Board board(width, height);
+		std::mt19937 random(12345);
+		StressBoard::Piece dot{ { 1 }, 1 };
+
+		// Stack rows are full but for their hole, locked a cell at a time like any other piece
+		const int stackTop = height / 2;
+		for (int row = stackTop; row < height; row++)
+			for (int column = 0; column < width; column++)
+				if (column != holeOf(row, width)) board.lock(dot, column, row);
+
+		// Tetromino shapes as column bits, see StressBoard::pieceOf
+		const StressBoard::Piece pieces[ ] = {
+			{ { 0x1, 0x1, 0x3 }, 3 }, { { 0xF }, 1 }, { { 0x3, 0x3 }, 2 }, { { 0x6, 0x3 }, 2 },
+			{ { 0x3, 0x6 }, 2 }, { { 0x2, 0x2, 0x3 }, 3 }, { { 0x7, 0x2 }, 2 },
+		};
+
+		// Drawn up front so the random generator stays out of the timings
+		struct Move {
+			const StressBoard::Piece* piece;
+			int x, y;
+		};
+		std::vector<Move> moves(4096);
+		for (auto& move : moves)
+			move = { &pieces[random( ) % 7], static_cast<int>(random( ) % (width + 2)) - 2, stackTop + static_cast<int>(random( ) % (height - stackTop)) };
+
+		Result result;
+		auto run = [&](auto&& op, int limit) {
+			int done = 0;
+			auto start = Clock::now( );
+			double elapsedMs = 0;
+			while (done < limit && elapsedMs < budgetMs) {
+				for (int i = 0; i < 64 && done < limit; i++, done++) op( );
+				elapsedMs = std::chrono::duration<double, std::milli>(Clock::now( ) - start).count( );
+			}
+			return elapsedMs * 1e6 / std::max(1, done);
+		};
+
+		volatile int sink = 0;
+		size_t next = 0;
+		result.collisionNs = run([&] {
+			const Move& move = moves[next++ % moves.size( )];
+			sink = sink + board.collides(*move.piece, move.x, move.y);
+		}, 1 << 24);
+		result.dropNs = run([&] {
+			const Move& move = moves[next++ % moves.size( )];
+			sink = sink + board.dropRow(*move.piece, std::max(0, std::min(move.x, width - 4)), 0);
+		}, 1 << 24);
+		result.idleClearNs = run([&] { sink = sink + board.clearLines( ); }, 1 << 24);
+
+		// Fill the bottom row's hole, which clears it and moves the whole stack down by one. The
+		// first clear is left out, it allocates what the later ones reuse.
+		board.lock(dot, holeOf(height - 1, width), height - 1);
+		board.clearLines( );
+		int cleared = 1;
+		result.clearNs = run([&] {
+			board.lock(dot, holeOf(height - 1 - cleared, width), height - 1);
+			sink = sink + board.clearLines( );
+			cleared++;
+		}, height - stackTop - 2);
+		return result;
+	}
+
+	void printUsage( ) {
+		std::cerr << "Usage: tetris_stressbench [--budget <ms per measurement>]" << std::endl;
+	}
+
+	bool parseArguments(int argc, char* argv[ ], double& budgetMs) {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			bool hasValue = i + 1 < argc;
+
+			if (arg == "--budget" && hasValue) {
+				budgetMs = std::max(1.0, atof(argv[++i]));
+			} else {
+				printUsage( );
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[ ]) {
+	double budgetMs = 200;
+	if (!parseArguments(argc, argv, budgetMs)) return 1;
+
+	std::printf("ns per operation, StressBoard / row vectors; a line clear is the bottom row under a stack of half the height\n");
+	std::printf("%12s %22s %22s %24s %26s\n", "board", "collision", "hard drop", "clear one line", "clear nothing");
+	const int sizes[ ][2] = { { 10, 18 }, { 10, 40 }, { 100, 1000 }, { 1000, 1000 }, { 1000, 10000 } };
+	for (const auto& size : sizes) {
+		Result bits = measure<StressBoard>(size[0], size[1], budgetMs);
+		Result rows = measure<RowVectorBoard>(size[0], size[1], budgetMs);
+		char name[32];
+		std::snprintf(name, sizeof(name), "%dx%d", size[0], size[1]);
+		std::printf("%12s %10.1f / %9.1f %10.1f / %9.1f %11.1f / %10.1f %12.1f / %11.1f\n", name,
+			bits.collisionNs, rows.collisionNs, bits.dropNs, rows.dropNs, bits.clearNs, rows.clearNs, bits.idleClearNs, rows.idleClearNs);
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include "tetris_env.h"
+#include "BatchEnv.hpp"
+
+#include <exception>
+
+struct TetrisEnv {
+	BatchEnv env;
+	TetrisEnvObservation observation;
+
+	TetrisEnv(size_t count, uint64_t seed, int threads) : env(count, seed, threads) {
+		observation.count = static_cast<int32_t>(env.size( ));
+		observation.width = BatchEnv::WIDTH;
+		observation.height = BatchEnv::HEIGHT;
+		observation.queueLength = BatchEnv::QUEUE_LENGTH;
+		observation.actionCount = BatchEnv::ACTION_COUNT;
+		observation.cells = env.getCells( );
+		observation.pieces = env.getPieces( );
+		observation.rewards = env.getRewards( );
+		observation.dones = env.getDones( );
+		observation.scores = env.getScores( );
+		observation.lines = env.getLines( );
+	}
+};
+
+TetrisEnv* tetris_env_create(size_t count, uint64_t seed, int32_t threads) {
+	if (count == 0) return nullptr;
+	// Nothing may throw across the C boundary, a failed allocation or thread start is a NULL env
+	try {
+		return new TetrisEnv(count, seed, threads);
+	} catch (const std::exception&) {
+		return nullptr;
+	}
+}
+
+void tetris_env_destroy(TetrisEnv* env) { delete env; }
+
+void tetris_env_reset(TetrisEnv* env, uint64_t seed) {
+	if (env) env->env.reset(seed);
+}
+
+void tetris_env_step(TetrisEnv* env, const uint8_t* actions) {
+	if (env && actions) env->env.step(actions);
+}
+
+const TetrisEnvObservation* tetris_env_observe(const TetrisEnv* env) { return env ? &env->observation : nullptr; }
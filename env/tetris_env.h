@@ -0,0 +1,52 @@
+#pragma once
+
+/* Plain C interface to BatchEnv for training code, e.g. through ctypes or cffi. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(TETRIS_ENV_BUILD)
+#define TETRIS_ENV_API __declspec(dllexport)
+#else
+#define TETRIS_ENV_API __declspec(dllimport)
+#endif
+#else
+#define TETRIS_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TetrisEnv TetrisEnv;
+
+/* Pointers into the environment's own arrays, valid until tetris_env_destroy. Every
+ * tetris_env_step and tetris_env_reset rewrites them in place, board i's values are at
+ * index i (scaled by the per board size where there is one). */
+typedef struct TetrisEnvObservation {
+	int32_t count;
+	int32_t width;
+	int32_t height;
+	int32_t queueLength;
+	int32_t actionCount;
+	const uint8_t* cells;       /* count * height * width, row major, 1 where a block is locked */
+	const uint8_t* pieces;      /* count * (1 + queueLength) shapes, the current piece first */
+	const float* rewards;       /* lines cleared by the last step */
+	const uint8_t* dones;       /* 1 when the last step topped out, the board has already restarted */
+	const int32_t* scores;
+	const int32_t* lines;
+} TetrisEnvObservation;
+
+/* threads 0 uses every core. Returns NULL when count is 0. */
+TETRIS_ENV_API TetrisEnv* tetris_env_create(size_t count, uint64_t seed, int32_t threads);
+TETRIS_ENV_API void tetris_env_destroy(TetrisEnv* env);
+/* Restarts every board, board i deals the pieces of a GameBoard seeded with seed + i */
+TETRIS_ENV_API void tetris_env_reset(TetrisEnv* env, uint64_t seed);
+/* One action per board: rotation * width + column of the rotated piece's left edge */
+TETRIS_ENV_API void tetris_env_step(TetrisEnv* env, const uint8_t* actions);
+TETRIS_ENV_API const TetrisEnvObservation* tetris_env_observe(const TetrisEnv* env);
+
+#ifdef __cplusplus
+}
+#endif
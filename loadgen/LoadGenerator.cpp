@@ -0,0 +1,263 @@
+#include "LoadGenerator.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "GameBoard.hpp"
+#include "Protocol.hpp"
+
+LoadGenerator::LoadGenerator(const LoadConfig& config) : config(config) { }
+
+LoadGenerator::~LoadGenerator( ) { stop( ); }
+
+bool LoadGenerator::start( ) {
+	addrinfo hints{ };
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* result = nullptr;
+	if (getaddrinfo(config.host.c_str( ), nullptr, &hints, &result) != 0 || !result) {
+		cerr << "Failed to resolve " << config.host << endl;
+		return false;
+	}
+	address = reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(result);
+
+	running = true;
+	int threads = max(1, config.threads);
+	for (int i = 0; i < threads; i++) {
+		auto shard = make_unique<Shard>( );
+		shard->target = config.players / threads + (i < config.players % threads ? 1 : 0);
+		shard->bots.resize(shard->target);
+		shard->random.seed(static_cast<uint32_t>(i * 7919 + 1));
+		shard->epollFd = epoll_create1(0);
+		shards.push_back(move(shard));
+	}
+	for (auto& shard : shards)
+		shard->handle = thread(&LoadGenerator::shardLoop, this, ref(*shard));
+	return true;
+}
+
+void LoadGenerator::stop( ) {
+	if (!running.exchange(false)) return;
+	for (auto& shard : shards) {
+		if (shard->handle.joinable( )) shard->handle.join( );
+		for (size_t i = 0; i < shard->bots.size( ); i++) closeBot(*shard, i);
+		close(shard->epollFd);
+	}
+}
+
+void LoadGenerator::shardLoop(Shard& shard) {
+	using clock = chrono::steady_clock;
+	const auto interval = chrono::nanoseconds(1000000000LL / max(1, config.inputRate));
+	const double rampPerShard = max(1.0, static_cast<double>(config.rampPerSecond) / shards.size( ));
+	const auto begin = clock::now( );
+	auto nextTick = begin;
+	epoll_event events[256];
+
+	while (running.load(memory_order_relaxed)) {
+		auto now = clock::now( );
+		int timeout = static_cast<int>(max<int64_t>(0, chrono::duration_cast<chrono::milliseconds>(nextTick - now).count( )));
+		int count = epoll_wait(shard.epollFd, events, 256, timeout);
+
+		for (int i = 0; i < count; i++) {
+			size_t index = static_cast<size_t>(events[i].data.u64);
+			Bot& bot = shard.bots[index];
+			if (bot.fd < 0) continue;
+
+			if (bot.connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+				int error = 0;
+				socklen_t length = sizeof(error);
+				getsockopt(bot.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+				if (error != 0) {
+					shard.connectFailures.fetch_add(1, memory_order_relaxed);
+					closeBot(shard, index);
+					continue;
+				}
+				bot.connecting = false;
+				shard.connected.fetch_add(1, memory_order_relaxed);
+
+				epoll_event event{ };
+				event.events = EPOLLIN | EPOLLRDHUP;
+				event.data.u64 = index;
+				epoll_ctl(shard.epollFd, EPOLL_CTL_MOD, bot.fd, &event);
+				sendHello(bot);
+				flushBot(shard, index);
+				continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readBot(shard, index);
+		}
+
+		now = clock::now( );
+		if (now < nextTick) continue;
+		nextTick += interval;
+		if (now - nextTick > interval * 4) nextTick = now + interval;
+
+		// Ramp: (re)open sockets up to what the elapsed time allows
+		size_t allowed = static_cast<size_t>(chrono::duration<double>(now - begin).count( ) * rampPerShard) + 1;
+		for (size_t i = 0; i < shard.bots.size( ) && shard.live.load(memory_order_relaxed) < allowed; i++)
+			if (shard.bots[i].fd < 0 && !openBot(shard, i)) break;
+
+		for (size_t i = 0; i < shard.bots.size( ); i++) {
+			Bot& bot = shard.bots[i];
+			if (bot.fd < 0 || !bot.playing) continue;
+
+			// Change the held buttons every few frames, roughly like someone playing fast
+			if (shard.random( ) % 8 == 0)
+				bot.buttons = static_cast<uint8_t>(shard.random( ) & (INPUT_LEFT | INPUT_RIGHT | INPUT_DROP | INPUT_ROTATE));
+			size_t message = Protocol::beginMessage(bot.outbox, MessageType::INPUT);
+			Protocol::putU32(bot.outbox, bot.frame++);
+			Protocol::putU8(bot.outbox, bot.buttons);
+			Protocol::endMessage(bot.outbox, message);
+			shard.inputsSent.fetch_add(1, memory_order_relaxed);
+			flushBot(shard, i);
+		}
+	}
+}
+
+bool LoadGenerator::openBot(Shard& shard, size_t index) {
+	Bot& bot = shard.bots[index];
+	bot = Bot( );
+
+	bot.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (bot.fd < 0) {
+		shard.connectFailures.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+	int enable = 1;
+	setsockopt(bot.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+	sockaddr_in target{ };
+	target.sin_family = AF_INET;
+	target.sin_addr.s_addr = address;
+	target.sin_port = htons(config.port);
+	if (connect(bot.fd, reinterpret_cast<sockaddr*>(&target), sizeof(target)) != 0 && errno != EINPROGRESS) {
+		shard.connectFailures.fetch_add(1, memory_order_relaxed);
+		close(bot.fd);
+		bot.fd = -1;
+		return false;
+	}
+
+	epoll_event event{ };
+	event.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+	event.data.u64 = index;
+	epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, bot.fd, &event);
+	shard.live.fetch_add(1, memory_order_relaxed);
+	return true;
+}
+
+void LoadGenerator::closeBot(Shard& shard, size_t index) {
+	Bot& bot = shard.bots[index];
+	if (bot.fd < 0) return;
+	epoll_ctl(shard.epollFd, EPOLL_CTL_DEL, bot.fd, nullptr);
+	close(bot.fd);
+	bot.fd = -1;
+	bot.playing = false;
+	shard.live.fetch_sub(1, memory_order_relaxed);
+}
+
+void LoadGenerator::readBot(Shard& shard, size_t index) {
+	Bot& bot = shard.bots[index];
+	uint8_t buffer[4096];
+	bool hungUp = false;
+
+	while (true) {
+		ssize_t received = recv(bot.fd, buffer, sizeof(buffer), 0);
+		if (received > 0) {
+			bot.inbox.insert(bot.inbox.end( ), buffer, buffer + received);
+			shard.bytesReceived.fetch_add(static_cast<uint64_t>(received), memory_order_relaxed);
+			continue;
+		}
+		if (received < 0 && errno == EINTR) continue;
+		hungUp = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+		break;
+	}
+
+	size_t consumed = 0;
+	while (true) {
+		MessageType type;
+		const uint8_t* payload;
+		size_t payloadSize;
+		size_t size = Protocol::peekMessage(bot.inbox.data( ) + consumed, bot.inbox.size( ) - consumed, type, payload, payloadSize);
+		if (size == 0) break;
+		if (size == SIZE_MAX) {
+			hungUp = true;
+			break;
+		}
+		consumed += size;
+
+		switch (type) {
+		case MessageType::MATCH_START:
+			bot.playing = true;
+			bot.frame = 0;
+			shard.matchesStarted.fetch_add(1, memory_order_relaxed);
+			break;
+		case MessageType::STATE:
+			shard.stateMessages.fetch_add(1, memory_order_relaxed);
+			break;
+		case MessageType::MATCH_END:
+			bot.playing = false;
+			shard.matchesEnded.fetch_add(1, memory_order_relaxed);
+			sendHello(bot);
+			break;
+		default:
+			break;
+		}
+	}
+	bot.inbox.erase(bot.inbox.begin( ), bot.inbox.begin( ) + consumed);
+
+	if (hungUp) {
+		shard.disconnects.fetch_add(1, memory_order_relaxed);
+		closeBot(shard, index);
+		return;
+	}
+	flushBot(shard, index);
+}
+
+void LoadGenerator::flushBot(Shard& shard, size_t index) {
+	Bot& bot = shard.bots[index];
+	size_t sent = 0;
+	while (sent < bot.outbox.size( )) {
+		ssize_t written = send(bot.fd, bot.outbox.data( ) + sent, bot.outbox.size( ) - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (written > 0) {
+			sent += static_cast<size_t>(written);
+		} else if (written < 0 && errno == EINTR) {
+			continue;
+		} else {
+			break;
+		}
+	}
+	bot.outbox.erase(bot.outbox.begin( ), bot.outbox.begin( ) + sent);
+}
+
+void LoadGenerator::sendHello(Bot& bot) {
+	size_t message = Protocol::beginMessage(bot.outbox, MessageType::HELLO);
+	Protocol::endMessage(bot.outbox, message);
+}
+
+void LoadGenerator::collect(Totals& totals) const {
+	for (const auto& shard : shards) {
+		totals.connected += shard->connected.load(memory_order_relaxed);
+		totals.connectFailures += shard->connectFailures.load(memory_order_relaxed);
+		totals.disconnects += shard->disconnects.load(memory_order_relaxed);
+		totals.matchesStarted += shard->matchesStarted.load(memory_order_relaxed);
+		totals.matchesEnded += shard->matchesEnded.load(memory_order_relaxed);
+		totals.stateMessages += shard->stateMessages.load(memory_order_relaxed);
+		totals.inputsSent += shard->inputsSent.load(memory_order_relaxed);
+		totals.bytesReceived += shard->bytesReceived.load(memory_order_relaxed);
+	}
+}
+
+size_t LoadGenerator::getLiveCount( ) const {
+	size_t live = 0;
+	for (const auto& shard : shards) live += shard->live.load(memory_order_relaxed);
+	return live;
+}
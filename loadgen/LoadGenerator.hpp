@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct LoadConfig {
+	string host = "127.0.0.1";
+	uint16_t port = 7100;
+	int players = 1000;
+	int rampPerSecond = 200;    // new connections per second, so the server is not hit by one accept storm
+	int threads = 1;
+	int inputRate = 60;         // INPUT messages per second per playing client
+	int seconds = 30;           // 0 runs until interrupted
+};
+
+// Opens many bot clients against tetris_server. Each bot queues with HELLO, mashes random
+// buttons while in a match and queues again when the match ends.
+class LoadGenerator {
+public:
+	struct Totals {
+		uint64_t connected = 0;
+		uint64_t connectFailures = 0;
+		uint64_t disconnects = 0;
+		uint64_t matchesStarted = 0;
+		uint64_t matchesEnded = 0;
+		uint64_t stateMessages = 0;
+		uint64_t inputsSent = 0;
+		uint64_t bytesReceived = 0;
+	};
+
+private:
+	struct Bot {
+		int fd = -1;
+		bool connecting = true;
+		bool playing = false;
+		uint8_t buttons = 0;
+		uint32_t frame = 0;
+		vector<uint8_t> inbox;
+		vector<uint8_t> outbox;
+	};
+
+	struct Shard {
+		thread handle;
+		int epollFd = -1;
+		int target = 0;
+		vector<Bot> bots;
+		mt19937 random;
+
+		atomic<uint64_t> connected{ 0 };
+		atomic<uint64_t> connectFailures{ 0 };
+		atomic<uint64_t> disconnects{ 0 };
+		atomic<uint64_t> matchesStarted{ 0 };
+		atomic<uint64_t> matchesEnded{ 0 };
+		atomic<uint64_t> stateMessages{ 0 };
+		atomic<uint64_t> inputsSent{ 0 };
+		atomic<uint64_t> bytesReceived{ 0 };
+		atomic<size_t> live{ 0 };
+	};
+
+	void shardLoop(Shard& shard);
+	bool openBot(Shard& shard, size_t index);
+	void closeBot(Shard& shard, size_t index);
+	void readBot(Shard& shard, size_t index);
+	void flushBot(Shard& shard, size_t index);
+	void sendHello(Bot& bot);
+
+	LoadConfig config;
+	vector<unique_ptr<Shard>> shards;
+	atomic<bool> running{ false };
+	uint32_t address = 0;
+
+public:
+	LoadGenerator(const LoadConfig& config);
+	~LoadGenerator( );
+
+	bool start( );
+	void stop( );
+	void collect(Totals& totals) const;
+	size_t getLiveCount( ) const;
+};
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <sys/resource.h>
+
+#include "LoadGenerator.hpp"
+
+static std::atomic<bool> interrupted{ false };
+
+static void handleSignal(int) { interrupted = true; }
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_loadgen [--host <address>] [--port <port>] [--players <count>] [--ramp <per second>]" << std::endl
+		<< "                      [--threads <count>] [--input-rate <hz>] [--seconds <duration, 0 = forever>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], LoadConfig& config) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--host" && hasValue) {
+			config.host = argv[++i];
+		} else if (arg == "--port" && hasValue) {
+			config.port = static_cast<uint16_t>(atoi(argv[++i]));
+		} else if (arg == "--players" && hasValue) {
+			config.players = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--ramp" && hasValue) {
+			config.rampPerSecond = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--threads" && hasValue) {
+			config.threads = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--input-rate" && hasValue) {
+			config.inputRate = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--seconds" && hasValue) {
+			config.seconds = std::max(0, atoi(argv[++i]));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[ ]) {
+	LoadConfig config;
+	if (!parseArguments(argc, argv, config)) return 1;
+
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	signal(SIGINT, handleSignal);
+	signal(SIGTERM, handleSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	LoadGenerator generator(config);
+	if (!generator.start( )) return 1;
+
+	auto begin = std::chrono::steady_clock::now( );
+	LoadGenerator::Totals previous;
+	while (!interrupted.load( )) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now( ) - begin).count( );
+
+		LoadGenerator::Totals totals;
+		generator.collect(totals);
+		printf("%5.0fs  live %zu  connected %llu  failed %llu  dropped %llu  matches %llu/%llu  inputs/s %llu  states/s %llu\n",
+			elapsed, generator.getLiveCount( ), static_cast<unsigned long long>(totals.connected),
+			static_cast<unsigned long long>(totals.connectFailures), static_cast<unsigned long long>(totals.disconnects),
+			static_cast<unsigned long long>(totals.matchesEnded), static_cast<unsigned long long>(totals.matchesStarted),
+			static_cast<unsigned long long>(totals.inputsSent - previous.inputsSent),
+			static_cast<unsigned long long>(totals.stateMessages - previous.stateMessages));
+		fflush(stdout);
+		previous = totals;
+
+		if (config.seconds > 0 && elapsed >= config.seconds) break;
+	}
+
+	generator.stop( );
+
+	LoadGenerator::Totals totals;
+	generator.collect(totals);
+	std::cout << "Finished: " << totals.matchesEnded << " matches played, " << totals.inputsSent << " inputs sent, "
+		<< totals.bytesReceived << " bytes received" << std::endl;
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "Match.hpp"
+
+#include <sys/socket.h>
+#include <cerrno>
+#include <ctime>
+
+// A client that stops reading gets dropped instead of growing its buffer forever
+static const size_t MAX_OUTBOX = 64 * 1024;
+
+bool Connection::flush( ) {
+	if (closed.load(memory_order_relaxed)) return false;
+
+	size_t sent = 0;
+	while (sent < outbox.size( )) {
+		ssize_t written = send(fd, outbox.data( ) + sent, outbox.size( ) - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (written > 0) {
+			sent += static_cast<size_t>(written);
+		} else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else if (written < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	outbox.erase(outbox.begin( ), outbox.begin( ) + sent);
+
+	if (outbox.size( ) > MAX_OUTBOX) {
+		// The network thread sees the hang up and releases the connection
+		shutdown(fd, SHUT_RDWR);
+		return false;
+	}
+	return true;
+}
+
+Match::Match(uint32_t id, uint64_t seed, shared_ptr<Connection> first, shared_ptr<Connection> second, HighScores* scores)
+	: id(id), seed(seed), players{ move(first), move(second) }, boards{ GameBoard(seed), GameBoard(seed) }, scores(scores) { }
+
+void Match::start( ) {
+	for (int player = 0; player < 2; player++) {
+		auto& outbox = players[player]->outbox;
+		size_t message = Protocol::beginMessage(outbox, MessageType::MATCH_START);
+		Protocol::putU32(outbox, id);
+		Protocol::putU64(outbox, seed);
+		Protocol::putU8(outbox, static_cast<uint8_t>(player));
+		Protocol::endMessage(outbox, message);
+		players[player]->flush( );
+	}
+}
+
+bool Match::tick( ) {
+	if (finished) return false;
+
+	bool firstGone = players[0]->closed.load(memory_order_relaxed);
+	bool secondGone = players[1]->closed.load(memory_order_relaxed);
+	if (firstGone || secondGone) {
+		finish(firstGone && secondGone ? 0xFF : (firstGone ? 1 : 0));
+		return false;
+	}
+
+	boards[0].tick(players[0]->buttons.load(memory_order_relaxed));
+	boards[1].tick(players[1]->buttons.load(memory_order_relaxed));
+	GameBoard::exchangeGarbage(boards[0], boards[1]);
+	frame++;
+
+	if (boards[0].isCollision( ) || boards[1].isCollision( )) {
+		sendState( );
+		recordScores( );
+		finish(boards[0].isCollision( ) && boards[1].isCollision( ) ? 0xFF : (boards[0].isCollision( ) ? 1 : 0));
+		return false;
+	}
+
+	if (frame % STATE_INTERVAL == 0) sendState( );
+	return true;
+}
+
+void Match::sendState( ) {
+	for (auto& player : players) {
+		auto& outbox = player->outbox;
+		size_t message = Protocol::beginMessage(outbox, MessageType::STATE);
+		Protocol::putU32(outbox, frame);
+		for (const auto& board : boards) {
+			Protocol::putU32(outbox, static_cast<uint32_t>(board.getScore( )));
+			Protocol::putU32(outbox, static_cast<uint32_t>(board.getLines( )));
+			Protocol::putU8(outbox, static_cast<uint8_t>(board.getPendingGarbage( )));
+			Protocol::putU8(outbox, board.isCollision( ) ? 1 : 0);
+		}
+		Protocol::endMessage(outbox, message);
+		player->flush( );
+	}
+}
+
+void Match::finish(int winner) {
+	finished = true;
+	for (auto& player : players) {
+		auto& outbox = player->outbox;
+		size_t message = Protocol::beginMessage(outbox, MessageType::MATCH_END);
+		Protocol::putU8(outbox, static_cast<uint8_t>(winner));
+		Protocol::endMessage(outbox, message);
+		player->flush( );
+	}
+}
+
+void Match::recordScores( ) {
+	if (!scores) return;
+
+	uint32_t finishedAt = static_cast<uint32_t>(time(nullptr));
+	for (const auto& board : boards) {
+		ScoreRecord record;
+		record.score = static_cast<uint32_t>(board.getScore( ));
+		record.lines = static_cast<uint32_t>(board.getLines( ));
+		record.level = static_cast<uint16_t>(board.getLevel( ));
+		record.seed = seed;
+		record.durationMs = static_cast<uint32_t>(uint64_t(frame) * 1000 / GameBoard::TICKS_PER_SECOND);
+		record.finishedAt = finishedAt;
+		scores->append(record);
+	}
+}
+
+const array<shared_ptr<Connection>, 2>& Match::getPlayers( ) const { return players; }
+uint32_t Match::getId( ) const { return id; }
+
+size_t Match::memoryFootprint( ) const {
+	size_t bytes = sizeof(Match);
+	// The cells are part of the boards and so of sizeof(Match)
+	for (const auto& board : boards) {
+		// Active and next piece: the shared_ptr control block with the Tetromino and its shape rows
+		for (const auto& piece : { board.getCurrentTetromino( ), board.getNextTetromino( ) }) {
+			if (!piece) continue;
+			bytes += sizeof(Tetromino) + 16;
+			for (const auto& row : piece->getShape( )) bytes += sizeof(row) + row.capacity( ) * sizeof(int);
+		}
+	}
+	for (const auto& player : players)
+		bytes += sizeof(Connection) + player->inbox.capacity( ) + player->outbox.capacity( );
+	return bytes;
+}
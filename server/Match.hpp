@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "GameBoard.hpp"
+#include "HighScores.hpp"
+#include "Protocol.hpp"
+
+using namespace std;
+
+// One client socket. The network thread owns reading; writing belongs to the network thread
+// while the client waits in the lobby and to the match's worker thread while it plays.
+struct Connection {
+	int fd = -1;
+	atomic<bool> closed{ false };
+	// Latest held buttons, stored by the network thread and sampled once per tick by the worker
+	atomic<uint8_t> buttons{ 0 };
+
+	vector<uint8_t> inbox;
+	vector<uint8_t> outbox;
+	bool inMatch = false;
+	bool queued = false;           // network thread only: sits in the lobby queue
+
+	// Sends what the socket accepts right now, false when the peer is gone or not reading
+	bool flush( );
+};
+
+// Authoritative versus match between two connections, ticked by exactly one worker thread
+class Match {
+public:
+	static constexpr int STATE_INTERVAL = 6;    // ticks between STATE messages
+
+private:
+	void sendState( );
+	void finish(int winner);
+	void recordScores( );
+
+	uint32_t id;
+	uint64_t seed;
+	array<shared_ptr<Connection>, 2> players;
+	array<GameBoard, 2> boards;
+	uint32_t frame = 0;
+	bool finished = false;
+	HighScores* scores;
+
+public:
+	// Both boards of a match that ends in a top out are appended to scores, when given
+	Match(uint32_t id, uint64_t seed, shared_ptr<Connection> first, shared_ptr<Connection> second, HighScores* scores = nullptr);
+
+	void start( );
+	// Advances one frame, returns false once the match is over
+	bool tick( );
+
+	const array<shared_ptr<Connection>, 2>& getPlayers( ) const;
+	uint32_t getId( ) const;
+	// Bytes owned by the match including the boards' heap allocations
+	size_t memoryFootprint( ) const;
+};
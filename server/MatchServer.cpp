@@ -0,0 +1,237 @@
+#include "MatchServer.hpp"
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+MatchServer::MatchServer(TickScheduler& scheduler) : scheduler(scheduler) { }
+
+MatchServer::~MatchServer( ) {
+	for (auto& entry : connections) close(entry.first);
+	if (listenFd >= 0) close(listenFd);
+	if (wakeFd >= 0) close(wakeFd);
+	if (epollFd >= 0) close(epollFd);
+}
+
+void MatchServer::setHighScores(HighScores* store) { scores = store; }
+
+bool MatchServer::listen(uint16_t port) {
+	listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (listenFd < 0) {
+		cerr << "Failed to create listen socket: " << strerror(errno) << endl;
+		return false;
+	}
+
+	int enable = 1;
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+	sockaddr_in address{ };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+		cerr << "Failed to listen on port " << port << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	epollFd = epoll_create1(0);
+	wakeFd = eventfd(0, EFD_NONBLOCK);
+	if (epollFd < 0 || wakeFd < 0) {
+		cerr << "Failed to create epoll instance: " << strerror(errno) << endl;
+		return false;
+	}
+
+	epoll_event event{ };
+	event.events = EPOLLIN;
+	event.data.fd = listenFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+	event.data.fd = wakeFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+	return true;
+}
+
+void MatchServer::run( ) {
+	running = true;
+	epoll_event events[256];
+
+	while (running.load(memory_order_relaxed)) {
+		int count = epoll_wait(epollFd, events, 256, 100);
+		if (count < 0 && errno != EINTR) {
+			cerr << "epoll_wait failed: " << strerror(errno) << endl;
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			int fd = events[i].data.fd;
+			if (fd == listenFd) {
+				acceptClients( );
+			} else if (fd == wakeFd) {
+				uint64_t value;
+				while (read(wakeFd, &value, sizeof(value)) > 0) { }
+			} else {
+				auto it = connections.find(fd);
+				if (it != connections.end( )) readClient(it->second);
+			}
+		}
+
+		drainReleased( );
+	}
+}
+
+void MatchServer::stop( ) {
+	running = false;
+	uint64_t one = 1;
+	if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) < 0) { }
+}
+
+void MatchServer::acceptClients( ) {
+	while (true) {
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				cerr << "accept failed: " << strerror(errno) << endl;
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		int enable = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		auto connection = make_shared<Connection>( );
+		connection->fd = fd;
+		connections[fd] = connection;
+		connectionCount.store(connections.size( ), memory_order_relaxed);
+
+		epoll_event event{ };
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.fd = fd;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+	}
+}
+
+void MatchServer::readClient(const shared_ptr<Connection>& connection) {
+	uint8_t buffer[4096];
+	bool hungUp = false;
+
+	while (true) {
+		ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+		if (received > 0) {
+			connection->inbox.insert(connection->inbox.end( ), buffer, buffer + received);
+			continue;
+		}
+		if (received < 0 && errno == EINTR) continue;
+		hungUp = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+		break;
+	}
+
+	size_t consumed = 0;
+	while (true) {
+		MessageType type;
+		const uint8_t* payload;
+		size_t payloadSize;
+		size_t size = Protocol::peekMessage(connection->inbox.data( ) + consumed, connection->inbox.size( ) - consumed, type, payload, payloadSize);
+		if (size == 0) break;
+		if (size == SIZE_MAX) {
+			hungUp = true;
+			break;
+		}
+		handleMessage(connection, type, payload, payloadSize);
+		consumed += size;
+	}
+	connection->inbox.erase(connection->inbox.begin( ), connection->inbox.begin( ) + consumed);
+
+	if (hungUp) disconnect(connection);
+}
+
+void MatchServer::handleMessage(const shared_ptr<Connection>& connection, MessageType type, const uint8_t* payload, size_t size) {
+	switch (type) {
+	case MessageType::HELLO:
+		if (!connection->inMatch && !connection->queued) {
+			connection->queued = true;
+			waiting.push_back(connection);
+			pairWaiting( );
+		}
+		break;
+	case MessageType::INPUT:
+		// Held buttons only, a newer state simply replaces an older one
+		if (size >= 5) connection->buttons.store(payload[4], memory_order_relaxed);
+		break;
+	default:
+		break;
+	}
+}
+
+void MatchServer::disconnect(const shared_ptr<Connection>& connection) {
+	if (connection->closed.exchange(true)) return;
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+
+	// A playing connection is still written by its worker, it gets closed once the match releases it
+	if (connection->inMatch) return;
+
+	close(connection->fd);
+	connections.erase(connection->fd);
+	connectionCount.store(connections.size( ), memory_order_relaxed);
+}
+
+void MatchServer::pairWaiting( ) {
+	while (!waiting.empty( ) && waiting.front( )->closed.load(memory_order_relaxed)) waiting.pop_front( );
+
+	while (waiting.size( ) >= 2) {
+		auto first = waiting.front( );
+		waiting.pop_front( );
+		auto second = waiting.front( );
+		waiting.pop_front( );
+		if (second->closed.load(memory_order_relaxed)) {
+			waiting.push_front(first);
+			continue;
+		}
+
+		for (auto& player : { first, second }) {
+			player->queued = false;
+			player->inMatch = true;
+			player->buttons.store(0, memory_order_relaxed);
+		}
+		scheduler.add(make_unique<Match>(nextMatchId++, seeds( ), first, second, scores));
+	}
+	waitingCount.store(waiting.size( ), memory_order_relaxed);
+}
+
+void MatchServer::release(shared_ptr<Connection> connection) {
+	{
+		lock_guard<mutex> lock(releasedMutex);
+		released.push_back(move(connection));
+	}
+	uint64_t one = 1;
+	if (write(wakeFd, &one, sizeof(one)) < 0) { }
+}
+
+void MatchServer::drainReleased( ) {
+	vector<shared_ptr<Connection>> batch;
+	{
+		lock_guard<mutex> lock(releasedMutex);
+		batch.swap(released);
+	}
+
+	for (auto& connection : batch) {
+		connection->inMatch = false;
+		if (connection->closed.load(memory_order_relaxed)) {
+			close(connection->fd);
+			connections.erase(connection->fd);
+		} else {
+			// Back in the lobby, the client sends HELLO again for a rematch
+			connection->flush( );
+		}
+	}
+	connectionCount.store(connections.size( ), memory_order_relaxed);
+}
+
+size_t MatchServer::getConnectionCount( ) const { return connectionCount.load(memory_order_relaxed); }
+size_t MatchServer::getWaitingCount( ) const { return waitingCount.load(memory_order_relaxed); }
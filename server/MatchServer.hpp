@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "Match.hpp"
+#include "TickScheduler.hpp"
+
+using namespace std;
+
+// epoll based network thread: accepts clients, decodes their messages, pairs waiting
+// clients into matches and hands those to the TickScheduler.
+class MatchServer {
+private:
+	void acceptClients( );
+	void readClient(const shared_ptr<Connection>& connection);
+	void handleMessage(const shared_ptr<Connection>& connection, MessageType type, const uint8_t* payload, size_t size);
+	void disconnect(const shared_ptr<Connection>& connection);
+	void pairWaiting( );
+	void drainReleased( );
+
+	TickScheduler& scheduler;
+	int listenFd = -1;
+	int epollFd = -1;
+	int wakeFd = -1;
+
+	unordered_map<int, shared_ptr<Connection>> connections;
+	deque<shared_ptr<Connection>> waiting;
+
+	mutex releasedMutex;
+	vector<shared_ptr<Connection>> released;
+
+	atomic<bool> running{ false };
+	atomic<size_t> connectionCount{ 0 };
+	atomic<size_t> waitingCount{ 0 };
+	uint32_t nextMatchId = 1;
+	mt19937_64 seeds{ random_device{ }( ) };
+	HighScores* scores = nullptr;
+
+public:
+	MatchServer(TickScheduler& scheduler);
+	~MatchServer( );
+
+	bool listen(uint16_t port);
+	// Finished matches append their scores here, call before run( )
+	void setHighScores(HighScores* store);
+	// Blocks until stop( ) is called from another thread or a signal handler
+	void run( );
+	void stop( );
+
+	// Thread safe, returns a player of a finished match to the lobby
+	void release(shared_ptr<Connection> connection);
+
+	size_t getConnectionCount( ) const;
+	size_t getWaitingCount( ) const;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Messages travel over TCP as: u16 payload length, u8 type, payload. All integers are little endian.
+enum class MessageType : uint8_t {
+	HELLO = 1,          // client: asks to be put into the next match
+	MATCH_START = 2,    // server: u32 match id, u64 seed, u8 player index
+	INPUT = 3,          // client: u32 frame, u8 held buttons (see InputButton)
+	STATE = 4,          // server: u32 frame, per player i32 score, i32 lines, u8 pending garbage, u8 topped out
+	MATCH_END = 5,      // server: u8 winning player, 0xFF for a draw
+};
+
+namespace Protocol {
+	constexpr size_t HEADER_SIZE = 3;
+	constexpr size_t MAX_PAYLOAD = 64;
+	constexpr uint16_t DEFAULT_PORT = 7100;
+
+	inline void putU8(vector<uint8_t>& out, uint8_t value) { out.push_back(value); }
+
+	inline void putU32(vector<uint8_t>& out, uint32_t value) {
+		for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+	}
+
+	inline void putU64(vector<uint8_t>& out, uint64_t value) {
+		putU32(out, static_cast<uint32_t>(value));
+		putU32(out, static_cast<uint32_t>(value >> 32));
+	}
+
+	inline uint32_t getU32(const uint8_t* in) {
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+		return value;
+	}
+
+	inline uint64_t getU64(const uint8_t* in) {
+		return getU32(in) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+	}
+
+	// Appends the header, the caller appends the payload and then calls endMessage
+	inline size_t beginMessage(vector<uint8_t>& out, MessageType type) {
+		size_t start = out.size( );
+		out.push_back(0);
+		out.push_back(0);
+		out.push_back(static_cast<uint8_t>(type));
+		return start;
+	}
+
+	inline void endMessage(vector<uint8_t>& out, size_t start) {
+		size_t payload = out.size( ) - start - HEADER_SIZE;
+		out[start] = static_cast<uint8_t>(payload);
+		out[start + 1] = static_cast<uint8_t>(payload >> 8);
+	}
+
+	// Looks at the front of a receive buffer. Returns the full message size, 0 if it is incomplete
+	// and SIZE_MAX if the stream is corrupt.
+	inline size_t peekMessage(const uint8_t* data, size_t available, MessageType& type, const uint8_t*& payload, size_t& payloadSize) {
+		if (available < HEADER_SIZE) return 0;
+		payloadSize = data[0] | (static_cast<size_t>(data[1]) << 8);
+		if (payloadSize > MAX_PAYLOAD) return SIZE_MAX;
+		if (available < HEADER_SIZE + payloadSize) return 0;
+		type = static_cast<MessageType>(data[2]);
+		payload = data + HEADER_SIZE;
+		return HEADER_SIZE + payloadSize;
+	}
+}
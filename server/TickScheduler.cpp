@@ -0,0 +1,119 @@
+#include "TickScheduler.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+TickScheduler::TickScheduler(int workerCount, int tickRate, bool pinThreads) : tickRate(tickRate), pinThreads(pinThreads) {
+	for (int i = 0; i < max(1, workerCount); i++)
+		workers.push_back(make_unique<Worker>( ));
+}
+
+TickScheduler::~TickScheduler( ) { stop( ); }
+
+void TickScheduler::setReleaseHandler(function<void(shared_ptr<Connection>)> handler) { releaseConnection = move(handler); }
+
+void TickScheduler::start( ) {
+	running = true;
+	int cpus = max(1u, thread::hardware_concurrency( ));
+	for (int i = 0; i < static_cast<int>(workers.size( )); i++) {
+		Worker& worker = *workers[i];
+		worker.handle = thread(&TickScheduler::workerLoop, this, ref(worker));
+
+		if (pinThreads) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i % cpus, &set);
+			if (pthread_setaffinity_np(worker.handle.native_handle( ), sizeof(set), &set) != 0)
+				cerr << "Failed to pin worker " << i << " to cpu " << i % cpus << endl;
+		}
+	}
+}
+
+void TickScheduler::stop( ) {
+	if (!running.exchange(false)) return;
+	for (auto& worker : workers)
+		if (worker->handle.joinable( )) worker->handle.join( );
+}
+
+void TickScheduler::add(unique_ptr<Match> match) {
+	Worker* target = workers[0].get( );
+	for (auto& worker : workers)
+		if (worker->matchCount.load(memory_order_relaxed) < target->matchCount.load(memory_order_relaxed))
+			target = worker.get( );
+
+	target->matchCount.fetch_add(1, memory_order_relaxed);
+	lock_guard<mutex> lock(target->pendingMutex);
+	target->pending.push_back(move(match));
+}
+
+void TickScheduler::workerLoop(Worker& worker) {
+	using clock = chrono::steady_clock;
+	const auto interval = chrono::nanoseconds(1000000000LL / tickRate);
+	auto nextTick = clock::now( );
+	vector<unique_ptr<Match>> incoming;
+
+	while (running.load(memory_order_relaxed)) {
+		this_thread::sleep_until(nextTick);
+		auto passStart = clock::now( );
+		worker.lateness.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(passStart - nextTick).count( )));
+
+		{
+			lock_guard<mutex> lock(worker.pendingMutex);
+			incoming.swap(worker.pending);
+		}
+		for (auto& match : incoming) {
+			match->start( );
+			worker.matches.push_back(move(match));
+		}
+		incoming.clear( );
+
+		uint64_t ticked = 0;
+		for (size_t i = 0; i < worker.matches.size( );) {
+			auto matchStart = clock::now( );
+			bool alive = worker.matches[i]->tick( );
+			worker.tickCost.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(clock::now( ) - matchStart).count( )));
+			ticked++;
+
+			if (alive) {
+				i++;
+				continue;
+			}
+
+			for (auto& player : worker.matches[i]->getPlayers( ))
+				if (releaseConnection) releaseConnection(player);
+			worker.matches[i] = move(worker.matches.back( ));
+			worker.matches.pop_back( );
+			worker.matchCount.fetch_sub(1, memory_order_relaxed);
+		}
+
+		if (!worker.matches.empty( ))
+			worker.sampleBytes.store(worker.matches[0]->memoryFootprint( ), memory_order_relaxed);
+		worker.matchTicks.fetch_add(ticked, memory_order_relaxed);
+		worker.passes.fetch_add(1, memory_order_relaxed);
+		worker.passCost.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(clock::now( ) - passStart).count( )));
+
+		nextTick += interval;
+		// Bounded catch up, a worker that fell far behind skips the missed ticks instead of bursting
+		if (clock::now( ) - nextTick > interval * 4) nextTick = clock::now( );
+	}
+}
+
+void TickScheduler::collect(Stats& stats) {
+	for (auto& worker : workers) {
+		stats.matchTicks += worker->matchTicks.exchange(0, memory_order_relaxed);
+		stats.passes += worker->passes.exchange(0, memory_order_relaxed);
+		size_t count = worker->matchCount.load(memory_order_relaxed);
+		stats.matches += count;
+		if (count > 0) {
+			stats.matchBytes += worker->sampleBytes.load(memory_order_relaxed);
+			stats.sampledMatches++;
+		}
+		worker->tickCost.drainInto(stats.tickCost);
+		worker->passCost.drainInto(stats.passCost);
+		worker->lateness.drainInto(stats.lateness);
+	}
+}
+
+int TickScheduler::getWorkerCount( ) const { return static_cast<int>(workers.size( )); }
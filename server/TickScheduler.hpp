@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Match.hpp"
+#include "LatencyHistogram.hpp"
+
+using namespace std;
+
+// Runs matches at a fixed tick rate on a pool of worker threads. A match stays on the
+// worker it was given to for its whole life, so its boards stay in that core's caches.
+class TickScheduler {
+public:
+	struct Stats {
+		uint64_t matchTicks = 0;        // match steps since the last collect
+		uint64_t passes = 0;            // worker tick passes since the last collect
+		size_t matches = 0;
+		size_t matchBytes = 0;          // summed Match::memoryFootprint of one sample per worker
+		size_t sampledMatches = 0;
+		LatencyHistogram tickCost;      // time to step one match
+		LatencyHistogram passCost;      // time for a worker to step all of its matches
+		LatencyHistogram lateness;      // how late a pass started against its schedule
+	};
+
+private:
+	struct Worker {
+		thread handle;
+		mutex pendingMutex;
+		vector<unique_ptr<Match>> pending;
+		vector<unique_ptr<Match>> matches;
+		atomic<size_t> matchCount{ 0 };
+		atomic<uint64_t> matchTicks{ 0 };
+		atomic<uint64_t> passes{ 0 };
+		atomic<size_t> sampleBytes{ 0 };
+		LatencyHistogram tickCost;
+		LatencyHistogram passCost;
+		LatencyHistogram lateness;
+	};
+
+	void workerLoop(Worker& worker);
+
+	vector<unique_ptr<Worker>> workers;
+	atomic<bool> running{ false };
+	int tickRate;
+	bool pinThreads;
+	function<void(shared_ptr<Connection>)> releaseConnection;
+
+public:
+	TickScheduler(int workerCount, int tickRate, bool pinThreads);
+	~TickScheduler( );
+
+	// Called on a worker thread for each player of a finished match
+	void setReleaseHandler(function<void(shared_ptr<Connection>)> handler);
+
+	void start( );
+	void stop( );
+
+	// Hands the match to the worker with the fewest matches
+	void add(unique_ptr<Match> match);
+	void collect(Stats& stats);
+
+	int getWorkerCount( ) const;
+};
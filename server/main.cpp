@@ -0,0 +1,174 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "MatchServer.hpp"
+#include "TickScheduler.hpp"
+#include "Metrics.hpp"
+
+struct ServerConfig {
+	uint16_t port = Protocol::DEFAULT_PORT;
+	int workers = 0;            // 0 = one per core
+	int tickRate = 60;
+	int reportSeconds = 5;
+	bool pinThreads = true;
+	std::string metrics;        // port or file, see MetricsExporter
+	std::string scores;         // high score file, see HighScores
+};
+
+static Metrics::Gauge& matchesGauge = Metrics::gauge("tetris_server_matches", "Matches being simulated");
+static Metrics::Gauge& connectionsGauge = Metrics::gauge("tetris_server_connections", "Open client connections");
+static Metrics::Gauge& waitingGauge = Metrics::gauge("tetris_server_waiting", "Players waiting for an opponent");
+static Metrics::Gauge& residentGauge = Metrics::gauge("tetris_server_resident_bytes", "Resident set size");
+static Metrics::Counter& matchTicks = Metrics::counter("tetris_server_match_ticks_total", "Match simulation steps");
+static Metrics::Gauge& tickP99 = Metrics::gauge("tetris_server_tick_p99_nanoseconds", "p99 time to step one match over the last report interval");
+static Metrics::Gauge& latenessP99 = Metrics::gauge("tetris_server_lateness_p99_nanoseconds", "p99 lateness of a worker pass over the last report interval");
+
+static MatchServer* activeServer = nullptr;
+
+static void handleSignal(int) {
+	if (activeServer) activeServer->stop( );
+}
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_server [--port <port>] [--workers <count>] [--tick-rate <hz>]" << std::endl
+		<< "                     [--report <seconds>] [--no-pin] [--metrics <port | file>]" << std::endl
+		<< "                     [--scores <file>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], ServerConfig& config) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--port" && hasValue) {
+			config.port = static_cast<uint16_t>(atoi(argv[++i]));
+		} else if (arg == "--workers" && hasValue) {
+			config.workers = atoi(argv[++i]);
+		} else if (arg == "--tick-rate" && hasValue) {
+			config.tickRate = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--report" && hasValue) {
+			config.reportSeconds = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--no-pin") {
+			config.pinThreads = false;
+		} else if (arg == "--metrics" && hasValue) {
+			config.metrics = argv[++i];
+		} else if (arg == "--scores" && hasValue) {
+			config.scores = argv[++i];
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+// Every connection is a socket, the default soft limit of 1024 runs out long before the cores do
+static void raiseFileLimit( ) {
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == limit.rlim_max) return;
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+static size_t residentBytes( ) {
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (!statm) return 0;
+	unsigned long pages = 0, resident = 0;
+	int read = fscanf(statm, "%lu %lu", &pages, &resident);
+	fclose(statm);
+	return read == 2 ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+static void printLatency(const char* name, const LatencyHistogram& histogram) {
+	printf("  %-10s p50 %7.1fus  p90 %7.1fus  p99 %7.1fus  p99.9 %7.1fus  max %7.1fus\n", name,
+		histogram.percentile(0.5) / 1000.0, histogram.percentile(0.9) / 1000.0, histogram.percentile(0.99) / 1000.0,
+		histogram.percentile(0.999) / 1000.0, histogram.max( ) / 1000.0);
+}
+
+static void report(TickScheduler& scheduler, MatchServer& server, double seconds, size_t baselineRss) {
+	TickScheduler::Stats stats;
+	scheduler.collect(stats);
+
+	size_t rss = residentBytes( );
+	printf("matches %zu  connections %zu  waiting %zu  ticks/s %.0f  passes/s %.0f\n", stats.matches,
+		server.getConnectionCount( ), server.getWaitingCount( ), stats.matchTicks / seconds, stats.passes / seconds);
+	printLatency("tick", stats.tickCost);
+	printLatency("pass", stats.passCost);
+	printLatency("lateness", stats.lateness);
+	if (stats.matches > 0) {
+		// Footprint is what a match owns, the RSS delta also covers allocator overhead and socket buffers in user space
+		printf("  memory/match %zu B sampled, %zu B by RSS\n", stats.sampledMatches ? stats.matchBytes / stats.sampledMatches : 0,
+			rss > baselineRss ? (rss - baselineRss) / stats.matches : 0);
+	}
+	fflush(stdout);
+
+	matchesGauge.set(static_cast<int64_t>(stats.matches));
+	connectionsGauge.set(static_cast<int64_t>(server.getConnectionCount( )));
+	waitingGauge.set(static_cast<int64_t>(server.getWaitingCount( )));
+	residentGauge.set(static_cast<int64_t>(rss));
+	matchTicks.add(stats.matchTicks);
+	tickP99.set(static_cast<int64_t>(stats.tickCost.percentile(0.99)));
+	latenessP99.set(static_cast<int64_t>(stats.lateness.percentile(0.99)));
+}
+
+int main(int argc, char* argv[ ]) {
+	ServerConfig config;
+	if (!parseArguments(argc, argv, config)) return 1;
+	raiseFileLimit( );
+
+	int workers = config.workers > 0 ? config.workers : static_cast<int>(std::max(2u, std::thread::hardware_concurrency( )) - 1);
+	TickScheduler scheduler(workers, config.tickRate, config.pinThreads);
+	MatchServer server(scheduler);
+	scheduler.setReleaseHandler([&server](std::shared_ptr<Connection> connection) { server.release(std::move(connection)); });
+
+	if (!server.listen(config.port)) return 1;
+
+	// Workers append from their tick loop, so records are flushed to the OS but not synced per
+	// match; a crash of the server loses nothing, a torn record from a power loss is cut off on open
+	HighScores scores;
+	if (!config.scores.empty( )) {
+		if (!scores.open(config.scores)) return 1;
+		scores.setDurable(false);
+		server.setHighScores(&scores);
+	}
+
+	MetricsExporter metrics;
+	if (!config.metrics.empty( ) && !metrics.open(config.metrics)) return 1;
+
+	activeServer = &server;
+	signal(SIGINT, handleSignal);
+	signal(SIGTERM, handleSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	size_t baselineRss = residentBytes( );
+	scheduler.start( );
+	std::cout << "Listening on port " << config.port << " with " << workers << " workers at " << config.tickRate << " Hz" << std::endl;
+
+	std::atomic<bool> reporting{ true };
+	std::thread reporter([&]( ) {
+		auto last = std::chrono::steady_clock::now( );
+		while (reporting.load( )) {
+			for (int i = 0; i < config.reportSeconds * 10 && reporting.load( ); i++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			auto now = std::chrono::steady_clock::now( );
+			report(scheduler, server, std::chrono::duration<double>(now - last).count( ), baselineRss);
+			last = now;
+		}
+	});
+
+	server.run( );
+
+	reporting = false;
+	reporter.join( );
+	scheduler.stop( );
+	activeServer = nullptr;
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+#include "PerfectClearSolver.hpp"
+
+// A position is the board's bottom rows, top first, one line each with '.' for empty and '#' for
+// filled cells, then a "queue" line with the pieces as letters. Lines starting with "//" are comments.
+struct NamedPosition {
+	int line;
+	PerfectClearSolver::Position position;
+};
+
+static void printUsage( ) {
+	std::cerr << "Usage: tetris_pcsolver [--threads <count, 0 = all cores>] [--pieces <max, up to 20>] [--table-bits <bits>]" << std::endl
+		<< "                       [--max-nodes <per position, 0 = no limit>] [--quiet] <positions file>" << std::endl;
+}
+
+static bool parseArguments(int argc, char* argv[ ], PerfectClearSolver::Config& config, bool& quiet, std::string& path) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--threads" && hasValue) {
+			config.threads = std::max(0, atoi(argv[++i]));
+		} else if (arg == "--pieces" && hasValue) {
+			config.maxPieces = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--table-bits" && hasValue) {
+			config.tableBits = atoi(argv[++i]);
+		} else if (arg == "--max-nodes" && hasValue) {
+			config.maxNodes = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--quiet") {
+			quiet = true;
+		} else if (path.empty( ) && !arg.empty( ) && arg[0] != '-') {
+			path = arg;
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	if (path.empty( )) {
+		printUsage( );
+		return false;
+	}
+	return true;
+}
+
+static bool readPositions(std::istream& in, std::vector<NamedPosition>& positions) {
+	std::vector<std::string> rows;
+	int start = 0, lineNumber = 0;
+	std::string line;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		if (!line.empty( ) && line.back( ) == '\r') line.pop_back( );
+		if (line.empty( ) || line.compare(0, 2, "//") == 0) continue;
+
+		if (line.compare(0, 6, "queue ") != 0) {
+			if (rows.empty( )) start = lineNumber;
+			rows.push_back(line);
+			continue;
+		}
+
+		NamedPosition named = { rows.empty( ) ? lineNumber : start, { } };
+		if (rows.size( ) > static_cast<size_t>(PerfectClearSolver::HEIGHT)) {
+			std::cerr << "line " << named.line << ": more than " << PerfectClearSolver::HEIGHT << " rows" << std::endl;
+			return false;
+		}
+		int top = PerfectClearSolver::HEIGHT - static_cast<int>(rows.size( ));
+		for (size_t row = 0; row < rows.size( ); row++) {
+			if (!named.position.setRow(top + static_cast<int>(row), rows[row])) {
+				std::cerr << "line " << named.line + static_cast<int>(row) << ": more than " << PerfectClearSolver::WIDTH << " columns" << std::endl;
+				return false;
+			}
+		}
+		for (size_t i = 6; i < line.size( ); i++) {
+			TetrominoShape shape;
+			if (line[i] == ' ') continue;
+			if (!PerfectClearSolver::parseShape(line[i], shape)) {
+				std::cerr << "line " << lineNumber << ": unknown piece '" << line[i] << "'" << std::endl;
+				return false;
+			}
+			named.position.queue.push_back(shape);
+		}
+		positions.push_back(std::move(named));
+		rows.clear( );
+	}
+	if (!rows.empty( )) {
+		std::cerr << "line " << start << ": board without a queue line" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[ ]) {
+	PerfectClearSolver::Config config;
+	bool quiet = false;
+	std::string path;
+	if (!parseArguments(argc, argv, config, quiet, path)) return 1;
+
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Cannot open " << path << std::endl;
+		return 1;
+	}
+	std::vector<NamedPosition> positions;
+	if (!readPositions(file, positions)) return 1;
+
+	PerfectClearSolver solver(config);
+	int solved = 0, unsolved = 0, gaveUp = 0;
+	uint64_t nodes = 0;
+	double seconds = 0.0;
+	for (const NamedPosition& named : positions) {
+		PerfectClearSolver::Result result = solver.solve(named.position);
+		nodes += result.nodes;
+		seconds += result.seconds;
+
+		const char* outcome = "no solution";
+		if (result.outcome == PerfectClearSolver::Outcome::SOLVED) {
+			outcome = "solved";
+			solved++;
+		} else if (result.outcome == PerfectClearSolver::Outcome::GAVE_UP) {
+			outcome = "gave up";
+			gaveUp++;
+		} else {
+			unsolved++;
+		}
+		printf("line %4d  %-11s  pieces %2zu  nodes %12llu  pruned %11llu  table hits %10llu  steals %6llu  %8.3fs  %6.2fM nodes/s\n",
+			named.line, outcome, result.placements.size( ), static_cast<unsigned long long>(result.nodes),
+			static_cast<unsigned long long>(result.pruned), static_cast<unsigned long long>(result.tableHits),
+			static_cast<unsigned long long>(result.steals), result.seconds,
+			result.seconds > 0.0 ? result.nodes / result.seconds / 1e6 : 0.0);
+		if (!quiet && !result.placements.empty( )) {
+			printf("           ");
+			for (const PerfectClearSolver::Placement& placement : result.placements)
+				printf(" %c r%d x%d y%d", PerfectClearSolver::shapeLetter(placement.shape), placement.rotation, placement.x, placement.y);
+			printf("\n");
+		}
+		fflush(stdout);
+	}
+
+	std::cout << "Finished: " << positions.size( ) << " positions with " << solver.getThreadCount( ) << " threads, " << solved
+		<< " solved, " << unsolved << " without solution, " << gaveUp << " gave up, " << nodes << " nodes in " << seconds << "s ("
+		<< (seconds > 0.0 ? nodes / seconds / 1e6 : 0.0) << "M nodes/s)" << std::endl;
+	return 0;
+}
@@ -0,0 +1,28 @@
+#include <cstdlib>
+#include <new>
+
+#include "Metrics.hpp"
+
+// Replaces the global operator new of the client to count heap allocations. The array and
+// nothrow forms forward to these, so every allocation from C++ code goes through here. Frees are
+// counted too: allocations minus deallocations is what C++ code holds on the heap.
+
+namespace {
+	Metrics::Counter allocations;
+	Metrics::Counter deallocations;
+	const bool registered = (Metrics::registerCounter("tetris_allocations_total", "Heap allocations through operator new", allocations),
+		Metrics::registerCounter("tetris_deallocations_total", "Heap allocations freed through operator delete", deallocations), true);
+}
+
+void* operator new(size_t size) {
+	allocations.add( );
+	if (void* memory = malloc(size ? size : 1)) return memory;
+	throw bad_alloc( );
+}
+
+void operator delete(void* memory) noexcept {
+	if (memory) deallocations.add( );
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept { operator delete(memory); }
@@ -0,0 +1,267 @@
+#include "AssetManager.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+extern "C" {
+#include <SDL2/SDL_image.h>
+}
+
+namespace {
+	Metrics::Counter& assetLoads = Metrics::counter("tetris_asset_loads_total", "Images, fonts and sounds loaded from disk");
+	Metrics::Counter& assetEvictions = Metrics::counter("tetris_asset_evictions_total", "Assets dropped to stay within the asset memory budget");
+	Metrics::Gauge& gpuBytes = Metrics::gauge("tetris_asset_gpu_bytes", "Texture memory of the resident assets");
+	Metrics::Gauge& cpuBytes = Metrics::gauge("tetris_asset_cpu_bytes", "Sound, music and font memory of the resident assets");
+	Metrics::Gauge& liveTextures = Metrics::gauge("tetris_sdl_textures_live", "SDL textures created and not yet destroyed");
+	Metrics::Gauge& liveChunks = Metrics::gauge("tetris_mixer_chunks_live", "Mixer chunks loaded and not yet freed");
+
+	// Groups every scene holds besides COMMON, which the manager holds itself
+	const vector<AssetGroup> SCENE_GROUPS[ ] = {
+		{ AssetGroup::TITLE },                          // START
+		{ AssetGroup::BOARD, AssetGroup::MUSIC },       // PLAY
+		{ AssetGroup::BOARD, AssetGroup::GAME_OVER },   // GAME_OVER
+	};
+	static_assert(sizeof(SCENE_GROUPS) / sizeof(SCENE_GROUPS[0]) == static_cast<size_t>(Scene::COUNT), "every scene needs its groups");
+
+	const char* SCENE_NAMES[ ] = { "start", "play", "game over" };
+
+	uint64_t fileSize(const string& path) {
+		SDL_RWops* file = SDL_RWFromFile(path.c_str( ), "rb");
+		if (!file) return 0;
+		Sint64 size = SDL_RWsize(file);
+		SDL_RWclose(file);
+		return size > 0 ? static_cast<uint64_t>(size) : 0;
+	}
+}
+
+AssetManager::AssetManager(uint64_t budgetBytes) : budget(budgetBytes) {
+	stats.budgetBytes = budget;
+	acquire(AssetGroup::COMMON);
+}
+
+string AssetManager::keyOf(Kind kind, const string& path, int fontSize) {
+	return kind == Kind::FONT ? path + "@" + to_string(fontSize) : path;
+}
+
+AssetManager::Entry& AssetManager::entry(Kind kind, const string& path, int fontSize) {
+	auto [it, created] = entries.try_emplace(keyOf(kind, path, fontSize));
+	if (created) {
+		it->second.kind = kind;
+		it->second.path = path;
+		it->second.fontSize = fontSize;
+	}
+	return it->second;
+}
+
+void AssetManager::add(AssetGroup group, Kind kind, const string& path, int fontSize) {
+	string key = keyOf(kind, path, fontSize);
+	vector<string>& members = groups[static_cast<size_t>(group)];
+	if (find(members.begin( ), members.end( ), key) != members.end( )) return;
+
+	Entry& added = entry(kind, path, fontSize);
+	members.push_back(key);
+	added.listed = true;
+	if (groupReferences[static_cast<size_t>(group)] > 0) {
+		added.references++;
+		if (!added.resident && !added.failed) load(added);
+	}
+}
+
+void AssetManager::addTexture(AssetGroup group, const string& path) { add(group, Kind::TEXTURE, path); }
+void AssetManager::addChunk(AssetGroup group, const string& path) { add(group, Kind::CHUNK, path); }
+void AssetManager::addMusic(AssetGroup group, const string& path) { add(group, Kind::MUSIC, path); }
+void AssetManager::addFont(AssetGroup group, const string& path, int size) { add(group, Kind::FONT, path, size); }
+
+bool AssetManager::load(Entry& entry) {
+	TRACE_ZONE("asset load");
+	// Textures wait for the renderer without counting as failed
+	if (entry.kind == Kind::TEXTURE && !renderer) return false;
+	assetLoads.add( );
+
+	switch (entry.kind) {
+	case Kind::TEXTURE: {
+		auto surface = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load(entry.path.c_str( )), SDL_FreeSurface);
+		SDL_Texture* texture = surface ? trackTexture(SDL_CreateTextureFromSurface(renderer.get( ), surface.get( ))) : nullptr;
+		if (texture) {
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+			entry.texture = { shared_ptr<SDL_Texture>(texture, destroyTexture), surface->w, surface->h };
+			entry.bytes = static_cast<uint64_t>(surface->w) * surface->h * 4;
+		}
+		break;
+	}
+	case Kind::CHUNK:
+		entry.chunk = shared_ptr<Mix_Chunk>(Mix_LoadWAV(entry.path.c_str( )), [ ](Mix_Chunk* chunk) {
+			if (!chunk) return;
+			Mix_FreeChunk(chunk);
+			liveChunks.add(-1);
+		});
+		if (entry.chunk) {
+			entry.bytes = entry.chunk->alen;
+			liveChunks.add(1);
+		}
+		break;
+	case Kind::MUSIC:
+		// How much of the file the decoder keeps in memory is up to SDL_mixer, the file size is the estimate
+		entry.music = shared_ptr<Mix_Music>(Mix_LoadMUS(entry.path.c_str( )), [ ](Mix_Music* music) { if (music) Mix_FreeMusic(music); });
+		if (entry.music) entry.bytes = fileSize(entry.path);
+		break;
+	case Kind::FONT:
+		entry.font = shared_ptr<TTF_Font>(TTF_OpenFont(entry.path.c_str( ), entry.fontSize), [ ](TTF_Font* font) { if (font) TTF_CloseFont(font); });
+		if (entry.font) entry.bytes = fileSize(entry.path);
+		break;
+	}
+
+	entry.resident = entry.texture.handle || entry.chunk || entry.music || entry.font;
+	if (!entry.resident) {
+		SDL_Log("Failed to load %s: %s", entry.path.c_str( ), SDL_GetError( ));
+		entry.failed = true;
+		entry.bytes = 0;
+		return false;
+	}
+
+	entry.lastUsed = frame;
+	if (entry.kind == Kind::TEXTURE) {
+		stats.gpuBytes += entry.bytes;
+		gpuBytes.add(static_cast<int64_t>(entry.bytes));
+	} else {
+		stats.cpuBytes += entry.bytes;
+		cpuBytes.add(static_cast<int64_t>(entry.bytes));
+	}
+	stats.loads++;
+	return true;
+}
+
+void AssetManager::evict(Entry& entry) {
+	if (entry.kind == Kind::TEXTURE) {
+		stats.gpuBytes -= entry.bytes;
+		gpuBytes.add(-static_cast<int64_t>(entry.bytes));
+	} else {
+		stats.cpuBytes -= entry.bytes;
+		cpuBytes.add(-static_cast<int64_t>(entry.bytes));
+	}
+	entry.texture = { };
+	entry.chunk.reset( );
+	entry.music.reset( );
+	entry.font.reset( );
+	entry.resident = false;
+	entry.bytes = 0;
+	stats.evictions++;
+	assetEvictions.add( );
+}
+
+void AssetManager::acquire(AssetGroup group) {
+	// Entries count the referenced groups that list them, not the scenes holding those groups
+	if (groupReferences[static_cast<size_t>(group)]++ > 0) return;
+	for (const string& key : groups[static_cast<size_t>(group)]) {
+		Entry& member = entries.at(key);
+		member.references++;
+		if (!member.resident && !member.failed) load(member);
+	}
+}
+
+void AssetManager::release(AssetGroup group) {
+	if (--groupReferences[static_cast<size_t>(group)] > 0) return;
+	for (const string& key : groups[static_cast<size_t>(group)]) entries.at(key).references--;
+}
+
+void AssetManager::trim( ) {
+	while (stats.gpuBytes + stats.cpuBytes > budget) {
+		Entry* oldest = nullptr;
+		for (auto& [key, candidate] : entries)
+			if (candidate.resident && candidate.references == 0 && (!oldest || candidate.lastUsed < oldest->lastUsed)) oldest = &candidate;
+		// What the current scene holds stays, the budget is exceeded instead
+		if (!oldest) return;
+		evict(*oldest);
+	}
+}
+
+void AssetManager::setRenderer(shared_ptr<SDL_Renderer> newRenderer) { renderer = move(newRenderer); }
+
+void AssetManager::setBudget(uint64_t bytes) {
+	budget = bytes;
+	stats.budgetBytes = bytes;
+	trim( );
+}
+
+void AssetManager::enterScene(Scene next) {
+	TRACE_ZONE("AssetManager::enterScene");
+	if (next == scene || next == Scene::COUNT) return;
+
+	// Groups both scenes share keep their references through the switch
+	for (AssetGroup group : SCENE_GROUPS[static_cast<size_t>(next)]) acquire(group);
+	if (scene != Scene::COUNT)
+		for (AssetGroup group : SCENE_GROUPS[static_cast<size_t>(scene)]) release(group);
+	scene = next;
+
+	prefetch.clear( );
+	Scene following = static_cast<Scene>((static_cast<size_t>(next) + 1) % static_cast<size_t>(Scene::COUNT));
+	for (AssetGroup group : SCENE_GROUPS[static_cast<size_t>(following)])
+		for (const string& key : groups[static_cast<size_t>(group)])
+			if (!entries.at(key).resident) prefetch.push_back(key);
+	trim( );
+
+	Stats current = getStats( );
+	SDL_Log("Assets: %s scene, %.1f KB texture %.1f KB sound and font, %u resident (%u in use), budget %.1f MB",
+		SCENE_NAMES[static_cast<size_t>(next)], current.gpuBytes / 1024.0, current.cpuBytes / 1024.0,
+		current.resident, current.referenced, current.budgetBytes / 1048576.0);
+}
+
+Scene AssetManager::getScene( ) const { return scene; }
+
+void AssetManager::endFrame( ) {
+	frame++;
+	while (!prefetch.empty( )) {
+		Entry& next = entries.at(prefetch.back( ));
+		prefetch.pop_back( );
+		if (next.resident || next.failed) continue;
+		// Ahead of time loading must not push out what is already there
+		if (stats.gpuBytes + stats.cpuBytes >= budget) {
+			prefetch.clear( );
+			break;
+		}
+		load(next);
+		break;
+	}
+	trim( );
+}
+
+AssetManager::Entry& AssetManager::use(Kind kind, const string& path, int fontSize) {
+	Entry& used = entry(kind, path, fontSize);
+	if (!used.listed) {
+		AssetGroup group = scene == Scene::COUNT ? AssetGroup::COMMON : SCENE_GROUPS[static_cast<size_t>(scene)].front( );
+		add(group, kind, path, fontSize);
+	}
+	if (!used.resident && !used.failed) load(used);
+	used.lastUsed = frame;
+	return used;
+}
+
+AssetManager::Texture AssetManager::texture(const string& path) { return use(Kind::TEXTURE, path).texture; }
+shared_ptr<Mix_Chunk> AssetManager::chunk(const string& path) { return use(Kind::CHUNK, path).chunk; }
+shared_ptr<Mix_Music> AssetManager::music(const string& path) { return use(Kind::MUSIC, path).music; }
+shared_ptr<TTF_Font> AssetManager::font(const string& path, int size) { return use(Kind::FONT, path, size).font; }
+
+AssetManager::Stats AssetManager::getStats( ) const {
+	Stats current = stats;
+	current.resident = current.referenced = 0;
+	for (const auto& [key, candidate] : entries) {
+		if (candidate.resident) current.resident++;
+		if (candidate.resident && candidate.references > 0) current.referenced++;
+	}
+	return current;
+}
+
+SDL_Texture* AssetManager::trackTexture(SDL_Texture* texture) {
+	if (texture) liveTextures.add(1);
+	return texture;
+}
+
+void AssetManager::destroyTexture(SDL_Texture* texture) {
+	if (!texture) return;
+	SDL_DestroyTexture(texture);
+	liveTextures.add(-1);
+}
+
+int64_t AssetManager::getLiveTextures( ) { return liveTextures.value( ); }
+int64_t AssetManager::getLiveChunks( ) { return liveChunks.value( ); }
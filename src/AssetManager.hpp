@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+#include <SDL2/SDL_ttf.h>
+}
+
+using namespace std;
+
+// Screens of the game, in the order they follow each other
+enum class Scene : uint8_t {
+	START,
+	PLAY,
+	GAME_OVER,
+	COUNT
+};
+
+// Assets that are loaded and released together. A scene holds a reference on each of its groups.
+enum class AssetGroup : uint8_t {
+	COMMON,     // font and sound effects, held for the whole run
+	TITLE,
+	BOARD,      // sprites and scoreboard of the running game and the game over screen
+	MUSIC,
+	GAME_OVER,
+	COUNT
+};
+
+// Owns every texture, sound chunk, music track and font. An asset is referenced by each entered
+// group that lists it and only assets without references are evicted, least recently used first,
+// once the resident bytes exceed the budget. Entering a scene queues the groups of the scene after
+// it, which endFrame( ) loads one asset per frame so the switch does not wait on the disk.
+// Handles are shared, an evicted asset lives on until its last user lets go of it.
+// Game thread only.
+class AssetManager {
+public:
+	static constexpr uint64_t DEFAULT_BUDGET = 16ull << 20;
+
+	struct Texture {
+		shared_ptr<SDL_Texture> handle;
+		int width = 0, height = 0;
+	};
+
+	struct Stats {
+		uint64_t gpuBytes = 0;      // textures at 4 bytes a pixel
+		uint64_t cpuBytes = 0;      // decoded sound chunks, music and font files at their file size
+		uint64_t budgetBytes = 0;
+		uint32_t resident = 0;
+		uint32_t referenced = 0;
+		uint64_t loads = 0;
+		uint64_t evictions = 0;
+	};
+
+private:
+	enum class Kind : uint8_t {
+		TEXTURE,
+		CHUNK,
+		MUSIC,
+		FONT,
+	};
+
+	struct Entry {
+		Kind kind;
+		string path;
+		int fontSize = 0;
+
+		Texture texture;
+		shared_ptr<Mix_Chunk> chunk;
+		shared_ptr<Mix_Music> music;
+		shared_ptr<TTF_Font> font;
+
+		bool listed = false;        // in at least one group
+		bool resident = false;
+		bool failed = false;        // not retried, a missing file would otherwise be read every frame
+		uint64_t bytes = 0;
+		int references = 0;
+		uint64_t lastUsed = 0;      // frame number
+	};
+
+	static string keyOf(Kind kind, const string& path, int fontSize);
+	Entry& entry(Kind kind, const string& path, int fontSize = 0);
+	// Marks the entry used this frame and loads it if needed. An asset no group lists joins the
+	// current scene's first group, so it is loaded ahead of time the next time round, and COMMON
+	// when no scene was entered yet.
+	Entry& use(Kind kind, const string& path, int fontSize = 0);
+	void add(AssetGroup group, Kind kind, const string& path, int fontSize = 0);
+	bool load(Entry& entry);
+	void evict(Entry& entry);
+	void acquire(AssetGroup group);
+	void release(AssetGroup group);
+	void trim( );
+
+	shared_ptr<SDL_Renderer> renderer;
+	uint64_t budget;
+	unordered_map<string, Entry> entries;
+	// Keys of the entries of every group
+	array<vector<string>, static_cast<size_t>(AssetGroup::COUNT)> groups;
+	array<int, static_cast<size_t>(AssetGroup::COUNT)> groupReferences{ };
+	Scene scene = Scene::COUNT;
+	// Keys of the next scene's assets that endFrame( ) still has to load
+	vector<string> prefetch;
+	uint64_t frame = 0;
+	Stats stats;
+
+public:
+	explicit AssetManager(uint64_t budgetBytes = DEFAULT_BUDGET);
+	AssetManager(const AssetManager&) = delete;
+	AssetManager& operator=(const AssetManager&) = delete;
+
+	// Textures are created for this renderer, none can be loaded before it is set
+	void setRenderer(shared_ptr<SDL_Renderer> renderer);
+	// Evicts right away when the resident assets no longer fit
+	void setBudget(uint64_t bytes);
+
+	// Lists an asset in a group, so entering a scene that uses the group loads it ahead of time
+	void addTexture(AssetGroup group, const string& path);
+	void addChunk(AssetGroup group, const string& path);
+	void addMusic(AssetGroup group, const string& path);
+	void addFont(AssetGroup group, const string& path, int size);
+
+	// Loads the scene's groups, drops the previous scene's references and queues the next scene
+	void enterScene(Scene scene);
+	Scene getScene( ) const;
+	// Loads one queued asset of the next scene, then evicts down to the budget. Once per frame.
+	void endFrame( );
+
+	// Empty handles when the file could not be loaded
+	Texture texture(const string& path);
+	shared_ptr<Mix_Chunk> chunk(const string& path);
+	shared_ptr<Mix_Music> music(const string& path);
+	shared_ptr<TTF_Font> font(const string& path, int size);
+
+	Stats getStats( ) const;
+
+	// Every SDL texture of the client is created through trackTexture and destroyed through
+	// destroyTexture, and every chunk is loaded here, so the live counts show handles nobody freed
+	static SDL_Texture* trackTexture(SDL_Texture* texture);
+	static void destroyTexture(SDL_Texture* texture);
+	static int64_t getLiveTextures( );
+	static int64_t getLiveChunks( );
+};
@@ -0,0 +1,125 @@
+#include "AudioMixer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_MIXER_SSE2 1
+#endif
+
+namespace {
+	// Enough for a 4096 frame stereo device buffer without growing inside the callback
+	constexpr size_t RESERVED_SAMPLES = 8192;
+}
+
+AudioMixer::AudioMixer(size_t voiceCount)
+	: voices(voiceCount), playing(make_unique<atomic<bool>[]>(voiceCount)) {
+	for (size_t voice = 0; voice < voiceCount; voice++) playing[voice] = false;
+	accumulator.reserve(RESERVED_SAMPLES);
+}
+
+bool AudioMixer::play(uint32_t voice, const AudioClip& clip, float gain, int32_t loops) {
+	if (voice >= voices.size( )) return false;
+	// Set before the push: a short clip can end in the callback before this line would run after it,
+	// and the callback's false must not be overwritten. A voice whose command did not fit reads free.
+	playing[voice].store(clip.count > 0, memory_order_relaxed);
+	if (!commands.tryPush({ voice, clip, gain, loops })) {
+		playing[voice].store(false, memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+bool AudioMixer::stop(uint32_t voice) { return play(voice, AudioClip( )); }
+
+bool AudioMixer::isPlaying(uint32_t voice) const {
+	return voice < voices.size( ) && playing[voice].load(memory_order_relaxed);
+}
+
+void AudioMixer::setMasterGain(float gain) { masterGain.store(gain, memory_order_relaxed); }
+float AudioMixer::getMasterGain( ) const { return masterGain.load(memory_order_relaxed); }
+size_t AudioMixer::getVoiceCount( ) const { return voices.size( ); }
+
+void AudioMixer::mix(int16_t* out, size_t samples) {
+	Command command;
+	while (commands.tryPop(command)) {
+		Voice& voice = voices[command.voice];
+		voice.clip = command.clip;
+		voice.position = 0;
+		voice.gain = command.gain;
+		voice.loops = command.loops;
+	}
+
+	if (accumulator.size( ) < samples) accumulator.resize(samples);
+	float* mixed = accumulator.data( );
+	widen(mixed, out, samples);
+
+	float master = masterGain.load(memory_order_relaxed);
+	for (size_t index = 0; index < voices.size( ); index++) {
+		Voice& voice = voices[index];
+		size_t done = 0;
+		while (voice.clip.count > 0 && done < samples) {
+			size_t count = min<size_t>(samples - done, voice.clip.count - voice.position);
+			accumulate(mixed + done, voice.clip.samples + voice.position, count, voice.gain * master);
+			done += count;
+			voice.position += static_cast<uint32_t>(count);
+			if (voice.position < voice.clip.count) continue;
+
+			voice.position = 0;
+			if (voice.loops > 0) voice.loops--;
+			else if (voice.loops == 0) {
+				voice.clip = AudioClip( );
+				playing[index].store(false, memory_order_relaxed);
+			}
+		}
+	}
+
+	saturate(out, mixed, samples);
+}
+
+void AudioMixer::accumulate(float* accumulator, const int16_t* samples, size_t count, float gain) {
+	size_t i = 0;
+#ifdef AUDIO_MIXER_SSE2
+	const __m128 scale = _mm_set1_ps(gain);
+	for (; i + 8 <= count; i += 8) {
+		__m128i pcm = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+		// Sign extend by placing each sample in the upper half and shifting it back down
+		__m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16));
+		__m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16));
+		_mm_storeu_ps(accumulator + i, _mm_add_ps(_mm_loadu_ps(accumulator + i), _mm_mul_ps(low, scale)));
+		_mm_storeu_ps(accumulator + i + 4, _mm_add_ps(_mm_loadu_ps(accumulator + i + 4), _mm_mul_ps(high, scale)));
+	}
+#endif
+	for (; i < count; i++)
+		accumulator[i] += samples[i] * gain;
+}
+
+void AudioMixer::widen(float* accumulator, const int16_t* samples, size_t count) {
+	size_t i = 0;
+#ifdef AUDIO_MIXER_SSE2
+	for (; i + 8 <= count; i += 8) {
+		__m128i pcm = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+		_mm_storeu_ps(accumulator + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16)));
+		_mm_storeu_ps(accumulator + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16)));
+	}
+#endif
+	for (; i < count; i++)
+		accumulator[i] = samples[i];
+}
+
+void AudioMixer::saturate(int16_t* out, const float* accumulator, size_t count) {
+	size_t i = 0;
+#ifdef AUDIO_MIXER_SSE2
+	// Clamped while still float, a sum past the int32 range would otherwise convert to INT32_MIN
+	const __m128 highest = _mm_set1_ps(32767.0f);
+	const __m128 lowest = _mm_set1_ps(-32768.0f);
+	for (; i + 8 <= count; i += 8) {
+		__m128 low = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(accumulator + i), highest), lowest);
+		__m128 high = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(accumulator + i + 4), highest), lowest);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = static_cast<int16_t>(lrintf(clamp(accumulator[i], -32768.0f, 32767.0f)));
+}
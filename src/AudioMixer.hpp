@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SpscQueue.hpp"
+
+using namespace std;
+
+// Interleaved signed 16 bit PCM already in the output device's rate and channel layout
+struct AudioClip {
+	const int16_t* samples = nullptr;
+	uint32_t count = 0;
+};
+
+// Software mixer for the audio callback. One control thread starts voices, the callback thread
+// mixes them; the two only meet in a lock-free command queue and one playing flag per voice.
+class AudioMixer {
+private:
+	struct Command {
+		uint32_t voice;
+		AudioClip clip;
+		float gain;
+		int32_t loops;      // -1 repeats forever
+	};
+
+	// Callback thread only
+	struct Voice {
+		AudioClip clip;
+		uint32_t position = 0;
+		float gain = 0.0f;
+		int32_t loops = 0;
+	};
+
+	SpscQueue<Command, 256> commands;
+	vector<Voice> voices;
+	unique_ptr<atomic<bool>[]> playing;
+	vector<float> accumulator;
+	atomic<float> masterGain{ 1.0f };
+
+public:
+	explicit AudioMixer(size_t voiceCount);
+
+	// Control thread. Replaces whatever the voice was playing, false when the queue is full.
+	bool play(uint32_t voice, const AudioClip& clip, float gain = 1.0f, int32_t loops = 0);
+	bool stop(uint32_t voice);
+	// True from play( ) until the callback reaches the end of the clip
+	bool isPlaying(uint32_t voice) const;
+	void setMasterGain(float gain);
+	float getMasterGain( ) const;
+	size_t getVoiceCount( ) const;
+
+	// Callback thread. Adds every playing voice onto what is already in out, saturating.
+	void mix(int16_t* out, size_t samples);
+
+	// The kernels mix is built from, exposed for the benchmark
+	static void accumulate(float* accumulator, const int16_t* samples, size_t count, float gain);
+	static void widen(float* accumulator, const int16_t* samples, size_t count);
+	static void saturate(int16_t* out, const float* accumulator, size_t count);
+};
@@ -0,0 +1,64 @@
+#include "AutoPlayer.hpp"
+
+#include <limits>
+#include <vector>
+
+namespace {
+	// Same turn as Tetromino::rotate, without the wall kicks
+	vector<vector<int>> rotated(const vector<vector<int>>& shape) {
+		vector<vector<int>> result(shape[0].size( ), vector<int>(shape.size( )));
+		for (size_t row = 0; row < shape.size( ); row++)
+			for (size_t col = 0; col < shape[0].size( ); col++)
+				result[col][shape.size( ) - 1 - row] = shape[row][col];
+		return result;
+	}
+}
+
+double AutoPlayer::score(const BoardFeatures& features) {
+	return -0.51 * features.aggregateHeight + 0.76 * features.clearedLines - 0.36 * features.holes - 0.18 * features.bumpiness;
+}
+
+void AutoPlayer::plan(const GameBoard& board) {
+	const shared_ptr<Tetromino> current = board.getCurrentTetromino( );
+	vector<vector<int>> shape = current->getShape( );
+	int y = current->getY( ), rotation = current->getState( ).rotationState;
+
+	double best = -numeric_limits<double>::infinity( );
+	targetRotation = rotation;
+	targetX = current->getX( );
+	for (int turns = 0; turns < 4; turns++, shape = rotated(shape)) {
+		for (int x = -static_cast<int>(shape[0].size( )); x < GameBoard::width; x++) {
+			if (!board.isValidPosition(shape, x, y)) continue;
+			int bottom = y;
+			while (board.isValidPosition(shape, x, bottom + 1)) bottom++;
+
+			double value = score(board.evaluatePlacement(shape, x, bottom));
+			if (value > best) {
+				best = value;
+				targetRotation = (rotation + turns) % 4;
+				targetX = x;
+			}
+		}
+	}
+}
+
+uint8_t AutoPlayer::buttons(const GameBoard& board) {
+	const shared_ptr<Tetromino> current = board.getCurrentTetromino( );
+	if (!current || board.isCollision( )) return 0;
+	if (current.get( ) != piece) {
+		piece = current.get( );
+		presses = 0;
+		plan(board);
+	}
+
+	if (++presses > MAX_PRESSES) return INPUT_DROP;
+	if (current->getState( ).rotationState != targetRotation) return INPUT_ROTATE;
+	if (current->getX( ) < targetX) return INPUT_RIGHT;
+	if (current->getX( ) > targetX) return INPUT_LEFT;
+	return INPUT_DROP;
+}
+
+void AutoPlayer::reset( ) {
+	piece = nullptr;
+	presses = 0;
+}
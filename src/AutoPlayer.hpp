@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include "BoardFeatures.hpp"
+#include "GameBoard.hpp"
+
+using namespace std;
+
+// Plays a GameBoard without a human, e.g. for soak runs. When a piece appears it picks the rotation
+// and column whose hard drop scores best on BoardFeatures, then presses one button a frame to get
+// there: rotations first, then sideways moves, then the drop. Moves the board refuses are not
+// retried forever, after MAX_PRESSES the piece is dropped wherever it is.
+class AutoPlayer {
+public:
+	static constexpr int MAX_PRESSES = 12;
+
+private:
+	void plan(const GameBoard& board);
+
+	// The piece the plan is for, compared by address only
+	const Tetromino* piece = nullptr;
+	int targetRotation = 0;
+	int targetX = 0;
+	int presses = 0;
+
+public:
+	// Higher is better: low, flat stacks without holes, cleared lines rewarded
+	static double score(const BoardFeatures& features);
+
+	// The INPUT_* button to press this frame, 0 while there is no piece
+	uint8_t buttons(const GameBoard& board);
+	void reset( );
+};
@@ -0,0 +1,206 @@
+#include "BatchEnv.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+namespace {
+	Metrics::Counter& envSteps = Metrics::counter("tetris_env_steps_total", "Board steps taken by batch environments");
+
+	// Boards per chunk boundary, keeps two threads from writing into one cache line of rewards
+	constexpr size_t CHUNK_ALIGN = 16;
+
+	// GameBoard::nextRandom, so a seed deals the same pieces here as on a GameBoard
+	uint32_t nextRandom(uint64_t& state, uint32_t bound) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		return static_cast<uint32_t>((z >> 32) * bound >> 32);
+	}
+}
+
+BatchEnv::BatchEnv(size_t count, uint64_t seed, int threads)
+	: count(count), rows(count * HEIGHT), rngState(count), cells(count * HEIGHT * WIDTH), pieces(count * (1 + QUEUE_LENGTH)),
+	rewards(count), dones(count), scores(count), lines(count) {
+	// Rotations as Tetromino::rotate turns the spawn shape, clockwise
+	for (int shape = 0; shape < static_cast<int>(TetrominoShape::COUNT); shape++) {
+		vector<vector<int>> matrix = Tetromino(static_cast<TetrominoShape>(shape), 0).getShape( );
+		for (int rotation = 0; rotation < ROTATIONS; rotation++) {
+			Shape& out = shapes[shape][rotation];
+			out = { };
+			out.height = static_cast<int>(matrix.size( ));
+			out.width = static_cast<int>(matrix[0].size( ));
+			for (int row = 0; row < out.height; row++)
+				for (int col = 0; col < out.width; col++)
+					if (matrix[row][col]) out.rows[row] |= static_cast<uint16_t>(1u << col);
+
+			vector<vector<int>> rotated(matrix[0].size( ), vector<int>(matrix.size( )));
+			for (size_t row = 0; row < matrix.size( ); row++)
+				for (size_t col = 0; col < matrix[0].size( ); col++)
+					rotated[col][matrix.size( ) - 1 - row] = matrix[row][col];
+			matrix = move(rotated);
+		}
+	}
+
+	reset(seed);
+
+	if (threads <= 0) threads = static_cast<int>(max(1u, thread::hardware_concurrency( )));
+	// No point in chunks smaller than a few cache lines of boards
+	size_t chunks = min(static_cast<size_t>(threads), max<size_t>(1, count / (4 * CHUNK_ALIGN)));
+	for (size_t chunk = 1; chunk < chunks; chunk++) workers.emplace_back(&BatchEnv::workerLoop, this, chunk);
+}
+
+BatchEnv::~BatchEnv( ) {
+	{
+		lock_guard<mutex> lock(poolMutex);
+		stopping = true;
+	}
+	wake.notify_all( );
+	for (auto& worker : workers) worker.join( );
+}
+
+uint8_t BatchEnv::drawPiece(size_t board) {
+	uint8_t shape = static_cast<uint8_t>(nextRandom(rngState[board], static_cast<uint32_t>(TetrominoShape::COUNT)));
+	// GameBoard draws a color right after every shape, keep the sequence in step
+	nextRandom(rngState[board], Tetromino::COLOR_COUNT);
+	return shape;
+}
+
+void BatchEnv::resetBoard(size_t board) {
+	fill_n(rows.begin( ) + board * HEIGHT, HEIGHT, 0);
+	uint8_t* queue = &pieces[board * (1 + QUEUE_LENGTH)];
+	for (int i = 0; i <= QUEUE_LENGTH; i++) queue[i] = drawPiece(board);
+	scores[board] = 0;
+	lines[board] = 0;
+}
+
+void BatchEnv::reset(uint64_t seed) {
+	for (size_t board = 0; board < count; board++) {
+		rngState[board] = seed + board;
+		resetBoard(board);
+		rewards[board] = 0;
+		dones[board] = 0;
+		writeObservation(board);
+	}
+}
+
+void BatchEnv::stepBoard(size_t board, uint8_t action) {
+	uint16_t* boardRows = &rows[board * HEIGHT];
+	uint8_t* queue = &pieces[board * (1 + QUEUE_LENGTH)];
+	action %= ACTION_COUNT;
+	const Shape& shape = shapes[queue[0]][action / WIDTH];
+	int x = min(action % WIDTH, WIDTH - shape.width);
+
+	auto fits = [&](const Shape& piece, int column, int y) {
+		if (y + piece.height > HEIGHT) return false;
+		for (int row = 0; row < piece.height; row++)
+			if (boardRows[y + row] & (piece.rows[row] << column)) return false;
+		return true;
+	};
+
+	rewards[board] = 0;
+	dones[board] = 0;
+	if (!fits(shape, x, 0)) {
+		dones[board] = 1;
+		resetBoard(board);
+		return;
+	}
+
+	int y = 0;
+	while (fits(shape, x, y + 1)) y++;
+	int cleared = 0;
+	for (int row = 0; row < shape.height; row++) {
+		boardRows[y + row] |= static_cast<uint16_t>(shape.rows[row] << x);
+		if (boardRows[y + row] == FULL_ROW) cleared++;
+	}
+
+	if (cleared > 0) {
+		// Only rows down to the piece's bottom can move
+		int write = y + shape.height - 1;
+		for (int read = write; read >= 0; read--)
+			if (boardRows[read] != FULL_ROW) boardRows[write--] = boardRows[read];
+		while (write >= 0) boardRows[write--] = 0;
+		rewards[board] = static_cast<float>(cleared);
+		scores[board] += 100 * cleared;
+		lines[board] += cleared;
+	}
+
+	copy(queue + 1, queue + 1 + QUEUE_LENGTH, queue);
+	queue[QUEUE_LENGTH] = drawPiece(board);
+
+	// GameBoard spawns at column 4 in the spawn rotation and tops out when that is blocked
+	if (!fits(shapes[queue[0]][0], 4, 0)) {
+		dones[board] = 1;
+		resetBoard(board);
+	}
+}
+
+void BatchEnv::writeObservation(size_t board) {
+	const uint16_t* boardRows = &rows[board * HEIGHT];
+	uint8_t* out = &cells[board * HEIGHT * WIDTH];
+	for (int row = 0; row < HEIGHT; row++)
+		for (int col = 0; col < WIDTH; col++) *out++ = (boardRows[row] >> col) & 1;
+}
+
+void BatchEnv::stepRange(size_t begin, size_t end, const uint8_t* actions) {
+	for (size_t board = begin; board < end; board++) {
+		stepBoard(board, actions[board]);
+		writeObservation(board);
+	}
+}
+
+size_t BatchEnv::chunkBegin(size_t chunk) const {
+	size_t chunks = workers.size( ) + 1;
+	size_t begin = (count * chunk / chunks) / CHUNK_ALIGN * CHUNK_ALIGN;
+	return chunk >= chunks ? count : begin;
+}
+
+void BatchEnv::workerLoop(size_t chunk) {
+	uint64_t seen = 0;
+	while (true) {
+		const uint8_t* actions;
+		{
+			unique_lock<mutex> lock(poolMutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			actions = pendingActions;
+		}
+
+		stepRange(chunkBegin(chunk), chunkBegin(chunk + 1), actions);
+
+		lock_guard<mutex> lock(poolMutex);
+		if (--busy == 0) finished.notify_one( );
+	}
+}
+
+void BatchEnv::step(const uint8_t* actions) {
+	TRACE_ZONE("BatchEnv::step");
+	if (!workers.empty( )) {
+		{
+			lock_guard<mutex> lock(poolMutex);
+			pendingActions = actions;
+			busy = workers.size( );
+			generation++;
+		}
+		wake.notify_all( );
+	}
+
+	stepRange(0, chunkBegin(1), actions);
+
+	if (!workers.empty( )) {
+		unique_lock<mutex> lock(poolMutex);
+		finished.wait(lock, [&] { return busy == 0; });
+	}
+	envSteps.add(count);
+}
+
+size_t BatchEnv::size( ) const { return count; }
+int BatchEnv::getThreadCount( ) const { return static_cast<int>(workers.size( )) + 1; }
+const uint8_t* BatchEnv::getCells( ) const { return cells.data( ); }
+const uint8_t* BatchEnv::getPieces( ) const { return pieces.data( ); }
+const float* BatchEnv::getRewards( ) const { return rewards.data( ); }
+const uint8_t* BatchEnv::getDones( ) const { return dones.data( ); }
+const int32_t* BatchEnv::getScores( ) const { return scores.data( ); }
+const int32_t* BatchEnv::getLines( ) const { return lines.data( ); }
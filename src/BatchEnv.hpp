@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "GameBoard.hpp"
+
+using namespace std;
+
+// Many single player boards for placement agents, stepped together. An action picks the rotation and
+// the column of the current piece, which is then hard dropped, locked and cleared like on GameBoard;
+// a seed deals the same pieces as GameBoard with that seed. State is kept as one array per field
+// across all boards (rows are bitmasks), and the observation arrays are written in place every step,
+// so a caller can keep pointers to them. Boards that top out restart right away within the step.
+class BatchEnv {
+public:
+	static constexpr int WIDTH = GameBoard::width;
+	static constexpr int HEIGHT = GameBoard::height;
+	static constexpr int ROTATIONS = 4;
+	// action = rotation * WIDTH + column of the rotated piece's left edge, clamped to the board
+	static constexpr int ACTION_COUNT = ROTATIONS * WIDTH;
+	// Pieces shown after the current one
+	static constexpr int QUEUE_LENGTH = 5;
+	static_assert(WIDTH <= 16, "rows are 16 bit masks");
+
+private:
+	static constexpr uint16_t FULL_ROW = (1u << WIDTH) - 1;
+
+	// A piece in one rotation as column bits per row, bit c is column x + c
+	struct Shape {
+		uint16_t rows[4];
+		int width, height;
+	};
+
+	uint8_t drawPiece(size_t board);
+	void resetBoard(size_t board);
+	void stepBoard(size_t board, uint8_t action);
+	void writeObservation(size_t board);
+	void stepRange(size_t begin, size_t end, const uint8_t* actions);
+	void workerLoop(size_t chunk);
+	size_t chunkBegin(size_t chunk) const;
+
+	size_t count;
+	Shape shapes[static_cast<int>(TetrominoShape::COUNT)][ROTATIONS];
+
+	// Simulation state, board i at [i * HEIGHT] and [i * (1 + QUEUE_LENGTH)]
+	vector<uint16_t> rows;
+	vector<uint64_t> rngState;
+	// Observations
+	vector<uint8_t> cells;      // count * HEIGHT * WIDTH, 1 where a block is locked
+	vector<uint8_t> pieces;     // count * (1 + QUEUE_LENGTH) TetrominoShape values, current piece first
+	vector<float> rewards;      // lines cleared by the last step
+	vector<uint8_t> dones;      // 1 when the last step topped out and the board restarted
+	vector<int32_t> scores;
+	vector<int32_t> lines;
+
+	// Worker k + 1 steps chunk k + 1, the calling thread chunk 0
+	vector<thread> workers;
+	mutex poolMutex;
+	condition_variable wake, finished;
+	uint64_t generation = 0;
+	size_t busy = 0;
+	bool stopping = false;
+	const uint8_t* pendingActions = nullptr;
+
+public:
+	// threads 0 uses every core; boards are seeded from seed, see reset( )
+	BatchEnv(size_t count, uint64_t seed, int threads = 0);
+	~BatchEnv( );
+	BatchEnv(const BatchEnv&) = delete;
+	BatchEnv& operator=(const BatchEnv&) = delete;
+
+	// Restarts every board, board i with GameBoard's seed seed + i
+	void reset(uint64_t seed);
+	// One action per board
+	void step(const uint8_t* actions);
+
+	size_t size( ) const;
+	int getThreadCount( ) const;
+	const uint8_t* getCells( ) const;
+	const uint8_t* getPieces( ) const;
+	const float* getRewards( ) const;
+	const uint8_t* getDones( ) const;
+	const int32_t* getScores( ) const;
+	const int32_t* getLines( ) const;
+};
@@ -0,0 +1,239 @@
+#include "BoardFeatures.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdlib>
+
+bool BoardFeatures::operator==(const BoardFeatures& other) const {
+	return aggregateHeight == other.aggregateHeight && maxHeight == other.maxHeight && holes == other.holes &&
+		rowTransitions == other.rowTransitions && wells == other.wells && bumpiness == other.bumpiness &&
+		clearedLines == other.clearedLines;
+}
+
+bool BoardFeatures::operator!=(const BoardFeatures& other) const { return !(*this == other); }
+
+template <int Width, int Height>
+BoardFeatureTracker<Width, Height>::BoardFeatureTracker( ) {
+	reset(Cells{ });
+}
+
+template <int Width, int Height>
+int BoardFeatureTracker<Width, Height>::transitions(RowBits row) {
+	// The row between its two walls, every bit that differs from its right neighbour is a transition
+	uint64_t walled = (static_cast<uint64_t>(row) << 1) | 1 | (uint64_t(1) << (Width + 1));
+	uint64_t changes = (walled ^ (walled >> 1)) & ((uint64_t(1) << (Width + 1)) - 1);
+	return static_cast<int>(bitset<64>(changes).count( ));
+}
+
+template <int Width, int Height>
+typename BoardFeatureTracker<Width, Height>::RowBits BoardFeatureTracker<Width, Height>::rowOf(const Cells& cells, int row) {
+	RowBits bits = 0;
+	for (int col = 0; col < Width; col++)
+		if (cells[row][col]) bits |= RowBits(1) << col;
+	return bits;
+}
+
+template <int Width, int Height>
+void BoardFeatureTracker<Width, Height>::sumNeighbourhood(const array<int, Width>& heights, int first, int last, int& wells, int& bumpiness) {
+	int from = max(0, first - 1), to = min(Width - 1, last + 1);
+	for (int col = from; col <= to; col++) {
+		int left = col > 0 ? heights[col - 1] : Height;
+		int right = col < Width - 1 ? heights[col + 1] : Height;
+		wells += max(0, min(left, right) - heights[col]);
+	}
+	for (int col = from; col < to; col++) bumpiness += abs(heights[col] - heights[col + 1]);
+}
+
+template <int Width, int Height>
+void BoardFeatureTracker<Width, Height>::sumColumns(const array<int, Width>& heights, BoardFeatures& features) {
+	features.aggregateHeight = features.maxHeight = features.wells = features.bumpiness = 0;
+	for (int col = 0; col < Width; col++) {
+		features.aggregateHeight += heights[col];
+		features.maxHeight = max(features.maxHeight, heights[col]);
+	}
+	sumNeighbourhood(heights, 0, Width - 1, features.wells, features.bumpiness);
+}
+
+template <int Width, int Height>
+void BoardFeatureTracker<Width, Height>::reset(const Cells& cells) {
+	heights.fill(0);
+	filled.fill(0);
+	for (int row = 0; row < Height; row++) {
+		rows[row] = rowOf(cells, row);
+		for (int col = 0; col < Width; col++)
+			if ((rows[row] >> col) & 1) {
+				filled[col]++;
+				heights[col] = max(heights[col], Height - row);
+			}
+	}
+	features = scan(cells);
+}
+
+template <int Width, int Height>
+void BoardFeatureTracker<Width, Height>::lock(const Cells& cells, int first, int last) {
+	const array<int, Width> before = heights;
+	int lo = Width, hi = -1, added = 0;
+	for (int row = max(0, first); row <= min(Height - 1, last); row++) {
+		RowBits now = rowOf(cells, row);
+		RowBits fresh = now & ~rows[row];
+		if (!fresh) continue;
+
+		features.rowTransitions += transitions(now) - transitions(rows[row]);
+		rows[row] = now;
+		for (int col = 0; col < Width; col++)
+			if ((fresh >> col) & 1) {
+				filled[col]++;
+				heights[col] = max(heights[col], Height - row);
+				lo = min(lo, col);
+				hi = max(hi, col);
+				added++;
+			}
+	}
+	if (hi < lo) return;
+
+	// Holes are height minus filled cells per column
+	features.holes -= added;
+	for (int col = lo; col <= hi; col++) {
+		int grown = heights[col] - before[col];
+		features.aggregateHeight += grown;
+		features.holes += grown;
+		features.maxHeight = max(features.maxHeight, heights[col]);
+	}
+
+	int oldWells = 0, oldBumpiness = 0, newWells = 0, newBumpiness = 0;
+	sumNeighbourhood(before, lo, hi, oldWells, oldBumpiness);
+	sumNeighbourhood(heights, lo, hi, newWells, newBumpiness);
+	features.wells += newWells - oldWells;
+	features.bumpiness += newBumpiness - oldBumpiness;
+}
+
+template <int Width, int Height>
+void BoardFeatureTracker<Width, Height>::clear(uint64_t clearedRows) {
+	clearedRows &= (uint64_t(2) << (Height - 1)) - 1;
+	const int cleared = static_cast<int>(bitset<64>(clearedRows).count( ));
+	if (cleared == 0) return;
+
+	int target = Height - 1;
+	for (int row = Height - 1; row >= 0; row--)
+		if (!((clearedRows >> row) & 1)) rows[target--] = rows[row];
+	while (target >= 0) rows[target--] = 0;
+
+	// A full row has a cell in every column, so every column loses one filled cell per cleared line
+	// and its top moves down by at least that many rows. It moves further when the top cell was in
+	// a cleared row, past the holes under it, which is the only walk down a column here.
+	const int oldHeight = features.aggregateHeight;
+	for (int col = 0; col < Width; col++) {
+		filled[col] -= cleared;
+		int row = min(Height, Height - heights[col] + cleared);
+		while (row < Height && !((rows[row] >> col) & 1)) row++;
+		heights[col] = Height - row;
+	}
+	sumColumns(heights, features);
+	features.holes += features.aggregateHeight - oldHeight + cleared * Width;
+	// Full rows have no transitions, the empty rows coming in at the top have one at each wall
+	features.rowTransitions += 2 * cleared;
+}
+
+template <int Width, int Height>
+const BoardFeatures& BoardFeatureTracker<Width, Height>::get( ) const { return features; }
+
+template <int Width, int Height>
+int BoardFeatureTracker<Width, Height>::getColumnHeight(int column) const { return heights[column]; }
+
+template <int Width, int Height>
+BoardFeatures BoardFeatureTracker<Width, Height>::evaluate(const Piece& piece) const {
+	BoardFeatures result = features;
+	array<int, Width> after = heights;
+	int lo = Width, hi = -1, added = 0;
+	uint64_t fullRows = 0;
+	for (int r = 0; r < min(4, piece.height); r++) {
+		int row = piece.y + r;
+		RowBits bits = piece.rows[r] & FULL_ROW;
+		if (!bits || row < 0 || row >= Height) continue;
+
+		RowBits now = rows[row] | bits;
+		result.rowTransitions += transitions(now) - transitions(rows[row]);
+		if (now == FULL_ROW) {
+			result.clearedLines++;
+			fullRows |= uint64_t(1) << row;
+		}
+		for (int col = 0; col < Width; col++)
+			if ((bits >> col) & 1) {
+				after[col] = max(after[col], Height - row);
+				lo = min(lo, col);
+				hi = max(hi, col);
+				added++;
+			}
+	}
+	if (hi < lo) return result;
+
+	result.holes -= added;
+	for (int col = lo; col <= hi; col++) {
+		int grown = after[col] - heights[col];
+		result.aggregateHeight += grown;
+		result.holes += grown;
+		result.maxHeight = max(result.maxHeight, after[col]);
+	}
+
+	int oldWells = 0, oldBumpiness = 0, newWells = 0, newBumpiness = 0;
+	sumNeighbourhood(heights, lo, hi, oldWells, oldBumpiness);
+	sumNeighbourhood(after, lo, hi, newWells, newBumpiness);
+	result.wells += newWells - oldWells;
+	result.bumpiness += newBumpiness - oldBumpiness;
+
+	if (result.clearedLines == 0) return result;
+
+	// Same bookkeeping as clear( ), on the rows as they would be before the clear: a column's new top
+	// is its first filled cell outside the full rows, moved down by the full rows under it
+	auto filledAt = [&](int row, int col) {
+		RowBits bits = rows[row];
+		if (row >= piece.y && row < piece.y + min(4, piece.height)) bits |= piece.rows[row - piece.y];
+		return (bits >> col) & 1;
+	};
+	const int lockedHeight = result.aggregateHeight;
+	for (int col = 0; col < Width; col++) {
+		int row = Height - after[col];
+		while (row < Height && (((fullRows >> row) & 1) || !filledAt(row, col))) row++;
+		after[col] = row < Height ? Height - row - static_cast<int>(bitset<64>(fullRows >> row).count( )) : 0;
+	}
+	sumColumns(after, result);
+	result.holes += result.aggregateHeight - lockedHeight + result.clearedLines * Width;
+	result.rowTransitions += 2 * result.clearedLines;
+	return result;
+}
+
+template <int Width, int Height>
+BoardFeatures BoardFeatureTracker<Width, Height>::scan(const Cells& cells) {
+	BoardFeatures result;
+	array<int, Width> columnHeights{ };
+	for (int col = 0; col < Width; col++) {
+		int top = 0;
+		while (top < Height && !cells[top][col]) top++;
+		columnHeights[col] = Height - top;
+		for (int row = top; row < Height; row++)
+			if (!cells[row][col]) result.holes++;
+		result.aggregateHeight += columnHeights[col];
+		result.maxHeight = max(result.maxHeight, columnHeights[col]);
+	}
+
+	for (int row = 0; row < Height; row++) {
+		bool previous = true;
+		for (int col = 0; col <= Width; col++) {
+			bool current = col == Width || cells[row][col] != 0;
+			if (current != previous) result.rowTransitions++;
+			previous = current;
+		}
+	}
+
+	for (int col = 0; col < Width; col++) {
+		int left = col > 0 ? columnHeights[col - 1] : Height;
+		int right = col < Width - 1 ? columnHeights[col + 1] : Height;
+		result.wells += max(0, min(left, right) - columnHeights[col]);
+		if (col < Width - 1) result.bumpiness += abs(columnHeights[col] - columnHeights[col + 1]);
+	}
+	return result;
+}
+
+template class BoardFeatureTracker<10, 18>;
+template class BoardFeatureTracker<10, 20>;
+template class BoardFeatureTracker<10, 40>;
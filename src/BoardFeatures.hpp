@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+using namespace std;
+
+// Stack shape statistics placement evaluation and analytics look at. Walls count as filled cells
+// and as columns of full height.
+struct BoardFeatures {
+	int aggregateHeight = 0;    // sum of column heights
+	int maxHeight = 0;
+	int holes = 0;              // empty cells below the top of their column
+	int rowTransitions = 0;     // filled/empty changes along every row, walls included
+	int wells = 0;              // sum of how far each column lies below the lower of its neighbours
+	int bumpiness = 0;          // sum of height differences between adjacent columns
+	int clearedLines = 0;       // lines the evaluated placement clears, 0 for a board's own features
+
+	bool operator==(const BoardFeatures& other) const;
+	bool operator!=(const BoardFeatures& other) const;
+};
+
+// Keeps BoardFeatures of a Width x Height board up to date as pieces lock and lines clear. Rows are
+// column bitmasks and columns keep their height and filled count, so a lock only revisits the rows
+// and columns it touched (plus one column to each side for wells and bumpiness). A line clear moves
+// row masks and revisits every column once, a few dozen operations on a 10 column board. Only the
+// sizes instantiated in BoardFeatures.cpp exist, like BasicGameBoard.
+template <int Width, int Height>
+class BoardFeatureTracker {
+public:
+	static_assert(Width <= 30, "rows are 32 bit masks with a bit for each wall");
+
+	using Cells = array<array<uint8_t, Width>, Height>;
+	using RowBits = uint32_t;
+	// Up to four rows of column bits from the piece's top row, bit c is column c of the board
+	struct Piece {
+		RowBits rows[4];
+		int y, height;
+	};
+
+private:
+	static constexpr RowBits FULL_ROW = (RowBits(1) << Width) - 1;
+
+	static int transitions(RowBits row);
+	static RowBits rowOf(const Cells& cells, int row);
+	// Wells of columns first - 1 ... last + 1 and bumpiness between them, walls clamp the range
+	static void sumNeighbourhood(const array<int, Width>& heights, int first, int last, int& wells, int& bumpiness);
+	// Everything but holes and row transitions over all columns
+	static void sumColumns(const array<int, Width>& heights, BoardFeatures& features);
+
+	array<RowBits, Height> rows;
+	array<int, Width> heights;
+	array<int, Width> filled;
+	BoardFeatures features;
+
+public:
+	BoardFeatureTracker( );
+
+	// Recounts everything, for boards that changed in other ways than lock( ) and clear( )
+	void reset(const Cells& cells);
+	// Takes in cells newly set in rows first ... last
+	void lock(const Cells& cells, int first, int last);
+	// Drops the full rows in the mask (bit r is row r) like a line clear does
+	void clear(uint64_t clearedRows);
+
+	const BoardFeatures& get( ) const;
+	int getColumnHeight(int column) const;
+	// Features after the piece locks at its y and the lines it completes clear, without changing
+	// anything. The piece must fit there.
+	BoardFeatures evaluate(const Piece& piece) const;
+
+	// From scratch over every cell, the reference the incremental updates are checked against
+	static BoardFeatures scan(const Cells& cells);
+};
+
+extern template class BoardFeatureTracker<10, 18>;
+extern template class BoardFeatureTracker<10, 20>;
+extern template class BoardFeatureTracker<10, 40>;
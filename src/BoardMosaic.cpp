@@ -0,0 +1,73 @@
+#include "BoardMosaic.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+BoardMosaic::BoardMosaic(int boards)
+	: boards(max(1, boards)),
+	gridColumns(static_cast<int>(ceil(sqrt(static_cast<double>(max(1, boards)))))),
+	gridRows((max(1, boards) + gridColumns - 1) / gridColumns),
+	engine(gridColumns * BLOCK_COLUMNS, gridRows * BLOCK_ROWS) { }
+
+TileEngine& BoardMosaic::getEngine( ) { return engine; }
+
+void BoardMosaic::setTiles(const Tiles& newTiles) {
+	tiles = newTiles;
+	// Slots past the last board stay gap
+	for (int row = 0; row < gridRows * BLOCK_ROWS; row++)
+		for (int column = 0; column < gridColumns * BLOCK_COLUMNS; column++) engine.setTile(column, row, tiles.gap);
+	for (int board = 0; board < boards; board++) clear(board);
+}
+
+int BoardMosaic::getBoardCount( ) const { return boards; }
+int BoardMosaic::getGridColumns( ) const { return gridColumns; }
+int BoardMosaic::getGridRows( ) const { return gridRows; }
+
+void BoardMosaic::fillBlock(int board, uint16_t wall) {
+	int left = (board % gridColumns) * BLOCK_COLUMNS, top = (board / gridColumns) * BLOCK_ROWS;
+	for (int row = 0; row < GameBoard::height; row++) {
+		engine.setTile(left, top + row, wall);
+		engine.setTile(left + BLOCK_COLUMNS - 1, top + row, wall);
+	}
+	for (int column = 0; column < BLOCK_COLUMNS; column++) engine.setTile(left + column, top + GameBoard::height, tiles.gap);
+}
+
+void BoardMosaic::clear(int board) {
+	if (board < 0 || board >= boards) return;
+	fillBlock(board, tiles.idleWall);
+	int left = (board % gridColumns) * BLOCK_COLUMNS + 1, top = (board / gridColumns) * BLOCK_ROWS;
+	for (int row = 0; row < GameBoard::height; row++)
+		for (int column = 0; column < GameBoard::width; column++) engine.setTile(left + column, top + row, tiles.empty);
+}
+
+void BoardMosaic::update(int board, const GameBoard::Snapshot& state, bool live) {
+	if (board < 0 || board >= boards) return;
+	fillBlock(board, live && !state.collision ? tiles.wall : tiles.idleWall);
+
+	auto cellTile = [&](int value, int color) {
+		if (value <= 0 || value > SHAPE_COUNT) return tiles.empty;
+		return tiles.cells[value - 1][min(max(color, 0), PALETTE_SIZE - 1)];
+	};
+
+	int left = (board % gridColumns) * BLOCK_COLUMNS + 1, top = (board / gridColumns) * BLOCK_ROWS;
+	for (int row = 0; row < GameBoard::height; row++)
+		for (int column = 0; column < GameBoard::width; column++)
+			engine.setTile(left + column, top + row, cellTile(state.cells[row][column], state.colors[row][column]));
+
+	if (!state.hasCurrent || state.collision) return;
+	const TetrominoState& piece = state.current;
+	uint16_t tile = cellTile(static_cast<int>(piece.shape) + 1, piece.colorIndex);
+	for (int row = 0; row < piece.rows; row++) {
+		for (int column = 0; column < piece.cols; column++) {
+			int boardRow = piece.y + row, boardColumn = piece.x + column;
+			if (!piece.cells[row][column] || boardRow < 0 || boardRow >= GameBoard::height || boardColumn < 0 || boardColumn >= GameBoard::width) continue;
+			engine.setTile(left + boardColumn, top + boardRow, tile);
+		}
+	}
+}
+
+TileEngine::Rect BoardMosaic::compose( ) {
+	TRACE_ZONE("BoardMosaic::compose");
+	return engine.compose( );
+}
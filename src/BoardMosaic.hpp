@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "GameBoard.hpp"
+#include "TileEngine.hpp"
+
+using namespace std;
+
+// Many boards on one TileEngine, for watching self-play and server matches side by side. Every board
+// is a block of tiles: its cells between two walls and a gap row below. The falling piece is drawn
+// as cell tiles too, so a frame only redraws the tiles whose cell changed, however many boards there
+// are, and the whole grid is one pixel buffer the caller scales onto the screen in one copy.
+class BoardMosaic {
+public:
+	static constexpr int BLOCK_COLUMNS = GameBoard::width + 2;
+	static constexpr int BLOCK_ROWS = GameBoard::height + 1;
+	// Cell values are shape + 1 up to garbage, see BasicGameBoard::Cells
+	static constexpr int SHAPE_COUNT = static_cast<int>(TetrominoShape::GARBAGE) + 1;
+	static constexpr int PALETTE_SIZE = Tetromino::GARBAGE_COLOR + 1;
+
+	// Ids of tiles the caller added to getEngine( )
+	struct Tiles {
+		uint16_t empty = 0;
+		uint16_t gap = 0;
+		uint16_t wall = 0;
+		// Walls of a board that topped out or whose feed is gone
+		uint16_t idleWall = 0;
+		array<array<uint16_t, PALETTE_SIZE>, SHAPE_COUNT> cells{ };
+	};
+
+private:
+	void fillBlock(int board, uint16_t wall);
+
+	int boards;
+	int gridColumns, gridRows;
+	TileEngine engine;
+	Tiles tiles;
+
+public:
+	// Lays the boards out in a grid about as wide as tall, in blocks, filled row by row
+	explicit BoardMosaic(int boards);
+
+	TileEngine& getEngine( );
+	// Draws every board empty with the new tiles
+	void setTiles(const Tiles& tiles);
+
+	int getBoardCount( ) const;
+	int getGridColumns( ) const;
+	int getGridRows( ) const;
+
+	// Sets the board's tiles from its state, unchanged cells are not redrawn. live false shows it idle.
+	void update(int board, const GameBoard::Snapshot& state, bool live = true);
+	// Empty board with idle walls, e.g. for a feed that never started
+	void clear(int board);
+
+	// Brings the pixel buffer up to date and returns the area that changed
+	TileEngine::Rect compose( );
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Tetromino.hpp"
+
+using namespace std;
+
+// Read-only look at a board of any size, everything the renderer and a rotating piece need.
+// Every BasicGameBoard instantiation implements it, see GameBoard.hpp
+class BoardView {
+public:
+	virtual ~BoardView( ) = default;
+
+	virtual const int getWidth( ) const = 0;
+	virtual const int getHeight( ) const = 0;
+	// Shape + 1 of the locked block at row, col, 0 when the cell is empty
+	virtual uint8_t getCell(int row, int col) const = 0;
+	// Palette index of the locked block, see Renderer::paletteColor
+	virtual uint8_t getColor(int row, int col) const = 0;
+	virtual bool isValidPosition(const vector<vector<int>>& shape, int x, int y) const = 0;
+
+	virtual const bool isCollision( ) const = 0;
+	virtual const int getScore( ) const = 0;
+	virtual const int getLevel( ) const = 0;
+	virtual const int getLines( ) const = 0;
+	virtual const int getPendingGarbage( ) const = 0;
+	virtual const shared_ptr<Tetromino> getCurrentTetromino( ) const = 0;
+	virtual const shared_ptr<Tetromino> getNextTetromino( ) const = 0;
+};
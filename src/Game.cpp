@@ -1,13 +1,44 @@
 #include "Game.hpp"
+#include "MosaicRenderer.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include <ctime>
 
-Game::Game( ) : window(nullptr, SDL_DestroyWindow), sound(make_unique<Sound>( )) { }
+namespace {
+	Metrics::Counter& hardDrops = Metrics::counter("tetris_hard_drops_total", "Pieces hard dropped on the boards this client plays");
+	Metrics::Counter& levelUps = Metrics::counter("tetris_level_ups_total", "Levels reached on the boards this client plays");
+
+	constexpr uint32_t SOUND_EVENTS = eventBit(GameEventType::PIECE_MOVED) | eventBit(GameEventType::PIECE_ROTATED) |
+		eventBit(GameEventType::PIECE_DROPPED) | eventBit(GameEventType::PIECE_LOCKED) | eventBit(GameEventType::LEVEL_UP) |
+		eventBit(GameEventType::LINES_CLEARED);
+	constexpr uint32_t METRIC_EVENTS = eventBit(GameEventType::PIECE_DROPPED) | eventBit(GameEventType::LEVEL_UP);
+
+	// Simulated time a soak spends on the start and game over screens between games
+	constexpr uint64_t SOAK_START_FRAMES = GameBoard::TICKS_PER_SECOND;
+	constexpr uint64_t SOAK_GAME_OVER_FRAMES = 3 * GameBoard::TICKS_PER_SECOND;
+	// The allocator keeps some freed pages and fragments a little, that much resident growth is no leak
+	constexpr int64_t SOAK_RSS_SLACK = 2 << 20;
+}
+
+Game::Game( ) : window(nullptr, SDL_DestroyWindow), assets(make_shared<AssetManager>( )), sound(make_unique<Sound>(*assets)) { }
+
+void Game::setInputConfig(const InputConfig& config) { input.setConfig(config); }
+
+void Game::setAudioConfig(const AudioConfig& config) {
+	sound->SetBufferFrames(config.bufferFrames);
+	if (config.softwareMixer) sound->UseSoftwareMixer( );
+}
+
+void Game::setAssetBudget(uint64_t bytes) { assets->setBudget(bytes); }
+
+void Game::useTileRenderer( ) { gameRenderer->useTileBackend( ); }
 
 bool Game::init(const char* title, int w, int h) {
 	window.reset(SDL_CreateWindow(
 		title,
 		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
 		w, h,
-		SDL_WINDOW_SHOWN
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
 	));
 
 	if (!window) {
@@ -16,156 +47,689 @@ bool Game::init(const char* title, int w, int h) {
 	}
 
 	renderer = std::shared_ptr<SDL_Renderer>(
-		SDL_CreateRenderer(window.get( ), -1, SDL_RENDERER_ACCELERATED),
+		SDL_CreateRenderer(window.get( ), -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE),
 		[ ](SDL_Renderer* r) { SDL_DestroyRenderer(r); }
 	);
 
+	// Headless video drivers, e.g. the dummy one of a soak run, only have the software renderer
+	if (!renderer) {
+		SDL_Log("No accelerated renderer (%s), falling back to software", SDL_GetError( ));
+		renderer = std::shared_ptr<SDL_Renderer>(
+			SDL_CreateRenderer(window.get( ), -1, SDL_RENDERER_SOFTWARE | SDL_RENDERER_TARGETTEXTURE),
+			[ ](SDL_Renderer* r) { SDL_DestroyRenderer(r); }
+		);
+	}
+
 	if (!renderer) {
 		SDL_Log("Failed to create renderer: %s", SDL_GetError( ));
 		return false;
 	}
-	int ww, wh;
-	SDL_GetWindowSize(window.get( ), &ww, &wh);
+	// The canvas is drawn at least 1:1
+	SDL_SetWindowMinimumSize(window.get( ), Renderer::NATIVE_WIDTH, Renderer::NATIVE_HEIGHT);
 
 	gameState.startSequence = true;
 
-	gameRenderer = make_shared<Renderer>(renderer, ww, wh);
-	gameBoard = make_shared<GameBoard>( );
-
-	handleWindowResize( );
+	assets->setRenderer(renderer);
+	gameRenderer = make_shared<Renderer>(renderer, assets);
+	subscribeToBoardEvents( );
+	assets->enterScene(Scene::START);
+	gameBoard = createBoard( );
 
 	return true;
 }
 
 void Game::run( ) {
+	if (soakConfig.hours > 0) {
+		soakPassed = runSoak( );
+		gameState.quit = true;
+		return;
+	}
+
+	if (gameState.spectating) {
+		assets->enterScene(Scene::PLAY);
+		if (spectatorConfig.mosaic.empty( )) runSpectator( );
+		else runMosaic( );
+		return;
+	}
+
 	while (gameState.startSequence) {
 		if (gameState.quit) return;
 		inputHandler( );
 		gameRenderer->renderStartScreen( );
 	}
 
-	sound->PlayMusic(MusicName::MAIN_THEME);
-	lastUpdateTime = SDL_GetTicks( );
-	while (!gameState.gameover && !gameBoard->isCollision( )) {
-		if (gameState.quit) return;
-		inputHandler( );
-		update( );
-		render( );
+	assets->enterScene(Scene::PLAY);
+	if (gameState.multiPlayer) {
+		if (!(versusConfigured ? runVersus( ) : runSplitScreen( ))) return;
+	} else {
+		sound->PlayMusic(MusicName::MAIN_THEME);
+		resetGravityClock( );
+		gameStartTicks = SDL_GetTicks( );
+		Uint32 lastLatencyReport = SDL_GetTicks( );
+		input.clearLatency( );
+		while (!gameState.gameover && !gameBoard->isCollision( )) {
+			TRACE_ZONE("frame");
+			if (gameState.quit) return;
+			inputHandler( );
+			update( );
+			events.publish( );
+			publishSpectatorFrame( );
+			render( );
+
+			if (SDL_GetTicks( ) - lastLatencyReport >= 10000) {
+				reportInputLatency( );
+				reportAudio( );
+				lastLatencyReport = SDL_GetTicks( );
+			}
+		}
+		reportInputLatency( );
+		// The top out happened after this frame's publish, make sure viewers see it
+		publishSpectatorFrame(true);
+		recordScore( );
 	}
 
 	gameState.gameover = true;
-	sound->PauseMusic( );
+	gameRenderer->setLayout(Renderer::Layout::SINGLE);
+	// Lets go of the track, the game over screen has no music and the next game starts it over
+	sound->StopMusic( );
+	assets->enterScene(Scene::GAME_OVER);
 	sound->PlaySound(SoundName::GAME_OVER);
+	reportAudio( );
 	while (gameState.gameover) {
 		if (gameState.quit) return;
+		// Keep answering so the peer also gets our last inputs
+		if (versus) versus->poll(SDL_GetTicks( ));
+		events.publish( );
+		SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+		SDL_RenderClear(renderer.get( ));
+		inputHandler( );
+		gameRenderer->renderGameOver(gameBoard, scoreRank, highScores.size( ));
+	}
+}
+
+bool Game::runVersus( ) {
+	versus = make_unique<RollbackSession>(versusConfig);
+	if (!versus->open( )) {
+		SDL_Log("Failed to open versus session");
+		restart( );
+		return false;
+	}
+
+	while (!versus->isSynchronized( )) {
+		inputHandler( );
+		if (gameState.quit || !versus) return false;
+		versus->poll(SDL_GetTicks( ));
+		gameRenderer->renderMessage(versusConfig.host ? "waiting" : "joining");
+		SDL_Delay(1);
+	}
+
+	gameBoard = versus->getLocalBoard( );
+	gameRenderer->setLayout(Renderer::Layout::SIDE_BY_SIDE);
+	sound->PlayMusic(MusicName::MAIN_THEME);
+
+	const double frameMs = 1000.0 / GameBoard::TICKS_PER_SECOND;
+	double nextFrame = SDL_GetTicks( );
+	Uint32 lastReport = SDL_GetTicks( );
+	while (!versus->isFinished( )) {
+		TRACE_ZONE("frame");
+		if (gameState.quit) return false;
+		inputHandler( );
+
+		Uint32 now = SDL_GetTicks( );
+		versus->poll(now);
+		// A stalled frame still consumes its time slot, that is how the faster peer waits
+		for (int steps = 0; now >= nextFrame && steps < 4; steps++) {
+			TRACE_ZONE("RollbackSession::advance");
+			versus->advance(readHeldButtons( ), now);
+			nextFrame += frameMs;
+		}
+		if (now >= nextFrame) nextFrame = now;
+		events.publish(versus->getEvents( ));
+		publishSpectatorFrame( );
+
+		const RollbackSession::Stats& stats = versus->getStats( );
+		if (now - lastReport >= 1000) {
+			SDL_Log("Versus frame %u rollback %d frames %.3f ms (max %d frames %.3f ms, %u resimulated) stalls %u waits %u lost %u desyncs %u of %u",
+				stats.frame, stats.rollbackDepth, stats.resimulationMs, stats.maxRollbackDepth, stats.maxResimulationMs,
+				stats.resimulatedFrames, stats.stalls, stats.timeSyncWaits, stats.packetsDropped, stats.desyncs, stats.hashChecks);
+			lastReport = now;
+		}
+
 		SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
 		SDL_RenderClear(renderer.get( ));
+		gameRenderer->renderSideBySide(gameBoard, versus->getRemoteBoard( ));
+		gameRenderer->renderRollbackStats(stats.rollbackDepth, stats.resimulationMs);
+		gameRenderer->present( );
+	}
+
+	return true;
+}
+
+bool Game::runSplitScreen( ) {
+	splitScreen = make_unique<SplitScreenSession>( );
+	for (auto& view : splitViews) view = make_shared<GameBoard>( );
+	splitScreen->start( );
+	gameRenderer->setLayout(Renderer::Layout::SIDE_BY_SIDE);
+	sound->PlayMusic(MusicName::MAIN_THEME);
+
+	// The boards step on their own threads, this loop only feeds them input and draws what they published
+	while (!splitScreen->isFinished( )) {
+		TRACE_ZONE("frame");
+		if (gameState.quit) return false;
+		inputHandler( );
+
+		for (int player = 0; player < 2; player++) {
+			splitScreen->setButtons(player, readPlayerButtons(player));
+			splitScreen->updateView(player, *splitViews[player]);
+		}
+		splitScreen->drainEvents(events.getBuffer( ));
+		events.publish( );
+
+		SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+		SDL_RenderClear(renderer.get( ));
+		gameRenderer->renderSideBySide(splitViews[0], splitViews[1]);
+		gameRenderer->present( );
+	}
+
+	splitScreen->stop( );
+	for (int player = 0; player < 2; player++) {
+		splitScreen->updateView(player, *splitViews[player]);
+		const SplitScreenSession::Stats stats = splitScreen->getStats(player);
+		SDL_Log("Player %d: %u frames, slowest frame %.3f ms, garbage deferred %u times", player + 1, stats.frames, stats.maxStepMs, stats.garbageDeferred);
+	}
+
+	int winner = splitScreen->getWinner( );
+	if (winner < 0) SDL_Log("Split screen: draw");
+	else SDL_Log("Split screen: player %d wins", winner + 1);
+	gameBoard = splitViews[max(winner, 0)];
+	return true;
+}
+
+void Game::runSpectator( ) {
+	SpectatorSource source;
+	if (!source.open(spectatorConfig.spectate)) {
+		gameState.quit = true;
+		return;
+	}
+
+	auto view = make_shared<GameBoard>( );
+	// Every shown frame is a restore, which the renderer takes as a change of the whole board
+	view->setEventBuffer(&events.getBuffer( ));
+
+	while (!gameState.quit) {
+		inputHandler( );
+
+		if (source.poll(SDL_GetTicks( ))) view->restore(source.getState( ));
+		if (source.isCorrupt( )) break;
+		events.publish( );
+
+		SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+		SDL_RenderClear(renderer.get( ));
+		if (source.hasState( )) {
+			gameRenderer->renderBoard(view);
+			gameRenderer->renderTetrominoPreview(view->getNextTetromino( ));
+			gameRenderer->present( );
+		} else {
+			gameRenderer->renderMessage(source.isEnded( ) ? "no stream" : "waiting");
+		}
+		SDL_Delay(1);
+	}
+	gameState.quit = true;
+}
+
+void Game::runMosaic( ) {
+	vector<string> names = SpectatorSource::parseList(spectatorConfig.mosaic);
+	if (names.empty( )) {
+		gameState.quit = true;
+		return;
+	}
+	// A source that cannot be opened keeps its slot, drawn idle, so the grid matches the list
+	vector<unique_ptr<SpectatorSource>> sources;
+	vector<bool> opened;
+	for (const string& name : names) {
+		sources.push_back(make_unique<SpectatorSource>( ));
+		opened.push_back(sources.back( )->open(name));
+	}
+
+	MosaicRenderer mosaicRenderer(*gameRenderer, static_cast<int>(sources.size( )));
+	if (!mosaicRenderer.init( )) {
+		gameState.quit = true;
+		return;
+	}
+	BoardMosaic& mosaic = mosaicRenderer.getMosaic( );
+	SDL_Log("Mosaic: %zu boards in a %dx%d grid, %dx%d pixels", sources.size( ), mosaic.getGridColumns( ), mosaic.getGridRows( ),
+		mosaic.getEngine( ).getWidth( ), mosaic.getEngine( ).getHeight( ));
+
+	// Time from the first feed read to the present, per frame, reported against the board count
+	LatencyHistogram frameTimes;
+	uint64_t tilesBefore = 0, framesBefore = 0;
+	vector<bool> idle(sources.size( ), true);
+	Uint32 lastReport = SDL_GetTicks( );
+	while (!gameState.quit) {
+		TRACE_ZONE("frame");
+		inputHandler( );
+		uint64_t start = SDL_GetPerformanceCounter( );
+
+		Uint32 now = SDL_GetTicks( );
+		for (size_t i = 0; i < sources.size( ); i++) {
+			if (!opened[i]) continue;
+			bool changed = sources[i]->poll(now);
+			bool live = !sources[i]->isEnded( ) && !sources[i]->isCorrupt( );
+			if (!sources[i]->hasState( )) continue;
+			// A feed that ends keeps its last board, with idle walls
+			bool wasIdle = idle[i];
+			idle[i] = !live;
+			if (changed || wasIdle != idle[i]) mosaic.update(static_cast<int>(i), sources[i]->getState( ), live);
+		}
+		mosaicRenderer.render( );
+		frameTimes.record(static_cast<uint64_t>((SDL_GetPerformanceCounter( ) - start) * 1e9 / SDL_GetPerformanceFrequency( )));
+
+		if (now - lastReport >= 10000) {
+			const TileEngine::Stats& stats = mosaic.getEngine( ).getStats( );
+			uint64_t frames = stats.frames - framesBefore;
+			SDL_Log("Mosaic: %zu boards, frame p50 %.2f ms p99 %.2f ms max %.2f ms, %.1f tiles redrawn per frame over %llu frames",
+				sources.size( ), frameTimes.percentile(0.5) / 1e6, frameTimes.percentile(0.99) / 1e6, frameTimes.max( ) / 1e6,
+				frames ? static_cast<double>(stats.tilesDrawn - tilesBefore) / frames : 0.0, static_cast<unsigned long long>(frames));
+			frameTimes.reset( );
+			tilesBefore = stats.tilesDrawn;
+			framesBefore = stats.frames;
+			lastReport = now;
+		}
+		SDL_Delay(1);
+	}
+}
+
+bool Game::runSoak( ) {
+	const uint64_t totalFrames = static_cast<uint64_t>(soakConfig.hours * 3600 * GameBoard::TICKS_PER_SECOND);
+	const uint64_t sampleFrames = max<uint64_t>(1, static_cast<uint64_t>(soakConfig.sampleSeconds) * GameBoard::TICKS_PER_SECOND);
+	SDL_Log("Soak: %.2f h simulated, a sample every %u s, %u warm-up samples",
+		soakConfig.hours, soakConfig.sampleSeconds, soakConfig.warmupSamples);
+
+	// Counted by the replaced operator new and delete, see AllocationCounter.cpp
+	Metrics::Counter& allocations = Metrics::counter("tetris_allocations_total", "Heap allocations through operator new");
+	Metrics::Counter& deallocations = Metrics::counter("tetris_deallocations_total", "Heap allocations freed through operator delete");
+	SoakMonitor monitor(soakConfig.warmupSamples);
+	monitor.track("resident bytes", SoakMonitor::residentBytes, SOAK_RSS_SLACK);
+	monitor.track("heap blocks", [&] { return static_cast<int64_t>(allocations.value( ) - deallocations.value( )); });
+	monitor.track("SDL textures", AssetManager::getLiveTextures);
+	monitor.track("mixer chunks", AssetManager::getLiveChunks);
+
+	// Frames stand for simulated time: gravity steps once per frame and nothing waits on the clock
+	AutoPlayer player;
+	uint64_t games = 0, phaseFrames = 0;
+	Uint32 wallStart = SDL_GetTicks( );
+	restart( );
+	for (uint64_t frame = 1; frame <= totalFrames && !gameState.quit; frame++) {
+		TRACE_ZONE("frame");
 		inputHandler( );
-		gameRenderer->renderGameOver(gameBoard);
+		if (gameState.startSequence) {
+			gameRenderer->renderStartScreen( );
+			if (++phaseFrames >= SOAK_START_FRAMES) {
+				phaseFrames = 0;
+				gameState.startSequence = false;
+				assets->enterScene(Scene::PLAY);
+				sound->PlayMusic(MusicName::MAIN_THEME);
+				player.reset( );
+			}
+		} else if (!gameState.gameover) {
+			uint8_t buttons = player.buttons(*gameBoard);
+			if (buttons & INPUT_LEFT) performAction(InputAction::LEFT);
+			if (buttons & INPUT_RIGHT) performAction(InputAction::RIGHT);
+			if (buttons & INPUT_ROTATE) performAction(InputAction::ROTATE);
+			if (buttons & INPUT_DROP) performAction(InputAction::DROP);
+			if (gameBoard->isGravityDue( )) history.push(gameBoard->snapshot( ));
+			gameBoard->applyGravity( );
+			events.publish( );
+			publishSpectatorFrame( );
+			render( );
+
+			if (gameBoard->isCollision( )) {
+				publishSpectatorFrame(true);
+				games++;
+				gameState.gameover = true;
+				sound->StopMusic( );
+				assets->enterScene(Scene::GAME_OVER);
+				sound->PlaySound(SoundName::GAME_OVER);
+			}
+		} else {
+			events.publish( );
+			SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+			SDL_RenderClear(renderer.get( ));
+			gameRenderer->renderGameOver(gameBoard);
+			if (++phaseFrames >= SOAK_GAME_OVER_FRAMES) {
+				phaseFrames = 0;
+				restart( );
+			}
+		}
+
+		if (frame % sampleFrames == 0) {
+			monitor.sample(frame / GameBoard::TICKS_PER_SECOND);
+			SDL_Log("Soak: %.2f h simulated in %.1f min, %llu games, %.1f MB resident, %lld heap blocks, %lld textures, %lld chunks",
+				frame / (3600.0 * GameBoard::TICKS_PER_SECOND), (SDL_GetTicks( ) - wallStart) / 60000.0, static_cast<unsigned long long>(games),
+				SoakMonitor::residentBytes( ) / 1048576.0, static_cast<long long>(allocations.value( ) - deallocations.value( )),
+				static_cast<long long>(AssetManager::getLiveTextures( )), static_cast<long long>(AssetManager::getLiveChunks( )));
+		}
+	}
+	sound->StopMusic( );
+
+	for (const SoakMonitor::Trend& trend : monitor.getTrends( ))
+		SDL_Log("Soak %s: %lld to %lld after warm-up, range %lld to %lld, %+.1f per hour%s", trend.name.c_str( ),
+			static_cast<long long>(trend.first), static_cast<long long>(trend.last), static_cast<long long>(trend.low),
+			static_cast<long long>(trend.high), trend.slopePerHour, trend.growing ? ", GROWING" : "");
+	if (!monitor.isConclusive( )) {
+		SDL_Log("Soak inconclusive: %zu samples, %u warm-up plus 9 are needed to judge a trend",
+			monitor.getSampleCount( ), soakConfig.warmupSamples);
+		return false;
+	}
+	SDL_Log("Soak %s after %llu games", monitor.passed( ) ? "passed" : "FAILED", static_cast<unsigned long long>(games));
+	return monitor.passed( );
+}
+
+void Game::publishSpectatorFrame(bool force) {
+	if (!spectatorFeed) return;
+	TRACE_ZONE("Game::publishSpectatorFrame");
+
+	// Wall clock frames keep the feed monotonic across restarts and modes
+	uint32_t frame = static_cast<uint32_t>(static_cast<uint64_t>(SDL_GetTicks( )) * GameBoard::TICKS_PER_SECOND / 1000);
+	if (force && frame <= spectatorFrame) frame = spectatorFrame + 1;
+	if (frame == spectatorFrame) return;
+
+	spectatorFrame = frame;
+	spectatorFeed->publish(*gameBoard, frame);
+}
+
+uint8_t Game::readPlayerButtons(int player) const {
+	const Uint8* keys = SDL_GetKeyboardState(nullptr);
+	uint8_t buttons = 0;
+	if (player == 0) {
+		if (keys[SDL_SCANCODE_A]) buttons |= INPUT_LEFT;
+		if (keys[SDL_SCANCODE_D]) buttons |= INPUT_RIGHT;
+		if (keys[SDL_SCANCODE_S]) buttons |= INPUT_DROP;
+		if (keys[SDL_SCANCODE_W]) buttons |= INPUT_ROTATE;
+	} else {
+		if (keys[SDL_SCANCODE_LEFT]) buttons |= INPUT_LEFT;
+		if (keys[SDL_SCANCODE_RIGHT]) buttons |= INPUT_RIGHT;
+		if (keys[SDL_SCANCODE_DOWN]) buttons |= INPUT_DROP;
+		if (keys[SDL_SCANCODE_UP]) buttons |= INPUT_ROTATE;
+	}
+	return buttons;
+}
+
+uint8_t Game::readHeldButtons( ) const {
+	const Uint8* keys = SDL_GetKeyboardState(nullptr);
+	uint8_t buttons = 0;
+	if (keys[SDL_SCANCODE_LEFT] || keys[SDL_SCANCODE_A]) buttons |= INPUT_LEFT;
+	if (keys[SDL_SCANCODE_RIGHT] || keys[SDL_SCANCODE_D]) buttons |= INPUT_RIGHT;
+	if (keys[SDL_SCANCODE_DOWN] || keys[SDL_SCANCODE_S]) buttons |= INPUT_DROP;
+	if (keys[SDL_SCANCODE_SPACE]) buttons |= INPUT_ROTATE;
+	return buttons;
+}
+
+bool Game::isPlaying( ) const {
+	// Versus boards only move through RollbackSession::advance, a spectated board only through its feed
+	return !gameState.gameover && !gameState.startSequence && !gameState.multiPlayer && !gameState.spectating;
+}
+
+shared_ptr<GameBoard> Game::createBoard( ) {
+	// Kept for the score record, the seed replays the same piece sequence
+	random_device dev;
+	boardSeed = (static_cast<uint64_t>(dev( )) << 32) | dev( );
+	scoreRank = 0;
+	auto board = make_shared<GameBoard>(boardSeed);
+	board->setEventBuffer(&events.getBuffer( ));
+	return board;
+}
+
+void Game::setVersusConfig(const VersusConfig& config) {
+	versusConfig = config;
+	versusConfigured = true;
+}
+
+void Game::setTracePath(const string& path) { tracePath = path; }
+
+void Game::openHighScores(const string& path) {
+	if (!highScores.open(path)) {
+		SDL_Log("High scores are not saved, failed to open %s", path.c_str( ));
+		return;
+	}
+	HighScores::Stats stats = highScores.getStats( );
+	if (stats.corrupt > 0 || stats.truncatedBytes > 0)
+		SDL_Log("%s: skipped %llu corrupt records, cut off %llu bytes", path.c_str( ),
+			static_cast<unsigned long long>(stats.corrupt), static_cast<unsigned long long>(stats.truncatedBytes));
+}
+
+void Game::recordScore( ) {
+	if (!gameBoard->isCollision( ) || scoreRecorded) return;
+
+	ScoreRecord record;
+	record.score = static_cast<uint32_t>(gameBoard->getScore( ));
+	record.lines = static_cast<uint32_t>(gameBoard->getLines( ));
+	record.level = static_cast<uint16_t>(gameBoard->getLevel( ));
+	record.seed = boardSeed;
+	record.durationMs = SDL_GetTicks( ) - gameStartTicks;
+	record.finishedAt = static_cast<uint32_t>(time(nullptr));
+	scoreRank = highScores.append(record);
+	scoreRecorded = true;
+	SDL_Log("Score %u is rank %llu of %llu", record.score,
+		static_cast<unsigned long long>(scoreRank), static_cast<unsigned long long>(highScores.size( )));
+}
+
+void Game::toggleTrace( ) {
+	if (!Trace::isRecording( )) {
+		Trace::start( );
+		SDL_Log("Tracing, F12 again writes %s", tracePath.c_str( ));
+	} else if (Trace::stop(tracePath)) {
+		SDL_Log("Trace written to %s", tracePath.c_str( ));
+	} else {
+		SDL_Log("Failed to write trace to %s", tracePath.c_str( ));
 	}
 }
 
+void Game::setSpectatorConfig(const SpectatorConfig& config) {
+	spectatorConfig = config;
+	gameState.spectating = !config.spectate.empty( ) || !config.mosaic.empty( );
+
+	if (!config.stream.empty( )) {
+		spectatorFeed = make_unique<SpectatorPublisher>( );
+		bool isPort = config.stream.find_first_not_of("0123456789") == string::npos;
+		bool opened = isPort ? spectatorFeed->listen(static_cast<uint16_t>(atoi(config.stream.c_str( ))))
+			: spectatorFeed->openFile(config.stream);
+		if (!opened) spectatorFeed.reset( );
+	}
+}
+
+void Game::setSoakConfig(const SoakConfig& config) { soakConfig = config; }
+bool Game::hasSoakPassed( ) const { return soakPassed; }
+
 void Game::inputHandler( ) {
+	TRACE_ZONE("Game::inputHandler");
 	SDL_Event event;
-	while (SDL_PollEvent(&event)) {
-		if (event.type == SDL_QUIT) {
-			SDL_Quit( );
-			gameState.quit = true;
-		} else if (event.type == SDL_KEYDOWN) {
-			switch (event.key.keysym.sym) {
-			case SDLK_LEFT:
-			case SDLK_a:
-				if (!gameState.gameover && !gameState.startSequence)
-					if (gameBoard->tryMoveCurrentTetromino(-1, 0))
-						sound->PlaySound(SoundName::MOVE_PIECE);
-				break;
-			case SDLK_RIGHT:
-			case SDLK_d:
-				if (!gameState.gameover && !gameState.startSequence)
-					if (gameBoard->tryMoveCurrentTetromino(1, 0))
-						sound->PlaySound(SoundName::MOVE_PIECE);
-				break;
-			case SDLK_DOWN:
-			case SDLK_s:
-				if (!gameState.gameover && !gameState.startSequence) {
-					gameBoard->moveToBottom( );
-					sound->PlaySound(SoundName::PIECE_LANDED);
-				}
-				break;
-			case SDLK_SPACE:
-				if (!gameState.gameover && !gameState.startSequence)
-					if (gameBoard->tryRotateCurrentTetromino( ))
-						sound->PlaySound(SoundName::ROTATE_PIECE);
-				break;
-			case SDLK_ESCAPE:
-				break;
-			case SDLK_g:
-				if (gameState.startSequence) {
-					gameState.startSequence = false;
-					sound->PlaySound(SoundName::MENU);
-				}
+	while (SDL_PollEvent(&event))
+		handleEvent(event);
+}
+
+void Game::latchInput( ) {
+	TRACE_ZONE("Game::latchInput");
+	// Late latch: key events that arrived while this frame was simulated still make it into the frame
+	SDL_PumpEvents( );
+	SDL_Event events[16];
+	int count;
+	while ((count = SDL_PeepEvents(events, 16, SDL_GETEVENT, SDL_KEYDOWN, SDL_KEYUP)) > 0)
+		for (int i = 0; i < count; i++)
+			handleEvent(events[i]);
+
+	if (isPlaying( ))
+		input.apply([this](InputAction action) { return performAction(action); });
+}
+
+bool Game::performAction(InputAction action) {
+	switch (action) {
+	case InputAction::LEFT:
+	case InputAction::RIGHT:
+		return gameBoard->tryMoveCurrentTetromino(action == InputAction::LEFT ? -1 : 1, 0);
+	case InputAction::DROP:
+		if (!gameBoard->getCurrentTetromino( )) return false;
+		gameBoard->moveToBottom( );
+		return true;
+	case InputAction::ROTATE:
+		return gameBoard->tryRotateCurrentTetromino( );
+	default:
+		return false;
+	}
+}
+
+void Game::subscribeToBoardEvents( ) {
+	events.subscribe(SOUND_EVENTS, [this](const GameEventBuffer& batch) {
+		for (const GameEvent& event : batch) {
+			switch (event.type) {
+			case GameEventType::PIECE_MOVED:
+				// Gravity moves down only and has no sound
+				if (event.dx != 0) sound->PlaySound(SoundName::MOVE_PIECE);
 				break;
-			case SDLK_r:
-				if (isGameOver( ))
-					restart( );
+			case GameEventType::PIECE_ROTATED:
+				sound->PlaySound(SoundName::ROTATE_PIECE);
 				break;
-			case SDLK_q:
-				SDL_Quit( );
-				gameState.quit = true;
-			case SDLK_EQUALS:
-				SDL_Log("Test %d", Mix_GetMusicVolume(bgm.get( )));
-				Mix_VolumeMusic(Mix_GetMusicVolume(bgm.get( )) + 8);
+			case GameEventType::PIECE_DROPPED:
+			case GameEventType::PIECE_LOCKED:
+				sound->PlaySound(SoundName::PIECE_LANDED);
 				break;
-			case SDLK_MINUS:
-				SDL_Log("Test %d", Mix_GetMusicVolume(bgm.get( )));
-
-				Mix_VolumeMusic(Mix_GetMusicVolume(bgm.get( )) - 8);
+			case GameEventType::LEVEL_UP:
+				sound->PlaySound(SoundName::LEVEL_UP);
 				break;
-			case SDLK_m:
-				sound->IsMusicPlaying( ) ? sound->PauseMusic( ) : sound->ResumeMusic( );
+			case GameEventType::LINES_CLEARED:
+				sound->PlaySound(event.value >= 4 ? SoundName::TETRIS_LINE_CLEAR : SoundName::LINE_CLEAR);
 				break;
 			default:
 				break;
 			}
-		} else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED) {
-			int TARGET_ASPECT_RATIO = 3 / 4;
-			int newHeight = event.window.data2, newWidth = event.window.data1;
-
-			float newAspectRatio = static_cast<float>(newWidth) / newHeight;
+		}
+	});
+	events.subscribe(METRIC_EVENTS, [ ](const GameEventBuffer& batch) {
+		for (const GameEvent& event : batch) {
+			if (event.type == GameEventType::PIECE_DROPPED) hardDrops.add( );
+			else if (event.type == GameEventType::LEVEL_UP) levelUps.add( );
+		}
+	});
+	gameRenderer->subscribe(events);
+}
 
-			if (newAspectRatio > TARGET_ASPECT_RATIO)
-				newWidth = static_cast<int>(newHeight * TARGET_ASPECT_RATIO);
-			else
-				newHeight = static_cast<int>(newWidth / TARGET_ASPECT_RATIO);
+void Game::reportInputLatency( ) {
+	const LatencyHistogram& latency = input.getLatency( );
+	if (latency.count( ) == 0) return;
+	SDL_Log("Input to present: p50 %.2f ms p90 %.2f ms p99 %.2f ms max %.2f ms over %llu actions",
+		latency.percentile(0.5) / 1e6, latency.percentile(0.9) / 1e6, latency.percentile(0.99) / 1e6,
+		latency.max( ) / 1e6, static_cast<unsigned long long>(latency.count( )));
+}
 
-			SDL_SetWindowSize(window.get( ), newWidth, newHeight);
+void Game::reportAudio( ) {
+	Sound::Stats audio = sound->getStats( );
+	SDL_Log("Audio: %u played, %u deduplicated, %u stolen, %u dropped",
+		audio.played, audio.deduplicated, audio.stolen, audio.dropped);
 
-			handleWindowResize( );
-		}
-	}
+	const LatencyHistogram& callbackTimes = sound->getCallbackTimes( );
+	SDL_Log("Audio buffer: %u frames (%.1f ms), %u underruns, %u resizes, callback p50 %.3f ms p99 %.3f ms max %.3f ms over %llu",
+		audio.bufferFrames, audio.outputLatencyMs, audio.underruns, audio.resizes,
+		callbackTimes.percentile(0.5) / 1e6, callbackTimes.percentile(0.99) / 1e6, callbackTimes.max( ) / 1e6,
+		static_cast<unsigned long long>(audio.callbacks));
 }
 
-void Game::handleWindowResize( ) {
-	int windowWidth, windowHeight;
-	SDL_GetWindowSize(window.get( ), &windowWidth, &windowHeight);
-
-	//gameRenderer->setScale(windowHeight / gameBoard->getHeight( ));
+void Game::handleEvent(const SDL_Event& event) {
+	// Gameplay keys go through the timestamped input queue, see InputSystem
+	if (isPlaying( ) && input.handleEvent(event)) return;
 
+	if (event.type == SDL_QUIT) {
+		SDL_Quit( );
+		gameState.quit = true;
+	} else if (event.type == SDL_KEYDOWN) {
+		switch (event.key.keysym.sym) {
+		case SDLK_ESCAPE:
+			// Gives up waiting for a versus peer
+			if (gameState.multiPlayer && versus && !versus->isSynchronized( ))
+				restart( );
+			break;
+		case SDLK_g:
+		case SDLK_1:
+			if (gameState.startSequence) {
+				gameState.startSequence = false;
+				gameState.multiPlayer = false;
+				sound->PlaySound(SoundName::MENU);
+			}
+			break;
+		case SDLK_2:
+			// Without --host or --join both players share this keyboard
+			if (gameState.startSequence) {
+				gameState.startSequence = false;
+				gameState.multiPlayer = true;
+				sound->PlaySound(SoundName::MENU);
+			}
+			break;
+		case SDLK_r:
+			if (isGameOver( ))
+				restart( );
+			break;
+		case SDLK_BACKSPACE:
+			if (isPlaying( ))
+				undo( );
+			break;
+		case SDLK_k:
+			if (isPlaying( ))
+				saveCheckpoint( );
+			break;
+		case SDLK_c:
+			if (isGameOver( ))
+				restoreCheckpoint( );
+			break;
+		case SDLK_q:
+			SDL_Quit( );
+			gameState.quit = true;
+		case SDLK_EQUALS:
+			SDL_Log("Test %d", Mix_GetMusicVolume(bgm.get( )));
+			Mix_VolumeMusic(Mix_GetMusicVolume(bgm.get( )) + 8);
+			break;
+		case SDLK_MINUS:
+			SDL_Log("Test %d", Mix_GetMusicVolume(bgm.get( )));
 
-	gameRenderer->setWindowSize(windowWidth, windowHeight);
+			Mix_VolumeMusic(Mix_GetMusicVolume(bgm.get( )) - 8);
+			break;
+		case SDLK_m:
+			sound->IsMusicPlaying( ) ? sound->PauseMusic( ) : sound->ResumeMusic( );
+			break;
+		case SDLK_F12:
+			toggleTrace( );
+			break;
+		default:
+			break;
+		}
+	}
 }
 
 void Game::update( ) {
-	Uint32 currentTime = SDL_GetTicks( );
-	Uint32 deltaTime = currentTime - lastUpdateTime;
+	TRACE_ZONE("Game::update");
+	input.apply([this](InputAction action) { return performAction(action); });
+
+	uint64_t now = SDL_GetPerformanceCounter( );
+	uint64_t step = SDL_GetPerformanceFrequency( );
+	gravityBacklog += (now - lastGravityTime) * GameBoard::TICKS_PER_SECOND;
+	lastGravityTime = now;
 
-	if (deltaTime >= max(50, 1000 - (gameBoard->getLevel( ) * 100))) {
-		gameBoard->update( );
-		lastUpdateTime = currentTime;
+	// After a stall (window drag, debugger) only a few frames are caught up, the rest is dropped
+	gravityBacklog = min(gravityBacklog, MAX_GRAVITY_CATCH_UP * step);
+	while (gravityBacklog >= step) {
+		gravityBacklog -= step;
+		if (gameBoard->isGravityDue( )) history.push(gameBoard->snapshot( ));
+		gameBoard->applyGravity( );
 	}
 }
 
+void Game::resetGravityClock( ) {
+	lastGravityTime = SDL_GetPerformanceCounter( );
+	gravityBacklog = 0;
+}
+
 void Game::render( ) {
+	TRACE_ZONE("Game::render");
+	latchInput( );
+
 	// Background color
 	SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
 	SDL_RenderClear(renderer.get( ));
@@ -173,13 +737,45 @@ void Game::render( ) {
 	gameRenderer->renderBoard(gameBoard);
 	gameRenderer->renderTetrominoPreview(gameBoard->getNextTetromino( ));
 
-	SDL_RenderPresent(renderer.get( ));
+	gameRenderer->present( );
+	input.presented( );
 }
 
 void Game::restart( ) {
 	gameState.gameover = false;
 	gameState.startSequence = true;
-	gameBoard = make_shared<GameBoard>( );
+	gameState.multiPlayer = false;
+	versus.reset( );
+	splitScreen.reset( );
+	gameBoard = createBoard( );
+	assets->enterScene(Scene::START);
+	input.reset( );
+	history.clear( );
+	hasCheckpoint = false;
+	scoreRecorded = false;
+}
+
+void Game::undo( ) {
+	GameBoard::Snapshot previous;
+	if (!history.pop(previous)) return;
+
+	gameBoard->restore(previous);
+	resetGravityClock( );
+}
+
+void Game::saveCheckpoint( ) {
+	checkpoint = gameBoard->snapshot( );
+	hasCheckpoint = true;
+	sound->PlaySound(SoundName::MENU);
+}
+
+void Game::restoreCheckpoint( ) {
+	if (!hasCheckpoint) return;
+
+	gameBoard->restore(checkpoint);
+	history.clear( );
+	gameState.gameover = false;
+	gameState.startSequence = false;
 }
 
 const bool Game::isGameOver( ) const { return gameState.gameover; }
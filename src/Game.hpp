@@ -10,6 +10,14 @@ extern "C" {
 #include "Renderer.hpp"
 #include "GameBoard.hpp"
 #include "Sound.hpp"
+#include "SnapshotRing.hpp"
+#include "RollbackSession.hpp"
+#include "SplitScreenSession.hpp"
+#include "SpectatorStream.hpp"
+#include "InputSystem.hpp"
+#include "HighScores.hpp"
+#include "SoakMonitor.hpp"
+#include "AutoPlayer.hpp"
 
 using namespace std;
 
@@ -18,25 +26,85 @@ private:
 	void update( );
 	void render( );
 	void inputHandler( );
-
-	void handleWindowResize( );
+	void handleEvent(const SDL_Event& event);
+	// Picks up key events right before drawing, see InputSystem
+	void latchInput( );
+	bool performAction(InputAction action);
+	void reportInputLatency( );
+	void reportAudio( );
+	bool runVersus( );
+	bool runSplitScreen( );
+	void runSpectator( );
+	// Every feed of SpectatorConfig::mosaic in one grid, see BoardMosaic
+	void runMosaic( );
+	// Single player games played by AutoPlayer for SoakConfig::hours of simulated time, true when no
+	// tracked resource kept growing, see SoakMonitor
+	bool runSoak( );
+	void publishSpectatorFrame(bool force = false);
+	uint8_t readHeldButtons( ) const;
+	// Split screen keys: player 0 plays on WASD, player 1 on the arrow keys with UP to rotate
+	uint8_t readPlayerButtons(int player) const;
+	bool isPlaying( ) const;
+	// Sound, metrics and the renderer's dirty rows, each for the event types it uses
+	void subscribeToBoardEvents( );
+	// Records into events, see GameEventBus
+	shared_ptr<GameBoard> createBoard( );
+	// Appends the finished single player game to the high scores and keeps its rank
+	void recordScore( );
 
 	unique_ptr<SDL_Window, void(*)(SDL_Window*)> window;
 	shared_ptr<SDL_Renderer> renderer;
 
 	shared_ptr<GameBoard> gameBoard;
 	shared_ptr<Renderer> gameRenderer;
+	// Events of the boards this client plays or shows, published once per frame
+	GameEventBus events;
+	// Shared with the renderer and the sound, constructed before both
+	shared_ptr<AssetManager> assets;
 
 	shared_ptr<Mix_Music> bgm;
 
-	Uint32 lastUpdateTime = 0;
-	int dropInterval = 1000;
+	InputSystem input;
+
+	// Fixed timestep gravity: real time since the last step, in performance counter ticks times
+	// TICKS_PER_SECOND so a step is exactly one counter frequency long
+	static constexpr int MAX_GRAVITY_CATCH_UP = 4;
+	uint64_t lastGravityTime = 0;
+	uint64_t gravityBacklog = 0;
+
+	// One board snapshot per gravity step, BACKSPACE steps back through them
+	SnapshotRing<GameBoard::Snapshot, 512> history;
+	GameBoard::Snapshot checkpoint;
+	bool hasCheckpoint = false;
+
+	VersusConfig versusConfig;
+	bool versusConfigured = false;
+	unique_ptr<RollbackSession> versus;
+	unique_ptr<SplitScreenSession> splitScreen;
+	shared_ptr<GameBoard> splitViews[2];
+
+	HighScores highScores;
+	uint64_t boardSeed = 0;
+	Uint32 gameStartTicks = 0;
+	uint64_t scoreRank = 0;
+	// A game resumed from a checkpoint after its top out was recorded is not recorded again
+	bool scoreRecorded = false;
+
+	SpectatorConfig spectatorConfig;
+	// F12 starts and stops a trace session, see Trace
+	string tracePath = "trace.json";
+	unique_ptr<SpectatorPublisher> spectatorFeed;
+	uint32_t spectatorFrame = 0;
+
+	SoakConfig soakConfig;
+	bool soakPassed = true;
 
 	struct GameState {
 		bool gameover = false;
 		bool singlePlayer = false;
 		bool multiPlayer = false;
 		bool startSequence = false;
+		bool spectating = false;
 		bool quit = false;
 	} gameState;
 
@@ -46,8 +114,28 @@ public:
 	Game( );
 
 	bool init(const char* title, int w, int h);
+	void setVersusConfig(const VersusConfig& config);
+	void setSpectatorConfig(const SpectatorConfig& config);
+	// Runs the soak instead of the game once, then quits
+	void setSoakConfig(const SoakConfig& config);
+	// False when the soak found a leak or did not run long enough to tell, true otherwise
+	bool hasSoakPassed( ) const;
+	void setTracePath(const string& path);
+	// Finished games are appended to this file, the game over screen shows their rank
+	void openHighScores(const string& path);
+	void toggleTrace( );
+	void setInputConfig(const InputConfig& config);
+	void setAudioConfig(const AudioConfig& config);
+	// Assets no screen uses are evicted above this many bytes, see AssetManager
+	void setAssetBudget(uint64_t bytes);
+	// CPU tile backend for the single player board, see TileRenderer
+	void useTileRenderer( );
 	void run( );
 	void restart( );
+	void undo( );
+	void resetGravityClock( );
+	void saveCheckpoint( );
+	void restoreCheckpoint( );
 
 	const bool isGameOver( ) const;
 	const void setGameOver(bool value);
@@ -1,14 +1,67 @@
 #include "GameBoard.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 #include <iostream>
+#include <cassert>
 
-GameBoard::GameBoard( )
-	: lockedTetrominos(18, vector<int>(10, 0)),
-	lockedColors(18, std::vector<SDL_Color>(10, { 0, 0, 0, 255 })), score(0), level(0), lines(0), collision(false),
-	sound(make_unique<Sound>( )) {
+namespace {
+	// Counted on every board, including the ones rollback re-simulates and the server's
+	Metrics::Counter& piecesLocked = Metrics::counter("tetris_pieces_locked_total", "Pieces locked into a board");
+	Metrics::Counter& linesCleared = Metrics::counter("tetris_lines_cleared_total", "Lines cleared on any board");
+
+	// Cells per frame by level in GRAVITY_UNITs. Levels 0-10 keep the old curve of
+	// max(50, 1000 - level * 100) ms per row (rounded up), later levels ramp up to 20G.
+	constexpr int32_t GRAVITY_CURVE[] = {
+		1093, 1214, 1366, 1561, 1821, 2185, 2731, 3641, 5462, 10923,   // 60 ... 6 frames per row
+		21846, 32768,                                                   // 3 and 2 frames per row
+		GameBoard::GRAVITY_UNIT, 2 * GameBoard::GRAVITY_UNIT, 3 * GameBoard::GRAVITY_UNIT,
+		5 * GameBoard::GRAVITY_UNIT, GameBoard::GRAVITY_20G,
+	};
+
+	// splitmix64 finalizer, the Zobrist keys are this of fixed indices
+	constexpr uint64_t mixKey(uint64_t value) {
+		value += 0x9E3779B97F4A7C15ull;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+
+	// Key spaces of the hash, kept apart so a column key never equals a row or piece key
+	constexpr uint64_t COLUMN_KEYS = 1ull << 60;
+	constexpr uint64_t ROW_KEYS = 2ull << 60;
+	constexpr uint64_t PIECE_KEYS = 3ull << 60;
+	constexpr uint64_t NEXT_KEYS = 4ull << 60;
+
+	uint64_t columnKey(int column) { return mixKey(COLUMN_KEYS | static_cast<uint64_t>(column)); }
+
+	uint64_t pieceKey(const Tetromino& piece, uint64_t space) {
+		uint64_t rotation = static_cast<uint64_t>(piece.getRotationAngle( ) / 90) & 3;
+		uint64_t pose = static_cast<uint64_t>(piece.getShapeEnumn( )) | rotation << 8 |
+			static_cast<uint64_t>(static_cast<uint16_t>(piece.getX( ))) << 16 | static_cast<uint64_t>(static_cast<uint16_t>(piece.getY( ))) << 32;
+		return mixKey(space | pose);
+	}
+}
+
+template <int Width, int Height>
+BasicGameBoard<Width, Height>::BasicGameBoard(uint64_t seed)
+	: lockedTetrominos{ }, lockedColors{ }, rngState(seed), collision(false), score(0), level(0), lines(0),
+	gravityProgress(0), pendingGarbage(0), outgoingGarbage(0), heldInput(0), dirtyRows(ALL_ROWS) {
+	rehashCells( );
 	spawnNewTetromino( );
 }
 
-bool GameBoard::tryMoveCurrentTetromino(int dx, int dy) {
+template <int Width, int Height>
+uint32_t BasicGameBoard<Width, Height>::nextRandom(uint32_t bound) {
+	// splitmix64, the whole generator state is one word so it fits into a snapshot
+	uint64_t z = (rngState += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	return static_cast<uint32_t>((z >> 32) * bound >> 32);
+}
+
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::shiftCurrentTetromino(int dx, int dy) {
 	if (!currentTetromino) return false;
 	currentTetromino->move(dx, dy);
 	if (checkCollision(*currentTetromino)) {
@@ -18,7 +71,15 @@ bool GameBoard::tryMoveCurrentTetromino(int dx, int dy) {
 	return true;
 }
 
-bool GameBoard::tryRotateCurrentTetromino( ) {
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::tryMoveCurrentTetromino(int dx, int dy) {
+	if (!shiftCurrentTetromino(dx, dy)) return false;
+	record(GameEventType::PIECE_MOVED, 0, 0, dx, dy);
+	return true;
+}
+
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::tryRotateCurrentTetromino( ) {
 	if (!currentTetromino) return false;
 	currentTetromino->rotate(*this);
 	if (checkCollision(*currentTetromino)) {
@@ -26,10 +87,12 @@ bool GameBoard::tryRotateCurrentTetromino( ) {
 			currentTetromino->rotate(*this);
 		return false;
 	}
+	record(GameEventType::PIECE_ROTATED);
 	return true;
 }
 
-bool GameBoard::checkCollision(const Tetromino& tetromino) const {
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::checkCollision(const Tetromino& tetromino) const {
 	const auto& shape = tetromino.getShape( );
 	int x = tetromino.getX( ), y = tetromino.getY( );
 
@@ -45,11 +108,14 @@ bool GameBoard::checkCollision(const Tetromino& tetromino) const {
 	return false;
 }
 
-void GameBoard::lockTetromino( ) {
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::lockTetromino( ) {
+	TRACE_ZONE("GameBoard::lockTetromino");
 	const auto& shape = currentTetromino->getShape( );
 	int x = currentTetromino->getX( ), y = currentTetromino->getY( );
 	double angle = currentTetromino->getRotationAngle( );
 	TetrominoShape tetrominoShape = currentTetromino->getShapeEnumn( );
+	piecesLocked.add( );
 
 	if (tetrominoShape == TetrominoShape::I) {
 		if (angle == 90 || angle == 270) {
@@ -59,13 +125,13 @@ void GameBoard::lockTetromino( ) {
 
 				if (lockedTetrominosY >= 0 && lockedTetrominosX >= 0 && lockedTetrominosX < width) {
 					if (col == 0) {
-						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_ENDR) + 1;
+						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_ENDR) + 1;
 					} else if (col == 3) {
-						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_STARTR) + 1;
+						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_STARTR) + 1;
 					} else {
-						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_MIDR) + 1;
+						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_MIDR) + 1;
 					}
-					lockedColors[lockedTetrominosY][lockedTetrominosX] = currentTetromino->getColor( );
+					lockedColors[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(currentTetromino->getColorIndex( ));
 				}
 			}
 		} else {
@@ -77,13 +143,13 @@ void GameBoard::lockTetromino( ) {
 
 						if (lockedTetrominosY >= 0 && lockedTetrominosX >= 0 && lockedTetrominosX < width && lockedTetrominosY < height) {
 							if (row == 0) {
-								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_END) + 1;
+								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_END) + 1;
 							} else if (row == 3) {
-								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_START) + 1;
+								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_START) + 1;
 							} else {
-								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(TetrominoShape::I_MID) + 1;
+								lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(TetrominoShape::I_MID) + 1;
 							}
-							lockedColors[lockedTetrominosY][lockedTetrominosX] = currentTetromino->getColor( );
+							lockedColors[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(currentTetromino->getColorIndex( ));
 						}
 					}
 				}
@@ -97,101 +163,357 @@ void GameBoard::lockTetromino( ) {
 					int lockedTetrominosY = y + row;
 
 					if (lockedTetrominosY >= 0 && lockedTetrominosX >= 0 && lockedTetrominosX < width && lockedTetrominosY < height) {
-						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<int>(tetrominoShape) + 1;
-						lockedColors[lockedTetrominosY][lockedTetrominosX] = currentTetromino->getColor( );
+						lockedTetrominos[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(tetrominoShape) + 1;
+						lockedColors[lockedTetrominosY][lockedTetrominosX] = static_cast<uint8_t>(currentTetromino->getColorIndex( ));
 					}
 				}
 			}
 		}
 	}
 
-	sound->PlaySound(SoundName::PIECE_LANDED);
+	RowMask lockedRows = 0;
+	for (int row = max(0, y); row < min(height, y + static_cast<int>(shape.size( ))); ++row)
+		lockedRows |= RowMask(1) << row;
+	dirtyRows |= lockedRows;
+	features.lock(lockedTetrominos, y, y + static_cast<int>(shape.size( )) - 1);
+	checkFeatures( );
+
+	// Rehashes the rows the piece went into from their cells, the I piece is written by its angle,
+	// which does not always agree with its shape
+	for (int row = max(0, y); row < min(height, y + static_cast<int>(shape.size( ))); ++row) {
+		cellsHash ^= rowHashKey(row, rowHashes[row]);
+		rowHashes[row] = hashRow(lockedTetrominos, row);
+		cellsHash ^= rowHashKey(row, rowHashes[row]);
+	}
+	checkHash( );
+
+	record(GameEventType::PIECE_LOCKED, 0, lockedRows);
 }
 
-void GameBoard::clearLines( ) {
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::clearLines( ) {
+	TRACE_ZONE("GameBoard::clearLines");
+	// One pass from the bottom: rows that stay are copied down over the full ones, the rows
+	// left over at the top are cleared
 	int clearedLines = 0;
-	for (int row = 0; row < height; row++) {
-		if (all_of(lockedTetrominos[row].begin( ), lockedTetrominos[row].end( ), [ ](int cell) { return cell != 0; })) {
-			lockedTetrominos.erase(lockedTetrominos.begin( ) + row);
-			lockedColors.erase(lockedColors.begin( ) + row);
-
-			lockedTetrominos.insert(lockedTetrominos.begin( ), vector<int>(width, 0));
-			lockedColors.insert(lockedColors.begin( ), vector<SDL_Color>(width, { 0, 0, 0, 0 }));
+	RowMask clearedRows = 0;
+	int target = height - 1;
+	for (int row = height - 1; row >= 0; row--) {
+		if (all_of(lockedTetrominos[row].begin( ), lockedTetrominos[row].end( ), [ ](uint8_t cell) { return cell != 0; })) {
+			// Everything above the lowest cleared row moves down
+			if (clearedLines == 0) dirtyRows |= (RowMask(2) << row) - 1;
 
 			score += 100;
 			if (score % 1000 == 0) {
 				level++;
-				Mix_Chunk* levelUpSound = Mix_LoadWAV("assets/sound_effects/level_up.wav");
-				if (levelUpSound == nullptr)
-					SDL_Log("Failed to play rotate sound effect: %s", Mix_GetError( ));
-				else {
-					Mix_PlayChannel(-1, levelUpSound, 0);
-				}
+				record(GameEventType::LEVEL_UP, level);
 			}
 			clearedLines++;
+			clearedRows |= RowMask(1) << row;
 			lines++;
+			continue;
+		}
+		if (target != row) {
+			lockedTetrominos[target] = lockedTetrominos[row];
+			lockedColors[target] = lockedColors[row];
+			rowHashes[target] = rowHashes[row];
 		}
+		target--;
+	}
+	for (int row = 0; row < clearedLines; row++) {
+		lockedTetrominos[row].fill(0);
+		lockedColors[row].fill(0);
+		rowHashes[row] = 0;
+	}
+	if (clearedLines > 0) {
+		features.clear(clearedRows);
+		checkFeatures( );
+		// Rows that moved are keyed by their new index, the cells themselves are not looked at
+		cellsHash = 0;
+		for (int row = 0; row < height; row++) cellsHash ^= rowHashKey(row, rowHashes[row]);
+		checkHash( );
+		linesCleared.add(clearedLines);
+		record(GameEventType::LINES_CLEARED, clearedLines, clearedRows);
 	}
 
-	if (clearedLines >= 4) {
-		Mix_Chunk* clearedLinesSound = Mix_LoadWAV("assets/sound_effects/tetris_line_clear.wav");
-		if (clearedLinesSound == nullptr)
-			SDL_Log("Failed to play rotate sound effect: %s", Mix_GetError( ));
-		else {
-			Mix_PlayChannel(-1, clearedLinesSound, 0);
-		}
-	} else if (clearedLines > 0) {
-		Mix_Chunk* clearedLinesSound = Mix_LoadWAV("assets/sound_effects/line_clear.wav");
-		if (clearedLinesSound == nullptr)
-			SDL_Log("Failed to play rotate sound effect: %s", Mix_GetError( ));
-		else {
-			Mix_PlayChannel(-1, clearedLinesSound, 0);
-		}
+	// Versus attack table, cleared lines first cancel garbage that is still queued for us
+	int attack = clearedLines >= 4 ? 4 : max(0, clearedLines - 1);
+	int cancelled = min(attack, pendingGarbage);
+	pendingGarbage -= cancelled;
+	outgoingGarbage += attack - cancelled;
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::insertGarbage( ) {
+	int rows = min(pendingGarbage, height);
+	pendingGarbage = 0;
+	if (rows == 0) return;
+	dirtyRows = ALL_ROWS;
+
+	// Rows pushed out at the top are lost, the following spawn decides whether that tops out
+	for (int row = 0; row + rows < height; row++) {
+		lockedTetrominos[row] = lockedTetrominos[row + rows];
+		lockedColors[row] = lockedColors[row + rows];
+	}
+
+	const uint8_t garbageCell = static_cast<uint8_t>(TetrominoShape::GARBAGE) + 1;
+	int hole = static_cast<int>(nextRandom(width));
+	for (int row = height - rows; row < height; row++) {
+		lockedTetrominos[row].fill(garbageCell);
+		lockedTetrominos[row][hole] = 0;
+		lockedColors[row].fill(Tetromino::GARBAGE_COLOR);
+		lockedColors[row][hole] = 0;
 	}
+	features.reset(lockedTetrominos);
+	rehashCells( );
+	record(GameEventType::GARBAGE_ADDED, rows);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::checkFeatures( ) const {
+	assert((features.get( ) == BoardFeatureTracker<Width, Height>::scan(lockedTetrominos)));
+}
+
+template <int Width, int Height>
+uint64_t BasicGameBoard<Width, Height>::rowHashKey(int row, uint64_t rowHash) {
+	return rowHash == 0 ? 0 : mixKey(rowHash ^ mixKey(ROW_KEYS | static_cast<uint64_t>(row)));
+}
+
+template <int Width, int Height>
+uint64_t BasicGameBoard<Width, Height>::hashRow(const Cells& cells, int row) {
+	uint64_t rowHash = 0;
+	for (int col = 0; col < width; col++)
+		if (cells[row][col]) rowHash ^= columnKey(col);
+	return rowHash;
 }
 
-void GameBoard::spawnNewTetromino( ) {
+template <int Width, int Height>
+uint64_t BasicGameBoard<Width, Height>::hashCells(const Cells& cells) {
+	uint64_t hash = 0;
+	for (int row = 0; row < height; row++) hash ^= rowHashKey(row, hashRow(cells, row));
+	return hash;
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::rehashCells( ) {
+	for (int row = 0; row < height; row++) rowHashes[row] = hashRow(lockedTetrominos, row);
+	cellsHash = hashCells(lockedTetrominos);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::checkHash( ) const {
+	assert(hashCells(lockedTetrominos) == cellsHash);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::record(GameEventType type, int value, uint64_t rows, int dx, int dy) {
+	if (!events) return;
+	GameEvent event{ };
+	event.type = type;
+	if (currentTetromino) {
+		event.shape = static_cast<uint8_t>(currentTetromino->getShapeEnumn( ));
+		event.x = static_cast<int8_t>(currentTetromino->getX( ));
+		event.y = static_cast<int8_t>(currentTetromino->getY( ));
+	}
+	event.dx = static_cast<int8_t>(dx);
+	event.dy = static_cast<int8_t>(dy);
+	event.value = static_cast<int16_t>(value);
+	event.rows = rows;
+	events->push(event);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::spawnNewTetromino( ) {
+	const uint32_t shapeCount = static_cast<uint32_t>(TetrominoShape::COUNT);
+
 	//Ensure on startup that we have a tetromino
 	if (!nextTetromino) {
-		random_device dev;
-		mt19937 rng(dev( ));
-		uniform_int_distribution<mt19937::result_type> dist6(0, static_cast<int>(TetrominoShape::COUNT) - 1);
-		TetrominoShape shape = static_cast<TetrominoShape>(dist6(rng));
-
-		nextTetromino = make_shared<Tetromino>(shape);
+		TetrominoShape shape = static_cast<TetrominoShape>(nextRandom(shapeCount));
+		nextTetromino = make_shared<Tetromino>(shape, nextRandom(Tetromino::COLOR_COUNT));
 	}
 
 	currentTetromino = move(nextTetromino);
 	currentTetromino->move(4, 0);
 
 	// Generate next tetromino
-	random_device dev;
-	mt19937 rng(dev( ));
-	uniform_int_distribution<mt19937::result_type> dist6(0, static_cast<int>(TetrominoShape::COUNT) - 1);
-	TetrominoShape shape = static_cast<TetrominoShape>(dist6(rng));
-	nextTetromino = make_shared<Tetromino>(shape);
+	TetrominoShape shape = static_cast<TetrominoShape>(nextRandom(shapeCount));
+	nextTetromino = make_shared<Tetromino>(shape, nextRandom(Tetromino::COLOR_COUNT));
 
 	if (checkCollision(*currentTetromino)) {
 		collision = true;
-		lockedTetrominos.clear( );
-		lockedColors.clear( );
+		dirtyRows = ALL_ROWS;
+		lockedTetrominos = Cells{ };
+		lockedColors = Cells{ };
+		features.reset(lockedTetrominos);
+		rehashCells( );
 		currentTetromino = nullptr;
 		nextTetromino = nullptr;
+		record(GameEventType::TOP_OUT);
+		return;
 	}
+	record(GameEventType::PIECE_SPAWNED);
 }
 
-void GameBoard::update( ) {
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::update( ) {
+	TRACE_ZONE("GameBoard::update");
+	// A topped out board has no cells left to simulate on
+	if (collision) return;
+
 	if (!currentTetromino)
 		spawnNewTetromino( );
 
-	if (!tryMoveCurrentTetromino(0, 1)) {
-		lockTetromino( );
-		clearLines( );
+	if (!tryMoveCurrentTetromino(0, 1))
+		settleCurrentTetromino( );
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::settleCurrentTetromino( ) {
+	lockTetromino( );
+	clearLines( );
+	insertGarbage( );
+	spawnNewTetromino( );
+}
+
+template <int Width, int Height>
+int32_t BasicGameBoard<Width, Height>::gravityForLevel(int level) {
+	constexpr int levels = static_cast<int>(sizeof(GRAVITY_CURVE) / sizeof(GRAVITY_CURVE[0]));
+	return GRAVITY_CURVE[clamp(level, 0, levels - 1)];
+}
+
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::isGravityDue( ) const {
+	return !collision && gravityProgress + gravityForLevel(level) >= GRAVITY_UNIT;
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::applyGravity( ) {
+	TRACE_ZONE("GameBoard::applyGravity");
+	if (collision) return;
+
+	if (!currentTetromino)
 		spawnNewTetromino( );
+
+	gravityProgress += gravityForLevel(level);
+	int fell = 0;
+	while (gravityProgress >= GRAVITY_UNIT) {
+		gravityProgress -= GRAVITY_UNIT;
+		if (shiftCurrentTetromino(0, 1)) {
+			fell++;
+			continue;
+		}
+
+		// A piece that lands this frame locks on the next row due, so even at 20G it can still slide.
+		// Leftover progress is dropped either way instead of carrying over to the next piece.
+		if (!fell) settleCurrentTetromino( );
+		gravityProgress = 0;
+		break;
 	}
+	// One event for the whole fall, 20G would otherwise record a move per row
+	if (fell > 0) record(GameEventType::PIECE_MOVED, 0, 0, 0, fell);
 }
 
-bool GameBoard::isValidPosition(const vector<vector<int>>& shape, int x, int y) const {
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::tick(uint8_t heldButtons) {
+	TRACE_ZONE("GameBoard::tick");
+	if (collision) return;
+
+	// Actions fire on the frame a button goes down, so a repeated held state is harmless
+	uint8_t pressed = heldButtons & ~heldInput;
+	heldInput = heldButtons;
+
+	if (pressed & INPUT_LEFT) tryMoveCurrentTetromino(-1, 0);
+	if (pressed & INPUT_RIGHT) tryMoveCurrentTetromino(1, 0);
+	if (pressed & INPUT_ROTATE) tryRotateCurrentTetromino( );
+	if (pressed & INPUT_DROP) moveToBottom( );
+
+	applyGravity( );
+}
+
+template <int Width, int Height>
+typename BasicGameBoard<Width, Height>::Snapshot BasicGameBoard<Width, Height>::snapshot( ) const {
+	Snapshot snapshot{ };
+	snapshot.cells = lockedTetrominos;
+	snapshot.colors = lockedColors;
+
+	snapshot.hasCurrent = currentTetromino != nullptr;
+	if (currentTetromino) snapshot.current = currentTetromino->getState( );
+	snapshot.hasNext = nextTetromino != nullptr;
+	if (nextTetromino) snapshot.next = nextTetromino->getState( );
+
+	snapshot.collision = collision;
+	snapshot.score = score;
+	snapshot.level = level;
+	snapshot.lines = lines;
+	snapshot.gravityProgress = gravityProgress;
+	snapshot.pendingGarbage = pendingGarbage;
+	snapshot.outgoingGarbage = outgoingGarbage;
+	snapshot.heldInput = heldInput;
+	snapshot.rngState = rngState;
+
+	return snapshot;
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::restore(const Snapshot& snapshot) {
+	// A topped out board keeps no cells, see spawnNewTetromino
+	lockedTetrominos = snapshot.collision ? Cells{ } : snapshot.cells;
+	lockedColors = snapshot.collision ? Cells{ } : snapshot.colors;
+
+	currentTetromino = snapshot.hasCurrent ? make_shared<Tetromino>(snapshot.current) : nullptr;
+	nextTetromino = snapshot.hasNext ? make_shared<Tetromino>(snapshot.next) : nullptr;
+
+	collision = snapshot.collision;
+	score = snapshot.score;
+	level = snapshot.level;
+	lines = snapshot.lines;
+	gravityProgress = snapshot.gravityProgress;
+	pendingGarbage = snapshot.pendingGarbage;
+	outgoingGarbage = snapshot.outgoingGarbage;
+	heldInput = snapshot.heldInput;
+	rngState = snapshot.rngState;
+	dirtyRows = ALL_ROWS;
+	features.reset(lockedTetrominos);
+	rehashCells( );
+	record(GameEventType::BOARD_RESET);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::setEventBuffer(GameEventBuffer* buffer) {
+	events = buffer;
+	record(GameEventType::BOARD_RESET);
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::addGarbage(int rows) {
+	if (collision || rows <= 0) return;
+	pendingGarbage = min(MAX_PENDING_GARBAGE, pendingGarbage + rows);
+}
+
+template <int Width, int Height>
+int BasicGameBoard<Width, Height>::takeOutgoingGarbage( ) {
+	int rows = outgoingGarbage;
+	outgoingGarbage = 0;
+	return rows;
+}
+
+template <int Width, int Height>
+typename BasicGameBoard<Width, Height>::RowMask BasicGameBoard<Width, Height>::takeDirtyRows( ) {
+	RowMask rows = dirtyRows;
+	dirtyRows = 0;
+	return rows;
+}
+
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::exchangeGarbage(BasicGameBoard& first, BasicGameBoard& second) {
+	int toSecond = first.takeOutgoingGarbage( );
+	int toFirst = second.takeOutgoingGarbage( );
+	second.addGarbage(toSecond);
+	first.addGarbage(toFirst);
+}
+
+template <int Width, int Height>
+bool BasicGameBoard<Width, Height>::isValidPosition(const vector<vector<int>>& shape, int x, int y) const {
 	for (int row = 0; row < shape.size( ); ++row)
 		for (int col = 0; col < shape[row].size( ); ++col)
 			if (shape[row][col]) {
@@ -204,20 +526,69 @@ bool GameBoard::isValidPosition(const vector<vector<int>>& shape, int x, int y)
 	return true;
 }
 
-void GameBoard::moveToBottom( ) {
-	while (isValidPosition(currentTetromino->getShape( ), currentTetromino->getX( ), currentTetromino->getY( ) + 1)) currentTetromino->move(0, 1);
+template <int Width, int Height>
+void BasicGameBoard<Width, Height>::moveToBottom( ) {
+	if (!currentTetromino) return;
+	int fell = 0;
+	for (; isValidPosition(currentTetromino->getShape( ), currentTetromino->getX( ), currentTetromino->getY( ) + 1); fell++) currentTetromino->move(0, 1);
+	record(GameEventType::PIECE_DROPPED, 0, 0, 0, fell);
 }
 
-const bool GameBoard::isCollision( ) const { return collision; }
-const int GameBoard::getScore( ) const { return score; }
-const int GameBoard::getLevel( ) const { return level; }
-const int GameBoard::getLines( ) const { return lines; }
-const shared_ptr<Tetromino> GameBoard::getNextTetromino( ) const { return nextTetromino; }
+template <int Width, int Height>
+const BoardFeatures& BasicGameBoard<Width, Height>::getFeatures( ) const { return features.get( ); }
+template <int Width, int Height>
+int BasicGameBoard<Width, Height>::getColumnHeight(int column) const { return features.getColumnHeight(column); }
+
+template <int Width, int Height>
+BoardFeatures BasicGameBoard<Width, Height>::evaluatePlacement(const vector<vector<int>>& shape, int x, int y) const {
+	typename BoardFeatureTracker<Width, Height>::Piece piece{ };
+	piece.y = y;
+	piece.height = min(4, static_cast<int>(shape.size( )));
+	for (int row = 0; row < piece.height; row++)
+		for (int col = 0; col < shape[row].size( ); col++)
+			if (shape[row][col] && x + col >= 0 && x + col < width) piece.rows[row] |= 1u << (x + col);
+	return features.evaluate(piece);
+}
+
+template <int Width, int Height>
+uint64_t BasicGameBoard<Width, Height>::getHash( ) const {
+	uint64_t hash = cellsHash;
+	if (currentTetromino) hash ^= pieceKey(*currentTetromino, PIECE_KEYS);
+	// Only the shape of the next piece, it has no position or rotation yet
+	if (nextTetromino) hash ^= mixKey(NEXT_KEYS | static_cast<uint64_t>(nextTetromino->getShapeEnumn( )));
+	return hash;
+}
+
+template <int Width, int Height>
+const bool BasicGameBoard<Width, Height>::isCollision( ) const { return collision; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getScore( ) const { return score; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getLevel( ) const { return level; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getLines( ) const { return lines; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getPendingGarbage( ) const { return pendingGarbage; }
+template <int Width, int Height>
+const shared_ptr<Tetromino> BasicGameBoard<Width, Height>::getNextTetromino( ) const { return nextTetromino; }
+
 
+template <int Width, int Height>
+const typename BasicGameBoard<Width, Height>::Cells& BasicGameBoard<Width, Height>::getLockedTetrominos( ) const { return lockedTetrominos; }
+template <int Width, int Height>
+const typename BasicGameBoard<Width, Height>::Cells& BasicGameBoard<Width, Height>::getLockedColors( ) const { return lockedColors; }
+template <int Width, int Height>
+const shared_ptr<Tetromino> BasicGameBoard<Width, Height>::getCurrentTetromino( ) const { return currentTetromino; }
 
-const vector<vector<int>>& GameBoard::getLockedTetrominos( ) const { return lockedTetrominos; }
-const vector<vector<SDL_Color>>& GameBoard::getLockedColors( ) const { return lockedColors; }
-const shared_ptr<Tetromino> GameBoard::getCurrentTetromino( ) const { return currentTetromino; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getWidth( ) const { return width; }
+template <int Width, int Height>
+const int BasicGameBoard<Width, Height>::getHeight( ) const { return height; }
+template <int Width, int Height>
+uint8_t BasicGameBoard<Width, Height>::getCell(int row, int col) const { return lockedTetrominos[row][col]; }
+template <int Width, int Height>
+uint8_t BasicGameBoard<Width, Height>::getColor(int row, int col) const { return lockedColors[row][col]; }
 
-const int GameBoard::getWidth( ) const { return width; }
-const int GameBoard::getHeight( ) const { return height; }
+template class BasicGameBoard<10, 18>;
+template class BasicGameBoard<10, 20>;
+template class BasicGameBoard<10, 40>;
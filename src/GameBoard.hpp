@@ -1,53 +1,186 @@
 #pragma once
 
-extern "C" {
-#include <SDL2/SDL_mixer.h>
-}
-
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <array>
 #include "Tetromino.hpp"
-#include "Sound.hpp"
+#include "GameEvents.hpp"
+#include "BoardView.hpp"
+#include "BoardFeatures.hpp"
+
+// Buttons held during one simulation frame, see BasicGameBoard::tick
+enum InputButton : uint8_t {
+	INPUT_LEFT = 1 << 0,
+	INPUT_RIGHT = 1 << 1,
+	INPUT_DROP = 1 << 2,
+	INPUT_ROTATE = 1 << 3,
+};
+
+// Board of Width columns and Height rows. The size is a template parameter so every loop over
+// the cells has constant bounds and the cells live inside the board instead of in row vectors.
+// Only the sizes instantiated in GameBoard.cpp exist, see the aliases below.
+template <int Width, int Height>
+class BasicGameBoard final : public BoardView {
+public:
+	static constexpr int width = Width;
+	static constexpr int height = Height;
+	static_assert(width > 0 && height > 0 && height < 64, "dirty rows are tracked in one 64 bit mask");
+
+	// Row major, shape + 1 or a palette index per cell
+	using Cells = array<array<uint8_t, width>, height>;
+	// Bit per row, see takeDirtyRows( )
+	using RowMask = conditional_t<(height < 32), uint32_t, uint64_t>;
+
+	// Complete board state as one flat block, copying it is a single memcpy
+	struct Snapshot {
+		Cells cells;
+		Cells colors;
+		TetrominoState current;
+		TetrominoState next;
+		bool hasCurrent;
+		bool hasNext;
+		bool collision;
+		int32_t score;
+		int32_t level;
+		int32_t lines;
+		int32_t gravityProgress;
+		int32_t pendingGarbage;
+		int32_t outgoingGarbage;
+		uint8_t heldInput;
+		uint64_t rngState;
+	};
+
+	// Frame rate the gravity of tick( ) is expressed in
+	static constexpr int TICKS_PER_SECOND = 60;
+	static constexpr int MAX_PENDING_GARBAGE = 12;
+	// Gravity is measured in 1/GRAVITY_UNIT cells per frame, GRAVITY_UNIT is one row a frame (1G)
+	static constexpr int32_t GRAVITY_UNIT = 1 << 16;
+	static constexpr int32_t GRAVITY_20G = 20 * GRAVITY_UNIT;
+	static constexpr RowMask ALL_ROWS = (RowMask(1) << height) - 1;
 
-class GameBoard {
 private:
 	void spawnNewTetromino( );
+	void settleCurrentTetromino( );
+	uint32_t nextRandom(uint32_t bound);
 	bool checkCollision(const Tetromino& tetromino) const;
 	void lockTetromino( );
 	void clearLines( );
+	void insertGarbage( );
+	// Moves the piece without recording an event, false and unchanged when it does not fit there
+	bool shiftCurrentTetromino(int dx, int dy);
+	// Appends to the attached buffer, with the current piece's shape and position when there is one
+	void record(GameEventType type, int value = 0, uint64_t rows = 0, int dx = 0, int dy = 0);
+	// Debug builds compare the incremental features with a full scan after every change
+	void checkFeatures( ) const;
+	// What the locked cells of row add to the hash, empty rows add nothing
+	static uint64_t rowHashKey(int row, uint64_t rowHash);
+	// XOR of the column keys of the row's filled cells
+	static uint64_t hashRow(const Cells& cells, int row);
+	// From scratch, the reference the incremental updates are checked against
+	static uint64_t hashCells(const Cells& cells);
+	void rehashCells( );
+	// Debug builds compare the incremental cell hash with a full recomputation, like checkFeatures
+	void checkHash( ) const;
 
-	vector<vector<int>> lockedTetrominos;
-	vector<vector<SDL_Color>> lockedColors;
+	Cells lockedTetrominos;
+	Cells lockedColors;
 	shared_ptr<Tetromino> currentTetromino;
 	shared_ptr<Tetromino> nextTetromino;
-	const int width = 10;
-	const int height = 18;
+	uint64_t rngState;
 	bool collision;
 	int score;
 	int level;
 	int lines;
+	int gravityProgress;
+	int pendingGarbage;
+	int outgoingGarbage;
+	uint8_t heldInput;
+	// Rows whose locked cells changed since the last takeDirtyRows( ), not part of a snapshot
+	RowMask dirtyRows;
+	// Derived from the cells, recounted on restore( ) instead of being part of a snapshot
+	BoardFeatureTracker<Width, Height> features;
+	// Zobrist hash of the locked cells, also derived: every row keeps its hashRow( ) and cellsHash
+	// combines the rows' rowHashKey( )s
+	array<uint64_t, Height> rowHashes;
+	uint64_t cellsHash;
 
-	const unique_ptr<Sound> sound;
+	// Not part of a snapshot, a restored board keeps recording where it did
+	GameEventBuffer* events = nullptr;
 
 public:
-	GameBoard( );
+	explicit BasicGameBoard(uint64_t seed = random_device{ }( ));
 	void update( );
+	void tick(uint8_t heldButtons);
+	// One frame of gravity, moves the piece down as many whole rows as have accumulated
+	void applyGravity( );
+	// True when the next applyGravity( ) moves or locks the piece
+	bool isGravityDue( ) const;
+	static int32_t gravityForLevel(int level);
+
+	Snapshot snapshot( ) const;
+	void restore(const Snapshot& snapshot);
+
+	// Events are recorded into this buffer from now on, starting with a BOARD_RESET. Boards without
+	// one record nothing, e.g. a re-simulated or remote board or one of the server's.
+	void setEventBuffer(GameEventBuffer* buffer);
+
+	void addGarbage(int rows);
+	int takeOutgoingGarbage( );
+	// Bit per row changed by a lock, a line clear, garbage or a restore since the last call
+	RowMask takeDirtyRows( );
+	// Moves the garbage each board produced this frame over to the other one
+	static void exchangeGarbage(BasicGameBoard& first, BasicGameBoard& second);
 	bool tryMoveCurrentTetromino(int dx, int dy);
 	bool tryRotateCurrentTetromino( );
-	bool isValidPosition(const vector<vector<int>>& shape, int x, int y) const;
+	bool isValidPosition(const vector<vector<int>>& shape, int x, int y) const override;
 	void moveToBottom( );
 
-	const bool isCollision( ) const;
-	const int getScore( ) const;
-	const int getLevel( ) const;
-	const int getLines( ) const;
-	const shared_ptr<Tetromino> getNextTetromino( ) const;
+	// Stack statistics of the locked cells, kept up to date by every lock and line clear
+	const BoardFeatures& getFeatures( ) const;
+	int getColumnHeight(int column) const;
+	// Features if the shape locked at x, y and its lines cleared, at the cost of the rows and columns
+	// it covers. The shape must fit there, see isValidPosition( ).
+	BoardFeatures evaluatePlacement(const vector<vector<int>>& shape, int x, int y) const;
+
+	// 64 bit Zobrist hash of which cells are filled, the current piece's shape, rotation and position
+	// and the next piece's shape. Colors, score and garbage are not part of it. A lock rehashes the
+	// rows the piece went into, a line clear recombines the row hashes without looking at cells and
+	// the pieces are keyed on read, so it is cheap enough to ask every frame, e.g. for transposition
+	// tables or to compare peers. The keys are fixed, equal boards hash equal across builds and
+	// machines.
+	uint64_t getHash( ) const;
 
-	const vector<vector<int>>& getLockedTetrominos( ) const;
-	const vector<vector<SDL_Color>>& getLockedColors( ) const;
-	const shared_ptr<Tetromino> getCurrentTetromino( ) const;
+	const bool isCollision( ) const override;
+	const int getScore( ) const override;
+	const int getLevel( ) const override;
+	const int getLines( ) const override;
+	const int getPendingGarbage( ) const override;
+	const shared_ptr<Tetromino> getNextTetromino( ) const override;
 
-	const int getWidth( ) const;
-	const int getHeight( ) const;
+	// A topped out board has every cell cleared
+	const Cells& getLockedTetrominos( ) const;
+	// Palette index per cell, see Renderer::paletteColor
+	const Cells& getLockedColors( ) const;
+	const shared_ptr<Tetromino> getCurrentTetromino( ) const override;
+	uint8_t getCell(int row, int col) const override;
+	uint8_t getColor(int row, int col) const override;
+
+	const int getWidth( ) const override;
+	const int getHeight( ) const override;
 };
+
+extern template class BasicGameBoard<10, 18>;
+extern template class BasicGameBoard<10, 20>;
+extern template class BasicGameBoard<10, 40>;
+
+// The Game Boy board everything plays on, the taller ones are for tools and tests
+using GameBoard = BasicGameBoard<10, 18>;
+using GameBoard10x20 = BasicGameBoard<10, 20>;
+// Guideline sized, 20 visible rows under a 20 row buffer zone
+using GameBoard10x40 = BasicGameBoard<10, 40>;
+
+static_assert(is_trivially_copyable<GameBoard::Snapshot>::value, "GameBoard::Snapshot must stay trivially copyable");
@@ -0,0 +1,28 @@
+#include "GameEvents.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+namespace {
+	Metrics::Counter& eventsPublished = Metrics::counter("tetris_game_events_total", "Board events delivered to subscribers");
+	Metrics::Counter& eventsDropped = Metrics::counter("tetris_game_events_dropped_total", "Board events lost to a full frame buffer");
+}
+
+void GameEventBus::subscribe(uint32_t types, Handler handler) {
+	subscribers.push_back({ types, move(handler) });
+}
+
+GameEventBuffer& GameEventBus::getBuffer( ) { return frame; }
+
+void GameEventBus::publish( ) { publish(frame); }
+
+void GameEventBus::publish(GameEventBuffer& batch) {
+	uint32_t dropped = batch.takeDropped( );
+	if (dropped > 0) eventsDropped.add(dropped);
+	if (batch.empty( )) return;
+
+	TRACE_ZONE("GameEventBus::publish");
+	eventsPublished.add(batch.size( ));
+	for (const Subscriber& subscriber : subscribers)
+		if (subscriber.types & batch.getTypes( )) subscriber.handler(batch);
+	batch.clear( );
+}
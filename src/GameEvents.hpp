@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// What happened on a board, in the order it happened within a frame
+enum class GameEventType : uint8_t {
+	PIECE_SPAWNED,
+	PIECE_MOVED,        // by the player or by gravity, dx and dy are the step
+	PIECE_ROTATED,
+	PIECE_DROPPED,      // hard drop, dy is the rows fallen
+	PIECE_LOCKED,       // rows has a bit for every row the piece's cells went into
+	LINES_CLEARED,      // rows has a bit for every cleared row, value is the number of lines
+	LEVEL_UP,           // value is the new level
+	GARBAGE_ADDED,      // value is the rows pushed in from the bottom
+	TOP_OUT,
+	BOARD_RESET,        // restored from a snapshot or newly attached, nothing about the cells is known
+	COUNT
+};
+
+constexpr uint32_t eventBit(GameEventType type) { return 1u << static_cast<uint32_t>(type); }
+constexpr uint32_t ALL_GAME_EVENTS = (1u << static_cast<uint32_t>(GameEventType::COUNT)) - 1;
+
+// One fixed size record per event. Piece events carry the shape and the position the piece ended up
+// at, row masks use bit r for board row r like BasicGameBoard::RowMask.
+struct GameEvent {
+	GameEventType type;
+	uint8_t shape;      // TetrominoShape of the piece events
+	int8_t x, y;
+	int8_t dx, dy;
+	int16_t value;
+	uint64_t rows;
+};
+
+static_assert(is_trivially_copyable<GameEvent>::value, "GameEvent must stay trivially copyable");
+
+// Events of one frame. The storage is part of the buffer, recording never allocates; once it is
+// full further events are counted as dropped instead.
+class GameEventBuffer {
+public:
+	static constexpr size_t CAPACITY = 256;
+
+private:
+	array<GameEvent, CAPACITY> events;
+	size_t count = 0;
+	uint32_t types = 0;
+	uint32_t dropped = 0;
+
+public:
+	void push(const GameEvent& event) {
+		if (count == CAPACITY) {
+			dropped++;
+			return;
+		}
+		events[count++] = event;
+		types |= eventBit(event.type);
+	}
+
+	void clear( ) {
+		count = 0;
+		types = 0;
+	}
+
+	// eventBit( ) of every type in the buffer
+	uint32_t getTypes( ) const { return types; }
+	bool empty( ) const { return count == 0; }
+	size_t size( ) const { return count; }
+	const GameEvent* begin( ) const { return events.data( ); }
+	const GameEvent* end( ) const { return events.data( ) + count; }
+
+	// Events that did not fit since the last call
+	uint32_t takeDropped( ) {
+		uint32_t lost = dropped;
+		dropped = 0;
+		return lost;
+	}
+};
+
+// Hands a frame's events to the subscribers in one batch each. A subscriber names the event types it
+// handles and is only called for batches that contain one of them, it skips the others itself.
+// Gameplay code only records into a buffer, everything with side effects (sound, drawing, metrics)
+// happens here on the thread that publishes. Single threaded, see SplitScreenSession for boards
+// that run on their own threads.
+class GameEventBus {
+public:
+	using Handler = function<void(const GameEventBuffer& batch)>;
+
+private:
+	struct Subscriber {
+		uint32_t types;
+		Handler handler;
+	};
+
+	vector<Subscriber> subscribers;
+	GameEventBuffer frame;
+
+public:
+	// types is a mask of eventBit( )s
+	void subscribe(uint32_t types, Handler handler);
+
+	// Boards of the publishing thread record into this buffer, see BasicGameBoard::setEventBuffer
+	GameEventBuffer& getBuffer( );
+	// Delivers what was recorded into getBuffer( ) since the last call and empties it. Once per frame.
+	void publish( );
+	// Same for a buffer someone else owns, e.g. a session's
+	void publish(GameEventBuffer& batch);
+};
@@ -0,0 +1,248 @@
+#include "HighScores.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#define fsync_(file) _commit(_fileno(file))
+#else
+#include <unistd.h>
+#define fsync_(file) fsync(fileno(file))
+#endif
+
+namespace {
+	const char MAGIC[4] = { 'T', 'S', 'C', 'R' };
+	// Records read per fread while opening
+	constexpr size_t READ_BATCH = 4096;
+
+	void writeU16(uint8_t* out, uint16_t value) {
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+	}
+
+	void writeU32(uint8_t* out, uint32_t value) {
+		for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+
+	void writeU64(uint8_t* out, uint64_t value) {
+		writeU32(out, static_cast<uint32_t>(value));
+		writeU32(out + 4, static_cast<uint32_t>(value >> 32));
+	}
+
+	uint16_t readU16(const uint8_t* in) { return static_cast<uint16_t>(in[0] | (in[1] << 8)); }
+
+	uint32_t readU32(const uint8_t* in) {
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+		return value;
+	}
+
+	uint64_t readU64(const uint8_t* in) {
+		return readU32(in) | (static_cast<uint64_t>(readU32(in + 4)) << 32);
+	}
+
+	// CRC-32 (IEEE), the one zip and PNG use
+	uint32_t crc32(const uint8_t* data, size_t size) {
+		static const array<uint32_t, 256> table = [ ] {
+			array<uint32_t, 256> entries{ };
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t value = i;
+				for (int bit = 0; bit < 8; bit++) value = (value >> 1) ^ (value & 1 ? 0xEDB88320u : 0);
+				entries[i] = value;
+			}
+			return entries;
+		}( );
+
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return crc ^ 0xFFFFFFFFu;
+	}
+}
+
+HighScores::HighScores( ) : tree(BUCKETS + 1, 0) { }
+
+HighScores::~HighScores( ) { close( ); }
+
+void HighScores::encode(const ScoreRecord& record, uint8_t out[RECORD_SIZE]) {
+	writeU32(out, record.score);
+	writeU32(out + 4, record.lines);
+	writeU16(out + 8, record.level);
+	writeU16(out + 10, 0);
+	writeU64(out + 12, record.seed);
+	writeU32(out + 20, record.durationMs);
+	writeU32(out + 24, record.finishedAt);
+	writeU32(out + 28, crc32(out, RECORD_SIZE - 4));
+}
+
+bool HighScores::decode(const uint8_t in[RECORD_SIZE], ScoreRecord& record) {
+	if (crc32(in, RECORD_SIZE - 4) != readU32(in + 28)) return false;
+
+	record.score = readU32(in);
+	record.lines = readU32(in + 4);
+	record.level = readU16(in + 8);
+	record.seed = readU64(in + 12);
+	record.durationMs = readU32(in + 20);
+	record.finishedAt = readU32(in + 24);
+	return true;
+}
+
+bool HighScores::open(const string& filePath) {
+	lock_guard<mutex> guard(lock);
+	if (file) {
+		fclose(file);
+		file = nullptr;
+	}
+	fill(tree.begin( ), tree.end( ), 0);
+	top.clear( );
+	stats = Stats( );
+	path = filePath;
+
+	FILE* in = fopen(path.c_str( ), "rb");
+	uint64_t goodEnd = HEADER_SIZE;
+	uint64_t fileSize = 0;
+	if (in) {
+		uint8_t header[HEADER_SIZE];
+		size_t headerRead = fread(header, 1, HEADER_SIZE, in);
+		if (headerRead == HEADER_SIZE && (memcmp(header, MAGIC, 4) != 0 || readU32(header + 4) != VERSION)) {
+			cerr << path << " is not a version " << VERSION << " score file" << endl;
+			fclose(in);
+			return false;
+		}
+		fileSize = headerRead;
+
+		// Streams the records, memory stays at one batch however long the file is
+		vector<uint8_t> batch(READ_BATCH * RECORD_SIZE);
+		uint64_t badSinceGood = 0;
+		size_t got;
+		while (headerRead == HEADER_SIZE && (got = fread(batch.data( ), 1, batch.size( ), in)) > 0) {
+			for (size_t offset = 0; offset + RECORD_SIZE <= got; offset += RECORD_SIZE) {
+				ScoreRecord record;
+				if (!decode(&batch[offset], record)) {
+					badSinceGood++;
+					continue;
+				}
+				stats.corrupt += badSinceGood;
+				badSinceGood = 0;
+				index(record);
+				goodEnd = fileSize + offset + RECORD_SIZE;
+			}
+			fileSize += got;
+		}
+		fclose(in);
+
+		// A partial or corrupt tail is what an interrupted append leaves behind, cut it off so
+		// the next record starts on a record boundary
+		if (headerRead < HEADER_SIZE) goodEnd = 0;
+		if (fileSize > goodEnd) {
+			error_code error;
+			filesystem::resize_file(path, goodEnd, error);
+			if (error) {
+				cerr << "Failed to truncate " << path << ": " << error.message( ) << endl;
+				return false;
+			}
+			stats.truncatedBytes = fileSize - goodEnd;
+			fileSize = goodEnd;
+		}
+	}
+
+	// Append mode keeps every write at the end even with another process appending too
+	file = fopen(path.c_str( ), "ab");
+	if (!file) {
+		cerr << "Failed to open " << path << endl;
+		return false;
+	}
+	if (fileSize == 0) {
+		uint8_t header[HEADER_SIZE];
+		memcpy(header, MAGIC, 4);
+		writeU32(header + 4, VERSION);
+		if (fwrite(header, 1, HEADER_SIZE, file) != HEADER_SIZE || fflush(file) != 0) {
+			cerr << "Failed to write " << path << endl;
+			fclose(file);
+			file = nullptr;
+			return false;
+		}
+	}
+	return true;
+}
+
+void HighScores::close( ) {
+	lock_guard<mutex> guard(lock);
+	if (!file) return;
+
+	if (durable) fsync_(file);
+	fclose(file);
+	file = nullptr;
+}
+
+bool HighScores::isOpen( ) const {
+	lock_guard<mutex> guard(lock);
+	return file != nullptr;
+}
+
+void HighScores::setDurable(bool value) {
+	lock_guard<mutex> guard(lock);
+	durable = value;
+}
+
+uint64_t HighScores::append(const ScoreRecord& record) {
+	uint8_t bytes[RECORD_SIZE];
+	encode(record, bytes);
+
+	lock_guard<mutex> guard(lock);
+	if (file) {
+		// One fwrite of a whole record, a crash can only tear the last one
+		bool written = fwrite(bytes, 1, RECORD_SIZE, file) == RECORD_SIZE && fflush(file) == 0;
+		if (written && durable) written = fsync_(file) == 0;
+		if (!written) cerr << "Failed to write score to " << path << endl;
+	}
+	index(record);
+	return 1 + stats.records - countUpTo(bucketOf(record.score));
+}
+
+uint32_t HighScores::bucketOf(uint32_t score) {
+	return min(score / SCORE_STEP, BUCKETS - 1);
+}
+
+void HighScores::index(const ScoreRecord& record) {
+	for (uint32_t i = bucketOf(record.score) + 1; i <= BUCKETS; i += i & (0 - i)) tree[i]++;
+	stats.records++;
+
+	// Ties keep the earlier game ahead
+	auto position = upper_bound(top.begin( ), top.end( ), record, [ ](const ScoreRecord& a, const ScoreRecord& b) {
+		return a.score > b.score;
+	});
+	if (position - top.begin( ) < static_cast<ptrdiff_t>(TOP_KEPT)) {
+		top.insert(position, record);
+		if (top.size( ) > TOP_KEPT) top.pop_back( );
+	}
+}
+
+uint64_t HighScores::countUpTo(uint32_t bucket) const {
+	uint64_t count = 0;
+	for (uint32_t i = bucket + 1; i > 0; i -= i & (0 - i)) count += tree[i];
+	return count;
+}
+
+uint64_t HighScores::rankOf(uint32_t score) const {
+	lock_guard<mutex> guard(lock);
+	return 1 + stats.records - countUpTo(bucketOf(score));
+}
+
+uint64_t HighScores::size( ) const {
+	lock_guard<mutex> guard(lock);
+	return stats.records;
+}
+
+vector<ScoreRecord> HighScores::topK(size_t k) const {
+	lock_guard<mutex> guard(lock);
+	return vector<ScoreRecord>(top.begin( ), top.begin( ) + min(k, top.size( )));
+}
+
+HighScores::Stats HighScores::getStats( ) const {
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
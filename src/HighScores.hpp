@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One finished game
+struct ScoreRecord {
+	uint32_t score = 0;
+	uint32_t lines = 0;
+	uint16_t level = 0;
+	uint64_t seed = 0;
+	uint32_t durationMs = 0;
+	uint32_t finishedAt = 0;    // unix time in seconds
+};
+
+// Persistent high scores: an append-only file of fixed size records, each with its own CRC32.
+// open( ) streams the file once to build the index, a torn last record from a crash is cut off and
+// any other corrupt record skipped. The index counts scores per bucket in a Fenwick tree, so rank
+// queries are O(log n) and its size does not grow with the number of records; only the best
+// TOP_KEPT records stay in memory. Safe to share between threads.
+class HighScores {
+public:
+	static constexpr uint32_t VERSION = 1;
+	static constexpr size_t HEADER_SIZE = 8;    // "TSCR", u32 version
+	static constexpr size_t RECORD_SIZE = 32;   // all integers little endian, u32 CRC32 last
+	// Scores only move in steps of 100, so a bucket per step keeps ranks exact up to the last
+	// bucket, which collects everything above
+	static constexpr uint32_t SCORE_STEP = 100;
+	static constexpr uint32_t BUCKETS = 1 << 18;
+	static constexpr size_t TOP_KEPT = 100;
+
+	struct Stats {
+		uint64_t records = 0;
+		uint64_t corrupt = 0;       // skipped while opening
+		uint64_t truncatedBytes = 0;
+	};
+
+private:
+	static uint32_t bucketOf(uint32_t score);
+	void index(const ScoreRecord& record);
+	// Number of indexed records in buckets [0, bucket]
+	uint64_t countUpTo(uint32_t bucket) const;
+
+	mutable mutex lock;
+	FILE* file = nullptr;
+	string path;
+	bool durable = true;
+	vector<uint32_t> tree;      // Fenwick tree over score buckets, 1 based
+	vector<ScoreRecord> top;    // best first
+	Stats stats;
+
+public:
+	HighScores( );
+	~HighScores( );
+	HighScores(const HighScores&) = delete;
+	HighScores& operator=(const HighScores&) = delete;
+
+	// Creates the file if missing, false if it can't be opened or isn't a score file
+	bool open(const string& path);
+	void close( );
+	bool isOpen( ) const;
+
+	// With durable off append( ) only flushes to the OS instead of syncing to disk, e.g. for
+	// self-play writing thousands of games a second
+	void setDurable(bool durable);
+	// Writes the record and indexes it, returns its rank
+	uint64_t append(const ScoreRecord& record);
+
+	// 1 + the number of recorded games that scored more
+	uint64_t rankOf(uint32_t score) const;
+	uint64_t size( ) const;
+	// The best k records, at most TOP_KEPT
+	vector<ScoreRecord> topK(size_t k) const;
+	Stats getStats( ) const;
+
+	static void encode(const ScoreRecord& record, uint8_t out[RECORD_SIZE]);
+	// False when the CRC does not match
+	static bool decode(const uint8_t in[RECORD_SIZE], ScoreRecord& record);
+};
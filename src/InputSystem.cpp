@@ -0,0 +1,129 @@
+#include "InputSystem.hpp"
+
+#include <algorithm>
+
+InputSystem::InputSystem(const InputConfig& config) : config(config), frequency(SDL_GetPerformanceFrequency( )) { }
+
+uint64_t InputSystem::eventTime(Uint32 timestampMs) const {
+	// SDL stamps events in SDL_GetTicks milliseconds, moved onto the performance counter by their age
+	uint64_t now = SDL_GetPerformanceCounter( );
+	Uint32 ticks = SDL_GetTicks( );
+	Uint32 age = static_cast<int32_t>(ticks - timestampMs) > 0 ? ticks - timestampMs : 0;
+	uint64_t ageCounts = static_cast<uint64_t>(age) * frequency / 1000;
+	return now > ageCounts ? now - ageCounts : now;
+}
+
+bool InputSystem::handleEvent(const SDL_Event& event) {
+	if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) return false;
+
+	InputAction action;
+	switch (event.key.keysym.sym) {
+	case SDLK_LEFT:
+	case SDLK_a:
+		action = InputAction::LEFT;
+		break;
+	case SDLK_RIGHT:
+	case SDLK_d:
+		action = InputAction::RIGHT;
+		break;
+	case SDLK_DOWN:
+	case SDLK_s:
+		action = InputAction::DROP;
+		break;
+	case SDLK_SPACE:
+		action = InputAction::ROTATE;
+		break;
+	default:
+		return false;
+	}
+
+	// OS key repeat is ignored, held directions repeat on the DAS/ARR schedule instead
+	if (event.key.repeat) return true;
+
+	queued.push_back(KeyEvent{ action, event.type == SDL_KEYDOWN, eventTime(event.key.timestamp) });
+	return true;
+}
+
+void InputSystem::apply(const function<bool(InputAction)>& perform) {
+	uint64_t now = SDL_GetPerformanceCounter( );
+	uint64_t das = static_cast<uint64_t>(config.dasMs) * frequency / 1000;
+	stable_sort(queued.begin( ), queued.end( ), [ ](const KeyEvent& a, const KeyEvent& b) { return a.time < b.time; });
+
+	for (const KeyEvent& event : queued) {
+		// Repeats that fell due before this event happen before it
+		repeatUntil(event.time, perform);
+
+		HeldKey& key = held[static_cast<size_t>(event.action)];
+		bool isDirection = event.action == InputAction::LEFT || event.action == InputAction::RIGHT;
+
+		if (event.pressed) {
+			if (key.down) continue;
+			key.down = true;
+			key.pressedAt = event.time;
+			key.repeats = 0;
+			if (isDirection) lastDirection = event.action;
+			if (perform(event.action)) unpresented.push_back(event.time);
+			continue;
+		}
+
+		key.down = false;
+		if (isDirection && event.action == lastDirection) {
+			// Falling back to the other held direction continues with its shift already charged
+			InputAction other = event.action == InputAction::LEFT ? InputAction::RIGHT : InputAction::LEFT;
+			HeldKey& otherKey = held[static_cast<size_t>(other)];
+			if (otherKey.down) {
+				lastDirection = other;
+				otherKey.pressedAt = event.time > das ? event.time - das : 0;
+				otherKey.repeats = 0;
+			}
+		}
+	}
+	queued.clear( );
+
+	repeatUntil(now, perform);
+}
+
+void InputSystem::repeatUntil(uint64_t time, const function<bool(InputAction)>& perform) {
+	HeldKey& key = held[static_cast<size_t>(lastDirection)];
+	if (!key.down) return;
+
+	uint64_t das = static_cast<uint64_t>(config.dasMs) * frequency / 1000;
+	uint64_t arr = static_cast<uint64_t>(config.arrMs) * frequency / 1000;
+
+	if (arr == 0) {
+		// Instant repeat: slide to the wall once the shift is charged
+		uint64_t due = key.pressedAt + das;
+		if (due > time) return;
+		for (int moves = 0; moves < 64 && perform(lastDirection); moves++)
+			unpresented.push_back(key.repeats++ == 0 ? due : time);
+		return;
+	}
+
+	// Each repeat happens at its scheduled time, however the frames fall
+	while (true) {
+		uint64_t due = key.pressedAt + das + key.repeats * arr;
+		if (due > time) return;
+		key.repeats++;
+		if (perform(lastDirection)) unpresented.push_back(due);
+	}
+}
+
+void InputSystem::presented( ) {
+	if (unpresented.empty( )) return;
+
+	uint64_t now = SDL_GetPerformanceCounter( );
+	for (uint64_t intended : unpresented)
+		latency.record(now > intended ? (now - intended) * 1000000000ull / frequency : 0);
+	unpresented.clear( );
+}
+
+void InputSystem::reset( ) {
+	queued.clear( );
+	held = { };
+	unpresented.clear( );
+}
+
+const LatencyHistogram& InputSystem::getLatency( ) const { return latency; }
+void InputSystem::clearLatency( ) { latency.reset( ); }
+void InputSystem::setConfig(const InputConfig& config) { this->config = config; }
+const InputConfig& InputSystem::getConfig( ) const { return config; }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+extern "C" {
+#include <SDL2/SDL.h>
+}
+
+#include "LatencyHistogram.hpp"
+
+using namespace std;
+
+enum class InputAction {
+	LEFT,
+	RIGHT,
+	DROP,
+	ROTATE,
+	COUNT,
+};
+
+struct InputConfig {
+	uint32_t dasMs = 150;   // delayed auto shift: how long a direction is held before it repeats
+	uint32_t arrMs = 50;    // auto repeat rate once shifting, 0 moves to the wall at once
+};
+
+// Single player input. Key events keep their SDL timestamps and are replayed in time order,
+// held directions repeat on the DAS/ARR schedule measured from the real key press instead of
+// the OS key repeat, and every applied action is timed until the frame showing it is presented.
+class InputSystem {
+private:
+	struct KeyEvent {
+		InputAction action;
+		bool pressed;
+		uint64_t time;          // performance counter ticks
+	};
+
+	struct HeldKey {
+		bool down = false;
+		uint64_t pressedAt = 0;
+		uint32_t repeats = 0;
+	};
+
+	void repeatUntil(uint64_t time, const function<bool(InputAction)>& perform);
+	uint64_t eventTime(Uint32 timestampMs) const;
+
+	InputConfig config;
+	uint64_t frequency;
+	vector<KeyEvent> queued;
+	array<HeldKey, static_cast<size_t>(InputAction::COUNT)> held;
+	InputAction lastDirection = InputAction::LEFT;
+
+	// Intended times of the actions applied since the last present
+	vector<uint64_t> unpresented;
+	LatencyHistogram latency;
+
+public:
+	explicit InputSystem(const InputConfig& config = InputConfig( ));
+
+	// Queues gameplay key presses and releases, false for every other event
+	bool handleEvent(const SDL_Event& event);
+	// Applies queued events and due auto repeats in time order up to now.
+	// perform returns whether the action changed the board.
+	void apply(const function<bool(InputAction)>& perform);
+	// Call right after SDL_RenderPresent, records input-to-present latency of what was just shown
+	void presented( );
+	// Forgets held keys and queued events, e.g. when a new game starts
+	void reset( );
+
+	const LatencyHistogram& getLatency( ) const;
+	void clearLatency( );
+	void setConfig(const InputConfig& config);
+	const InputConfig& getConfig( ) const;
+};
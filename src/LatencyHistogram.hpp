@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+// Log-linear nanosecond histogram, four buckets per power of two (~19% resolution).
+// Recording is one relaxed atomic add so any thread can write while a reporter drains it.
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKETS = 4;
+	static constexpr int BUCKETS = 64 * SUB_BUCKETS;
+
+private:
+	array<atomic<uint64_t>, BUCKETS> counts{ };
+	atomic<uint64_t> maximum{ 0 };
+
+	// Index of the highest set bit, value must not be 0
+	static int highestBit(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<int>(index);
+#elif defined(__GNUC__)
+		return 63 - __builtin_clzll(value);
+#else
+		int index = 0;
+		while (value >>= 1) index++;
+		return index;
+#endif
+	}
+
+	static int bucketOf(uint64_t nanoseconds) {
+		if (nanoseconds < SUB_BUCKETS) return static_cast<int>(nanoseconds);
+		int msb = highestBit(nanoseconds);
+		int sub = static_cast<int>((nanoseconds >> (msb - 2)) & (SUB_BUCKETS - 1));
+		return (msb - 1) * SUB_BUCKETS + sub;
+	}
+
+	static uint64_t upperBoundOf(int bucket) {
+		if (bucket < SUB_BUCKETS) return bucket;
+		int msb = bucket / SUB_BUCKETS + 1;
+		uint64_t sub = bucket % SUB_BUCKETS;
+		return ((SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+	}
+
+public:
+	void record(uint64_t nanoseconds) {
+		counts[bucketOf(nanoseconds)].fetch_add(1, memory_order_relaxed);
+		uint64_t seen = maximum.load(memory_order_relaxed);
+		while (nanoseconds > seen && !maximum.compare_exchange_weak(seen, nanoseconds, memory_order_relaxed)) { }
+	}
+
+	// Moves everything recorded so far into the target and resets this histogram
+	void drainInto(LatencyHistogram& target) {
+		for (int i = 0; i < BUCKETS; i++) {
+			uint64_t count = counts[i].exchange(0, memory_order_relaxed);
+			if (count) target.counts[i].fetch_add(count, memory_order_relaxed);
+		}
+		uint64_t seen = maximum.exchange(0, memory_order_relaxed);
+		uint64_t targetMax = target.maximum.load(memory_order_relaxed);
+		if (seen > targetMax) target.maximum.store(seen, memory_order_relaxed);
+	}
+
+	void reset( ) {
+		for (auto& bucket : counts) bucket.store(0, memory_order_relaxed);
+		maximum.store(0, memory_order_relaxed);
+	}
+
+	uint64_t count( ) const {
+		uint64_t total = 0;
+		for (const auto& bucket : counts) total += bucket.load(memory_order_relaxed);
+		return total;
+	}
+
+	// Upper bound of the bucket holding the given quantile, 0 when empty
+	uint64_t percentile(double quantile) const {
+		uint64_t total = count( );
+		if (total == 0) return 0;
+		uint64_t rank = static_cast<uint64_t>(quantile * (total - 1)) + 1;
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			seen += counts[i].load(memory_order_relaxed);
+			if (seen >= rank) return upperBoundOf(i) < max( ) ? upperBoundOf(i) : max( );
+		}
+		return max( );
+	}
+
+	// Samples in the buckets that lie entirely at or below the bound
+	uint64_t countAtMost(uint64_t nanoseconds) const {
+		uint64_t total = 0;
+		for (int i = 0; i < BUCKETS && upperBoundOf(i) <= nanoseconds; i++)
+			total += counts[i].load(memory_order_relaxed);
+		return total;
+	}
+
+	uint64_t max( ) const { return maximum.load(memory_order_relaxed); }
+};
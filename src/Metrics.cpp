@@ -0,0 +1,202 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace {
+	enum class MetricType {
+		COUNTER,
+		GAUGE,
+		HISTOGRAM,
+	};
+
+	struct Entry {
+		string name;
+		string help;
+		MetricType type;
+		void* metric;
+	};
+
+	// Creation and export take the lock, updates never do
+	struct Registry {
+		mutex lock;
+		vector<Entry> entries;
+		deque<Metrics::Counter> counters;
+		deque<Metrics::Gauge> gauges;
+		deque<Metrics::Histogram> histograms;
+	};
+
+	Registry& registry( ) {
+		static Registry instance;
+		return instance;
+	}
+
+	template <typename T>
+	T& findOrCreate(const char* name, const char* help, MetricType type, deque<T>& storage) {
+		Registry& metrics = registry( );
+		lock_guard<mutex> guard(metrics.lock);
+		for (const Entry& entry : metrics.entries)
+			if (entry.name == name && entry.type == type) return *static_cast<T*>(entry.metric);
+
+		storage.emplace_back( );
+		metrics.entries.push_back({ name, help, type, &storage.back( ) });
+		return storage.back( );
+	}
+
+	// Histogram bucket bounds in seconds, from a fraction of a frame to a full stall
+	constexpr double BUCKET_BOUNDS[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.133, 0.25, 0.5, 1.0 };
+
+	const char* typeName(MetricType type) {
+		switch (type) {
+		case MetricType::COUNTER: return "counter";
+		case MetricType::GAUGE: return "gauge";
+		default: return "histogram";
+		}
+	}
+
+	void appendLine(string& out, const char* format, ...) {
+		char line[256];
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+		if (length > 0) out.append(line, min<size_t>(length, sizeof(line) - 1));
+	}
+}
+
+namespace Metrics {
+	Counter& counter(const char* name, const char* help) {
+		return findOrCreate(name, help, MetricType::COUNTER, registry( ).counters);
+	}
+
+	Gauge& gauge(const char* name, const char* help) {
+		return findOrCreate(name, help, MetricType::GAUGE, registry( ).gauges);
+	}
+
+	Histogram& histogram(const char* name, const char* help) {
+		return findOrCreate(name, help, MetricType::HISTOGRAM, registry( ).histograms);
+	}
+
+	void registerCounter(const char* name, const char* help, Counter& counter) {
+		Registry& metrics = registry( );
+		lock_guard<mutex> guard(metrics.lock);
+		metrics.entries.push_back({ name, help, MetricType::COUNTER, &counter });
+	}
+
+	string renderText( ) {
+		Registry& metrics = registry( );
+		lock_guard<mutex> guard(metrics.lock);
+
+		string out;
+		out.reserve(metrics.entries.size( ) * 160);
+		for (const Entry& entry : metrics.entries) {
+			out += "# HELP " + entry.name + " " + entry.help + "\n";
+			out += "# TYPE " + entry.name + " " + typeName(entry.type) + "\n";
+
+			const char* name = entry.name.c_str( );
+			if (entry.type == MetricType::COUNTER) {
+				appendLine(out, "%s %llu\n", name, static_cast<unsigned long long>(static_cast<Counter*>(entry.metric)->value( )));
+			} else if (entry.type == MetricType::GAUGE) {
+				appendLine(out, "%s %lld\n", name, static_cast<long long>(static_cast<Gauge*>(entry.metric)->value( )));
+			} else {
+				const Histogram& histogram = *static_cast<Histogram*>(entry.metric);
+				const LatencyHistogram& buckets = histogram.getBuckets( );
+				for (double bound : BUCKET_BOUNDS)
+					appendLine(out, "%s_bucket{le=\"%g\"} %llu\n", name, bound,
+						static_cast<unsigned long long>(buckets.countAtMost(static_cast<uint64_t>(bound * 1e9))));
+				unsigned long long total = static_cast<unsigned long long>(buckets.count( ));
+				appendLine(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, total);
+				appendLine(out, "%s_sum %.9f\n", name, histogram.getSumNs( ) / 1e9);
+				appendLine(out, "%s_count %llu\n", name, total);
+			}
+		}
+		return out;
+	}
+}
+
+MetricsExporter::~MetricsExporter( ) { stop( ); }
+
+bool MetricsExporter::open(const string& target, uint32_t interval) {
+	stop( );
+	bool isPort = !target.empty( ) && all_of(target.begin( ), target.end( ), [ ](char c) { return c >= '0' && c <= '9'; });
+	if (isPort) {
+		if (!listener.listen(static_cast<uint16_t>(atoi(target.c_str( ))))) return false;
+	} else {
+		path = target;
+	}
+	intervalMs = max<uint32_t>(interval, 100);
+
+	running = true;
+	worker = thread(&MetricsExporter::exportLoop, this);
+	return true;
+}
+
+void MetricsExporter::stop( ) {
+	if (!running.exchange(false)) return;
+	if (worker.joinable( )) worker.join( );
+	// One last dump, so a file always ends up with the final values
+	if (!path.empty( )) writeFile( );
+	listener.close( );
+}
+
+void MetricsExporter::exportLoop( ) {
+	using clock = chrono::steady_clock;
+	auto nextWrite = clock::now( );
+
+	while (running.load(memory_order_relaxed)) {
+		TcpSocket client;
+		while (listener.accept(client)) serve(client);
+
+		if (!path.empty( ) && clock::now( ) >= nextWrite) {
+			writeFile( );
+			nextWrite = clock::now( ) + chrono::milliseconds(intervalMs);
+		}
+		this_thread::sleep_for(chrono::milliseconds(50));
+	}
+}
+
+void MetricsExporter::serve(TcpSocket& client) {
+	// Whatever was asked for gets the metrics, the request only has to arrive within a second
+	string request;
+	uint8_t buffer[1024];
+	auto deadline = chrono::steady_clock::now( ) + chrono::seconds(1);
+	while (request.find("\r\n\r\n") == string::npos && chrono::steady_clock::now( ) < deadline) {
+		int received = client.receive(buffer, sizeof(buffer));
+		if (received < 0) return;
+		if (received == 0) this_thread::sleep_for(chrono::milliseconds(1));
+		else request.append(reinterpret_cast<char*>(buffer), received);
+	}
+
+	string body = Metrics::renderText( );
+	string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size( )) +
+		"\r\nConnection: close\r\n\r\n" + body;
+
+	size_t sent = 0;
+	while (sent < response.size( ) && chrono::steady_clock::now( ) < deadline + chrono::seconds(1)) {
+		int written = client.send(reinterpret_cast<const uint8_t*>(response.data( )) + sent, response.size( ) - sent);
+		if (written < 0) return;
+		if (written == 0) this_thread::sleep_for(chrono::milliseconds(1));
+		sent += written;
+	}
+}
+
+void MetricsExporter::writeFile( ) {
+	// Written beside the target and renamed over it, a reader never sees half a dump
+	string temporary = path + ".tmp";
+	FILE* file = fopen(temporary.c_str( ), "wb");
+	if (!file) return;
+	string body = Metrics::renderText( );
+	bool written = fwrite(body.data( ), 1, body.size( ), file) == body.size( );
+	fclose(file);
+	if (!written) return;
+#ifdef _WIN32
+	remove(path.c_str( ));
+#endif
+	rename(temporary.c_str( ), path.c_str( ));
+}
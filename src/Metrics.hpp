@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "LatencyHistogram.hpp"
+#include "Net.hpp"
+
+using namespace std;
+
+// Process wide metrics in the Prometheus text format. Metrics are created once, usually into a
+// static reference next to the code they measure, and updating one is a relaxed atomic add.
+namespace Metrics {
+	constexpr size_t SHARDS = 16;
+
+	// Each thread adds to its own cache line, reading sums them
+	inline size_t threadShard( ) {
+		static atomic<size_t> nextShard{ 0 };
+		thread_local size_t shard = nextShard.fetch_add(1, memory_order_relaxed) % SHARDS;
+		return shard;
+	}
+
+	class Counter {
+	private:
+		struct alignas(64) Shard {
+			atomic<uint64_t> value{ 0 };
+		};
+		array<Shard, SHARDS> shards{ };
+
+	public:
+		// Constant initialized, so a global counter works before any constructor ran
+		constexpr Counter( ) = default;
+		Counter(const Counter&) = delete;
+		Counter& operator=(const Counter&) = delete;
+
+		void add(uint64_t amount = 1) { shards[threadShard( )].value.fetch_add(amount, memory_order_relaxed); }
+		uint64_t value( ) const {
+			uint64_t total = 0;
+			for (const auto& shard : shards) total += shard.value.load(memory_order_relaxed);
+			return total;
+		}
+	};
+
+	class Gauge {
+	private:
+		atomic<int64_t> current{ 0 };
+
+	public:
+		void set(int64_t value) { current.store(value, memory_order_relaxed); }
+		void add(int64_t amount) { current.fetch_add(amount, memory_order_relaxed); }
+		int64_t value( ) const { return current.load(memory_order_relaxed); }
+	};
+
+	// Durations in nanoseconds, exported in seconds
+	class Histogram {
+	private:
+		LatencyHistogram buckets;
+		atomic<uint64_t> sumNs{ 0 };
+
+	public:
+		void observe(uint64_t nanoseconds) {
+			buckets.record(nanoseconds);
+			sumNs.fetch_add(nanoseconds, memory_order_relaxed);
+		}
+		const LatencyHistogram& getBuckets( ) const { return buckets; }
+		uint64_t getSumNs( ) const { return sumNs.load(memory_order_relaxed); }
+	};
+
+	// Returns the metric of that name, creating it on first use. Names follow Prometheus rules.
+	Counter& counter(const char* name, const char* help);
+	Gauge& gauge(const char* name, const char* help);
+	Histogram& histogram(const char* name, const char* help);
+	// Exports a counter that lives elsewhere, e.g. one updated from operator new
+	void registerCounter(const char* name, const char* help, Counter& counter);
+
+	string renderText( );
+}
+
+// Serves the metrics over HTTP on localhost and/or rewrites them into a file, from its own thread
+class MetricsExporter {
+private:
+	void exportLoop( );
+	void serve(TcpSocket& client);
+	void writeFile( );
+
+	TcpSocket listener;
+	string path;
+	uint32_t intervalMs = 1000;
+	thread worker;
+	atomic<bool> running{ false };
+
+public:
+	MetricsExporter( ) = default;
+	~MetricsExporter( );
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+	// A port number serves http://127.0.0.1:<port>/metrics, anything else is a file rewritten every intervalMs
+	bool open(const string& target, uint32_t intervalMs = 1000);
+	void stop( );
+};
@@ -0,0 +1,70 @@
+#include "MosaicRenderer.hpp"
+#include "TileRenderer.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+namespace {
+	Metrics::Counter& tilesDrawn = Metrics::counter("tetris_tiles_drawn_total", "Background tiles redrawn by the tile renderer");
+	Metrics::Counter& textureCreations = Metrics::counter("tetris_texture_creations_total", "Textures created");
+
+	constexpr SDL_Color WALL{ 165, 42, 42, 255 };
+	constexpr SDL_Color IDLE_WALL{ 128, 128, 128, 255 };
+	constexpr SDL_Color WHITE{ 255, 255, 255, 255 };
+	constexpr SDL_Color GAP{ 0, 0, 0, 255 };
+}
+
+MosaicRenderer::MosaicRenderer(Renderer& owner, int boards)
+	: owner(owner), mosaic(boards), texture(nullptr, AssetManager::destroyTexture) { }
+
+bool MosaicRenderer::init( ) {
+	TRACE_ZONE("MosaicRenderer::init");
+	using Surface = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+	TileEngine& engine = mosaic.getEngine( );
+	BoardMosaic::Tiles tiles;
+
+	tiles.empty = engine.addTile(TileRenderer::bake(nullptr, 0, 0, WHITE, true).data( ));
+	TileRenderer::Tile gap;
+	gap.fill(static_cast<uint32_t>(GAP.r) << 24 | GAP.g << 16 | GAP.b << 8 | 255);
+	tiles.gap = engine.addTile(gap.data( ));
+
+	Surface border(TileRenderer::loadRgba(owner.textures[TetrisAssets::BORDER]), SDL_FreeSurface);
+	if (!border) return false;
+	tiles.wall = engine.addTile(TileRenderer::bake(border.get( ), 0, 0, WALL, true).data( ));
+	tiles.idleWall = engine.addTile(TileRenderer::bake(border.get( ), 0, 0, IDLE_WALL, true).data( ));
+
+	// Every cell value's sprite in every palette color, COUNT is the only value no cell holds
+	for (int shape = 0; shape < BoardMosaic::SHAPE_COUNT; shape++) {
+		if (static_cast<TetrominoShape>(shape) == TetrominoShape::COUNT) continue;
+		TetrisAssets asset = owner.shapeToAsset(static_cast<TetrominoShape>(shape));
+		Surface sprite(TileRenderer::loadRgba(owner.textures[asset]), SDL_FreeSurface);
+		if (!sprite) return false;
+		for (int color = 0; color < BoardMosaic::PALETTE_SIZE; color++)
+			tiles.cells[shape][color] = engine.addTile(TileRenderer::bake(sprite.get( ), 0, 0, owner.paletteColor(color), true).data( ));
+	}
+	mosaic.setTiles(tiles);
+
+	texture.reset(AssetManager::trackTexture(SDL_CreateTexture(owner.renderer.get( ), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, engine.getWidth( ), engine.getHeight( ))));
+	if (!texture) {
+		SDL_Log("Failed to create the %dx%d mosaic texture: %s", engine.getWidth( ), engine.getHeight( ), SDL_GetError( ));
+		return false;
+	}
+	textureCreations.add( );
+	return true;
+}
+
+BoardMosaic& MosaicRenderer::getMosaic( ) { return mosaic; }
+
+void MosaicRenderer::render( ) {
+	TRACE_ZONE("MosaicRenderer::render");
+	TileEngine& engine = mosaic.getEngine( );
+	uint64_t drawnBefore = engine.getStats( ).tilesDrawn;
+	TileEngine::Rect changed = mosaic.compose( );
+	tilesDrawn.add(engine.getStats( ).tilesDrawn - drawnBefore);
+	if (changed.w > 0) {
+		SDL_Rect area{ changed.x, changed.y, changed.w, changed.h };
+		const uint32_t* first = engine.getPixels( ) + changed.y * engine.getWidth( ) + changed.x;
+		SDL_UpdateTexture(texture.get( ), &area, first, engine.getPitch( ));
+	}
+	owner.presentTexture(texture.get( ), engine.getWidth( ), engine.getHeight( ));
+	SDL_SetRenderTarget(owner.renderer.get( ), owner.canvas.get( ));
+}
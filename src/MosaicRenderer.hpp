@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+extern "C" {
+#include <SDL2/SDL.h>
+}
+
+#include "Renderer.hpp"
+#include "BoardMosaic.hpp"
+
+using namespace std;
+
+// Draws a BoardMosaic with the game's sprites, baked into tiles once like TileRenderer's. Each frame
+// the changed part of the composed grid is uploaded to one streaming texture and the whole grid is
+// scaled onto the window in a single copy, so the cost per board is a few tile compares plus the
+// tiles that actually changed, not a draw call per cell.
+class MosaicRenderer {
+private:
+	Renderer& owner;
+	BoardMosaic mosaic;
+	unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture;
+
+public:
+	MosaicRenderer(Renderer& owner, int boards);
+
+	// Bakes the tiles and creates the texture, false when an asset is missing
+	bool init( );
+	BoardMosaic& getMosaic( );
+	// Composes, uploads what changed and presents
+	void render( );
+};
@@ -0,0 +1,291 @@
+#include "Net.hpp"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef _WIN32
+typedef int socklen_t;
+static const SocketHandle INVALID_HANDLE = INVALID_SOCKET;
+#define closesocket_ closesocket
+#else
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+static const SocketHandle INVALID_HANDLE = -1;
+#define closesocket_ ::close
+#endif
+
+static void setNonBlocking(SocketHandle handle) {
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+	fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static bool lastCallWouldBlock( ) {
+#ifdef _WIN32
+	return WSAGetLastError( ) == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static bool ensureNetInit( ) {
+#ifdef _WIN32
+	static bool initialized = false;
+	if (!initialized) {
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0) return false;
+		initialized = true;
+	}
+#endif
+	return true;
+}
+
+bool NetAddress::resolve(const string& host, uint16_t port, NetAddress& out) {
+	if (!ensureNetInit( )) return false;
+
+	addrinfo hints{ };
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.empty( ) ? "127.0.0.1" : host.c_str( ), nullptr, &hints, &result) != 0 || !result) {
+		cerr << "Failed to resolve " << host << endl;
+		return false;
+	}
+
+	memcpy(&out.addr, result->ai_addr, sizeof(sockaddr_in));
+	out.addr.sin_port = htons(port);
+	freeaddrinfo(result);
+	return true;
+}
+
+bool NetAddress::parse(const string& hostAndPort, NetAddress& out) {
+	size_t colon = hostAndPort.rfind(':');
+	string host = colon == string::npos ? "" : hostAndPort.substr(0, colon);
+	string port = colon == string::npos ? hostAndPort : hostAndPort.substr(colon + 1);
+
+	int portNumber = atoi(port.c_str( ));
+	if (portNumber <= 0 || portNumber > 65535) return false;
+
+	return resolve(host, static_cast<uint16_t>(portNumber), out);
+}
+
+bool NetAddress::operator==(const NetAddress& other) const {
+	return addr.sin_addr.s_addr == other.addr.sin_addr.s_addr && addr.sin_port == other.addr.sin_port;
+}
+
+string NetAddress::toString( ) const {
+	char host[INET_ADDRSTRLEN] = { };
+	inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+	return string(host) + ":" + to_string(ntohs(addr.sin_port));
+}
+
+UdpSocket::UdpSocket( ) : handle(INVALID_HANDLE) { }
+
+UdpSocket::~UdpSocket( ) { close( ); }
+
+bool UdpSocket::open(uint16_t port) {
+	close( );
+	if (!ensureNetInit( )) return false;
+
+	handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (handle == INVALID_HANDLE) {
+		cerr << "Failed to create UDP socket" << endl;
+		return false;
+	}
+
+	sockaddr_in local{ };
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(handle, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+		cerr << "Failed to bind UDP port " << port << endl;
+		closesocket_(handle);
+		handle = INVALID_HANDLE;
+		return false;
+	}
+
+	setNonBlocking(handle);
+
+	valid = true;
+	return true;
+}
+
+void UdpSocket::close( ) {
+	if (valid) closesocket_(handle);
+	handle = INVALID_HANDLE;
+	valid = false;
+}
+
+bool UdpSocket::sendTo(const NetAddress& to, const uint8_t* data, size_t size) {
+	if (!valid) return false;
+	return sendto(handle, reinterpret_cast<const char*>(data), static_cast<int>(size), 0,
+		reinterpret_cast<const sockaddr*>(&to.addr), sizeof(to.addr)) == static_cast<int>(size);
+}
+
+int UdpSocket::receiveFrom(NetAddress& from, uint8_t* buffer, size_t capacity) {
+	if (!valid) return -1;
+	socklen_t length = sizeof(from.addr);
+	int received = static_cast<int>(recvfrom(handle, reinterpret_cast<char*>(buffer), static_cast<int>(capacity), 0,
+		reinterpret_cast<sockaddr*>(&from.addr), &length));
+	return received < 0 ? -1 : received;
+}
+
+bool UdpSocket::isOpen( ) const { return valid; }
+
+uint16_t UdpSocket::getLocalPort( ) const {
+	if (!valid) return 0;
+	sockaddr_in local{ };
+	socklen_t length = sizeof(local);
+	getsockname(handle, reinterpret_cast<sockaddr*>(&local), &length);
+	return ntohs(local.sin_port);
+}
+
+TcpSocket::TcpSocket( ) : handle(INVALID_HANDLE) { }
+
+TcpSocket::~TcpSocket( ) { close( ); }
+
+TcpSocket::TcpSocket(TcpSocket&& other) noexcept : handle(other.handle), valid(other.valid) {
+	other.handle = INVALID_HANDLE;
+	other.valid = false;
+}
+
+TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept {
+	if (this != &other) {
+		close( );
+		handle = other.handle;
+		valid = other.valid;
+		other.handle = INVALID_HANDLE;
+		other.valid = false;
+	}
+	return *this;
+}
+
+bool TcpSocket::listen(uint16_t port, bool loopbackOnly) {
+	close( );
+	if (!ensureNetInit( )) return false;
+
+	handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (handle == INVALID_HANDLE) {
+		cerr << "Failed to create TCP socket" << endl;
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in local{ };
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(handle, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || ::listen(handle, 16) != 0) {
+		cerr << "Failed to listen on TCP port " << port << endl;
+		closesocket_(handle);
+		handle = INVALID_HANDLE;
+		return false;
+	}
+	setNonBlocking(handle);
+
+	valid = true;
+	return true;
+}
+
+bool TcpSocket::accept(TcpSocket& client) {
+	if (!valid) return false;
+	SocketHandle accepted = ::accept(handle, nullptr, nullptr);
+	if (accepted == INVALID_HANDLE) return false;
+
+	setNonBlocking(accepted);
+	client.close( );
+	client.handle = accepted;
+	client.valid = true;
+	return true;
+}
+
+bool TcpSocket::connect(const NetAddress& to) {
+	close( );
+	if (!ensureNetInit( )) return false;
+
+	handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (handle == INVALID_HANDLE || ::connect(handle, reinterpret_cast<const sockaddr*>(&to.addr), sizeof(to.addr)) != 0) {
+		cerr << "Failed to connect to " << to.toString( ) << endl;
+		if (handle != INVALID_HANDLE) closesocket_(handle);
+		handle = INVALID_HANDLE;
+		return false;
+	}
+	setNonBlocking(handle);
+
+	valid = true;
+	return true;
+}
+
+void TcpSocket::close( ) {
+	if (valid) closesocket_(handle);
+	handle = INVALID_HANDLE;
+	valid = false;
+}
+
+int TcpSocket::send(const uint8_t* data, size_t size) {
+	if (!valid) return -1;
+#ifdef MSG_NOSIGNAL
+	int flags = MSG_NOSIGNAL;
+#else
+	int flags = 0;
+#endif
+	int written = static_cast<int>(::send(handle, reinterpret_cast<const char*>(data), static_cast<int>(size), flags));
+	if (written >= 0) return written;
+	return lastCallWouldBlock( ) ? 0 : -1;
+}
+
+int TcpSocket::receive(uint8_t* buffer, size_t capacity) {
+	if (!valid) return -1;
+	int received = static_cast<int>(recv(handle, reinterpret_cast<char*>(buffer), static_cast<int>(capacity), 0));
+	if (received > 0) return received;
+	if (received == 0) return -1;
+	return lastCallWouldBlock( ) ? 0 : -1;
+}
+
+bool TcpSocket::isOpen( ) const { return valid; }
+
+void LinkConditioner::configure(uint32_t latency, uint32_t jitter, float loss) {
+	latencyMs = latency;
+	jitterMs = jitter;
+	lossPercent = loss;
+}
+
+bool LinkConditioner::isActive( ) const { return latencyMs > 0 || jitterMs > 0 || lossPercent > 0.0f; }
+
+void LinkConditioner::send(UdpSocket& socket, const NetAddress& to, const uint8_t* data, size_t size, uint32_t nowMs) {
+	if (!isActive( )) {
+		socket.sendTo(to, data, size);
+		return;
+	}
+
+	if (lossPercent > 0.0f && uniform_real_distribution<float>(0.0f, 100.0f)(rng) < lossPercent) {
+		dropped++;
+		return;
+	}
+
+	uint32_t delay = latencyMs + (jitterMs > 0 ? uniform_int_distribution<uint32_t>(0, jitterMs)(rng) : 0);
+	pending.push_back(Pending{ nowMs + delay, to, vector<uint8_t>(data, data + size) });
+	flush(socket, nowMs);
+}
+
+void LinkConditioner::flush(UdpSocket& socket, uint32_t nowMs) {
+	auto due = stable_partition(pending.begin( ), pending.end( ), [nowMs](const Pending& packet) {
+		return static_cast<int32_t>(packet.deliverAt - nowMs) > 0;
+	});
+	for (auto it = due; it != pending.end( ); ++it)
+		socket.sendTo(it->to, it->data.data( ), it->data.size( ));
+	pending.erase(due, pending.end( ));
+}
+
+uint32_t LinkConditioner::getDropped( ) const { return dropped; }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <random>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+#else
+#include <netinet/in.h>
+typedef int SocketHandle;
+#endif
+
+using namespace std;
+
+struct NetAddress {
+	sockaddr_in addr{ };
+
+	static bool resolve(const string& host, uint16_t port, NetAddress& out);
+	// Accepts "host:port" and ":port"/"port" for localhost
+	static bool parse(const string& hostAndPort, NetAddress& out);
+
+	bool operator==(const NetAddress& other) const;
+	bool operator!=(const NetAddress& other) const { return !(*this == other); }
+	string toString( ) const;
+};
+
+// Non-blocking datagram socket
+class UdpSocket {
+private:
+	SocketHandle handle;
+	bool valid = false;
+
+public:
+	UdpSocket( );
+	~UdpSocket( );
+	UdpSocket(const UdpSocket&) = delete;
+	UdpSocket& operator=(const UdpSocket&) = delete;
+
+	bool open(uint16_t port);
+	void close( );
+
+	bool sendTo(const NetAddress& to, const uint8_t* data, size_t size);
+	// Returns the datagram size or -1 when nothing is queued
+	int receiveFrom(NetAddress& from, uint8_t* buffer, size_t capacity);
+
+	bool isOpen( ) const;
+	uint16_t getLocalPort( ) const;
+};
+
+// Non-blocking stream socket, spectator feeds use it to reach any number of viewers
+class TcpSocket {
+private:
+	SocketHandle handle;
+	bool valid = false;
+
+public:
+	TcpSocket( );
+	~TcpSocket( );
+	TcpSocket(const TcpSocket&) = delete;
+	TcpSocket& operator=(const TcpSocket&) = delete;
+	TcpSocket(TcpSocket&& other) noexcept;
+	TcpSocket& operator=(TcpSocket&& other) noexcept;
+
+	// Only accepts connections from this machine unless loopbackOnly is false
+	bool listen(uint16_t port, bool loopbackOnly = true);
+	// Takes one pending connection, false when nobody is waiting
+	bool accept(TcpSocket& client);
+	// Blocks until connected, the socket is non-blocking afterwards
+	bool connect(const NetAddress& to);
+	void close( );
+
+	// Bytes written, 0 when the send buffer is full and -1 once the peer is gone
+	int send(const uint8_t* data, size_t size);
+	// Bytes read, 0 when nothing is queued and -1 once the peer is gone
+	int receive(uint8_t* buffer, size_t capacity);
+
+	bool isOpen( ) const;
+};
+
+// Delays, reorders and drops outgoing datagrams to emulate a bad connection on localhost
+class LinkConditioner {
+private:
+	struct Pending {
+		uint32_t deliverAt;
+		NetAddress to;
+		vector<uint8_t> data;
+	};
+
+	vector<Pending> pending;
+	uint32_t latencyMs = 0;
+	uint32_t jitterMs = 0;
+	float lossPercent = 0.0f;
+	uint32_t dropped = 0;
+	mt19937 rng{ random_device{ }( ) };
+
+public:
+	void configure(uint32_t latencyMs, uint32_t jitterMs, float lossPercent);
+	bool isActive( ) const;
+
+	void send(UdpSocket& socket, const NetAddress& to, const uint8_t* data, size_t size, uint32_t nowMs);
+	void flush(UdpSocket& socket, uint32_t nowMs);
+
+	uint32_t getDropped( ) const;
+};
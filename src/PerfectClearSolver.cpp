@@ -0,0 +1,414 @@
+#include "PerfectClearSolver.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+	Metrics::Counter& solverNodes = Metrics::counter("tetris_pc_solver_nodes_total", "Placements generated by the perfect clear solver");
+	Metrics::Counter& solverSteals = Metrics::counter("tetris_pc_solver_steals_total", "Search tasks taken from another solver thread");
+
+	constexpr uint16_t FULL_ROW = (1u << PerfectClearSolver::WIDTH) - 1;
+	constexpr uint16_t EVEN_COLUMNS = 0x5555 & FULL_ROW;
+	constexpr uint16_t ODD_COLUMNS = 0xAAAA & FULL_ROW;
+
+	// Levels of the tree that are queued as tasks instead of searched in place
+	constexpr int SPLIT_DEPTH = 2;
+	// Nodes a thread counts before it adds them to the shared total and checks the node limit
+	constexpr uint64_t NODE_BATCH = 4096;
+
+	const char SHAPE_LETTERS[ ] = "LIOSZJT";
+	static_assert(sizeof(SHAPE_LETTERS) - 1 == static_cast<size_t>(TetrominoShape::COUNT), "a letter for every shape");
+
+	uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// Column of the lowest set bit, bits must not be 0
+	int lowestBit(uint16_t bits) {
+		int column = 0;
+		while (!(bits & 1)) {
+			bits >>= 1;
+			column++;
+		}
+		return column;
+	}
+}
+
+bool PerfectClearSolver::Position::setRow(int row, const string& cells) {
+	if (row < 0 || row >= HEIGHT || cells.size( ) > static_cast<size_t>(WIDTH)) return false;
+	uint16_t bits = 0;
+	for (size_t col = 0; col < cells.size( ); col++)
+		if (cells[col] != '.' && cells[col] != ' ') bits |= static_cast<uint16_t>(1u << col);
+	rows[row] = bits;
+	return true;
+}
+
+PerfectClearSolver::Position PerfectClearSolver::Position::fromBoard(const GameBoard& board, vector<TetrominoShape> queue) {
+	Position position;
+	for (int row = 0; row < HEIGHT; row++)
+		for (int col = 0; col < WIDTH; col++)
+			if (board.getCell(row, col)) position.rows[row] |= static_cast<uint16_t>(1u << col);
+	position.queue = move(queue);
+	return position;
+}
+
+bool PerfectClearSolver::parseShape(char letter, TetrominoShape& shape) {
+	for (int index = 0; index < static_cast<int>(TetrominoShape::COUNT); index++)
+		if (SHAPE_LETTERS[index] == toupper(static_cast<unsigned char>(letter))) {
+			shape = static_cast<TetrominoShape>(index);
+			return true;
+		}
+	return false;
+}
+
+char PerfectClearSolver::shapeLetter(TetrominoShape shape) {
+	int index = static_cast<int>(shape);
+	return index >= 0 && index < static_cast<int>(TetrominoShape::COUNT) ? SHAPE_LETTERS[index] : '?';
+}
+
+PerfectClearSolver::PerfectClearSolver(const Config& config) : config(config) {
+	this->config.maxPieces = clamp(config.maxPieces, 0, MAX_PIECES);
+	this->config.tableBits = clamp(config.tableBits, 10, 30);
+	table = vector<atomic<uint64_t>>(size_t(1) << this->config.tableBits);
+
+	// Rotations as Tetromino::rotate turns the spawn shape, clockwise, like BatchEnv
+	for (int shape = 0; shape < static_cast<int>(TetrominoShape::COUNT); shape++) {
+		vector<vector<int>> matrix = Tetromino(static_cast<TetrominoShape>(shape), 0).getShape( );
+		for (int rotation = 0; rotation < 4; rotation++) {
+			Shape out = { };
+			out.height = static_cast<int>(matrix.size( ));
+			out.width = static_cast<int>(matrix[0].size( ));
+			out.rotation = rotation;
+			for (int row = 0; row < out.height; row++)
+				for (int col = 0; col < out.width; col++)
+					if (matrix[row][col]) out.rows[out.height - 1 - row] |= static_cast<uint16_t>(1u << col);
+
+			// O, I, S and Z look the same after two or four turns, searching both only doubles the tree
+			bool seen = any_of(shapes[shape].begin( ), shapes[shape].end( ), [&](const Shape& other) {
+				return other.width == out.width && other.height == out.height && equal(out.rows, out.rows + out.height, other.rows);
+			});
+			if (!seen) shapes[shape].push_back(out);
+
+			vector<vector<int>> rotated(matrix[0].size( ), vector<int>(matrix.size( )));
+			for (size_t row = 0; row < matrix.size( ); row++)
+				for (size_t col = 0; col < matrix[0].size( ); col++)
+					rotated[col][matrix.size( ) - 1 - row] = matrix[row][col];
+			matrix = move(rotated);
+		}
+	}
+}
+
+int PerfectClearSolver::getThreadCount( ) const {
+	return config.threads > 0 ? config.threads : static_cast<int>(max(1u, thread::hardware_concurrency( )));
+}
+
+// State of one solve( ) call for one zone height
+struct PerfectClearSolver::Search {
+	struct Step {
+		uint8_t shape, shapeIndex, x, y;
+	};
+
+	// A position inside the zone: rows bottom up, only the first height of them can have cells
+	struct Node {
+		array<uint16_t, HEIGHT> rows;
+		int8_t height;
+		int8_t depth;       // pieces placed, also the queue index of the next piece
+		Step path[MAX_PIECES];
+	};
+	static_assert(is_trivially_copyable<Node>::value, "nodes are copied in and out of the task queues");
+
+	struct alignas(64) Worker {
+		mutex lock;
+		deque<Node> tasks;
+		uint64_t nodes = 0;
+		uint64_t unreported = 0;
+		uint64_t pruned = 0;
+		uint64_t tableHits = 0;
+		uint64_t steals = 0;
+	};
+
+	const PerfectClearSolver& solver;
+	const vector<TetrominoShape>& queue;
+	vector<atomic<uint64_t>>& table;
+	int tableShift;
+	uint64_t salt;
+
+	vector<Worker> workers;
+	atomic<int> pending{ 0 };
+	atomic<bool> stop{ false };
+	atomic<uint64_t> totalNodes{ 0 };
+	atomic<bool> gaveUp{ false };
+
+	mutex solutionLock;
+	bool solved = false;
+	Node solution;
+
+	Search(const PerfectClearSolver& solver, const vector<TetrominoShape>& queue, uint64_t number, int threads)
+		: solver(solver), queue(queue), table(solver.table), tableShift(64 - solver.config.tableBits), salt(mix(number)), workers(threads) { }
+
+	// Drops the piece at column x onto the node. False when it would stick out of the zone.
+	bool place(const Node& from, int shapeIndex, int x, Node& to) const {
+		TetrominoShape shape = queue[from.depth];
+		const Shape& piece = solver.shapes[static_cast<int>(shape)][shapeIndex];
+		uint16_t masks[4];
+		for (int row = 0; row < piece.height; row++) masks[row] = static_cast<uint16_t>(piece.rows[row] << x);
+
+		// Everything above the zone is empty, the drop starts with the piece resting on the zone's top
+		int y = from.height;
+		for (; y > 0; y--) {
+			bool blocked = false;
+			for (int row = 0; row < piece.height && !blocked; row++)
+				blocked = y - 1 + row < from.height && (from.rows[y - 1 + row] & masks[row]);
+			if (blocked) break;
+		}
+		if (y + piece.height > from.height) return false;
+
+		to = from;
+		int cleared = 0;
+		for (int row = 0; row < piece.height; row++) {
+			to.rows[y + row] |= masks[row];
+			if (to.rows[y + row] == FULL_ROW) cleared++;
+		}
+		if (cleared > 0) {
+			int write = y;
+			for (int read = y; read < from.height; read++)
+				if (to.rows[read] != FULL_ROW) to.rows[write++] = to.rows[read];
+			for (; write < from.height; write++) to.rows[write] = 0;
+			to.height = static_cast<int8_t>(from.height - cleared);
+		}
+		to.path[from.depth] = { static_cast<uint8_t>(shape), static_cast<uint8_t>(shapeIndex), static_cast<uint8_t>(x), static_cast<uint8_t>(y) };
+		to.depth = static_cast<int8_t>(from.depth + 1);
+		return true;
+	}
+
+	// Parity and cavity checks on what is left of the zone, see the class comment
+	bool promising(const Node& node) const {
+		int even = 0, odd = 0;
+		uint16_t linked = 0;
+		int columnEmpty[WIDTH] = { };
+		for (int row = 0; row < node.height; row++) {
+			uint16_t empty = static_cast<uint16_t>(~node.rows[row] & FULL_ROW);
+			even += static_cast<int>(bitset<16>(empty & EVEN_COLUMNS).count( ));
+			odd += static_cast<int>(bitset<16>(empty & ODD_COLUMNS).count( ));
+			linked |= empty & (empty >> 1);
+			for (uint16_t bits = empty; bits; bits &= bits - 1) columnEmpty[lowestBit(bits)]++;
+		}
+
+		int group = 0;
+		for (int col = 0; col < WIDTH; col++) {
+			group += columnEmpty[col];
+			if (!(linked & (1u << col))) {
+				if (group % 4 != 0) return false;
+				group = 0;
+			}
+		}
+
+		int remaining = (even + odd) / 4;
+		int lj = 0, t = 0, i = 0;
+		for (int index = node.depth; index < node.depth + remaining; index++) {
+			switch (queue[index]) {
+			case TetrominoShape::L:
+			case TetrominoShape::J: lj++; break;
+			case TetrominoShape::T: t++; break;
+			case TetrominoShape::I: i++; break;
+			default: break;
+			}
+		}
+		// In units of two cells, L and J move it by one, T by one or none, I by two or none
+		int imbalance = abs(even - odd) / 2;
+		if (imbalance > lj + t + 2 * i) return false;
+		return t > 0 || (imbalance - lj) % 2 == 0;
+	}
+
+	uint64_t keyOf(const Node& node) const {
+		// Zone height and depth pick the remaining queue, so they are part of the position
+		uint64_t key = salt ^ (static_cast<uint64_t>(node.depth) << 8 | static_cast<uint64_t>(node.height));
+		for (int row = 0; row < node.height; row++) key = mix(key ^ node.rows[row]) + row;
+		// Zero marks an empty slot
+		return mix(key) | 1;
+	}
+
+	bool knownToFail(uint64_t key) const { return table[key >> tableShift].load(memory_order_relaxed) == key; }
+	void markFailed(uint64_t key) { table[key >> tableShift].store(key, memory_order_relaxed); }
+
+	void countNode(Worker& worker) {
+		worker.nodes++;
+		if (++worker.unreported < NODE_BATCH) return;
+		uint64_t total = totalNodes.fetch_add(worker.unreported, memory_order_relaxed) + worker.unreported;
+		worker.unreported = 0;
+		if (solver.config.maxNodes > 0 && total >= solver.config.maxNodes) {
+			gaveUp.store(true, memory_order_relaxed);
+			stop.store(true, memory_order_relaxed);
+		}
+	}
+
+	void report(const Node& node) {
+		lock_guard<mutex> guard(solutionLock);
+		if (solved) return;
+		solved = true;
+		solution = node;
+		stop.store(true, memory_order_relaxed);
+	}
+
+	// Calls visit(child) for every placement of the node's next piece that survives pruning, stops
+	// early when visit returns true or a solution turns up. True when one did.
+	template <typename Visit>
+	bool expand(Worker& worker, const Node& node, Visit visit) {
+		TetrominoShape shape = queue[node.depth];
+		const vector<Shape>& rotations = solver.shapes[static_cast<int>(shape)];
+		Node child;
+		for (int shapeIndex = 0; shapeIndex < static_cast<int>(rotations.size( )); shapeIndex++) {
+			for (int x = 0; x + rotations[shapeIndex].width <= WIDTH; x++) {
+				if (stop.load(memory_order_relaxed)) return false;
+				if (!place(node, shapeIndex, x, child)) continue;
+				countNode(worker);
+				if (child.height == 0) {
+					report(child);
+					return true;
+				}
+				if (!promising(child)) {
+					worker.pruned++;
+					continue;
+				}
+				if (knownToFail(keyOf(child))) {
+					worker.tableHits++;
+					continue;
+				}
+				if (visit(child)) return true;
+			}
+		}
+		return false;
+	}
+
+	bool searchFrom(Worker& worker, const Node& node) {
+		bool found = expand(worker, node, [&](const Node& child) {
+			if (searchFrom(worker, child)) return true;
+			// A stopped search did not finish the subtree, it has not failed
+			if (!stop.load(memory_order_relaxed)) markFailed(keyOf(child));
+			return false;
+		});
+		return found;
+	}
+
+	void push(Worker& worker, const Node& node) {
+		pending.fetch_add(1, memory_order_relaxed);
+		lock_guard<mutex> guard(worker.lock);
+		worker.tasks.push_back(node);
+	}
+
+	// Own tasks newest first, which keeps a thread's search depth first, then the oldest task of
+	// another thread, which is the one closest to the root and so the most work
+	bool take(size_t self, Node& node) {
+		{
+			Worker& own = workers[self];
+			lock_guard<mutex> guard(own.lock);
+			if (!own.tasks.empty( )) {
+				node = own.tasks.back( );
+				own.tasks.pop_back( );
+				return true;
+			}
+		}
+		for (size_t offset = 1; offset < workers.size( ); offset++) {
+			Worker& victim = workers[(self + offset) % workers.size( )];
+			lock_guard<mutex> guard(victim.lock);
+			if (!victim.tasks.empty( )) {
+				node = victim.tasks.front( );
+				victim.tasks.pop_front( );
+				workers[self].steals++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(size_t self) {
+		Worker& worker = workers[self];
+		Node node;
+		while (!stop.load(memory_order_relaxed)) {
+			if (!take(self, node)) {
+				// Tasks still being searched can queue new ones
+				if (pending.load(memory_order_acquire) == 0) break;
+				this_thread::yield( );
+				continue;
+			}
+			if (node.depth < SPLIT_DEPTH) expand(worker, node, [&](const Node& child) { push(worker, child); return false; });
+			else if (!searchFrom(worker, node) && !stop.load(memory_order_relaxed)) markFailed(keyOf(node));
+			pending.fetch_sub(1, memory_order_release);
+		}
+		totalNodes.fetch_add(worker.unreported, memory_order_relaxed);
+		worker.unreported = 0;
+	}
+};
+
+PerfectClearSolver::Result PerfectClearSolver::solve(const Position& position) const {
+	TRACE_ZONE("PerfectClearSolver::solve");
+	auto start = chrono::steady_clock::now( );
+	Result result;
+
+	// Bottom up, with rows that are already full taken out like the board would
+	array<uint16_t, HEIGHT> rows{ };
+	int filled = 0, stackHeight = 0, height = 0;
+	for (int row = HEIGHT - 1; row >= 0; row--) {
+		uint16_t bits = position.rows[row] & FULL_ROW;
+		if (bits == FULL_ROW) continue;
+		rows[height++] = bits;
+		filled += static_cast<int>(bitset<16>(bits).count( ));
+		if (bits) stackHeight = height;
+	}
+
+	int available = min(config.maxPieces, static_cast<int>(position.queue.size( )));
+	if (filled == 0) result.outcome = Outcome::SOLVED;
+
+	int threads = getThreadCount( );
+	// Higher zones need more pieces, so the first zone that can be cleared is also the quickest
+	for (int zone = max(stackHeight, 1); zone <= HEIGHT && filled > 0 && result.outcome == Outcome::NO_SOLUTION; zone++) {
+		int empty = WIDTH * zone - filled;
+		if (empty % 4 != 0) continue;
+		if (empty / 4 > available) break;
+
+		Search search(*this, position.queue, ++searches, threads);
+		Search::Node root = { };
+		copy(rows.begin( ), rows.end( ), root.rows.begin( ));
+		root.height = static_cast<int8_t>(zone);
+		root.depth = 0;
+		if (!search.promising(root)) continue;
+		search.push(search.workers[0], root);
+
+		vector<thread> helpers;
+		for (int worker = 1; worker < threads; worker++) helpers.emplace_back(&Search::run, &search, worker);
+		search.run(0);
+		for (auto& helper : helpers) helper.join( );
+
+		for (const Search::Worker& worker : search.workers) {
+			result.nodes += worker.nodes;
+			result.pruned += worker.pruned;
+			result.tableHits += worker.tableHits;
+			result.steals += worker.steals;
+		}
+		if (search.solved) {
+			result.outcome = Outcome::SOLVED;
+			for (int step = 0; step < search.solution.depth; step++) {
+				const Search::Step& taken = search.solution.path[step];
+				const Shape& piece = shapes[taken.shape][taken.shapeIndex];
+				result.placements.push_back({ static_cast<TetrominoShape>(taken.shape), piece.rotation, taken.x, HEIGHT - taken.y - piece.height });
+			}
+		} else if (search.gaveUp.load( )) {
+			result.outcome = Outcome::GAVE_UP;
+		}
+	}
+
+	solverNodes.add(result.nodes);
+	solverSteals.add(result.steals);
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now( ) - start).count( );
+	return result;
+}
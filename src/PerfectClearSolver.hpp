@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GameBoard.hpp"
+
+using namespace std;
+
+// Searches for placements of a known piece queue, in order and without hold, that leave a board
+// completely empty. Pieces move like BatchEnv actions: turned, shifted to a column and hard dropped
+// from above the stack, no tucks or spins.
+//
+// A perfect clear fills every empty cell of the bottom h rows and nothing above, so for each zone
+// height h whose empty cells are a multiple of four (one piece count each) the search tries the
+// queue's first (empty cells / 4) pieces inside that zone, lowest zone first. Positions are pruned
+// before they are searched:
+// - column parity: the empty cells of even and odd columns differ by an amount only some pieces
+//   change (L and J always by two, T by two or not at all, I by four or not at all, the rest never),
+//   and line clears do not change it
+// - cavities: columns that no row has an empty cell in both of can never share a piece, so every
+//   group of columns linked by such rows has to take a multiple of four cells
+// - a transposition table of positions known to fail, shared by all threads
+// The first two levels of the tree are queued as tasks; every thread searches its own tasks depth
+// first and steals the oldest task of another thread when it runs out.
+class PerfectClearSolver {
+public:
+	static constexpr int WIDTH = GameBoard::width;
+	static constexpr int HEIGHT = GameBoard::height;
+	static constexpr int MAX_PIECES = 20;
+	static_assert(WIDTH <= 16, "rows are 16 bit masks");
+
+	struct Position {
+		// Board rows top first like GameBoard, bit c is column c
+		array<uint16_t, HEIGHT> rows{ };
+		vector<TetrominoShape> queue;
+
+		// '.' or ' ' is empty, anything else filled; false when a row is too wide or there are too many
+		bool setRow(int row, const string& cells);
+		static Position fromBoard(const GameBoard& board, vector<TetrominoShape> queue);
+	};
+
+	// rotation and x are a BatchEnv action (rotation * WIDTH + x); y is the board row of the piece's
+	// top row when it locks, on the board as the earlier placements and their line clears left it
+	struct Placement {
+		TetrominoShape shape;
+		int rotation;
+		int x, y;
+	};
+
+	enum class Outcome {
+		SOLVED,
+		NO_SOLUTION,    // within the piece limit
+		GAVE_UP,        // the node limit was reached first
+	};
+
+	struct Config {
+		int maxPieces = 10;
+		int threads = 0;            // 0 uses every core
+		int tableBits = 22;         // transposition table of 2^tableBits entries of 8 bytes
+		uint64_t maxNodes = 0;      // per solve( ), 0 for no limit
+	};
+
+	struct Result {
+		Outcome outcome = Outcome::NO_SOLUTION;
+		vector<Placement> placements;
+		uint64_t nodes = 0;         // placements generated
+		uint64_t pruned = 0;        // by parity or cavities
+		uint64_t tableHits = 0;
+		uint64_t steals = 0;
+		double seconds = 0.0;
+	};
+
+private:
+	// One rotation as bottom up rows of column bits from the shape's left edge
+	struct Shape {
+		uint16_t rows[4];
+		int width, height;
+		int rotation;
+	};
+
+	struct Search;
+
+	Config config;
+	// Distinct rotations of every shape, Tetromino::rotate order
+	vector<Shape> shapes[static_cast<int>(TetrominoShape::COUNT)];
+	// Positions that failed in any search so far. Keys are salted with the search's number, so entries
+	// of earlier searches stop matching without the table being cleared.
+	mutable vector<atomic<uint64_t>> table;
+	mutable uint64_t searches = 0;
+
+public:
+	explicit PerfectClearSolver(const Config& config);
+
+	// One call at a time, a call uses all of the configured threads
+	Result solve(const Position& position) const;
+	int getThreadCount( ) const;
+
+	static bool parseShape(char letter, TetrominoShape& shape);
+	static char shapeLetter(TetrominoShape shape);
+};
@@ -1,8 +1,22 @@
 #include "Renderer.hpp"
+#include "TileRenderer.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
-Renderer::Renderer(shared_ptr<SDL_Renderer> renderer, int w, int h) : renderer(renderer), windowHeight(h), windowWidth(w) {
+namespace {
+	Metrics::Counter& framesRendered = Metrics::counter("tetris_frames_rendered_total", "Frames presented");
+	Metrics::Histogram& frameTime = Metrics::histogram("tetris_frame_time_seconds", "Time between two presented frames");
+	Metrics::Counter& drawCalls = Metrics::counter("tetris_draw_calls_total", "SDL copy and fill calls");
+	Metrics::Counter& textureCreations = Metrics::counter("tetris_texture_creations_total", "Textures created");
+
+	const char* const FONT_PATH = "assets/font/tetris-gb.ttf";
+}
+
+Renderer::Renderer(shared_ptr<SDL_Renderer> renderer, shared_ptr<AssetManager> assets)
+	: renderer(renderer), assets(assets), canvas(nullptr, AssetManager::destroyTexture) {
 	textures[TetrisAssets::SINGLE] = "assets/sprites/single.png";
 	textures[TetrisAssets::BORDER] = "assets/sprites/border.png";
 	textures[TetrisAssets::J] = "assets/sprites/J.png";
@@ -18,27 +32,112 @@ Renderer::Renderer(shared_ptr<SDL_Renderer> renderer, int w, int h) : renderer(r
 	textures[TetrisAssets::I_ENDR] = "assets/sprites/I_ENDR.png";
 	textures[TetrisAssets::I_MIDR] = "assets/sprites/I_MIDR.png";
 	textures[TetrisAssets::I_STARTR] = "assets/sprites/I_STARTR.png";
+
+	assets->addFont(AssetGroup::COMMON, FONT_PATH, 8);
+	assets->addTexture(AssetGroup::TITLE, "assets/sprites/title.png");
+	assets->addTexture(AssetGroup::TITLE, "assets/sprites/title_bg.png");
+	for (const auto& [asset, path] : textures) assets->addTexture(AssetGroup::BOARD, path);
+	assets->addTexture(AssetGroup::BOARD, "assets/sprites/scoreboard.png");
+	assets->addTexture(AssetGroup::GAME_OVER, "assets/sprites/game_over.png");
+	assets->addTexture(AssetGroup::GAME_OVER, "assets/sprites/please_try_again_text.png");
+
+	setLayout(Layout::SINGLE);
+}
+
+Renderer::~Renderer( ) = default;
+
+bool Renderer::useTileBackend( ) {
+	tiles = make_unique<TileRenderer>(*this);
+	if (tiles->init( )) return true;
+
+	SDL_Log("Tile renderer unavailable, drawing sprites");
+	tiles.reset( );
+	return false;
+}
+
+void Renderer::subscribe(GameEventBus& bus) {
+	constexpr uint32_t types = eventBit(GameEventType::PIECE_LOCKED) | eventBit(GameEventType::LINES_CLEARED) |
+		eventBit(GameEventType::GARBAGE_ADDED) | eventBit(GameEventType::TOP_OUT) | eventBit(GameEventType::BOARD_RESET);
+	bus.subscribe(types, [this](const GameEventBuffer& batch) { onBoardEvents(batch); });
+	tracksBoardEvents = true;
+}
+
+void Renderer::onBoardEvents(const GameEventBuffer& batch) {
+	for (const GameEvent& event : batch) {
+		switch (event.type) {
+		case GameEventType::PIECE_LOCKED:
+			dirtyRows |= event.rows;
+			break;
+		case GameEventType::LINES_CLEARED: {
+			// Everything above the lowest cleared row moved down
+			int lowest = 63;
+			while (lowest > 0 && !((event.rows >> lowest) & 1)) lowest--;
+			dirtyRows |= lowest == 63 ? ~0ull : (uint64_t(2) << lowest) - 1;
+			break;
+		}
+		case GameEventType::GARBAGE_ADDED:
+		case GameEventType::TOP_OUT:
+		case GameEventType::BOARD_RESET:
+			dirtyRows = ~0ull;
+			break;
+		default:
+			break;
+		}
+	}
 }
 
-void Renderer::renderBoard(const shared_ptr<GameBoard> gameBoard) {
+uint64_t Renderer::takeDirtyRows( ) {
+	if (!tracksBoardEvents) return ~0ull;
+	uint64_t rows = dirtyRows;
+	dirtyRows = 0;
+	return rows;
+}
+
+void Renderer::setLayout(Layout newLayout) {
+	int width = newLayout == Layout::SINGLE ? NATIVE_WIDTH : SIDE_BY_SIDE_WIDTH;
+	int height = newLayout == Layout::SINGLE ? NATIVE_HEIGHT : SIDE_BY_SIDE_HEIGHT;
+	if (canvas && width == canvasWidth && height == canvasHeight) return;
+
+	// Nearest neighbour keeps the pixel art sharp when present( ) scales the canvas up
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	canvas.reset(AssetManager::trackTexture(SDL_CreateTexture(renderer.get( ), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height)));
+	if (!canvas) {
+		SDL_Log("Failed to create the %dx%d canvas: %s", width, height, SDL_GetError( ));
+		return;
+	}
+	textureCreations.add( );
+	canvasWidth = width;
+	canvasHeight = height;
+	layout = newLayout;
+	SDL_SetRenderTarget(renderer.get( ), canvas.get( ));
+}
+
+void Renderer::renderBoard(const shared_ptr<const BoardView> gameBoard) {
+	TRACE_ZONE("Renderer::renderBoard");
+	if (tiles && layout == Layout::SINGLE) {
+		tiles->render(*gameBoard);
+		return;
+	}
+	int firstRow = max(0, gameBoard->getHeight( ) - canvasHeight / gridSize);
 	drawScoreboard(gameBoard->getScore( ), gameBoard->getLevel( ), gameBoard->getLines( ));
 	drawWall(gameBoard->getWidth( ), gameBoard->getHeight( ));
-	drawLockedBlocks(gameBoard);
-	drawTetromino(gameBoard->getCurrentTetromino( ));
+	drawLockedBlocks(*gameBoard, firstRow);
+	drawTetromino(gameBoard->getCurrentTetromino( ), firstRow);
 }
 
 void Renderer::drawScoreboard(int score, int level, int lines) {
-	SDL_Rect blackRect = { 0, 0,  7 * scale, windowHeight };
+	TRACE_ZONE("Renderer::drawScoreboard");
+	SDL_Rect blackRect = { 0, 0,  7, canvasHeight };
 	SDL_SetRenderDrawColor(renderer.get( ), 0, 0, 0, 255);
 	SDL_RenderFillRect(renderer.get( ), &blackRect);
+	drawCalls.add( );
 	SDL_Color col{ 255,255,255 };
-	auto surf = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load("assets/sprites/scoreboard.png"), SDL_FreeSurface);
 	scoreBoardDimensions = renderTexture(
 		"assets/sprites/scoreboard.png",
-		windowWidth,
+		canvasWidth,
+		0,
+		0,
 		0,
-		surf->w * scale,
-		surf->h * scale,
 		col,
 		1.0f,
 		HAlign::RIGHT
@@ -46,27 +145,27 @@ void Renderer::drawScoreboard(int score, int level, int lines) {
 
 	renderText(
 		fmt::format("{0}", score),
-		windowWidth - (7 * scale),
-		23 * scale,
-		8 * scale,
+		canvasWidth - 7,
+		23,
+		8,
 		SDL_Color{ 0,0,0 },
 		HAlign::RIGHT,
 		VAlign::TOP
 	);
 	renderText(
 		fmt::format("{0}", level),
-		windowWidth - (15 * scale),
-		55 * scale,
-		8 * scale,
+		canvasWidth - 15,
+		55,
+		8,
 		SDL_Color{ 0,0,0 },
 		HAlign::RIGHT,
 		VAlign::TOP
 	);
 	renderText(
 		fmt::format("{0}", lines),
-		windowWidth - (15 * scale),
-		79 * scale,
-		8 * scale,
+		canvasWidth - 15,
+		79,
+		8,
 		SDL_Color{ 0,0,0 },
 		HAlign::RIGHT,
 		VAlign::TOP
@@ -74,55 +173,54 @@ void Renderer::drawScoreboard(int score, int level, int lines) {
 }
 
 void Renderer::drawWall(const int w, const int h) {
+	TRACE_ZONE("Renderer::drawWall");
 	SDL_Color color{ 165, 42, 42 }, gapColor{ 0,0,0 };
 	SDL_SetRenderDrawColor(renderer.get( ), color.r, color.g, color.b, 255);
 
-	for (int y = 0; y <= windowHeight; y += ((gridSize - 2) * scale)) {
+	for (int y = 0; y <= canvasHeight; y += ((gridSize - 2))) {
 		leftBorder = renderTexture(
 			textures[TetrisAssets::BORDER],
-			gridSize * scale,
+			gridSize,
 			y,
-			gridSize * scale,
-			(gridSize * scale),
+			gridSize,
+			gridSize,
 			color
 		);
-		int t = ceil(static_cast<float>(scoreBoardDimensions->w) / scale / gridSize);
 		rightBorder = renderTexture(
 			textures[TetrisAssets::BORDER],
-			windowWidth - (ceil(static_cast<float>(scoreBoardDimensions->w) / scale / gridSize) + 1) * 8 * scale,
+			canvasWidth - (ceil(static_cast<float>(scoreBoardDimensions.w) / gridSize) + 1) * 8,
 			y,
-			gridSize * scale,
-			gridSize * scale,
+			gridSize,
+			gridSize,
 			color
 		);
 	}
 }
 
-void Renderer::drawLockedBlocks(const shared_ptr<GameBoard> gameBoard) {
-	const auto& lockedTetrominos = gameBoard->getLockedTetrominos( );
-	const auto& lockedColors = gameBoard->getLockedColors( );
-
-	for (int row = 0; row < lockedTetrominos.size( ); ++row) {
-		for (int col = 0; col < lockedTetrominos[row].size( ); ++col) {
-			int blockType = lockedTetrominos[row][col];
+void Renderer::drawLockedBlocks(const BoardView& gameBoard, int firstRow) {
+	TRACE_ZONE("Renderer::drawLockedBlocks");
+	for (int row = firstRow; row < gameBoard.getHeight( ); ++row) {
+		for (int col = 0; col < gameBoard.getWidth( ); ++col) {
+			int blockType = gameBoard.getCell(row, col);
 			if (blockType != 0) {
-				SDL_Color color = lockedColors[row][col];
+				SDL_Color color = paletteColor(gameBoard.getColor(row, col));
 				renderTexture(
 					textures[shapeToAsset(static_cast<TetrominoShape>(blockType - 1))],
-					(col + 2) * gridSize * scale,
-					row * gridSize * scale,
-					gridSize * scale,
-					gridSize * scale,
+					(col + 2) * gridSize,
+					(row - firstRow) * gridSize,
+					gridSize,
+					gridSize,
 					color);
 			}
 		}
 	}
 }
 
-void Renderer::drawTetromino(const shared_ptr<Tetromino> tetromino) {
+void Renderer::drawTetromino(const shared_ptr<Tetromino> tetromino, int firstRow) {
+	TRACE_ZONE("Renderer::drawTetromino");
 	if (!tetromino) return;
 
-	int x = tetromino->getX( ), y = tetromino->getY( );
+	int x = tetromino->getX( ), y = tetromino->getY( ) - firstRow;
 
 	if (tetromino->getShapeEnumn( ) == TetrominoShape::I) {
 		double angle = tetromino->getRotationAngle( );
@@ -131,61 +229,61 @@ void Renderer::drawTetromino(const shared_ptr<Tetromino> tetromino) {
 			for (int i = 0; i < 4; ++i) {
 				renderTexture(
 					textures[TetrisAssets::I_MIDR],
-					(2 + x + i) * gridSize * scale,
-					y * gridSize * scale,
-					gridSize * scale,
-					gridSize * scale,
-					tetromino->getColor( )
+					(2 + x + i) * gridSize,
+					y * gridSize,
+					gridSize,
+					gridSize,
+					paletteColor(tetromino->getColorIndex( ))
 				);
 			}
 			renderTexture(
 				textures[TetrisAssets::I_ENDR],
-				(2 + x) * gridSize * scale,
-				y * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x) * gridSize,
+				y * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 			renderTexture(
 				textures[TetrisAssets::I_STARTR],
-				(2 + x + 3) * gridSize * scale,
-				y * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x + 3) * gridSize,
+				y * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 		} else {
 			renderTexture(
 				textures[TetrisAssets::I_END],
-				(2 + x) * gridSize * scale,
-				y * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x) * gridSize,
+				y * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 			renderTexture(
 				textures[TetrisAssets::I_MID],
-				(2 + x) * gridSize * scale,
-				(y + 1) * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x) * gridSize,
+				(y + 1) * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 			renderTexture(
 				textures[TetrisAssets::I_MID],
-				(2 + x) * gridSize * scale,
-				(y + 2) * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x) * gridSize,
+				(y + 2) * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 			renderTexture(
 				textures[TetrisAssets::I_START],
-				(2 + x) * gridSize * scale,
-				(y + 3) * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				tetromino->getColor( )
+				(2 + x) * gridSize,
+				(y + 3) * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(tetromino->getColorIndex( ))
 			);
 		}
 	} else {
@@ -195,11 +293,11 @@ void Renderer::drawTetromino(const shared_ptr<Tetromino> tetromino) {
 				if (shape[row][col] != 0) {
 					renderTexture(
 						textures[shapeToAsset(tetromino->getShapeEnumn( ))],
-						((x + col) * gridSize * scale) + leftBorder->x + leftBorder->w,
-						(y + row) * gridSize * scale,
-						gridSize * scale,
-						gridSize * scale,
-						tetromino->getColor( )
+						((x + col) * gridSize) + leftBorder.x + leftBorder.w,
+						(y + row) * gridSize,
+						gridSize,
+						gridSize,
+						paletteColor(tetromino->getColorIndex( ))
 					);
 				}
 			}
@@ -235,38 +333,86 @@ const TetrisAssets Renderer::shapeToAsset(const TetrominoShape shape) const {
 		return TetrisAssets::I_STARTR;
 	case TetrominoShape::I_MIDR:
 		return TetrisAssets::I_MIDR;
+	case TetrominoShape::GARBAGE:
+		return TetrisAssets::SINGLE;
 	default:
 		return TetrisAssets::I;
 		break;
 	}
 }
 
+const SDL_Color Renderer::paletteColor(int colorIndex) const {
+	SDL_Color color{ 0, 0, 0, 255 };
+
+	switch (colorIndex) {
+	case 0:
+		color.r = 0;
+		color.g = 191;
+		color.b = 255;
+		break;
+	case 1:
+		color.r = 255;
+		color.g = 215;
+		color.b = 0;
+		break;
+	case 2:
+		color.r = 138;
+		color.g = 43;
+		color.b = 226;
+		break;
+	case 3:
+		color.r = 0;
+		color.g = 204;
+		color.b = 102;
+		break;
+	case 4:
+		color.r = 255;
+		color.g = 69;
+		color.b = 0;
+		break;
+	case 5:
+		color.r = 30;
+		color.g = 144;
+		color.b = 255;
+		break;
+	case 6:
+		color.r = 255;
+		color.g = 140;
+		color.b = 0;
+		break;
+	case Tetromino::GARBAGE_COLOR:
+		color.r = 128;
+		color.g = 128;
+		color.b = 128;
+		break;
+	default:
+		break;
+	}
+
+	return color;
+}
+
 void Renderer::renderStartScreen( ) {
+	TRACE_ZONE("Renderer::renderStartScreen");
 	SDL_SetRenderDrawColor(renderer.get( ), 0, 0, 0, 255);
 	SDL_RenderClear(renderer.get( ));
 
-	auto title = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load("assets/sprites/title.png"), SDL_FreeSurface);
-
 	int titlePaddingX = 3, titlePaddingY = 8;
 
-	TextureDimensions* titleDimensions = renderTexture(
+	TextureDimensions titleDimensions = renderTexture(
 		"assets/sprites/title.png",
-		titlePaddingX * scale,
-		titlePaddingY * scale,
-		title->w * scale,
-		title->h * scale
+		titlePaddingX,
+		titlePaddingY
 	);
 
-	auto titleBg = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load("assets/sprites/title_bg.png"), SDL_FreeSurface);
-
 	SDL_Color col = { 255,255,255 };
 
-	TextureDimensions* titleBgDimensions = renderTexture(
+	TextureDimensions titleBgDimensions = renderTexture(
 		"assets/sprites/title_bg.png",
-		windowWidth / 2,
-		titleDimensions->y + titleDimensions->h,
-		titleBg->w * scale,
-		titleBg->h * scale,
+		canvasWidth / 2,
+		titleDimensions.y + titleDimensions.h,
+		0,
+		0,
 		col,
 		1.0f,
 		HAlign::CENTER
@@ -275,73 +421,88 @@ void Renderer::renderStartScreen( ) {
 	SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
 
 	int titleBgBottomPadding = 6;
-	int y = titleBgDimensions->y + titleBgDimensions->h + titleBgBottomPadding * scale;
+	int y = titleBgDimensions.y + titleBgDimensions.h + titleBgBottomPadding;
 
 	SDL_Rect rect{
 		0,
 		y,
-		windowWidth,
-		windowHeight - y,
+		canvasWidth,
+		canvasHeight - y,
 	};
 
 	SDL_RenderFillRect(renderer.get( ), &rect);
+	drawCalls.add( );
 
 	TextDimensions player1TextDimendions = renderText(
 		"1player",
-		windowWidth / 4,
-		y + (1 * scale),
-		8 * scale,
+		canvasWidth / 4,
+		y + 1,
+		8,
 		SDL_Color{ 0, 0, 0 },
 		HAlign::CENTER
 	);
 
 	renderText(
 		"2player",
-		windowWidth * 3 / 4,
-		y + (1 * scale),
-		8 * scale,
+		canvasWidth * 3 / 4,
+		y + 1,
+		8,
 		SDL_Color{ 0, 0, 0 },
 		HAlign::CENTER
 	);
 
 	renderText(
 		"©1989 ®",
-		windowWidth / 2,
-		windowHeight - (14 * scale),
-		8 * scale,
+		canvasWidth / 2,
+		canvasHeight - 14,
+		8,
 		SDL_Color{ 0, 0, 0 },
 		HAlign::CENTER
 	);
 
-	SDL_RenderPresent(renderer.get( ));
+	present( );
 }
 
-void Renderer::renderGameOver(const shared_ptr<GameBoard> gameBoard) {
+void Renderer::renderGameOver(const shared_ptr<const BoardView> gameBoard, uint64_t rank, uint64_t total) {
+	TRACE_ZONE("Renderer::renderGameOver");
 	//Needed to draw the Walls again
 	drawWall(gameBoard->getWidth( ), gameBoard->getHeight( ));
 	drawScoreboard(gameBoard->getScore( ), gameBoard->getLevel( ), gameBoard->getLines( ));
 
-	auto gameOver = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load("assets/sprites/game_over.png"), SDL_FreeSurface);
+	AssetManager::Texture gameOver = assets->texture("assets/sprites/game_over.png");
 
-	int gameOverWidth = static_cast<int>(windowWidth * 0.3f);
-	int gameOverHeight = static_cast<int>(gameOverWidth * (static_cast<float>(gameOver->h) / gameOver->w));
+	int gameOverWidth = static_cast<int>(canvasWidth * 0.3f);
+	int gameOverHeight = gameOver.width > 0 ? static_cast<int>(gameOverWidth * (static_cast<float>(gameOver.height) / gameOver.width)) : 0;
 
 	renderTexture(
 		"assets/sprites/game_over.png",
-		(windowWidth / 2) - (gameOverWidth / 2),
-		static_cast<int>(windowHeight * 0.15f),
+		(canvasWidth / 2) - (gameOverWidth / 2),
+		static_cast<int>(canvasHeight * 0.15f),
 		gameOverWidth,
 		gameOverHeight
 	);
 
 	SDL_Color col{ 255,255,255 };
-	renderTexture("assets/sprites/please_try_again_text.png", windowWidth / 2, windowHeight * 0.7f, 0, 0, col, 3.5f, HAlign::CENTER);
+	renderTexture("assets/sprites/please_try_again_text.png", canvasWidth / 2, canvasHeight * 0.7f, 0, 0, col, 0.7f, HAlign::CENTER);
+
+	if (rank > 0) {
+		renderText(
+			fmt::format("rank {0} of {1}", rank, total),
+			canvasWidth / 2,
+			static_cast<int>(canvasHeight * 0.6f),
+			8,
+			SDL_Color{ 0, 0, 0 },
+			HAlign::CENTER
+		);
+	}
 
-	SDL_RenderPresent(renderer.get( ));
+	present( );
 }
 
 void Renderer::renderTetrominoPreview(const shared_ptr<Tetromino> nextTetromino) {
-	if (!nextTetromino) return;
+	TRACE_ZONE("Renderer::renderTetrominoPreview");
+	// The tile frame of renderBoard already has the preview
+	if (!nextTetromino || (tiles && layout == Layout::SINGLE)) return;
 
 	int x = nextTetromino->getX( ), y = nextTetromino->getY( );
 
@@ -349,30 +510,30 @@ void Renderer::renderTetrominoPreview(const shared_ptr<Tetromino> nextTetromino)
 		for (int i = 0; i < 4; ++i) {
 			renderTexture(
 				textures[TetrisAssets::I_MIDR],
-				(windowWidth - 155) + (x + i) * gridSize * scale,
-				(windowHeight - 120) + y * gridSize * scale,
-				gridSize * scale,
-				gridSize * scale,
-				nextTetromino->getColor( )
+				(canvasWidth - 31) + (x + i) * gridSize,
+				(canvasHeight - 24) + y * gridSize,
+				gridSize,
+				gridSize,
+				paletteColor(nextTetromino->getColorIndex( ))
 			);
 		}
 
 		renderTexture(
 			textures[TetrisAssets::I_ENDR],
-			(windowWidth - 155) + x * gridSize * scale,
-			(windowHeight - 120) + y * gridSize * scale,
-			gridSize * scale,
-			gridSize * scale,
-			nextTetromino->getColor( )
+			(canvasWidth - 31) + x * gridSize,
+			(canvasHeight - 24) + y * gridSize,
+			gridSize,
+			gridSize,
+			paletteColor(nextTetromino->getColorIndex( ))
 		);
 
 		renderTexture(
 			textures[TetrisAssets::I_STARTR],
-			(windowWidth - 155) + (x + 3) * gridSize * scale,
-			(windowHeight - 120) + y * gridSize * scale,
-			gridSize * scale,
-			gridSize * scale,
-			nextTetromino->getColor( )
+			(canvasWidth - 31) + (x + 3) * gridSize,
+			(canvasHeight - 24) + y * gridSize,
+			gridSize,
+			gridSize,
+			paletteColor(nextTetromino->getColorIndex( ))
 		);
 
 	} else {
@@ -381,11 +542,11 @@ void Renderer::renderTetrominoPreview(const shared_ptr<Tetromino> nextTetromino)
 				if (nextTetromino->getShape( )[row][col] != 0) {
 					renderTexture(
 						textures[shapeToAsset(nextTetromino->getShapeEnumn( ))],
-						(windowWidth - 140) + col * gridSize * scale,
-						(windowHeight - 130) + row * gridSize * scale,
-						gridSize * scale,
-						gridSize * scale,
-						nextTetromino->getColor( )
+						(canvasWidth - 28) + col * gridSize,
+						(canvasHeight - 26) + row * gridSize,
+						gridSize,
+						gridSize,
+						paletteColor(nextTetromino->getColorIndex( ))
 					);
 				}
 			}
@@ -393,15 +554,173 @@ void Renderer::renderTetrominoPreview(const shared_ptr<Tetromino> nextTetromino)
 	}
 }
 
+void Renderer::renderSideBySide(const shared_ptr<const BoardView> left, const shared_ptr<const BoardView> right) {
+	TRACE_ZONE("Renderer::renderSideBySide");
+	const shared_ptr<const BoardView> boards[2] = { left, right };
+	// Both halves use the larger board's size so the two stay aligned
+	int boardWidth = 0, boardHeight = 0;
+	for (const auto& board : boards) {
+		if (!board) continue;
+		boardWidth = max(boardWidth, board->getWidth( ));
+		boardHeight = max(boardHeight, board->getHeight( ));
+	}
+	int halfWidth = canvasWidth / 2;
+	// Wall, board, wall across and two rows of text above the board
+	int boardScale = max(1, min(halfWidth / ((boardWidth + 2) * gridSize), canvasHeight / ((boardHeight + 2) * gridSize)));
+	int cell = gridSize * boardScale;
+	// A board too tall for the canvas even at 1x shows its bottom rows
+	int visibleRows = min(boardHeight, canvasHeight / cell - 2);
+
+	vector<Sprite> sprites;
+	sprites.reserve(2 * (boardWidth + 2) * visibleRows);
+	int originX[2], originY = 2 * cell;
+	for (int i = 0; i < 2; i++) {
+		originX[i] = i * halfWidth + (halfWidth - (boardWidth + 2) * cell) / 2;
+		if (boards[i]) appendBoardSprites(sprites, *boards[i], originX[i], originY, cell, visibleRows);
+	}
+	drawSprites(sprites);
+
+	for (int i = 0; i < 2; i++) {
+		if (!boards[i]) continue;
+
+		// Incoming garbage as a red bar over the left wall
+		int pending = min(boards[i]->getPendingGarbage( ), visibleRows);
+		if (pending > 0) {
+			SDL_Rect meter{ originX[i] + cell / 4, originY + (visibleRows - pending) * cell, cell / 2, pending * cell };
+			SDL_SetRenderDrawColor(renderer.get( ), 220, 20, 60, 255);
+			SDL_RenderFillRect(renderer.get( ), &meter);
+			drawCalls.add( );
+		}
+
+		renderText(
+			fmt::format("{0}p {1}{2}", i + 1, boards[i]->getScore( ), boards[i]->isCollision( ) ? " ko" : ""),
+			originX[i] + cell,
+			0,
+			8 * boardScale,
+			SDL_Color{ 0, 0, 0 }
+		);
+		renderText(
+			fmt::format("lines {0}", boards[i]->getLines( )),
+			originX[i] + cell,
+			cell,
+			8 * boardScale,
+			SDL_Color{ 128, 128, 128 }
+		);
+	}
+}
+
+void Renderer::appendBoardSprites(vector<Sprite>& sprites, const BoardView& board, int x, int y, int cell, int visibleRows) const {
+	SDL_Color wallColor{ 165, 42, 42, 255 };
+	for (int row = 0; row < visibleRows; row++) {
+		sprites.push_back({ TetrisAssets::BORDER, { x, y + row * cell, cell, cell }, wallColor });
+		sprites.push_back({ TetrisAssets::BORDER, { x + (board.getWidth( ) + 1) * cell, y + row * cell, cell, cell }, wallColor });
+	}
+
+	// Board row firstRow goes to y, everything above it is cut off
+	int firstRow = max(0, board.getHeight( ) - visibleRows);
+	int boardY = y - firstRow * cell;
+	for (int row = firstRow; row < board.getHeight( ); ++row) {
+		for (int col = 0; col < board.getWidth( ); ++col) {
+			int blockType = board.getCell(row, col);
+			if (blockType == 0) continue;
+			sprites.push_back({
+				shapeToAsset(static_cast<TetrominoShape>(blockType - 1)),
+				{ x + (col + 1) * cell, boardY + row * cell, cell, cell },
+				paletteColor(board.getColor(row, col))
+			});
+		}
+	}
+
+	if (board.getCurrentTetromino( )) {
+		size_t pieceStart = sprites.size( );
+		appendTetrominoSprites(sprites, *board.getCurrentTetromino( ), x + cell, boardY, cell);
+		sprites.erase(remove_if(sprites.begin( ) + pieceStart, sprites.end( ), [y](const Sprite& sprite) { return sprite.rect.y < y; }), sprites.end( ));
+	}
+}
+
+void Renderer::appendTetrominoSprites(vector<Sprite>& sprites, const Tetromino& tetromino, int x, int y, int cell) const {
+	int pieceX = tetromino.getX( ), pieceY = tetromino.getY( );
+	SDL_Color color = paletteColor(tetromino.getColorIndex( ));
+
+	if (tetromino.getShapeEnumn( ) == TetrominoShape::I) {
+		double angle = tetromino.getRotationAngle( );
+		bool horizontal = angle == 90 || angle == 270;
+		for (int i = 0; i < 4; ++i) {
+			TetrisAssets asset;
+			if (horizontal)
+				asset = i == 0 ? TetrisAssets::I_ENDR : (i == 3 ? TetrisAssets::I_STARTR : TetrisAssets::I_MIDR);
+			else
+				asset = i == 0 ? TetrisAssets::I_END : (i == 3 ? TetrisAssets::I_START : TetrisAssets::I_MID);
+			int col = pieceX + (horizontal ? i : 0), row = pieceY + (horizontal ? 0 : i);
+			sprites.push_back({ asset, { x + col * cell, y + row * cell, cell, cell }, color });
+		}
+		return;
+	}
+
+	const auto& shape = tetromino.getShape( );
+	for (int row = 0; row < shape.size( ); ++row)
+		for (int col = 0; col < shape[row].size( ); ++col)
+			if (shape[row][col] != 0)
+				sprites.push_back({ shapeToAsset(tetromino.getShapeEnumn( )), { x + (pieceX + col) * cell, y + (pieceY + row) * cell, cell, cell }, color });
+}
+
+void Renderer::drawSprites(vector<Sprite>& sprites) {
+	TRACE_ZONE("Renderer::drawSprites");
+	// Grouped by asset so the texture is set up once per asset instead of once per block
+	stable_sort(sprites.begin( ), sprites.end( ), [ ](const Sprite& a, const Sprite& b) { return a.asset < b.asset; });
+
+	for (size_t begin = 0; begin < sprites.size( );) {
+		size_t end = begin;
+		while (end < sprites.size( ) && sprites[end].asset == sprites[begin].asset) end++;
+
+		SDL_Texture* texture = assets->texture(textures[sprites[begin].asset]).handle.get( );
+		if (!texture) {
+			begin = end;
+			continue;
+		}
+
+		for (size_t i = begin; i < end; i++) {
+			SDL_SetTextureColorMod(texture, sprites[i].color.r, sprites[i].color.g, sprites[i].color.b);
+			SDL_RenderCopy(renderer.get( ), texture, nullptr, &sprites[i].rect);
+			drawCalls.add( );
+		}
+		begin = end;
+	}
+}
+
+void Renderer::renderRollbackStats(int rollbackDepth, double resimulationMs) {
+	TRACE_ZONE("Renderer::renderRollbackStats");
+	renderText(
+		fmt::format("rb {0} {1:.2f}ms", rollbackDepth, resimulationMs),
+		canvasWidth / 2,
+		canvasHeight - 10,
+		8,
+		SDL_Color{ 128, 128, 128 },
+		HAlign::CENTER
+	);
+}
+
+void Renderer::renderMessage(const string& message) {
+	TRACE_ZONE("Renderer::renderMessage");
+	SDL_SetRenderDrawColor(renderer.get( ), 248, 248, 248, 255);
+	SDL_RenderClear(renderer.get( ));
+
+	renderText(message, canvasWidth / 2, canvasHeight / 2, 8, SDL_Color{ 0, 0, 0 }, HAlign::CENTER, VAlign::CENTER);
+
+	present( );
+}
+
 Renderer::TextDimensions Renderer::renderText(const string& text, int x, int y, int fontSize, SDL_Color color, HAlign hAlign, VAlign vAlign) {
-	auto font = unique_ptr<TTF_Font, decltype(&TTF_CloseFont)>(TTF_OpenFont("assets/font/tetris-gb.ttf", fontSize), TTF_CloseFont);
-	if (!font) { SDL_Log("Failed to create font: %s", TTF_GetError( )); return{ 0,0,0,0 }; }
+	TRACE_ZONE("Renderer::renderText");
+	shared_ptr<TTF_Font> font = assets->font(FONT_PATH, fontSize);
+	if (!font) return{ 0,0,0,0 };
 
 	auto surface = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(TTF_RenderText_Solid(font.get( ), text.c_str( ), color), SDL_FreeSurface);
 	if (!surface) { SDL_Log("Failed to create surface: %s", TTF_GetError( ));return{ 0,0,0,0 }; }
 
-	auto texture = unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>(SDL_CreateTextureFromSurface(renderer.get( ), surface.get( )), SDL_DestroyTexture);
+	auto texture = unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>(AssetManager::trackTexture(SDL_CreateTextureFromSurface(renderer.get( ), surface.get( ))), AssetManager::destroyTexture);
 	if (!texture) { SDL_Log("Failed to create texture from surface: %s", SDL_GetError( ));return{ 0,0,0,0 }; }
+	textureCreations.add( );
 
 	int width = surface->w;
 	int height = surface->h;
@@ -419,25 +738,24 @@ Renderer::TextDimensions Renderer::renderText(const string& text, int x, int y,
 
 	SDL_Rect destRect = { x, y, width, height };
 	SDL_RenderCopy(renderer.get( ), texture.get( ), nullptr, &destRect);
+	drawCalls.add( );
 
 	return TextDimensions{ x, y, width, height };
 }
 
-Renderer::TextureDimensions* Renderer::renderTexture(
+Renderer::TextureDimensions Renderer::renderTexture(
 	const string& texturePath, int x, int y, int width, int height,
 	SDL_Color color, float scale, HAlign textHAlign, VAlign textVAlign) {
+	TRACE_ZONE("Renderer::renderTexture");
 
-	auto surface = unique_ptr <SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load(texturePath.c_str( )), SDL_FreeSurface);
-	if (!surface) { SDL_Log("Failed to load surface from %s: %s", texturePath, SDL_GetError( ));return nullptr; }
-
-	auto texture = unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)>(SDL_CreateTextureFromSurface(renderer.get( ), surface.get( )), SDL_DestroyTexture);
-	if (!texture) { SDL_Log("Failed to create texture from surface: %s", SDL_GetError( )); return nullptr; }
+	// The manager logged why when it could not be loaded
+	AssetManager::Texture texture = assets->texture(texturePath);
+	if (!texture.handle) return{ 0,0,0,0 };
 
-	SDL_SetTextureBlendMode(texture.get( ), SDL_BLENDMODE_BLEND);
-	SDL_SetTextureColorMod(texture.get( ), color.r, color.g, color.b);
+	SDL_SetTextureColorMod(texture.handle.get( ), color.r, color.g, color.b);
 
-	int textureWidth = static_cast<int>((width == 0 ? surface->w : width) * scale);
-	int textureHeight = static_cast<int>((height == 0 ? surface->h : height) * scale);
+	int textureWidth = static_cast<int>((width == 0 ? texture.width : width));
+	int textureHeight = static_cast<int>((height == 0 ? texture.height : height));
 
 	if (textHAlign == HAlign::CENTER)
 		x -= textureWidth / 2;
@@ -451,26 +769,47 @@ Renderer::TextureDimensions* Renderer::renderTexture(
 		y -= textureHeight;
 
 	SDL_Rect rect{ x,y,textureWidth,textureHeight };
-	SDL_RenderCopy(renderer.get( ), texture.get( ), nullptr, &rect);
+	SDL_RenderCopy(renderer.get( ), texture.handle.get( ), nullptr, &rect);
+	drawCalls.add( );
 
-	return new TextureDimensions{ x,y,textureWidth, textureHeight };
+	return TextureDimensions{ x,y,textureWidth, textureHeight, color };
 }
 
-const int Renderer::getScale( ) const { return scale; }
-
-void Renderer::setScale(int newScale) { scale = newScale; }
-
-void Renderer::setOffset(int newX, int newY) {
-	offsetX = newX;
-	offsetY = newY;
+void Renderer::present( ) {
+	TRACE_ZONE("Renderer::present");
+	presentTexture(canvas.get( ), canvasWidth, canvasHeight);
+	SDL_SetRenderTarget(renderer.get( ), canvas.get( ));
 }
 
-const int Renderer::getOffsetX( ) const { return offsetX; }
+void Renderer::presentTexture(SDL_Texture* texture, int width, int height) {
+	// The texture is the only thing drawn at output resolution, once, at the largest integer
+	// scale that fits and centered; a window smaller than the texture shrinks it to fit instead
+	int outputWidth, outputHeight;
+	SDL_GetRendererOutputSize(renderer.get( ), &outputWidth, &outputHeight);
+	SDL_Rect output{ 0, 0, outputWidth, outputHeight };
+	int upscale = min(outputWidth / width, outputHeight / height);
+	if (upscale >= 1) {
+		output.w = width * upscale;
+		output.h = height * upscale;
+	} else if (outputWidth * height > outputHeight * width) {
+		output.w = outputHeight * width / height;
+	} else {
+		output.h = outputWidth * height / width;
+	}
+	output.x = (outputWidth - output.w) / 2;
+	output.y = (outputHeight - output.h) / 2;
+
+	SDL_SetRenderTarget(renderer.get( ), nullptr);
+	SDL_SetRenderDrawColor(renderer.get( ), 0, 0, 0, 255);
+	SDL_RenderClear(renderer.get( ));
+	SDL_RenderCopy(renderer.get( ), texture, nullptr, &output);
+	drawCalls.add( );
+	SDL_RenderPresent(renderer.get( ));
 
-const int Renderer::getOffsetY( ) const { return offsetY; }
+	uint64_t now = SDL_GetPerformanceCounter( );
+	if (lastPresent != 0) frameTime.observe(static_cast<uint64_t>((now - lastPresent) * 1e9 / SDL_GetPerformanceFrequency( )));
+	lastPresent = now;
+	framesRendered.add( );
 
-void Renderer::setWindowSize(int w, int h) {
-	windowWidth = w;
-	windowHeight = h;
+	assets->endFrame( );
 }
-
@@ -2,6 +2,7 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <fmt/format.h>
 
 extern "C" {
@@ -10,7 +11,11 @@ extern "C" {
 #include <SDL2/SDL_ttf.h>
 }
 
-#include "GameBoard.hpp"
+#include "BoardView.hpp"
+#include "AssetManager.hpp"
+#include "GameEvents.hpp"
+
+class TileRenderer;
 
 enum class TetrisAssets {
 	BORDER,
@@ -30,20 +35,65 @@ enum class TetrisAssets {
 	T,
 };
 
+// Everything is drawn 1:1 in sprite pixels into a small canvas texture; present( ) scales that
+// canvas to the window in a single copy, so the window can take any size
 class Renderer {
+public:
+	// Game Boy screen, the single player layout
+	static constexpr int NATIVE_WIDTH = 160;
+	static constexpr int NATIVE_HEIGHT = 144;
+	// Two boards with walls and two text rows above them
+	static constexpr int SIDE_BY_SIDE_WIDTH = 200;
+	static constexpr int SIDE_BY_SIDE_HEIGHT = 180;
+
+	enum class Layout {
+		SINGLE,
+		SIDE_BY_SIDE,
+	};
+
 private:
 	void drawWall(const int w, const int h);
-	void drawLockedBlocks(const shared_ptr<GameBoard> gameBoard);
-	void drawTetromino(const shared_ptr<Tetromino> tetromino);
+	// firstRow is the board row drawn at the top of the canvas, rows above it are cut off
+	void drawLockedBlocks(const BoardView& gameBoard, int firstRow);
+	void drawTetromino(const shared_ptr<Tetromino> tetromino, int firstRow = 0);
 	void drawScoreboard(int score, int level, int lines);
 
+	// One sprite of a batched pass, see renderSideBySide
+	struct Sprite {
+		TetrisAssets asset;
+		SDL_Rect rect;
+		SDL_Color color;
+	};
+	// Draws the bottom visibleRows rows of the board
+	void appendBoardSprites(vector<Sprite>& sprites, const BoardView& board, int x, int y, int cell, int visibleRows) const;
+	void appendTetrominoSprites(vector<Sprite>& sprites, const Tetromino& tetromino, int x, int y, int cell) const;
+	void drawSprites(vector<Sprite>& sprites);
+
+	void onBoardEvents(const GameEventBuffer& batch);
+	// Board rows whose cells may have changed since the last call, every row unless subscribe( )d
+	uint64_t takeDirtyRows( );
+
+	// Shows texture centered on the window at the largest integer scale, or shrunk to fit
+	void presentTexture(SDL_Texture* texture, int width, int height);
+
 	const TetrisAssets shapeToAsset(const TetrominoShape shape) const;
+	const SDL_Color paletteColor(int colorIndex) const;
 
 	const shared_ptr<SDL_Renderer> renderer;
-
-	int scale = 5, gridSize = 8;
-	int offsetX, offsetY;
-	int windowHeight = 0, windowWidth = 0;
+	// Every image and font comes from here, textures are created once and shared between draws
+	const shared_ptr<AssetManager> assets;
+
+	int gridSize = 8;
+	unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> canvas;
+	int canvasHeight = 0, canvasWidth = 0;
+	Layout layout = Layout::SINGLE;
+	// Set by useTileBackend( ), draws the single player board instead of the sprite calls below
+	unique_ptr<TileRenderer> tiles;
+	friend class TileRenderer;
+	friend class MosaicRenderer;
+	// Collected from the board events for the tile backend, see takeDirtyRows( )
+	bool tracksBoardEvents = false;
+	uint64_t dirtyRows = ~0ull;
 
 	unordered_map<TetrisAssets, string> textures;
 
@@ -64,35 +114,54 @@ private:
 		const int fontSize;
 	};
 
+	// Where a texture was drawn; kept between frames, so unlike TextDimensions it is assignable
 	struct TextureDimensions {
-		const int x, y, w, h;
-		const SDL_Color color;
+		int x, y, w, h;
+		SDL_Color color;
 	};
 
-	TextureDimensions* scoreBoardDimensions;
-	TextureDimensions* leftBorder, * rightBorder;
+	TextureDimensions scoreBoardDimensions{ };
+	TextureDimensions leftBorder{ }, rightBorder{ };
+
+	uint64_t lastPresent = 0;
 
 public:
-	Renderer(shared_ptr<SDL_Renderer> renderer, int w, int h);
+	// Lists the images and the font of every screen with assets, see AssetGroup
+	Renderer(shared_ptr<SDL_Renderer> renderer, shared_ptr<AssetManager> assets);
+	~Renderer( );
+
+	// Switches renderBoard and renderTetrominoPreview to the CPU tile renderer, false when it
+	// could not be set up and the sprite path stays
+	bool useTileBackend( );
 
-	void renderBoard(const shared_ptr<GameBoard> gameBoard);
+	// Takes the locked cell changes from the board events instead of rereading every cell each frame.
+	// Only the boards recording into the bus may be drawn with renderBoard from then on.
+	void subscribe(GameEventBus& bus);
+
+	// Switches the canvas size, the renderer must support render targets
+	void setLayout(Layout layout);
+
+	// Any board size; a board taller than the canvas shows its bottom rows
+	void renderBoard(const shared_ptr<const BoardView> gameBoard);
 
 	void renderStartScreen( );
-	void renderGameOver(shared_ptr<GameBoard> gameBoard);
+	// rank is the finished game's place among all recorded games out of total, 0 when not recorded
+	void renderGameOver(shared_ptr<const BoardView> gameBoard, uint64_t rank = 0, uint64_t total = 0);
 	TextDimensions renderText(
 		const string& text, int x, int y, int fontSize,
 		SDL_Color color, HAlign textHAlign = HAlign::LEFT, VAlign textVAlign = VAlign::TOP
 	);
-	TextureDimensions* renderTexture(
+	// All zero when the texture could not be loaded
+	TextureDimensions renderTexture(
 		const string& texturePath, int x, int y, int width = 0, int height = 0,
 		SDL_Color color = { 255,255,255 }, float scale = 1.0f, HAlign textHAlign = HAlign::LEFT, VAlign textVAlign = VAlign::TOP
 	);
 	void renderTetrominoPreview(const shared_ptr<Tetromino> nextTetromino);
-
-	const int getScale( ) const;
-	void setScale(int newBlockSize);
-	void setOffset(int newX, int newY);
-	const int getOffsetX( ) const;
-	const int getOffsetY( ) const;
-	void setWindowSize(int w, int h);
+	// Both boards of a versus match in one batched pass, left and right half of the canvas, needs Layout::SIDE_BY_SIDE
+	void renderSideBySide(const shared_ptr<const BoardView> left, const shared_ptr<const BoardView> right);
+	void renderRollbackStats(int rollbackDepth, double resimulationMs);
+	void renderMessage(const string& message);
+	// Scales the canvas to the window, SDL_RenderPresent plus the frame count and frame time metrics,
+	// then lets the asset manager prefetch and evict
+	void present( );
 };
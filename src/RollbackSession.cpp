@@ -0,0 +1,311 @@
+#include "RollbackSession.hpp"
+#include <chrono>
+#include <random>
+#include <iostream>
+
+// type, ack, frame, advantage, first input frame, input count, hashed frame, board hash
+static const int INPUT_HEADER = 27;
+
+static void writeU32(uint8_t* out, uint32_t value) {
+	for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static uint32_t readU32(const uint8_t* in) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+	return value;
+}
+
+static void writeU64(uint8_t* out, uint64_t value) {
+	writeU32(out, static_cast<uint32_t>(value));
+	writeU32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+static uint64_t readU64(const uint8_t* in) {
+	return readU32(in) | (static_cast<uint64_t>(readU32(in + 4)) << 32);
+}
+
+RollbackSession::RollbackSession(const VersusConfig& versusConfig) : config(versusConfig), localPlayer(versusConfig.host ? 0 : 1) {
+	// Keeps every unacknowledged input inside one packet, see sendInputs
+	config.inputDelay = max(0, min(config.inputDelay, 8));
+	if (config.host) {
+		random_device dev;
+		seed = (static_cast<uint64_t>(dev( )) << 32) | dev( );
+		if (seed == 0) seed = 1;
+	}
+}
+
+bool RollbackSession::open( ) {
+	if (!socket.open(config.localPort)) return false;
+	conditioner.configure(config.latencyMs, config.jitterMs, config.lossPercent);
+
+	if (!config.host) {
+		if (!NetAddress::parse(config.remote, peer)) {
+			cerr << "Invalid remote address " << config.remote << endl;
+			return false;
+		}
+		hasPeer = true;
+	}
+
+	cerr << "Versus " << (config.host ? "hosting" : "joining") << " on UDP port " << socket.getLocalPort( ) << endl;
+	return true;
+}
+
+void RollbackSession::poll(uint32_t nowMs) {
+	conditioner.flush(socket, nowMs);
+	receive(nowMs);
+
+	if (!hasPeer || nowMs - lastSendMs < 1000 / GameBoard::TICKS_PER_SECOND) return;
+
+	// The client keeps knocking until the host answers, the host repeats its seed until echoed
+	if (!synchronized)
+		sendSync(nowMs);
+	else
+		sendInputs(nowMs);
+}
+
+bool RollbackSession::advance(uint8_t heldButtons, uint32_t nowMs) {
+	if (!synchronized) return false;
+
+	rollback( );
+	checkRemoteHash( );
+
+	if (currentFrame >= remoteConfirmed + MAX_ROLLBACK) {
+		stats.stalls++;
+		return false;
+	}
+
+	// Both sides see the other one delayed by the same latency, so only the difference matters.
+	// The peer running ahead waits a frame, otherwise it would do all the rolling back
+	int localAdvantage = static_cast<int>(currentFrame - remoteFrame);
+	if (localAdvantage - remoteAdvantage >= 2) {
+		stats.timeSyncWaits++;
+		remoteAdvantage++;
+		return false;
+	}
+
+	localInputs[(currentFrame + config.inputDelay) % INPUT_HISTORY] = heldButtons;
+
+	FrameState state{ currentFrame, { boards[0]->snapshot( ), boards[1]->snapshot( ) } };
+	states.push(state);
+	simulateFrame(currentFrame);
+	currentFrame++;
+
+	sendInputs(nowMs);
+
+	stats.frame = currentFrame;
+	stats.remoteLag = currentFrame > remoteConfirmed ? static_cast<int>(currentFrame - remoteConfirmed) : 0;
+	stats.packetsDropped = conditioner.getDropped( );
+	return true;
+}
+
+void RollbackSession::simulateFrame(uint32_t frame) {
+	uint8_t inputs[2];
+	uint8_t remote = remoteInputFor(frame);
+	usedRemoteInputs[frame % INPUT_HISTORY] = remote;
+	inputs[localPlayer] = localInputs[frame % INPUT_HISTORY];
+	inputs[1 - localPlayer] = remote;
+
+	// Fixed board order on both peers keeps the simulation identical
+	boards[0]->tick(inputs[0]);
+	boards[1]->tick(inputs[1]);
+
+	GameBoard::exchangeGarbage(*boards[0], *boards[1]);
+	frameHashes[frame % INPUT_HISTORY] = hashBoards( );
+
+	toppedOut[frame % INPUT_HISTORY] = boards[0]->isCollision( ) || boards[1]->isCollision( );
+}
+
+void RollbackSession::rollback( ) {
+	stats.rollbackDepth = 0;
+	stats.resimulationMs = 0.0;
+
+	if (rollbackFrom >= currentFrame) {
+		rollbackFrom = UINT32_MAX;
+		return;
+	}
+
+	// The latest stored state is the one frame currentFrame - 1 started from
+	size_t age = currentFrame - 1 - rollbackFrom;
+	const FrameState* state = states.peek(age);
+	rollbackFrom = UINT32_MAX;
+	if (!state) {
+		cerr << "Rollback target fell out of the snapshot ring" << endl;
+		return;
+	}
+
+	auto start = chrono::steady_clock::now( );
+	uint32_t frame = state->frame;
+	boards[0]->restore(state->boards[0]);
+	boards[1]->restore(state->boards[1]);
+	states.rewind(age + 1);
+
+	// Consumers hear of the corrected frames only as the BOARD_RESET of the reattached buffer
+	boards[localPlayer]->setEventBuffer(nullptr);
+	for (; frame < currentFrame; frame++) {
+		FrameState resimulated{ frame, { boards[0]->snapshot( ), boards[1]->snapshot( ) } };
+		states.push(resimulated);
+		simulateFrame(frame);
+	}
+	boards[localPlayer]->setEventBuffer(&events);
+
+	stats.rollbackDepth = static_cast<int>(age + 1);
+	stats.resimulationMs = chrono::duration<double, milli>(chrono::steady_clock::now( ) - start).count( );
+	stats.maxRollbackDepth = max(stats.maxRollbackDepth, stats.rollbackDepth);
+	stats.maxResimulationMs = max(stats.maxResimulationMs, stats.resimulationMs);
+	stats.rollbacks++;
+	stats.resimulatedFrames += stats.rollbackDepth;
+}
+
+uint64_t RollbackSession::hashBoards( ) const {
+	return boards[0]->getHash( ) ^ (boards[1]->getHash( ) * 0x9E3779B97F4A7C15ull);
+}
+
+void RollbackSession::checkRemoteHash( ) {
+	// Comparable once our own state after those frames was simulated on confirmed inputs too
+	uint32_t frame = remoteHashFrame;
+	if (frame == 0 || frame > min(remoteConfirmed, currentFrame)) return;
+	remoteHashFrame = 0;
+	if (currentFrame - frame >= INPUT_HISTORY) return;
+
+	stats.hashChecks++;
+	if (frameHashes[(frame - 1) % INPUT_HISTORY] == remoteHash) return;
+	if (stats.desyncs++ == 0) cerr << "Versus desync: the boards after frame " << frame - 1 << " differ from the remote's" << endl;
+}
+
+uint8_t RollbackSession::remoteInputFor(uint32_t frame) const {
+	if (frame < remoteConfirmed) return remoteInputs[frame % INPUT_HISTORY];
+	// Predict that the remote keeps holding whatever it held last
+	return remoteConfirmed > 0 ? remoteInputs[(remoteConfirmed - 1) % INPUT_HISTORY] : 0;
+}
+
+void RollbackSession::receive(uint32_t nowMs) {
+	uint8_t buffer[512];
+	NetAddress from;
+	int size;
+	while ((size = socket.receiveFrom(from, buffer, sizeof(buffer))) > 0) {
+		switch (static_cast<PacketType>(buffer[0])) {
+		case PacketType::SYNC:
+			handleSync(buffer, size, from, nowMs);
+			if (synchronized && !config.host) sendSync(nowMs);
+			break;
+		case PacketType::INPUT:
+			if (synchronized && hasPeer && from == peer) handleInput(buffer, size);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void RollbackSession::handleSync(const uint8_t* data, int size, const NetAddress& from, uint32_t nowMs) {
+	if (size < 9) return;
+	uint64_t packetSeed = readU64(data + 1);
+
+	if (config.host) {
+		if (!hasPeer) {
+			peer = from;
+			hasPeer = true;
+			cerr << "Versus peer " << peer.toString( ) << " connected" << endl;
+		}
+		if (from != peer || synchronized) return;
+		// The client echoes our seed once it has started
+		if (packetSeed == seed) synchronized = true;
+		else sendSync(nowMs);
+	} else {
+		if (synchronized || from != peer || packetSeed == 0) return;
+		seed = packetSeed;
+		synchronized = true;
+	}
+
+	if (synchronized) {
+		for (auto& board : boards) board = make_shared<GameBoard>(seed);
+		boards[localPlayer]->setEventBuffer(&events);
+	}
+}
+
+void RollbackSession::handleInput(const uint8_t* data, int size) {
+	if (size < INPUT_HEADER) return;
+	uint32_t ack = readU32(data + 1);
+	uint32_t frame = readU32(data + 5);
+	int8_t advantage = static_cast<int8_t>(data[9]);
+	uint32_t start = readU32(data + 10);
+	int count = min<int>(data[14], size - INPUT_HEADER);
+	uint32_t hashFrame = readU32(data + 15);
+	if (hashFrame > remoteHashFrame) {
+		remoteHashFrame = hashFrame;
+		remoteHash = readU64(data + 19);
+	}
+
+	remoteAcked = max(remoteAcked, ack);
+	if (frame >= remoteFrame) {
+		remoteFrame = frame;
+		remoteAdvantage = advantage;
+	}
+
+	for (int i = 0; i < count; i++) {
+		uint32_t frame = start + i;
+		if (frame < remoteConfirmed) continue;
+		if (frame > remoteConfirmed || frame >= currentFrame + INPUT_HISTORY - MAX_ROLLBACK) break;
+
+		uint8_t input = data[INPUT_HEADER + i];
+		remoteInputs[frame % INPUT_HISTORY] = input;
+		if (frame < currentFrame && usedRemoteInputs[frame % INPUT_HISTORY] != input)
+			rollbackFrom = min(rollbackFrom, frame);
+		remoteConfirmed++;
+	}
+}
+
+void RollbackSession::sendSync(uint32_t nowMs) {
+	uint8_t packet[9];
+	packet[0] = static_cast<uint8_t>(PacketType::SYNC);
+	writeU64(packet + 1, seed);
+	conditioner.send(socket, peer, packet, sizeof(packet), nowMs);
+	lastSendMs = nowMs;
+}
+
+void RollbackSession::sendInputs(uint32_t nowMs) {
+	// Everything the remote has not acknowledged yet, so a lost packet is repaired by the next one
+	uint32_t known = currentFrame + config.inputDelay;
+	uint32_t start = remoteAcked;
+	int count = static_cast<int>(min<uint32_t>(known - min(known, start), INPUTS_PER_PACKET));
+
+	int advantage = static_cast<int>(currentFrame - remoteFrame);
+
+	uint8_t packet[INPUT_HEADER + INPUTS_PER_PACKET];
+	packet[0] = static_cast<uint8_t>(PacketType::INPUT);
+	writeU32(packet + 1, remoteConfirmed);
+	writeU32(packet + 5, currentFrame);
+	packet[9] = static_cast<uint8_t>(static_cast<int8_t>(max(-127, min(127, advantage))));
+	writeU32(packet + 10, start);
+	packet[14] = static_cast<uint8_t>(count);
+	// The newest state both inputs are known for, frames a pending rollback will redo do not count yet
+	uint32_t hashFrame = min(min(remoteConfirmed, currentFrame), rollbackFrom);
+	writeU32(packet + 15, hashFrame);
+	writeU64(packet + 19, hashFrame > 0 ? frameHashes[(hashFrame - 1) % INPUT_HISTORY] : 0);
+	for (int i = 0; i < count; i++)
+		packet[INPUT_HEADER + i] = localInputs[(start + i) % INPUT_HISTORY];
+
+	conditioner.send(socket, peer, packet, INPUT_HEADER + count, nowMs);
+	lastSendMs = nowMs;
+}
+
+bool RollbackSession::isSynchronized( ) const { return synchronized; }
+
+bool RollbackSession::isFinished( ) const {
+	if (!synchronized || rollbackFrom != UINT32_MAX) return false;
+
+	// Only a top out reached on confirmed inputs ends the match, a predicted one may still be rolled back
+	uint32_t confirmed = min(remoteConfirmed, currentFrame);
+	return confirmed > 0 && toppedOut[(confirmed - 1) % INPUT_HISTORY];
+}
+
+bool RollbackSession::isWinner( ) const {
+	return isFinished( ) && !getLocalBoard( )->isCollision( ) && getRemoteBoard( )->isCollision( );
+}
+
+GameEventBuffer& RollbackSession::getEvents( ) { return events; }
+
+const shared_ptr<GameBoard> RollbackSession::getLocalBoard( ) const { return boards[localPlayer]; }
+const shared_ptr<GameBoard> RollbackSession::getRemoteBoard( ) const { return boards[1 - localPlayer]; }
+const RollbackSession::Stats& RollbackSession::getStats( ) const { return stats; }
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include "GameBoard.hpp"
+#include "SnapshotRing.hpp"
+#include "Net.hpp"
+
+using namespace std;
+
+struct VersusConfig {
+	bool host = false;
+	uint16_t localPort = 0;
+	string remote;
+	int inputDelay = 2;
+
+	// Link conditioner applied to everything this process sends
+	uint32_t latencyMs = 0;
+	uint32_t jitterMs = 0;
+	float lossPercent = 0.0f;
+};
+
+// Two player versus over UDP with input delay and rollback.
+// Both boards are simulated locally, the remote player's inputs are predicted
+// until they arrive and mispredicted frames are re-simulated from a snapshot.
+class RollbackSession {
+public:
+	static constexpr int MAX_ROLLBACK = 16;
+	static constexpr int INPUT_HISTORY = 128;
+	static constexpr int INPUTS_PER_PACKET = 64;
+
+	struct Stats {
+		uint32_t frame = 0;
+		int rollbackDepth = 0;          // frames re-simulated during the last advance
+		double resimulationMs = 0.0;    // time spent doing that
+		int maxRollbackDepth = 0;
+		double maxResimulationMs = 0.0;
+		uint32_t rollbacks = 0;
+		uint32_t resimulatedFrames = 0;
+		uint32_t stalls = 0;
+		uint32_t timeSyncWaits = 0;
+		uint32_t packetsDropped = 0;
+		int remoteLag = 0;              // frames simulated on prediction alone
+		uint32_t hashChecks = 0;        // confirmed frames compared with the remote's board hashes
+		uint32_t desyncs = 0;           // of those, frames where the boards differed
+	};
+
+private:
+	enum class PacketType : uint8_t {
+		SYNC = 1,
+		INPUT = 2,
+	};
+
+	struct FrameState {
+		uint32_t frame;
+		GameBoard::Snapshot boards[2];
+	};
+
+	void simulateFrame(uint32_t frame);
+	void rollback( );
+	void receive(uint32_t nowMs);
+	void handleSync(const uint8_t* data, int size, const NetAddress& from, uint32_t nowMs);
+	void handleInput(const uint8_t* data, int size);
+	void sendSync(uint32_t nowMs);
+	void sendInputs(uint32_t nowMs);
+	uint8_t remoteInputFor(uint32_t frame) const;
+	// Both boards after simulating the frame, in the fixed board order of simulateFrame
+	uint64_t hashBoards( ) const;
+	void checkRemoteHash( );
+
+	VersusConfig config;
+	UdpSocket socket;
+	LinkConditioner conditioner;
+	NetAddress peer;
+	bool hasPeer = false;
+	bool synchronized = false;
+	uint64_t seed = 0;
+
+	int localPlayer;
+	array<shared_ptr<GameBoard>, 2> boards;
+	SnapshotRing<FrameState, MAX_ROLLBACK + 2> states;
+
+	array<uint8_t, INPUT_HISTORY> localInputs{ };
+	array<uint8_t, INPUT_HISTORY> remoteInputs{ };
+	array<uint8_t, INPUT_HISTORY> usedRemoteInputs{ };
+	array<bool, INPUT_HISTORY> toppedOut{ };
+	// hashBoards( ) after each frame, rewritten when the frame is re-simulated
+	array<uint64_t, INPUT_HISTORY> frameHashes{ };
+	// Newest hash the remote sent: of the state after frames below remoteHashFrame, 0 for none
+	uint32_t remoteHashFrame = 0;
+	uint64_t remoteHash = 0;
+	uint32_t currentFrame = 0;      // next frame to simulate
+	uint32_t remoteConfirmed = 0;   // remote inputs known for all frames below this
+	uint32_t remoteAcked = 0;       // the remote has all our inputs below this
+	uint32_t rollbackFrom = UINT32_MAX;
+	uint32_t remoteFrame = 0;       // newest frame the remote reported to be on
+	int remoteAdvantage = 0;        // how far ahead the remote thinks it is
+	uint32_t lastSendMs = 0;
+
+	// The local board's events, re-simulated frames record nothing since they were delivered once
+	GameEventBuffer events;
+	Stats stats;
+
+public:
+	RollbackSession(const VersusConfig& config);
+
+	bool open( );
+	// Pumps the network, must be called every frame even while not advancing
+	void poll(uint32_t nowMs);
+	// Simulates one frame with the buttons currently held, false when waiting for the remote
+	bool advance(uint8_t heldButtons, uint32_t nowMs);
+
+	bool isSynchronized( ) const;
+	bool isFinished( ) const;
+	// True when the local player is the last one standing
+	bool isWinner( ) const;
+
+	// Events of the local board since the caller last emptied it, see GameEventBus::publish
+	GameEventBuffer& getEvents( );
+
+	const shared_ptr<GameBoard> getLocalBoard( ) const;
+	const shared_ptr<GameBoard> getRemoteBoard( ) const;
+	const Stats& getStats( ) const;
+};
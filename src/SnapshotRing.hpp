@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+using namespace std;
+
+// Fixed-size ring of the most recent snapshots, oldest entries are overwritten.
+// Push, peek and pop are a single copy of T and never allocate.
+template <typename T, size_t Capacity>
+class SnapshotRing {
+	static_assert(is_trivially_copyable<T>::value, "Snapshots must be trivially copyable");
+	static_assert(Capacity > 0, "SnapshotRing needs at least one slot");
+
+private:
+	array<T, Capacity> entries;
+	size_t head = 0;
+	size_t count = 0;
+
+public:
+	void push(const T& snapshot) {
+		entries[head] = snapshot;
+		head = (head + 1) % Capacity;
+		if (count < Capacity) count++;
+	}
+
+	// age 0 is the latest snapshot, age size( ) - 1 the oldest one still kept
+	const T* peek(size_t age = 0) const {
+		if (age >= count) return nullptr;
+		return &entries[(head + Capacity - 1 - age) % Capacity];
+	}
+
+	bool pop(T& out) {
+		if (count == 0) return false;
+		head = (head + Capacity - 1) % Capacity;
+		count--;
+		out = entries[head];
+		return true;
+	}
+
+	// Drops the newest entries so that the snapshot of the given age becomes the latest
+	void rewind(size_t age) {
+		size_t dropped = age < count ? age : count;
+		head = (head + Capacity - dropped) % Capacity;
+		count -= dropped;
+	}
+
+	void clear( ) { head = count = 0; }
+
+	size_t size( ) const { return count; }
+	bool empty( ) const { return count == 0; }
+	static constexpr size_t capacity( ) { return Capacity; }
+};
@@ -0,0 +1,101 @@
+#include "SoakMonitor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+SoakMonitor::SoakMonitor(uint32_t warmupSamples) : warmupSamples(warmupSamples) { }
+
+void SoakMonitor::track(const string& name, function<int64_t( )> read, int64_t slack) {
+	series.push_back({ name, move(read), slack, { } });
+}
+
+void SoakMonitor::sample(uint64_t seconds) {
+	sampleHours.push_back(seconds / 3600.0);
+	for (Series& tracked : series) tracked.samples.push_back(tracked.read( ));
+}
+
+size_t SoakMonitor::getSampleCount( ) const { return sampleHours.size( ); }
+
+bool SoakMonitor::isConclusive( ) const { return sampleHours.size( ) >= warmupSamples + 9; }
+
+vector<SoakMonitor::Trend> SoakMonitor::getTrends( ) const {
+	vector<Trend> trends;
+	size_t begin = min<size_t>(warmupSamples, sampleHours.size( ));
+	size_t count = sampleHours.size( ) - begin;
+	for (const Series& tracked : series) {
+		Trend trend;
+		trend.name = tracked.name;
+		if (count == 0) {
+			trends.push_back(trend);
+			continue;
+		}
+
+		auto first = tracked.samples.begin( ) + begin, end = tracked.samples.end( );
+		trend.first = *first;
+		trend.last = tracked.samples.back( );
+		trend.low = *min_element(first, end);
+		trend.high = *max_element(first, end);
+
+		double meanHours = 0, meanValue = 0;
+		for (size_t i = begin; i < sampleHours.size( ); i++) {
+			meanHours += sampleHours[i];
+			meanValue += static_cast<double>(tracked.samples[i]);
+		}
+		meanHours /= count;
+		meanValue /= count;
+		double covariance = 0, variance = 0;
+		for (size_t i = begin; i < sampleHours.size( ); i++) {
+			covariance += (sampleHours[i] - meanHours) * (tracked.samples[i] - meanValue);
+			variance += (sampleHours[i] - meanHours) * (sampleHours[i] - meanHours);
+		}
+		trend.slopePerHour = variance > 0 ? covariance / variance : 0;
+
+		if (count >= 3) {
+			size_t third = count / 3;
+			vector<int64_t> early(first, first + third), late(end - third, end);
+			sort(early.begin( ), early.end( ));
+			sort(late.begin( ), late.end( ));
+			int64_t spread = early[third * 3 / 4] - early[third / 4];
+			trend.growing = late[third / 2] > early[third / 2] + tracked.slack + spread;
+		}
+		trends.push_back(trend);
+	}
+	return trends;
+}
+
+bool SoakMonitor::passed( ) const {
+	if (!isConclusive( )) return false;
+	for (const Trend& trend : getTrends( ))
+		if (trend.growing) return false;
+	return true;
+}
+
+int64_t SoakMonitor::residentBytes( ) {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess( ), &counters, sizeof(counters))) return 0;
+	return static_cast<int64_t>(counters.WorkingSetSize);
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self( ), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) return 0;
+	return static_cast<int64_t>(info.resident_size);
+#else
+	// Second field: resident pages
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file) return 0;
+	long long size = 0, resident = 0;
+	int fields = fscanf(file, "%lld %lld", &size, &resident);
+	fclose(file);
+	return fields == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
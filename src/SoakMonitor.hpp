@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SoakConfig {
+	// Simulated hours of play, 0 runs the normal game
+	double hours = 0;
+	// Simulated seconds between samples
+	uint32_t sampleSeconds = 60;
+	// Samples left out of the trend while caches and pools fill up
+	uint32_t warmupSamples = 10;
+};
+
+// Samples resource counts over a long run and tells which of them keep growing after warm-up. A
+// series grows when the median of the last third of the samples after warm-up lies above the median
+// of the first third by more than its slack plus the first third's interquartile range. A level that
+// rises and falls with what is on screen passes however noisy it is, a leak fails once the run is
+// long enough for it to outgrow that noise.
+class SoakMonitor {
+public:
+	struct Trend {
+		string name;
+		int64_t first = 0, last = 0;
+		int64_t low = 0, high = 0;      // over the samples after warm-up
+		double slopePerHour = 0;        // least squares over the samples after warm-up
+		bool growing = false;
+	};
+
+private:
+	struct Series {
+		string name;
+		function<int64_t( )> read;
+		int64_t slack;
+		vector<int64_t> samples;
+	};
+
+	uint32_t warmupSamples;
+	vector<Series> series;
+	vector<double> sampleHours;
+
+public:
+	explicit SoakMonitor(uint32_t warmupSamples);
+
+	// slack absorbs growth that is not a leak, e.g. the allocator keeping freed pages
+	void track(const string& name, function<int64_t( )> read, int64_t slack = 0);
+	// Reads every series, at simulated time seconds
+	void sample(uint64_t seconds);
+
+	size_t getSampleCount( ) const;
+	// Enough samples after warm-up to judge a trend, at least three per third
+	bool isConclusive( ) const;
+	vector<Trend> getTrends( ) const;
+	// Conclusive and nothing growing
+	bool passed( ) const;
+
+	// Resident set size of this process in bytes, 0 where it cannot be read
+	static int64_t residentBytes( );
+};
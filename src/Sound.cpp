@@ -1,64 +1,354 @@
 #include "Sound.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+#include <chrono>
+
+// Mix_GetMusicPosition came with SDL_mixer 2.6, older versions restart the music after a reopen
+#ifdef SDL_MIXER_VERSION_ATLEAST
+#if SDL_MIXER_VERSION_ATLEAST(2, 6, 0)
+#define SOUND_RESUMES_MUSIC
+#endif
+#endif
+
+namespace {
+	struct SoundPolicy {
+		int priority;   // a sound may cut a playing one of lower or equal priority
+		int maxVoices;  // a further play restarts the oldest voice of the same sound
+	};
+
+	// Indexed by SoundName
+	constexpr SoundPolicy SOUND_POLICIES[] = {
+		{ 9, 1 },   // GAME_OVER
+		{ 6, 2 },   // LINE_CLEAR
+		{ 1, 2 },   // MOVE_PIECE
+		{ 3, 2 },   // PIECE_LANDED
+		{ 9, 1 },   // ROCKET_ENDING
+		{ 8, 1 },   // TETRIS_LINE_CLEAR
+		{ 7, 1 },   // LEVEL_UP
+		{ 4, 1 },   // MENU
+		{ 3, 2 },   // PIECE_FALLING_AFTER_LINE_CLEAR
+		{ 5, 2 },   // PLAYER_SENDING_BLOCKS
+		{ 2, 2 },   // ROTATE_PIECE
+	};
+	static_assert(sizeof(SOUND_POLICIES) / sizeof(SOUND_POLICIES[0]) == static_cast<size_t>(SoundName::COUNT), "every sound needs a policy");
+
+	Metrics::Counter& audioEventsDropped = Metrics::counter("tetris_audio_events_dropped_total", "Sound events lost to a full queue or no free voice");
+
+	// Indexed by SoundName
+	const char* const SOUND_PATHS[ ] = {
+		"assets/sound_effects/game_over.wav",
+		"assets/sound_effects/line_clear.wav",
+		"assets/sound_effects/move_piece.wav",
+		"assets/sound_effects/piece_landed.wav",
+		"assets/sound_effects/rocket_ending.wav",
+		"assets/sound_effects/tetris_line_clear.wav",
+		"assets/sound_effects/level_up.wav",
+		"assets/sound_effects/menu.wav",
+		"assets/sound_effects/piece_falling_after_line_clear.wav",
+		"assets/sound_effects/player_sending_blocks.wav",
+		"assets/sound_effects/rotate_piece.wav",
+	};
+	static_assert(sizeof(SOUND_PATHS) / sizeof(SOUND_PATHS[0]) == static_cast<size_t>(SoundName::COUNT), "every sound needs a file");
+
+	// Indexed by MusicName
+	const char* const MUSIC_PATHS[ ] = {
+		"assets/sound_tracks/bgm.mp3",
+	};
+
+	// Polling interval of the audio thread while the queue is empty
+	constexpr auto AUDIO_POLL = chrono::milliseconds(2);
+}
 
 unique_ptr<unordered_map<SoundName, shared_ptr<Mix_Chunk>>> Sound::cachedSounds = nullptr;
-unique_ptr<unordered_map<MusicName, shared_ptr<Mix_Music>>> Sound::cachedMusic = nullptr;
 
-Sound::Sound( ) {
+Sound::Sound(AssetManager& assets) : assets(assets), frameTicks(SDL_GetPerformanceFrequency( ) / 60) {
+	TRACE_ZONE("asset load");
 	if (!cachedSounds) {
 		cachedSounds = make_unique<unordered_map<SoundName, shared_ptr<Mix_Chunk>>>( );
+		for (size_t name = 0; name < static_cast<size_t>(SoundName::COUNT); name++) {
+			assets.addChunk(AssetGroup::COMMON, SOUND_PATHS[name]);
+			cachedSounds->emplace(static_cast<SoundName>(name), assets.chunk(SOUND_PATHS[name]));
+		}
+	}
+	assets.addMusic(AssetGroup::MUSIC, MUSIC_PATHS[static_cast<size_t>(MusicName::MAIN_THEME)]);
+
+	int rate = 0, channels = 0;
+	Uint16 format = 0;
+	if (Mix_QuerySpec(&rate, &format, &channels) != 0) frequency = rate;
+
+	Mix_AllocateChannels(VOICES);
+	// Registered even without the software mixer, the hook times every device callback
+	Mix_SetPostMix(&Sound::postMix, this);
+	running = true;
+	audioThread = thread(&Sound::audioLoop, this);
+}
+
+Sound::~Sound( ) {
+	running = false;
+	if (audioThread.joinable( )) audioThread.join( );
+	Mix_SetPostMix(nullptr, nullptr);
+}
+
+bool Sound::post(Command command, uint8_t name, int loop) {
+	Event event{ command, name, static_cast<int16_t>(loop), SDL_GetPerformanceCounter( ) };
+	if (events.tryPush(event)) return true;
+	dropped.fetch_add(1, memory_order_relaxed);
+	audioEventsDropped.add( );
+	return false;
+}
+
+void Sound::audioLoop( ) {
+	Trace::setThreadName("audio");
+	while (running.load(memory_order_relaxed)) {
+		Event event;
+		bool idle = true;
+		while (events.tryPop(event)) {
+			execute(event);
+			idle = false;
+		}
+		if (idle) this_thread::sleep_for(AUDIO_POLL);
+		watchUnderruns(SDL_GetPerformanceCounter( ));
+	}
+}
+
+void Sound::watchUnderruns(uint64_t now) {
+	if (bufferFrames.load(memory_order_relaxed) <= 0) return;
+	if (underrunWindowStart == 0) underrunWindowStart = now;
+	if (now - underrunWindowStart < SDL_GetPerformanceFrequency( )) return;
+
+	uint32_t total = underruns.load(memory_order_relaxed);
+	uint32_t recent = total - underrunsAtWindowStart;
+	underrunWindowStart = now;
+	underrunsAtWindowStart = total;
+
+	int frames = bufferFrames.load(memory_order_relaxed);
+	if (recent < UNDERRUNS_TO_GROW || frames >= MAX_BUFFER_FRAMES) return;
+
+	int grown = min(frames * 2, MAX_BUFFER_FRAMES);
+	if (reopenAudio(grown)) {
+		resizes.fetch_add(1, memory_order_relaxed);
+		SDL_Log("Audio: %u underruns in the last second, buffer grown to %d frames", recent, grown);
+	}
+	// The reopen itself leaves a gap, start counting afresh
+	underrunWindowStart = SDL_GetPerformanceCounter( );
+	underrunsAtWindowStart = underruns.load(memory_order_relaxed);
+}
+
+bool Sound::reopenAudio(int frames) {
+	int rate = 0, channels = 0;
+	Uint16 format = 0;
+	if (Mix_QuerySpec(&rate, &format, &channels) == 0) return false;
+
+	int volume = Mix_Volume(-1, -1);
+	double musicPosition = 0;
+#ifdef SOUND_RESUMES_MUSIC
+	// -1 for formats that cannot tell, those start over
+	if (currentMusic) musicPosition = Mix_GetMusicPosition(currentMusic.get( ));
+#endif
+	Mix_HaltChannel(-1);
+	for (Voice& voice : voices) voice.active = false;
+	Mix_CloseAudio( );
+	// No callback runs while the device is closed
+	lastCallback = 0;
+
+	bool grown = true;
+	if (Mix_OpenAudio(rate, format, channels, frames) < 0) {
+		SDL_Log("Audio: reopening with %d frames failed: %s", frames, Mix_GetError( ));
+		grown = false;
+		frames = bufferFrames.load(memory_order_relaxed);
+		if (Mix_OpenAudio(rate, format, channels, frames) < 0) {
+			bufferFrames = 0;
+			return false;
+		}
+	}
+
+	// Chunks were converted to the old format, they only stay valid if the device agreed to it again
+	int newRate = 0, newChannels = 0;
+	Uint16 newFormat = 0;
+	Mix_QuerySpec(&newRate, &newFormat, &newChannels);
+	if (newRate != rate || newFormat != format || newChannels != channels)
+		SDL_Log("Audio: device format changed on reopen, sound effects may play wrong");
+
+	Mix_AllocateChannels(VOICES);
+	Mix_Volume(-1, volume);
+	Mix_SetPostMix(&Sound::postMix, this);
+	if (currentMusic) {
+		// SDL_mixer forgets the playing music on close, it carries on where it was when it can
+		if (musicPosition <= 0 || Mix_FadeInMusicPos(currentMusic.get( ), musicLoop, 0, musicPosition) < 0)
+			Mix_PlayMusic(currentMusic.get( ), musicLoop);
+		if (musicPaused) Mix_PauseMusic( );
+	}
+
+	bufferFrames = frames;
+	frequency = newRate;
+	return grown;
+}
+
+void Sound::execute(const Event& event) {
+	TRACE_ZONE("Sound::execute");
+	switch (event.command) {
+	case Command::PLAY_SOUND:
+		playSound(static_cast<SoundName>(event.name), event.loop, event.time);
+		break;
+	case Command::PLAY_MUSIC: {
+		shared_ptr<Mix_Music> music;
+		{
+			lock_guard<mutex> lock(musicMutex);
+			music = pendingMusic;
+		}
+		if (music) {
+			currentMusic = move(music);
+			musicLoop = event.loop;
+			musicPaused = false;
+			Mix_PlayMusic(currentMusic.get( ), musicLoop);
+		}
+		break;
+	}
+	case Command::STOP_MUSIC:
+		Mix_HaltMusic( );
+		// The last reference may be this one, the track is freed here then
+		currentMusic.reset( );
+		musicPaused = false;
+		break;
+	case Command::PAUSE_MUSIC:
+		musicPaused = true;
+		if (Mix_PlayingMusic( ) != 0)
+			Mix_PauseMusic( );
+		break;
+	case Command::RESUME_MUSIC:
+		musicPaused = false;
+		if (Mix_PausedMusic( ))
+			Mix_ResumeMusic( );
+		break;
+	case Command::VOLUME_UP: {
+		int currentVolume = Mix_Volume(-1, -1);
+		if (currentVolume < MIX_MAX_VOLUME)
+			Mix_Volume(-1, currentVolume + 2);
+		if (mixer) mixer->setMasterGain(min(1.0f, mixer->getMasterGain( ) + 2.0f / MIX_MAX_VOLUME));
+		break;
+	}
+	case Command::VOLUME_DOWN: {
+		int currentVolume = Mix_Volume(-1, -1);
+		if (currentVolume > 0)
+			Mix_Volume(-1, currentVolume - 2);
+		if (mixer) mixer->setMasterGain(max(0.0f, mixer->getMasterGain( ) - 2.0f / MIX_MAX_VOLUME));
+		break;
+	}
+	case Command::USE_SOFTWARE_MIXER:
+		enableSoftwareMixer( );
+		break;
+	}
+}
+
+void Sound::enableSoftwareMixer( ) {
+	if (mixer) return;
+
+	int frequency = 0, channels = 0;
+	Uint16 format = 0;
+	if (Mix_QuerySpec(&frequency, &format, &channels) == 0 || format != AUDIO_S16SYS) {
+		SDL_Log("Software mixer needs signed 16 bit output, keeping SDL_mixer channels");
+		return;
+	}
+
+	// Mix_LoadWAV already converted every chunk to the device format, the mixer reads them in place
+	for (const auto& [name, chunk] : *cachedSounds)
+		if (chunk) clips[static_cast<size_t>(name)] = { reinterpret_cast<const int16_t*>(chunk->abuf), chunk->alen / 2 };
+
+	Mix_HaltChannel(-1);
+	for (Voice& voice : voices) voice.active = false;
+	mixer = make_unique<AudioMixer>(VOICES);
+	mixer->setMasterGain(static_cast<float>(Mix_Volume(-1, -1)) / MIX_MAX_VOLUME);
+	mixing.store(mixer.get( ), memory_order_release);
+}
+
+void Sound::postMix(void* sound, Uint8* stream, int length) {
+	TRACE_ZONE("Sound::postMix");
+	Sound& self = *static_cast<Sound*>(sound);
+	uint64_t start = SDL_GetPerformanceCounter( );
+	uint64_t counterFrequency = SDL_GetPerformanceFrequency( );
+
+	int frames = self.bufferFrames.load(memory_order_relaxed);
+	int rate = self.frequency.load(memory_order_relaxed);
+	if (self.lastCallback != 0 && frames > 0 && rate > 0) {
+		// The device asks again one buffer later, half a buffer past that it has run dry
+		uint64_t period = counterFrequency * frames / rate;
+		if (start - self.lastCallback > period + period / 2) self.underruns.fetch_add(1, memory_order_relaxed);
+	}
+	self.lastCallback = start;
+
+	if (AudioMixer* mixer = self.mixing.load(memory_order_acquire))
+		mixer->mix(reinterpret_cast<int16_t*>(stream), static_cast<size_t>(length) / 2);
+
+	self.callbacks.fetch_add(1, memory_order_relaxed);
+	self.callbackTimes.record((SDL_GetPerformanceCounter( ) - start) * 1000000000ull / counterFrequency);
+}
+
+void Sound::playSound(SoundName soundName, int loop, uint64_t time) {
+	TRACE_ZONE("Sound::playSound");
+	size_t index = static_cast<size_t>(soundName);
+	// Two boards or a burst of key events asking for the same sound within one frame play it once
+	if (lastStarted[index] != 0 && time - lastStarted[index] < frameTicks) {
+		deduplicated.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	int channel = claimVoice(soundName);
+	// No voice, or the mixer's command queue is full
+	bool started = channel >= 0 && (mixer ? mixer->play(channel, clips[index], 1.0f, loop)
+		: Mix_PlayChannel(channel, cachedSounds->at(soundName).get( ), loop) >= 0);
+	if (!started) {
+		dropped.fetch_add(1, memory_order_relaxed);
+		audioEventsDropped.add( );
+		return;
+	}
 
-		cachedSounds->emplace(
-			SoundName::GAME_OVER,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/game_over.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::LINE_CLEAR,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/line_clear.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::MOVE_PIECE,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/move_piece.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::PIECE_LANDED,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/piece_landed.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::ROCKET_ENDING,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/rocket_ending.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::TETRIS_LINE_CLEAR,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/tetris_line_clear.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::LEVEL_UP,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/level_up.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::MENU,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/menu.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::PIECE_FALLING_AFTER_LINE_CLEAR,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/piece_falling_after_line_clear.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::PLAYER_SENDING_BLOCKS,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/player_sending_blocks.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-		cachedSounds->emplace(
-			SoundName::ROTATE_PIECE,
-			std::shared_ptr<Mix_Chunk>(Mix_LoadWAV("assets/sound_effects/rotate_piece.wav"), [ ](Mix_Chunk* r) { Mix_FreeChunk(r); })
-		);
-	}
-	if (!cachedMusic) {
-		cachedMusic = make_unique<unordered_map<MusicName, shared_ptr<Mix_Music>>>( );
-		cachedMusic->emplace(
-			MusicName::MAIN_THEME,
-			shared_ptr<Mix_Music>(Mix_LoadMUS("assets/sound_tracks/bgm.mp3"), [ ](Mix_Music* r) {Mix_FreeMusic(r);})
-		);
+	voices[channel] = { true, soundName, time };
+	lastStarted[index] = time;
+	played.fetch_add(1, memory_order_relaxed);
+}
+
+int Sound::claimVoice(SoundName soundName) {
+	const SoundPolicy& policy = SOUND_POLICIES[static_cast<size_t>(soundName)];
+	int sameCount = 0, oldestSame = -1, freeVoice = -1, victim = -1;
+
+	for (int channel = 0; channel < VOICES; channel++) {
+		Voice& voice = voices[channel];
+		if (voice.active && !isVoicePlaying(channel)) voice.active = false;
+		if (!voice.active) {
+			if (freeVoice < 0) freeVoice = channel;
+			continue;
+		}
+
+		if (voice.name == soundName) {
+			sameCount++;
+			if (oldestSame < 0 || voice.startedAt < voices[oldestSame].startedAt) oldestSame = channel;
+		}
+
+		// Lowest priority first, the oldest of those when tied
+		const SoundPolicy& playing = SOUND_POLICIES[static_cast<size_t>(voice.name)];
+		if (playing.priority > policy.priority) continue;
+		if (victim < 0) {
+			victim = channel;
+			continue;
+		}
+		const SoundPolicy& current = SOUND_POLICIES[static_cast<size_t>(voices[victim].name)];
+		if (playing.priority < current.priority || (playing.priority == current.priority && voice.startedAt < voices[victim].startedAt))
+			victim = channel;
 	}
+
+	if (sameCount >= policy.maxVoices) victim = oldestSame;
+	else if (freeVoice >= 0) return freeVoice;
+	if (victim < 0) return -1;
+
+	// The software mixer replaces the voice with the next play, no need to stop it first
+	if (!mixer) Mix_HaltChannel(victim);
+	stolen.fetch_add(1, memory_order_relaxed);
+	return victim;
+}
+
+bool Sound::isVoicePlaying(int channel) const {
+	return mixer ? mixer->isPlaying(channel) : Mix_Playing(channel) != 0;
 }
 
 bool Sound::PlaySound(SoundName soundName, int loop) {
@@ -67,42 +357,66 @@ bool Sound::PlaySound(SoundName soundName, int loop) {
 		return false;
 	}
 
-	Mix_PlayChannel(-1, it->second.get( ), loop);
-
-	return true;
+	return post(Command::PLAY_SOUND, static_cast<uint8_t>(soundName), loop);
 }
 
 bool Sound::PlayMusic(MusicName musicName, int loop) {
-	auto it = cachedMusic->find(musicName);
-	if (it == cachedMusic->end( ) || !it->second) {
+	shared_ptr<Mix_Music> music = assets.music(MUSIC_PATHS[static_cast<size_t>(musicName)]);
+	if (!music) {
 		return false;
 	}
 
-	Mix_PlayMusic(it->second.get( ), loop);
+	{
+		lock_guard<mutex> lock(musicMutex);
+		pendingMusic = move(music);
+	}
+	musicPlaying = true;
+	return post(Command::PLAY_MUSIC, static_cast<uint8_t>(musicName), loop);
+}
 
-	return true;
+void Sound::StopMusic( ) {
+	{
+		lock_guard<mutex> lock(musicMutex);
+		pendingMusic.reset( );
+	}
+	musicPlaying = false;
+	post(Command::STOP_MUSIC);
 }
 
 void Sound::PauseMusic( ) {
-	if (Mix_PlayingMusic( ) != 0)
-		Mix_PauseMusic( );
+	musicPlaying = false;
+	post(Command::PAUSE_MUSIC);
 }
 
 void Sound::ResumeMusic( ) {
-	if (Mix_PausedMusic( ))
-		Mix_ResumeMusic( );
+	musicPlaying = true;
+	post(Command::RESUME_MUSIC);
 }
 
-void Sound::IncreaseVolume( ) {
-	int currentVolume = Mix_Volume(-1, -1);
-	if (currentVolume < MIX_MAX_VOLUME)
-		Mix_Volume(-1, currentVolume + 2);
-}
+void Sound::IncreaseVolume( ) { post(Command::VOLUME_UP); }
+
+void Sound::DecreaseVolume( ) { post(Command::VOLUME_DOWN); }
+
+bool Sound::IsMusicPlaying( ) { return musicPlaying; }
+
+void Sound::UseSoftwareMixer( ) { post(Command::USE_SOFTWARE_MIXER); }
+
+void Sound::SetBufferFrames(int frames) { bufferFrames = frames; }
+
+Sound::Stats Sound::getStats( ) const {
+	Stats stats;
+	stats.played = played.load(memory_order_relaxed);
+	stats.deduplicated = deduplicated.load(memory_order_relaxed);
+	stats.stolen = stolen.load(memory_order_relaxed);
+	stats.dropped = dropped.load(memory_order_relaxed);
 
-void Sound::DecreaseVolume( ) {
-	int currentVolume = Mix_Volume(-1, -1);
-	if (currentVolume > 0)
-		Mix_Volume(-1, currentVolume - 2);
+	stats.bufferFrames = static_cast<uint32_t>(max(0, bufferFrames.load(memory_order_relaxed)));
+	stats.frequency = static_cast<uint32_t>(max(0, frequency.load(memory_order_relaxed)));
+	stats.underruns = underruns.load(memory_order_relaxed);
+	stats.resizes = resizes.load(memory_order_relaxed);
+	stats.callbacks = callbacks.load(memory_order_relaxed);
+	if (stats.frequency > 0) stats.outputLatencyMs = stats.bufferFrames * 1000.0 / stats.frequency;
+	return stats;
 }
 
-bool Sound::IsMusicPlaying( ) { return Mix_PlayingMusic( ) && !Mix_PausedMusic( ); }
+const LatencyHistogram& Sound::getCallbackTimes( ) const { return callbackTimes; }
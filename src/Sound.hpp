@@ -3,44 +3,150 @@
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
 
 extern "C" {
 #include <SDL2/SDL_mixer.h>
 }
 
-enum class SoundName {
-	GAME_OVER,
-	LINE_CLEAR,
-	MOVE_PIECE,
-	PIECE_LANDED,
-	ROCKET_ENDING,
-	TETRIS_LINE_CLEAR,
-	LEVEL_UP,
-	MENU,
-	PIECE_FALLING_AFTER_LINE_CLEAR,
-	PLAYER_SENDING_BLOCKS,
-	ROTATE_PIECE
-};
-
-enum class MusicName {
-	MAIN_THEME
-};
+#include "SoundName.hpp"
+#include "SpscQueue.hpp"
+#include "AudioMixer.hpp"
+#include "LatencyHistogram.hpp"
+#include "AssetManager.hpp"
 
 using namespace std;
 
+struct AudioConfig {
+	bool softwareMixer = false;     // see Sound::UseSoftwareMixer
+	int bufferFrames = 256;         // initial device buffer, grows on underruns
+};
+
+// Every call only posts a command, the mixer is driven by one audio thread that owns all channels.
+// Sound effects are preloaded and held for the whole run, music belongs to the play scene; both
+// come from the AssetManager, so neither thread touches the disk during a game.
 class Sound {
+public:
+	static constexpr int VOICES = 16;
+	// Output buffer in sample frames: main opens the device small (AudioConfig), underruns double it up to this
+	static constexpr int MAX_BUFFER_FRAMES = 4096;
+	// Late callbacks within one second that make the buffer grow
+	static constexpr uint32_t UNDERRUNS_TO_GROW = 2;
+
+	struct Stats {
+		uint32_t played = 0;
+		uint32_t deduplicated = 0;  // same sound already started within one frame
+		uint32_t stolen = 0;        // a playing voice was cut for this one
+		uint32_t dropped = 0;       // no voice could be taken, or the command queue was full
+
+		uint32_t bufferFrames = 0;
+		uint32_t frequency = 0;
+		uint32_t underruns = 0;     // callbacks that came more than a buffer late
+		uint32_t resizes = 0;
+		uint64_t callbacks = 0;
+		double outputLatencyMs = 0; // one buffer at the device rate, what the device adds is not known
+	};
+
 private:
+	enum class Command : uint8_t {
+		PLAY_SOUND,
+		PLAY_MUSIC,
+		STOP_MUSIC,
+		PAUSE_MUSIC,
+		RESUME_MUSIC,
+		VOLUME_UP,
+		VOLUME_DOWN,
+		USE_SOFTWARE_MIXER,
+	};
+
+	struct Event {
+		Command command;
+		uint8_t name;
+		int16_t loop;
+		uint64_t time;      // performance counter when posted
+	};
+
+	struct Voice {
+		bool active = false;
+		SoundName name = SoundName::MENU;
+		uint64_t startedAt = 0;
+	};
+
+	bool post(Command command, uint8_t name = 0, int loop = 0);
+	void audioLoop( );
+	void execute(const Event& event);
+	void playSound(SoundName soundName, int loop, uint64_t time);
+	int claimVoice(SoundName soundName);
+	bool isVoicePlaying(int channel) const;
+	void enableSoftwareMixer( );
+	static void postMix(void* sound, Uint8* stream, int length);
+	void watchUnderruns(uint64_t now);
+	bool reopenAudio(int bufferFrames);
+
 	static unique_ptr <unordered_map<SoundName, shared_ptr<Mix_Chunk>>> cachedSounds;
-	static unique_ptr <unordered_map<MusicName, shared_ptr<Mix_Music>>> cachedMusic;
+
+	AssetManager& assets;
+	// Music handed from PlayMusic to the audio thread, which keeps its own reference while playing
+	mutex musicMutex;
+	shared_ptr<Mix_Music> pendingMusic;
+
+	SpscQueue<Event, 256> events;
+	thread audioThread;
+	atomic<bool> running{ false };
+	// Tracks what was asked for on the game thread, the mixer itself is only read by the audio thread
+	bool musicPlaying = false;
+
+	// Audio thread only
+	array<Voice, VOICES> voices;
+	array<uint64_t, static_cast<size_t>(SoundName::COUNT)> lastStarted{ };
+	uint64_t frameTicks;
+	// Created once by the audio thread, the callback picks it up through mixing
+	unique_ptr<AudioMixer> mixer;
+	atomic<AudioMixer*> mixing{ nullptr };
+	array<AudioClip, static_cast<size_t>(SoundName::COUNT)> clips{ };
+	shared_ptr<Mix_Music> currentMusic;
+	int musicLoop = 0;
+	bool musicPaused = false;
+	uint64_t underrunWindowStart = 0;
+	uint32_t underrunsAtWindowStart = 0;
+
+	// Callback thread, reset by the audio thread only while the device is closed
+	uint64_t lastCallback = 0;
+
+	atomic<int> bufferFrames{ 0 };
+	atomic<int> frequency{ 0 };
+	atomic<uint32_t> underruns{ 0 }, resizes{ 0 };
+	atomic<uint64_t> callbacks{ 0 };
+	LatencyHistogram callbackTimes;
+	atomic<uint32_t> played{ 0 }, deduplicated{ 0 }, stolen{ 0 }, dropped{ 0 };
+
 public:
-	Sound( );
+	explicit Sound(AssetManager& assets);
+	~Sound( );
+	Sound(const Sound&) = delete;
+	Sound& operator=(const Sound&) = delete;
 
 	bool PlaySound(SoundName soundName, int loop = 0);
 	bool PlayMusic(MusicName musicName, int loop = -1);
 
+	// Halts the music and lets go of it, so the asset manager can evict the track
+	void StopMusic( );
 	void PauseMusic( );
 	void ResumeMusic( );
 	void IncreaseVolume( );
 	void DecreaseVolume( );
 	bool IsMusicPlaying( );
+	// Mixes sound effects with AudioMixer in SDL_mixer's post mix hook instead of mixer channels.
+	// Stays on SDL_mixer when the device does not take signed 16 bit samples.
+	void UseSoftwareMixer( );
+	// Tells the audio thread the buffer size main opened the device with, enables growing it
+	void SetBufferFrames(int frames);
+
+	Stats getStats( ) const;
+	// Time spent in our post mix hook per device callback
+	const LatencyHistogram& getCallbackTimes( ) const;
 };
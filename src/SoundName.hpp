@@ -0,0 +1,20 @@
+#pragma once
+
+enum class SoundName {
+	GAME_OVER,
+	LINE_CLEAR,
+	MOVE_PIECE,
+	PIECE_LANDED,
+	ROCKET_ENDING,
+	TETRIS_LINE_CLEAR,
+	LEVEL_UP,
+	MENU,
+	PIECE_FALLING_AFTER_LINE_CLEAR,
+	PLAYER_SENDING_BLOCKS,
+	ROTATE_PIECE,
+	COUNT
+};
+
+enum class MusicName {
+	MAIN_THEME
+};
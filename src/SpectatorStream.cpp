@@ -0,0 +1,489 @@
+#include "SpectatorStream.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	void putU16(vector<uint8_t>& out, uint16_t value) {
+		out.push_back(static_cast<uint8_t>(value));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	void putU32(vector<uint8_t>& out, uint32_t value) {
+		for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+	}
+
+	uint16_t getU16(const uint8_t* in) { return static_cast<uint16_t>(in[0] | (in[1] << 8)); }
+
+	uint32_t getU32(const uint8_t* in) {
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+		return value;
+	}
+
+	size_t beginRecord(vector<uint8_t>& out, Spectator::RecordType type) {
+		size_t start = out.size( );
+		out.push_back(static_cast<uint8_t>(type));
+		putU16(out, 0);
+		return start;
+	}
+
+	void endRecord(vector<uint8_t>& out, size_t start) {
+		size_t payload = out.size( ) - start - Spectator::RECORD_HEADER_SIZE;
+		out[start + 1] = static_cast<uint8_t>(payload);
+		out[start + 2] = static_cast<uint8_t>(payload >> 8);
+	}
+
+	const uint8_t MAGIC[4] = { 'T', 'S', 'P', 'C' };
+}
+
+void Spectator::writeHeader(vector<uint8_t>& out) {
+	out.insert(out.end( ), MAGIC, MAGIC + 4);
+	out.push_back(VERSION);
+	out.push_back(static_cast<uint8_t>(GameBoard::width));
+	out.push_back(static_cast<uint8_t>(GameBoard::height));
+}
+
+void SpectatorEncoder::encodePiece(const GameBoard& board, array<uint8_t, Spectator::PIECE_SIZE>& out) const {
+	out.fill(0);
+	const auto& current = board.getCurrentTetromino( );
+	if (!current) return;
+
+	TetrominoState state = current->getState( );
+	uint16_t mask = 0;
+	for (int row = 0; row < state.rows && row < 4; row++)
+		for (int col = 0; col < state.cols && col < 4; col++)
+			if (state.cells[row][col]) mask |= 1u << (row * 4 + col);
+
+	out[0] = 1;
+	out[1] = static_cast<uint8_t>(state.shape);
+	out[2] = static_cast<uint8_t>(state.colorIndex);
+	out[3] = static_cast<uint8_t>(static_cast<int8_t>(state.x));
+	out[4] = static_cast<uint8_t>(static_cast<int8_t>(state.y));
+	out[5] = static_cast<uint8_t>(state.rotationState);
+	out[6] = static_cast<uint8_t>((state.rows << 4) | (state.cols & 0xF));
+	out[7] = static_cast<uint8_t>(mask);
+	out[8] = static_cast<uint8_t>(mask >> 8);
+}
+
+void SpectatorEncoder::encodeNext(const GameBoard& board, array<uint8_t, Spectator::NEXT_SIZE>& out) const {
+	out.fill(0);
+	const auto& next = board.getNextTetromino( );
+	if (!next) return;
+	out[0] = 1;
+	out[1] = static_cast<uint8_t>(next->getShapeEnumn( ));
+	out[2] = static_cast<uint8_t>(next->getColorIndex( ));
+}
+
+void SpectatorEncoder::encodeStats(const GameBoard& board, array<uint8_t, Spectator::STATS_SIZE>& out) const {
+	uint32_t score = static_cast<uint32_t>(board.getScore( ));
+	out[0] = board.isCollision( ) ? 1 : 0;
+	for (int i = 0; i < 4; i++) out[1 + i] = static_cast<uint8_t>(score >> (8 * i));
+	out[5] = static_cast<uint8_t>(board.getLevel( ));
+	out[6] = static_cast<uint8_t>(board.getLevel( ) >> 8);
+	out[7] = static_cast<uint8_t>(board.getLines( ));
+	out[8] = static_cast<uint8_t>(board.getLines( ) >> 8);
+	out[9] = static_cast<uint8_t>(board.getPendingGarbage( ));
+}
+
+void SpectatorEncoder::appendRow(const GameBoard& board, int row, vector<uint8_t>& out) const {
+	const auto& cells = board.getLockedTetrominos( );
+	const auto& colors = board.getLockedColors( );
+	for (int col = 0; col < GameBoard::width; col++)
+		out.push_back(static_cast<uint8_t>((cells[row][col] & 0xF) | (colors[row][col] << 4)));
+}
+
+void SpectatorEncoder::encode(GameBoard& board, uint32_t frame, vector<uint8_t>& out, bool& keyframe) {
+	keyframe = !started || frame - lastKeyframe >= Spectator::KEYFRAME_INTERVAL;
+
+	if (keyframe) {
+		board.takeDirtyRows( );
+		encodePiece(board, piece);
+		encodeNext(board, next);
+		encodeStats(board, stats);
+
+		size_t record = beginRecord(out, Spectator::RecordType::KEYFRAME);
+		putU32(out, frame);
+		for (int row = 0; row < GameBoard::height; row++) appendRow(board, row, out);
+		out.insert(out.end( ), piece.begin( ), piece.end( ));
+		out.insert(out.end( ), next.begin( ), next.end( ));
+		out.insert(out.end( ), stats.begin( ), stats.end( ));
+		endRecord(out, record);
+
+		started = true;
+		lastKeyframe = lastFrame = frame;
+		return;
+	}
+
+	array<uint8_t, Spectator::PIECE_SIZE> newPiece;
+	array<uint8_t, Spectator::NEXT_SIZE> newNext;
+	array<uint8_t, Spectator::STATS_SIZE> newStats;
+	encodePiece(board, newPiece);
+	encodeNext(board, newNext);
+	encodeStats(board, newStats);
+
+	uint8_t sections = 0;
+	uint32_t rows = board.takeDirtyRows( );
+	if (rows) sections |= Spectator::SECTION_ROWS;
+	if (newPiece != piece) sections |= Spectator::SECTION_PIECE;
+	if (newNext != next) sections |= Spectator::SECTION_NEXT;
+	if (newStats != stats) sections |= Spectator::SECTION_STATS;
+	if (sections == 0) return;
+
+	size_t record = beginRecord(out, Spectator::RecordType::DELTA);
+	putU16(out, static_cast<uint16_t>(min<uint32_t>(frame - lastFrame, UINT16_MAX)));
+	out.push_back(sections);
+	if (sections & Spectator::SECTION_ROWS) {
+		putU32(out, rows);
+		for (int row = 0; row < GameBoard::height; row++)
+			if (rows & (1u << row)) appendRow(board, row, out);
+	}
+	if (sections & Spectator::SECTION_PIECE) out.insert(out.end( ), newPiece.begin( ), newPiece.end( ));
+	if (sections & Spectator::SECTION_NEXT) out.insert(out.end( ), newNext.begin( ), newNext.end( ));
+	if (sections & Spectator::SECTION_STATS) out.insert(out.end( ), newStats.begin( ), newStats.end( ));
+	endRecord(out, record);
+
+	piece = newPiece;
+	next = newNext;
+	stats = newStats;
+	lastFrame = frame;
+}
+
+void SpectatorEncoder::reset( ) { started = false; }
+
+void SpectatorDecoder::feed(const uint8_t* data, size_t size) {
+	// Drop what was already applied once it makes up most of the buffer
+	if (readOffset > 4096 && readOffset * 2 > pending.size( )) {
+		pending.erase(pending.begin( ), pending.begin( ) + readOffset);
+		readOffset = 0;
+	}
+	pending.insert(pending.end( ), data, data + size);
+}
+
+bool SpectatorDecoder::apply(uint32_t untilFrame) {
+	while (true) {
+		size_t available = pending.size( ) - readOffset;
+		const uint8_t* data = pending.data( ) + readOffset;
+
+		if (!headerSeen) {
+			if (available < Spectator::HEADER_SIZE) return true;
+			if (memcmp(data, MAGIC, 4) != 0 || data[4] != Spectator::VERSION
+				|| data[5] != GameBoard::width || data[6] != GameBoard::height) {
+				cerr << "Not a spectator stream of this version or board size" << endl;
+				return false;
+			}
+			headerSeen = true;
+			readOffset += Spectator::HEADER_SIZE;
+			continue;
+		}
+
+		if (available < Spectator::RECORD_HEADER_SIZE) return true;
+		size_t payloadSize = getU16(data + 1);
+		if (available < Spectator::RECORD_HEADER_SIZE + payloadSize) return true;
+
+		auto type = static_cast<Spectator::RecordType>(data[0]);
+		const uint8_t* payload = data + Spectator::RECORD_HEADER_SIZE;
+
+		// Playback pacing, a record that belongs to a later frame waits in the buffer
+		if (synchronized) {
+			if (type == Spectator::RecordType::DELTA && payloadSize >= 2 && frame + getU16(payload) > untilFrame) return true;
+			if (type == Spectator::RecordType::KEYFRAME && payloadSize >= 4 && getU32(payload) > untilFrame) return true;
+		}
+
+		if (!applyRecord(type, payload, payloadSize)) {
+			cerr << "Corrupt spectator record" << endl;
+			return false;
+		}
+		readOffset += Spectator::RECORD_HEADER_SIZE + payloadSize;
+	}
+}
+
+bool SpectatorDecoder::hasRecord( ) const {
+	size_t available = pending.size( ) - readOffset;
+	if (!headerSeen || available < Spectator::RECORD_HEADER_SIZE) return false;
+	return available >= Spectator::RECORD_HEADER_SIZE + getU16(pending.data( ) + readOffset + 1);
+}
+
+bool SpectatorDecoder::applyRecord(Spectator::RecordType type, const uint8_t* payload, size_t size) {
+	const size_t rowBytes = GameBoard::width;
+
+	if (type == Spectator::RecordType::KEYFRAME) {
+		if (size != 4 + GameBoard::height * rowBytes + Spectator::PIECE_SIZE + Spectator::NEXT_SIZE + Spectator::STATS_SIZE) return false;
+		frame = getU32(payload);
+		const uint8_t* in = payload + 4;
+		for (int row = 0; row < GameBoard::height; row++, in += rowBytes)
+			if (!decodeRow(row, in)) return false;
+		if (!decodePiece(in) || !decodeNext(in + Spectator::PIECE_SIZE)) return false;
+		decodeStats(in + Spectator::PIECE_SIZE + Spectator::NEXT_SIZE);
+		synchronized = true;
+		return true;
+	}
+
+	if (type != Spectator::RecordType::DELTA) return false;
+	if (size < 3) return false;
+	// Deltas before the first keyframe have nothing to apply to
+	if (!synchronized) return true;
+
+	uint8_t sections = payload[2];
+	const uint8_t* in = payload + 3;
+	const uint8_t* end = payload + size;
+
+	if (sections & Spectator::SECTION_ROWS) {
+		if (end - in < 4) return false;
+		uint32_t rows = getU32(in);
+		in += 4;
+		for (int row = 0; row < GameBoard::height; row++) {
+			if (!(rows & (1u << row))) continue;
+			if (static_cast<size_t>(end - in) < rowBytes) return false;
+			if (!decodeRow(row, in)) return false;
+			in += rowBytes;
+		}
+	}
+	if (sections & Spectator::SECTION_PIECE) {
+		if (static_cast<size_t>(end - in) < Spectator::PIECE_SIZE) return false;
+		if (!decodePiece(in)) return false;
+		in += Spectator::PIECE_SIZE;
+	}
+	if (sections & Spectator::SECTION_NEXT) {
+		if (static_cast<size_t>(end - in) < Spectator::NEXT_SIZE) return false;
+		if (!decodeNext(in)) return false;
+		in += Spectator::NEXT_SIZE;
+	}
+	if (sections & Spectator::SECTION_STATS) {
+		if (static_cast<size_t>(end - in) < Spectator::STATS_SIZE) return false;
+		decodeStats(in);
+		in += Spectator::STATS_SIZE;
+	}
+
+	frame += getU16(payload);
+	return in == end;
+}
+
+bool SpectatorDecoder::decodeRow(int row, const uint8_t* in) {
+	for (int col = 0; col < GameBoard::width; col++)
+		if ((in[col] >> 4) > Tetromino::GARBAGE_COLOR) return false;
+	for (int col = 0; col < GameBoard::width; col++) {
+		state.cells[row][col] = in[col] & 0xF;
+		state.colors[row][col] = in[col] >> 4;
+	}
+	return true;
+}
+
+bool SpectatorDecoder::decodePiece(const uint8_t* in) {
+	if (in[0] != 0 && (in[1] >= static_cast<uint8_t>(TetrominoShape::COUNT) || in[2] > Tetromino::GARBAGE_COLOR)) return false;
+	state.hasCurrent = in[0] != 0;
+	if (!state.hasCurrent) return true;
+
+	TetrominoState& piece = state.current;
+	piece = TetrominoState{ };
+	piece.shape = static_cast<TetrominoShape>(in[1]);
+	piece.colorIndex = in[2];
+	piece.x = static_cast<int8_t>(in[3]);
+	piece.y = static_cast<int8_t>(in[4]);
+	piece.rotationState = in[5];
+	piece.rows = min(4, in[6] >> 4);
+	piece.cols = min(4, in[6] & 0xF);
+	uint16_t mask = getU16(in + 7);
+	for (int row = 0; row < piece.rows; row++)
+		for (int col = 0; col < piece.cols; col++)
+			piece.cells[row][col] = (mask >> (row * 4 + col)) & 1;
+	return true;
+}
+
+bool SpectatorDecoder::decodeNext(const uint8_t* in) {
+	if (in[0] != 0 && in[2] > Tetromino::GARBAGE_COLOR) return false;
+	state.hasNext = in[0] != 0;
+	if (state.hasNext && in[1] < static_cast<uint8_t>(TetrominoShape::COUNT))
+		state.next = Tetromino(static_cast<TetrominoShape>(in[1]), in[2]).getState( );
+	else
+		state.hasNext = false;
+	return true;
+}
+
+void SpectatorDecoder::decodeStats(const uint8_t* in) {
+	state.collision = in[0] != 0;
+	state.score = static_cast<int32_t>(getU32(in + 1));
+	state.level = getU16(in + 5);
+	state.lines = getU16(in + 7);
+	state.pendingGarbage = in[9];
+}
+
+bool SpectatorDecoder::hasState( ) const { return synchronized; }
+uint32_t SpectatorDecoder::getFrame( ) const { return frame; }
+const GameBoard::Snapshot& SpectatorDecoder::getState( ) const { return state; }
+
+SpectatorPublisher::SpectatorPublisher( ) { Spectator::writeHeader(header); }
+
+SpectatorPublisher::~SpectatorPublisher( ) {
+	if (file && ownsFile) fclose(file);
+}
+
+bool SpectatorPublisher::openFile(const string& path) {
+	if (path == "-") {
+		file = stdout;
+		ownsFile = false;
+	} else {
+		file = fopen(path.c_str( ), "wb");
+		ownsFile = true;
+	}
+	if (!file) {
+		cerr << "Failed to open spectator stream " << path << endl;
+		return false;
+	}
+	fwrite(header.data( ), 1, header.size( ), file);
+	fflush(file);
+	return true;
+}
+
+bool SpectatorPublisher::listen(uint16_t port) { return listener.listen(port); }
+
+void SpectatorPublisher::publish(GameBoard& board, uint32_t frame) {
+	if (started && static_cast<int32_t>(frame - lastFrame) <= 0) return;
+	started = true;
+	lastFrame = frame;
+
+	acceptViewers( );
+
+	bool keyframe = false;
+	record.clear( );
+	encoder.encode(board, frame, record, keyframe);
+	if (record.empty( )) return;
+
+	// Encoded once, every sink gets the same bytes
+	stats.records++;
+	stats.bytesEncoded += record.size( );
+	if (keyframe) {
+		stats.keyframes++;
+		sinceKeyframe.clear( );
+	}
+	sinceKeyframe.insert(sinceKeyframe.end( ), record.begin( ), record.end( ));
+
+	if (file) {
+		fwrite(record.data( ), 1, record.size( ), file);
+		fflush(file);
+	}
+
+	for (auto& viewer : viewers) send(viewer, record.data( ), record.size( ));
+	size_t before = viewers.size( );
+	viewers.erase(remove_if(viewers.begin( ), viewers.end( ), [ ](const Viewer& viewer) { return !viewer.socket.isOpen( ); }), viewers.end( ));
+	stats.viewersDropped += static_cast<uint32_t>(before - viewers.size( ));
+	stats.viewers = static_cast<uint32_t>(viewers.size( ));
+}
+
+void SpectatorPublisher::acceptViewers( ) {
+	if (!listener.isOpen( )) return;
+
+	Viewer viewer;
+	while (listener.accept(viewer.socket)) {
+		// Late join: header, last keyframe and the deltas since, then the live records
+		send(viewer, header.data( ), header.size( ));
+		send(viewer, sinceKeyframe.data( ), sinceKeyframe.size( ));
+		viewers.push_back(move(viewer));
+		viewer = Viewer( );
+	}
+	stats.viewers = static_cast<uint32_t>(viewers.size( ));
+}
+
+void SpectatorPublisher::send(Viewer& viewer, const uint8_t* data, size_t size) {
+	if (!viewer.socket.isOpen( ) || size == 0) return;
+	viewer.outbox.insert(viewer.outbox.end( ), data, data + size);
+
+	size_t sent = 0;
+	while (sent < viewer.outbox.size( )) {
+		int written = viewer.socket.send(viewer.outbox.data( ) + sent, viewer.outbox.size( ) - sent);
+		if (written < 0) {
+			viewer.socket.close( );
+			return;
+		}
+		if (written == 0) break;
+		sent += static_cast<size_t>(written);
+	}
+	viewer.outbox.erase(viewer.outbox.begin( ), viewer.outbox.begin( ) + sent);
+
+	if (viewer.outbox.size( ) > MAX_VIEWER_BACKLOG) viewer.socket.close( );
+}
+
+const SpectatorPublisher::Stats& SpectatorPublisher::getStats( ) const { return stats; }
+
+SpectatorSource::~SpectatorSource( ) {
+	if (file) fclose(file);
+}
+
+bool SpectatorSource::open(const string& source) {
+	// "host:port" is a live feed, anything else a recording
+	live = source.find(':') != string::npos;
+	if (live) {
+		NetAddress address;
+		if (!NetAddress::parse(source, address) || !socket.connect(address)) {
+			cerr << "Failed to connect to spectator feed " << source << endl;
+			return false;
+		}
+		return true;
+	}
+
+	file = fopen(source.c_str( ), "rb");
+	if (!file) {
+		cerr << "Failed to open spectator recording " << source << endl;
+		return false;
+	}
+	return true;
+}
+
+bool SpectatorSource::poll(uint64_t nowMs) {
+	if (corrupt) return false;
+	uint8_t buffer[4096];
+	if (!ended && live) {
+		int received;
+		while ((received = socket.receive(buffer, sizeof(buffer))) > 0) decoder.feed(buffer, static_cast<size_t>(received));
+		ended = received < 0 || !socket.isOpen( );
+	} else if (!fileRead && file) {
+		size_t read = fread(buffer, 1, sizeof(buffer), file);
+		decoder.feed(buffer, read);
+		fileRead = read == 0;
+	} else if (!file && !live) {
+		ended = true;
+	}
+
+	uint32_t untilFrame = UINT32_MAX;
+	if (!live) untilFrame = decoder.hasState( ) ? firstFrame + static_cast<uint32_t>((nowMs - playbackStart) * GameBoard::TICKS_PER_SECOND / 1000) : 0;
+	if (!decoder.apply(untilFrame)) {
+		corrupt = true;
+		return false;
+	}
+	// A recording ends once the records read from it are played, not when the file is
+	if (fileRead && !decoder.hasRecord( )) ended = true;
+
+	if (decoder.hasState( ) && playbackStart == 0) {
+		playbackStart = max<uint64_t>(1, nowMs);
+		firstFrame = decoder.getFrame( );
+	}
+	if (!decoder.hasState( ) || decoder.getFrame( ) == shownFrame) return false;
+	shownFrame = decoder.getFrame( );
+	return true;
+}
+
+bool SpectatorSource::hasState( ) const { return decoder.hasState( ); }
+const GameBoard::Snapshot& SpectatorSource::getState( ) const { return decoder.getState( ); }
+bool SpectatorSource::isEnded( ) const { return ended; }
+bool SpectatorSource::isCorrupt( ) const { return corrupt; }
+
+vector<string> SpectatorSource::parseList(const string& list) {
+	vector<string> sources;
+	string entry;
+	if (!list.empty( ) && list[0] == '@') {
+		ifstream in(list.substr(1));
+		if (!in) cerr << "Failed to open source list " << list.substr(1) << endl;
+		while (getline(in, entry)) {
+			if (!entry.empty( ) && entry.back( ) == '\r') entry.pop_back( );
+			if (!entry.empty( ) && entry[0] != '#') sources.push_back(entry);
+		}
+		return sources;
+	}
+
+	stringstream in(list);
+	while (getline(in, entry, ',')) if (!entry.empty( )) sources.push_back(entry);
+	return sources;
+}
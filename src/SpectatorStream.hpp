@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "GameBoard.hpp"
+#include "Net.hpp"
+
+using namespace std;
+
+// Spectator feed: a stream header followed by records of u8 type, u16 payload length, payload.
+// A keyframe carries the whole board, a delta only the rows, piece pose, next piece and stats
+// that changed since the previous record. All integers are little endian.
+namespace Spectator {
+	constexpr uint8_t VERSION = 1;
+	constexpr size_t HEADER_SIZE = 7;           // "TSPC", version, width, height
+	constexpr size_t RECORD_HEADER_SIZE = 3;
+	constexpr uint32_t KEYFRAME_INTERVAL = 300; // frames, a late viewer waits at most this long for a full board
+
+	enum class RecordType : uint8_t {
+		KEYFRAME = 1,   // u32 frame, cells, piece, next, stats
+		DELTA = 2,      // u16 frames since the previous record, u8 sections, then the present sections
+	};
+
+	enum Section : uint8_t {
+		SECTION_ROWS = 1 << 0,  // u32 row mask, then width cells per set row
+		SECTION_PIECE = 1 << 1, // u8 present, shape, color, x, y, rotation, rows << 4 | cols, u16 cell mask
+		SECTION_NEXT = 1 << 2,  // u8 present, shape, color
+		SECTION_STATS = 1 << 3, // u8 topped out, u32 score, u16 level, u16 lines, u8 pending garbage
+	};
+
+	constexpr size_t PIECE_SIZE = 9;
+	constexpr size_t NEXT_SIZE = 3;
+	constexpr size_t STATS_SIZE = 10;
+
+	void writeHeader(vector<uint8_t>& out);
+}
+
+struct SpectatorConfig {
+	// Publish: a port number for localhost viewers or a file/pipe path, "-" for stdout
+	string stream;
+	// Watch: "host:port" of a publisher or a recorded file
+	string spectate;
+	// Watch many at once: sources like spectate separated by commas, or "@file" with one per line
+	string mosaic;
+};
+
+// Turns successive states of one board into keyframes and deltas
+class SpectatorEncoder {
+private:
+	void encodePiece(const GameBoard& board, array<uint8_t, Spectator::PIECE_SIZE>& out) const;
+	void encodeNext(const GameBoard& board, array<uint8_t, Spectator::NEXT_SIZE>& out) const;
+	void encodeStats(const GameBoard& board, array<uint8_t, Spectator::STATS_SIZE>& out) const;
+	void appendRow(const GameBoard& board, int row, vector<uint8_t>& out) const;
+
+	bool started = false;
+	uint32_t lastFrame = 0;
+	uint32_t lastKeyframe = 0;
+	array<uint8_t, Spectator::PIECE_SIZE> piece{ };
+	array<uint8_t, Spectator::NEXT_SIZE> next{ };
+	array<uint8_t, Spectator::STATS_SIZE> stats{ };
+
+public:
+	// Appends the record for this frame, nothing when the board did not change.
+	// Consumes the board's dirty rows, so one board feeds exactly one encoder.
+	void encode(GameBoard& board, uint32_t frame, vector<uint8_t>& out, bool& keyframe);
+	void reset( );
+};
+
+// Rebuilds a board snapshot from a feed, starting at the first keyframe it sees
+class SpectatorDecoder {
+private:
+	bool applyRecord(Spectator::RecordType type, const uint8_t* payload, size_t size);
+	// The decoders return false for a shape or color no piece has, the record is corrupt
+	bool decodePiece(const uint8_t* in);
+	bool decodeNext(const uint8_t* in);
+	void decodeStats(const uint8_t* in);
+	bool decodeRow(int row, const uint8_t* in);
+
+	vector<uint8_t> pending;
+	size_t readOffset = 0;
+	bool headerSeen = false;
+	bool synchronized = false;
+	uint32_t frame = 0;
+	GameBoard::Snapshot state{ };
+
+public:
+	void feed(const uint8_t* data, size_t size);
+	// Applies buffered records whose frame is at most untilFrame, false once the stream is corrupt
+	bool apply(uint32_t untilFrame = UINT32_MAX);
+
+	// True while a whole record waits in the buffer, e.g. one that belongs to a later frame
+	bool hasRecord( ) const;
+	// True once a keyframe was applied
+	bool hasState( ) const;
+	uint32_t getFrame( ) const;
+	const GameBoard::Snapshot& getState( ) const;
+};
+
+// Encodes a board once per frame and fans the bytes out to a file or pipe and to localhost viewers.
+// A viewer that connects late gets the last keyframe and every delta since, so it can start right away.
+class SpectatorPublisher {
+public:
+	// A viewer this far behind is dropped instead of buffering without bound
+	static constexpr size_t MAX_VIEWER_BACKLOG = 256 * 1024;
+
+	struct Stats {
+		uint64_t bytesEncoded = 0;
+		uint32_t keyframes = 0;
+		uint32_t records = 0;
+		uint32_t viewers = 0;
+		uint32_t viewersDropped = 0;
+	};
+
+private:
+	struct Viewer {
+		TcpSocket socket;
+		vector<uint8_t> outbox;
+	};
+
+	void acceptViewers( );
+	void send(Viewer& viewer, const uint8_t* data, size_t size);
+
+	SpectatorEncoder encoder;
+	FILE* file = nullptr;
+	bool ownsFile = false;
+	TcpSocket listener;
+	vector<Viewer> viewers;
+
+	vector<uint8_t> header;
+	vector<uint8_t> sinceKeyframe;
+	vector<uint8_t> record;
+	bool started = false;
+	uint32_t lastFrame = 0;
+	Stats stats;
+
+public:
+	SpectatorPublisher( );
+	~SpectatorPublisher( );
+	SpectatorPublisher(const SpectatorPublisher&) = delete;
+	SpectatorPublisher& operator=(const SpectatorPublisher&) = delete;
+
+	// "-" writes to stdout; a named pipe works like a file
+	bool openFile(const string& path);
+	bool listen(uint16_t port);
+
+	// Publishes the board state of the given frame, repeated frames are ignored
+	void publish(GameBoard& board, uint32_t frame);
+
+	const Stats& getStats( ) const;
+};
+
+// One watched feed: a live "host:port" publisher, or a recording played back at game speed from its
+// first keyframe on
+class SpectatorSource {
+private:
+	TcpSocket socket;
+	FILE* file = nullptr;
+	SpectatorDecoder decoder;
+	bool live = false;
+	bool fileRead = false;
+	bool ended = false;
+	bool corrupt = false;
+	uint64_t playbackStart = 0;     // ms, 0 until the first keyframe
+	uint32_t firstFrame = 0;
+	uint32_t shownFrame = UINT32_MAX;
+
+public:
+	SpectatorSource( ) = default;
+	~SpectatorSource( );
+	SpectatorSource(const SpectatorSource&) = delete;
+	SpectatorSource& operator=(const SpectatorSource&) = delete;
+
+	// Connects to a live feed or opens a recording, whichever source names
+	bool open(const string& source);
+
+	// Reads what arrived and applies the records due at nowMs, true when there is a new frame to show
+	bool poll(uint64_t nowMs);
+
+	bool hasState( ) const;
+	const GameBoard::Snapshot& getState( ) const;
+	// The publisher went away or the recording is played to its end
+	bool isEnded( ) const;
+	// A record did not decode, nothing more is applied
+	bool isCorrupt( ) const;
+
+	// Splits a SpectatorConfig::mosaic list into sources, reading an "@file" list
+	static vector<string> parseList(const string& list);
+};
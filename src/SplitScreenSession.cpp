@@ -0,0 +1,107 @@
+#include "SplitScreenSession.hpp"
+#include "Trace.hpp"
+
+#include <chrono>
+
+SplitScreenSession::SplitScreenSession(uint64_t seed) {
+	// Same seed on both sides, the players race the same piece sequence
+	for (int player = 0; player < 2; player++) {
+		players[player] = make_unique<Player>(seed);
+		Player* self = players[player].get( );
+		self->board.setEventBuffer(&self->frameEvents);
+		self->view.publish(self->board.snapshot( ));
+	}
+}
+
+SplitScreenSession::~SplitScreenSession( ) { stop( ); }
+
+void SplitScreenSession::start( ) {
+	if (running.exchange(true)) return;
+	for (int player = 0; player < 2; player++)
+		players[player]->handle = thread(&SplitScreenSession::boardLoop, this, player);
+}
+
+void SplitScreenSession::stop( ) {
+	if (!running.exchange(false)) return;
+	for (auto& player : players)
+		if (player->handle.joinable( )) player->handle.join( );
+}
+
+void SplitScreenSession::boardLoop(int player) {
+	using clock = chrono::steady_clock;
+	const auto interval = chrono::nanoseconds(1000000000LL / GameBoard::TICKS_PER_SECOND);
+	Player& self = *players[player];
+	Player& opponent = *players[1 - player];
+	auto nextFrame = clock::now( );
+	Trace::setThreadName(player == 0 ? "board 1" : "board 2");
+
+	while (running.load(memory_order_relaxed)) {
+		this_thread::sleep_until(nextFrame);
+		nextFrame += interval;
+		if (clock::now( ) - nextFrame > interval * 4) nextFrame = clock::now( ) + interval;
+
+		if (self.toppedOut.load(memory_order_relaxed) || opponent.toppedOut.load(memory_order_relaxed)) continue;
+
+		auto stepStart = clock::now( );
+		uint8_t rows;
+		while (self.incomingGarbage.tryPop(rows)) self.board.addGarbage(rows);
+		self.board.tick(self.buttons.load(memory_order_relaxed));
+		self.unsentGarbage += self.board.takeOutgoingGarbage( );
+		sendGarbage(self, opponent);
+		self.view.publish(self.board.snapshot( ));
+		for (const GameEvent& event : self.frameEvents) self.events.tryPush(event);
+		self.frameEvents.clear( );
+
+		uint64_t stepNs = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(clock::now( ) - stepStart).count( ));
+		if (stepNs > self.maxStepNs.load(memory_order_relaxed)) self.maxStepNs.store(stepNs, memory_order_relaxed);
+		self.frames.fetch_add(1, memory_order_relaxed);
+		if (self.board.isCollision( )) self.toppedOut.store(true, memory_order_release);
+	}
+}
+
+void SplitScreenSession::sendGarbage(Player& from, Player& to) {
+	// A full queue keeps the rows here for the next frame instead of waiting on the other thread
+	while (from.unsentGarbage > 0) {
+		uint8_t rows = static_cast<uint8_t>(min(from.unsentGarbage, GameBoard::MAX_PENDING_GARBAGE));
+		if (!to.incomingGarbage.tryPush(rows)) {
+			from.garbageDeferred.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		from.unsentGarbage -= rows;
+	}
+}
+
+void SplitScreenSession::setButtons(int player, uint8_t heldButtons) {
+	players[player]->buttons.store(heldButtons, memory_order_relaxed);
+}
+
+bool SplitScreenSession::updateView(int player, GameBoard& view) {
+	if (!players[player]->view.update( )) return false;
+	view.restore(players[player]->view.read( ));
+	return true;
+}
+
+void SplitScreenSession::drainEvents(GameEventBuffer& into) {
+	GameEvent event;
+	for (auto& player : players)
+		while (player->events.tryPop(event)) into.push(event);
+}
+
+bool SplitScreenSession::isFinished( ) const {
+	return players[0]->toppedOut.load(memory_order_acquire) || players[1]->toppedOut.load(memory_order_acquire);
+}
+
+int SplitScreenSession::getWinner( ) const {
+	bool first = players[0]->toppedOut.load(memory_order_acquire);
+	bool second = players[1]->toppedOut.load(memory_order_acquire);
+	if (first == second) return -1;
+	return first ? 1 : 0;
+}
+
+SplitScreenSession::Stats SplitScreenSession::getStats(int player) const {
+	Stats stats;
+	stats.frames = players[player]->frames.load(memory_order_relaxed);
+	stats.maxStepMs = players[player]->maxStepNs.load(memory_order_relaxed) / 1e6;
+	stats.garbageDeferred = players[player]->garbageDeferred.load(memory_order_relaxed);
+	return stats;
+}
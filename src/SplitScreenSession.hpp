@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "GameBoard.hpp"
+#include "SpscQueue.hpp"
+#include "TripleBuffer.hpp"
+
+using namespace std;
+
+// Local two player versus. Each board steps at GameBoard::TICKS_PER_SECOND on its own thread;
+// garbage and board events leave a board thread only through bounded lock-free queues and the board
+// state reaches the render thread through a triple buffer, so no thread ever waits on another.
+class SplitScreenSession {
+public:
+	static constexpr int GARBAGE_QUEUE = 16;
+	// A frame records a handful of events, this covers a few frames of the render thread falling behind
+	static constexpr int EVENT_QUEUE = 128;
+
+	struct Stats {
+		uint32_t frames = 0;
+		double maxStepMs = 0.0;         // slowest single frame of this board so far
+		uint32_t garbageDeferred = 0;   // frames where the opponent's queue was full
+	};
+
+private:
+	struct Player {
+		explicit Player(uint64_t seed) : board(seed) { }
+
+		GameBoard board;                // touched by the board thread only
+		atomic<uint8_t> buttons{ 0 };   // held buttons, written by the input thread
+		SpscQueue<uint8_t, GARBAGE_QUEUE> incomingGarbage;     // rows sent by the opponent's thread
+		GameEventBuffer frameEvents;    // recorded by the board during one step
+		SpscQueue<GameEvent, EVENT_QUEUE> events;              // drained by the render thread
+		TripleBuffer<GameBoard::Snapshot> view;
+		int unsentGarbage = 0;
+
+		atomic<bool> toppedOut{ false };
+		atomic<uint32_t> frames{ 0 };
+		atomic<uint64_t> maxStepNs{ 0 };
+		atomic<uint32_t> garbageDeferred{ 0 };
+		thread handle;
+	};
+
+	void boardLoop(int player);
+	void sendGarbage(Player& from, Player& to);
+
+	array<unique_ptr<Player>, 2> players;
+	atomic<bool> running{ false };
+
+public:
+	explicit SplitScreenSession(uint64_t seed = random_device{ }( ));
+	~SplitScreenSession( );
+
+	void start( );
+	void stop( );
+
+	void setButtons(int player, uint8_t heldButtons);
+	// Copies the newest published state of a board into a render side copy, false if nothing changed
+	bool updateView(int player, GameBoard& view);
+	// Moves the events both boards recorded since the last call into the calling thread's buffer,
+	// e.g. GameEventBus::getBuffer( ). Events that did not fit the queue are lost.
+	void drainEvents(GameEventBuffer& into);
+
+	bool isFinished( ) const;
+	// 0 or 1, -1 for a draw or while still running
+	int getWinner( ) const;
+	Stats getStats(int player) const;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+using namespace std;
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Neither side ever blocks: a full queue rejects the push and an empty one the pop.
+template <typename T, size_t Capacity>
+class SpscQueue {
+	static_assert(is_trivially_copyable<T>::value, "SpscQueue entries must be trivially copyable");
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+private:
+	array<T, Capacity> entries;
+	// Producer and consumer indices on their own cache lines so the two threads do not share one
+	alignas(64) atomic<size_t> tail{ 0 };
+	alignas(64) atomic<size_t> head{ 0 };
+
+public:
+	bool tryPush(const T& value) {
+		size_t write = tail.load(memory_order_relaxed);
+		if (write - head.load(memory_order_acquire) == Capacity) return false;
+		entries[write & (Capacity - 1)] = value;
+		tail.store(write + 1, memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& out) {
+		size_t read = head.load(memory_order_relaxed);
+		if (read == tail.load(memory_order_acquire)) return false;
+		out = entries[read & (Capacity - 1)];
+		head.store(read + 1, memory_order_release);
+		return true;
+	}
+
+	// Only exact when called from the producer or the consumer while the other side is idle
+	size_t size( ) const { return tail.load(memory_order_acquire) - head.load(memory_order_acquire); }
+	bool empty( ) const { return size( ) == 0; }
+	static constexpr size_t capacity( ) { return Capacity; }
+};
@@ -0,0 +1,132 @@
+#include "StressBoard.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <numeric>
+
+StressBoard::Piece StressBoard::pieceOf(const Tetromino& tetromino) {
+	Piece piece{ };
+	const auto& shape = tetromino.getShape( );
+	piece.height = min(4, static_cast<int>(shape.size( )));
+	for (int row = 0; row < piece.height; row++)
+		for (int col = 0; col < min(8, static_cast<int>(shape[row].size( ))); col++)
+			if (shape[row][col]) piece.rows[row] |= static_cast<uint8_t>(1u << col);
+	return piece;
+}
+
+StressBoard::StressBoard(int width, int height)
+	: width(max(1, width)), height(max(1, height)), wordsPerRow((this->width + WORD_BITS - 1) / WORD_BITS),
+	cells(static_cast<size_t>(wordsPerRow) * this->height, 0), slots(this->height), filled(this->height, 0), stackTop(this->height) {
+	iota(slots.begin( ), slots.end( ), 0u);
+}
+
+int StressBoard::getWidth( ) const { return width; }
+int StressBoard::getHeight( ) const { return height; }
+int StressBoard::getStackTop( ) const { return stackTop; }
+
+uint64_t* StressBoard::rowWords(int row) { return &cells[static_cast<size_t>(slots[row]) * wordsPerRow]; }
+const uint64_t* StressBoard::rowWords(int row) const { return &cells[static_cast<size_t>(slots[row]) * wordsPerRow]; }
+
+bool StressBoard::isFilled(int row, int column) const {
+	if (row < 0 || row >= height || column < 0 || column >= width) return false;
+	return (rowWords(row)[column / WORD_BITS] >> (column % WORD_BITS)) & 1;
+}
+
+int StressBoard::getFilledCount(int row) const {
+	if (row < 0 || row >= height) return 0;
+	return static_cast<int>(filled[slots[row]]);
+}
+
+bool StressBoard::place(uint8_t bits, int x, int& word, uint64_t& low, uint64_t& high) const {
+	if (x < 0) {
+		if (x <= -8 || (bits & ((1u << -x) - 1))) return false;
+		bits = static_cast<uint8_t>(bits >> -x);
+		x = 0;
+	}
+	int inside = width - x;
+	if (inside <= 0 || (inside < 8 && (bits >> inside))) return false;
+
+	word = x / WORD_BITS;
+	int shift = x % WORD_BITS;
+	low = static_cast<uint64_t>(bits) << shift;
+	// A piece row is at most 8 bits wide, so it only spills into the next word near the end of one
+	high = shift > WORD_BITS - 8 ? static_cast<uint64_t>(bits) >> (WORD_BITS - shift) : 0;
+	return true;
+}
+
+bool StressBoard::collides(const Piece& piece, int x, int y) const {
+	for (int r = 0; r < piece.height; r++) {
+		uint8_t bits = piece.rows[r];
+		if (!bits) continue;
+
+		int word;
+		uint64_t low, high;
+		if (!place(bits, x, word, low, high)) return true;
+		int row = y + r;
+		if (row >= height) return true;
+		if (row < 0) continue;
+
+		const uint64_t* words = rowWords(row);
+		if ((words[word] & low) || (high && (words[word + 1] & high))) return true;
+	}
+	return false;
+}
+
+int StressBoard::dropRow(const Piece& piece, int x, int y) const {
+	if (collides(piece, x, y)) return y;
+	// Nothing above stackTop can stop the piece, only the rows of the stack are tested one by one
+	int row = max(y, stackTop - piece.height);
+	// Bounded for a piece without cells, which collides nowhere
+	while (row + 1 < height && !collides(piece, x, row + 1)) row++;
+	return row;
+}
+
+void StressBoard::lock(const Piece& piece, int x, int y) {
+	for (int r = 0; r < piece.height; r++) {
+		uint8_t bits = piece.rows[r];
+		int row = y + r;
+		int word;
+		uint64_t low, high;
+		if (!bits || row < 0 || row >= height || !place(bits, x, word, low, high)) continue;
+
+		uint64_t* words = rowWords(row);
+		words[word] |= low;
+		if (high) words[word + 1] |= high;
+
+		uint32_t& count = filled[slots[row]];
+		count += static_cast<uint32_t>(bitset<8>(bits).count( ));
+		if (count == static_cast<uint32_t>(width)) fullRows.push_back(row);
+		stackTop = min(stackTop, row);
+	}
+}
+
+int StressBoard::clearLines( ) {
+	if (fullRows.empty( )) return 0;
+	sort(fullRows.begin( ), fullRows.end( ));
+	fullRows.erase(unique(fullRows.begin( ), fullRows.end( )), fullRows.end( ));
+	const int cleared = static_cast<int>(fullRows.size( ));
+
+	// Rows of the stack above the lowest full one move down past the full ones, the full rows'
+	// slots are collected in fullRows as they are passed. Rows above stackTop are empty, so they
+	// need not move: the freed slots become the top rows of the stack instead.
+	int write = fullRows.back( );
+	size_t next = fullRows.size( );
+	for (int row = write; row >= stackTop; row--) {
+		if (next > 0 && fullRows[next - 1] == row) {
+			fullRows[--next] = static_cast<int>(slots[row]);
+			continue;
+		}
+		slots[write--] = slots[row];
+	}
+
+	for (int i = 0; i < cleared; i++) {
+		uint32_t slot = static_cast<uint32_t>(fullRows[i]);
+		fill_n(cells.begin( ) + static_cast<size_t>(slot) * wordsPerRow, wordsPerRow, 0);
+		filled[slot] = 0;
+		slots[stackTop + i] = slot;
+	}
+
+	stackTop = min(height, stackTop + cleared);
+	fullRows.clear( );
+	return cleared;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Tetromino.hpp"
+
+using namespace std;
+
+// Rules engine for boards of any size, e.g. 1000x10000, to find what scales badly before it shows
+// up on the real board. Every row is a bitset of 64 bit words plus a count of its set cells, and rows
+// are reached through an index of storage slots, so a line clear renumbers rows instead of moving
+// their cells. Only what tetris_stressbench measures: collision, hard drop, locking and line clears.
+class StressBoard {
+public:
+	// Up to four rows of column bits, bit c of rows[r] is the cell at column x + c and row y + r
+	struct Piece {
+		uint8_t rows[4];
+		int height;
+	};
+	static Piece pieceOf(const Tetromino& tetromino);
+
+private:
+	static constexpr int WORD_BITS = 64;
+
+	// The piece row's bits at column x as the two words it can straddle, false when part of it
+	// is outside the board
+	bool place(uint8_t bits, int x, int& word, uint64_t& low, uint64_t& high) const;
+	uint64_t* rowWords(int row);
+	const uint64_t* rowWords(int row) const;
+
+	int width, height;
+	int wordsPerRow;
+	vector<uint64_t> cells;     // wordsPerRow words per slot
+	vector<uint32_t> slots;     // storage slot of every row, top row first
+	vector<uint32_t> filled;    // set cells per slot
+	// Every row above stackTop is empty, a hard drop skips them in one step
+	int stackTop;
+	// Rows completed by lock( ) since the last clearLines( )
+	vector<int> fullRows;
+
+public:
+	StressBoard(int width, int height);
+
+	int getWidth( ) const;
+	int getHeight( ) const;
+	bool isFilled(int row, int column) const;
+	int getFilledCount(int row) const;
+	// Highest row that may hold a cell, height when the board is empty
+	int getStackTop( ) const;
+
+	// Rows above the board are free, columns outside it and rows below it are not
+	bool collides(const Piece& piece, int x, int y) const;
+	// Row the piece comes to rest on when dropped from y, y itself when it cannot move down
+	int dropRow(const Piece& piece, int x, int y) const;
+	// Sets the piece's cells, which must be free; cells above the board are dropped
+	void lock(const Piece& piece, int x, int y);
+	// Removes the rows completed since the last call and returns how many there were. Costs the
+	// number of rows above the lowest cleared one in index moves plus the cleared rows' words.
+	int clearLines( );
+};
@@ -1,59 +1,17 @@
 #include "Tetromino.hpp"
-#include "GameBoard.hpp"
+#include "BoardView.hpp"
 
-Tetromino::Tetromino(TetrominoShape shape) : x(0), y(0), textureShape(shape) {
+Tetromino::Tetromino(TetrominoShape shape, int colorIndex) : x(0), y(0), textureShape(shape), colorIndex(colorIndex) {
 	initializeShape(shape);
 	currentRotationState = 1;
+}
 
-	color.a = 255;
-	color.r = 0;
-	color.g = 0;
-	color.b = 0;
-
-	random_device dev;
-	mt19937 rng(dev( ));
-	uniform_int_distribution<mt19937::result_type> dist6(0, 5);
-
-	switch (dist6(rng)) {
-	case 0:
-		color.r = 0;
-		color.g = 191;
-		color.b = 255;
-		break;
-	case 1:
-		color.r = 255;
-		color.g = 215;
-		color.b = 0;
-		break;
-	case 2:
-		color.r = 138;
-		color.g = 43;
-		color.b = 226;
-		break;
-	case 3:
-		color.r = 0;
-		color.g = 204;
-		color.b = 102;
-		break;
-	case 4:
-		color.r = 255;
-		color.g = 69;
-		color.b = 0;
-		break;
-	case 5:
-		color.r = 30;
-		color.g = 144;
-		color.b = 255;
-		break;
-	case 6:
-		color.r = 255;
-		color.g = 140;
-		color.b = 0;
-		break;
-	default:
-		break;
-	}
-
+Tetromino::Tetromino(const TetrominoState& state)
+	: x(state.x), y(state.y), currentRotationState(state.rotationState), textureShape(state.shape), colorIndex(state.colorIndex) {
+	shape.assign(state.rows, vector<int>(state.cols, 0));
+	for (int row = 0; row < state.rows; ++row)
+		for (int col = 0; col < state.cols; ++col)
+			shape[row][col] = state.cells[row][col];
 }
 
 void Tetromino::initializeShape(TetrominoShape s) {
@@ -85,7 +43,7 @@ void Tetromino::initializeShape(TetrominoShape s) {
 	}
 }
 
-void Tetromino::rotate(GameBoard& gameBoard) {
+void Tetromino::rotate(const BoardView& gameBoard) {
 	vector<vector<int>> rotated(shape[0].size( ), vector<int>(shape.size( )));
 	for (int row = 0; row < shape.size( ); ++row)
 		for (int col = 0; col < shape[0].size( ); ++col)
@@ -125,4 +83,19 @@ const TetrominoShape Tetromino::getShapeEnumn( ) const { return textureShape; }
 int Tetromino::getX( ) const { return x; }
 int Tetromino::getY( ) const { return y; }
 
-SDL_Color Tetromino::getColor( ) const { return color; }
+int Tetromino::getColorIndex( ) const { return colorIndex; }
+
+TetrominoState Tetromino::getState( ) const {
+	TetrominoState state{ };
+	state.shape = textureShape;
+	state.x = x;
+	state.y = y;
+	state.rotationState = currentRotationState;
+	state.colorIndex = colorIndex;
+	state.rows = static_cast<uint8_t>(shape.size( ));
+	state.cols = static_cast<uint8_t>(shape.empty( ) ? 0 : shape[0].size( ));
+	for (int row = 0; row < state.rows; ++row)
+		for (int col = 0; col < state.cols; ++col)
+			state.cells[row][col] = static_cast<uint8_t>(shape[row][col]);
+	return state;
+}
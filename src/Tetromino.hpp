@@ -1,12 +1,9 @@
 #pragma once
 
-extern "C" {
-#include <SDL2/SDL.h>
-}
-
 #include <vector>
 #include <string>
 #include <random>
+#include <cstdint>
 
 using namespace std;
 
@@ -25,9 +22,20 @@ enum class TetrominoShape {
 	I_ENDR,
 	I_STARTR,
 	I_MIDR,
+	GARBAGE,
 };
 
-class GameBoard;
+class BoardView;
+
+// Plain-data copy of a tetromino so board snapshots stay trivially copyable
+struct TetrominoState {
+	TetrominoShape shape;
+	int32_t x, y;
+	int32_t rotationState;
+	int32_t colorIndex;
+	uint8_t rows, cols;
+	uint8_t cells[4][4];
+};
 
 class Tetromino {
 private:
@@ -40,11 +48,16 @@ private:
 
 	TetrominoShape textureShape;
 
-	SDL_Color color;
+	int colorIndex;
 public:
-	Tetromino(TetrominoShape shape);
+	// Pieces pick one of the first COLOR_COUNT palette entries, the renderer owns the actual colors
+	static constexpr int COLOR_COUNT = 6;
+	static constexpr int GARBAGE_COLOR = 7;
 
-	void rotate(GameBoard& gameBoard);
+	Tetromino(TetrominoShape shape, int colorIndex);
+	Tetromino(const TetrominoState& state);
+
+	void rotate(const BoardView& gameBoard);
 	void move(int dx, int dy);
 	double getRotationAngle( ) const;
 
@@ -53,5 +66,7 @@ public:
 	int getX( ) const;
 	int getY( ) const;
 
-	SDL_Color getColor( ) const;
+	int getColorIndex( ) const;
+
+	TetrominoState getState( ) const;
 };
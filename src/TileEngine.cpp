@@ -0,0 +1,164 @@
+#include "TileEngine.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TILE_ENGINE_SSE2 1
+#endif
+
+namespace {
+	// Never a valid id, forces the first draw of every cell
+	constexpr uint16_t NOT_DRAWN = 0xFFFF;
+}
+
+TileEngine::TileEngine(int columns, int rows)
+	: columns(columns), rows(rows), map(columns * rows, 0), drawn(columns * rows, NOT_DRAWN), dirty(columns * rows, 0),
+	pixels(static_cast<size_t>(columns) * rows * TILE_PIXELS, 0) { }
+
+uint16_t TileEngine::addTile(const uint32_t* tilePixels) {
+	atlas.insert(atlas.end( ), tilePixels, tilePixels + TILE_PIXELS);
+	return static_cast<uint16_t>(atlas.size( ) / TILE_PIXELS - 1);
+}
+
+size_t TileEngine::getTileCount( ) const { return atlas.size( ) / TILE_PIXELS; }
+
+void TileEngine::setTile(int column, int row, uint16_t tile) {
+	if (column < 0 || column >= columns || row < 0 || row >= rows) return;
+	map[row * columns + column] = tile;
+}
+
+uint16_t TileEngine::getTile(int column, int row) const {
+	if (column < 0 || column >= columns || row < 0 || row >= rows) return 0;
+	return map[row * columns + column];
+}
+
+void TileEngine::invalidate( ) { fill(drawn.begin( ), drawn.end( ), NOT_DRAWN); }
+
+void TileEngine::clearObjects( ) {
+	previousObjects.swap(objects);
+	objects.clear( );
+}
+
+void TileEngine::addObject(uint16_t tile, int x, int y) { objects.push_back({ tile, x, y }); }
+
+void TileEngine::objectCells(const Object& object, int& firstColumn, int& lastColumn, int& firstRow, int& lastRow) const {
+	// Clamped, an object partly off screen only covers the cells it overlaps
+	firstColumn = max(0, object.x / TILE_SIZE);
+	firstRow = max(0, object.y / TILE_SIZE);
+	lastColumn = min(columns - 1, (object.x + TILE_SIZE - 1) / TILE_SIZE);
+	lastRow = min(rows - 1, (object.y + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+void TileEngine::markObject(const Object& object) {
+	int firstColumn, lastColumn, firstRow, lastRow;
+	objectCells(object, firstColumn, lastColumn, firstRow, lastRow);
+	for (int row = firstRow; row <= lastRow; row++)
+		for (int column = firstColumn; column <= lastColumn; column++) dirty[row * columns + column] = 1;
+}
+
+bool TileEngine::touchesDirty(const Object& object) const {
+	int firstColumn, lastColumn, firstRow, lastRow;
+	objectCells(object, firstColumn, lastColumn, firstRow, lastRow);
+	for (int row = firstRow; row <= lastRow; row++)
+		for (int column = firstColumn; column <= lastColumn; column++)
+			if (dirty[row * columns + column]) return true;
+	return false;
+}
+
+TileEngine::Rect TileEngine::compose( ) {
+	stats.frames++;
+	for (size_t cell = 0; cell < map.size( ); cell++)
+		if (map[cell] != drawn[cell]) dirty[cell] = 1;
+
+	// An object that moved or changed uncovers the cells it left and needs the ones it entered
+	size_t common = min(objects.size( ), previousObjects.size( ));
+	for (size_t i = 0; i < common; i++) {
+		if (objects[i] == previousObjects[i]) continue;
+		markObject(previousObjects[i]);
+		markObject(objects[i]);
+	}
+	for (size_t i = common; i < previousObjects.size( ); i++) markObject(previousObjects[i]);
+	for (size_t i = common; i < objects.size( ); i++) markObject(objects[i]);
+
+	int width = getWidth( );
+	int minColumn = columns, minRow = rows, maxColumn = -1, maxRow = -1;
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns; column++) {
+			size_t cell = row * columns + column;
+			if (!dirty[cell]) continue;
+
+			uint16_t tile = map[cell];
+			if (static_cast<size_t>(tile) * TILE_PIXELS < atlas.size( ))
+				copyTile(&pixels[(row * TILE_SIZE) * width + column * TILE_SIZE], width, &atlas[tile * TILE_PIXELS]);
+			drawn[cell] = tile;
+			stats.tilesDrawn++;
+			minColumn = min(minColumn, column);
+			maxColumn = max(maxColumn, column);
+			minRow = min(minRow, row);
+			maxRow = max(maxRow, row);
+		}
+	}
+
+	// Redrawn cells lost whatever objects covered them, objects over untouched cells are still there
+	int height = getHeight( );
+	for (const Object& object : objects) {
+		if (static_cast<size_t>(object.tile) * TILE_PIXELS >= atlas.size( ) || !touchesDirty(object)) continue;
+
+		int firstColumn = max(0, -object.x), lastColumn = min(TILE_SIZE, width - object.x);
+		int firstRow = max(0, -object.y), lastRow = min(TILE_SIZE, height - object.y);
+		if (firstColumn >= lastColumn || firstRow >= lastRow) continue;
+		uint32_t* visible = &pixels[static_cast<size_t>(object.y + firstRow) * width + object.x + firstColumn];
+		drawObject(visible, width, &atlas[object.tile * TILE_PIXELS], firstColumn, lastColumn, firstRow, lastRow);
+		stats.objectsDrawn++;
+	}
+
+	fill(dirty.begin( ), dirty.end( ), 0);
+	if (maxColumn < 0) return { 0, 0, 0, 0 };
+	return {
+		minColumn * TILE_SIZE, minRow * TILE_SIZE,
+		(maxColumn - minColumn + 1) * TILE_SIZE, (maxRow - minRow + 1) * TILE_SIZE
+	};
+}
+
+const uint32_t* TileEngine::getPixels( ) const { return pixels.data( ); }
+int TileEngine::getPitch( ) const { return getWidth( ) * static_cast<int>(sizeof(uint32_t)); }
+int TileEngine::getWidth( ) const { return columns * TILE_SIZE; }
+int TileEngine::getHeight( ) const { return rows * TILE_SIZE; }
+const TileEngine::Stats& TileEngine::getStats( ) const { return stats; }
+
+void TileEngine::copyTile(uint32_t* destination, size_t stride, const uint32_t* tile) {
+	for (int row = 0; row < TILE_SIZE; row++, destination += stride, tile += TILE_SIZE) {
+#ifdef TILE_ENGINE_SSE2
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + 4), _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + 4)));
+#else
+		memcpy(destination, tile, TILE_SIZE * sizeof(uint32_t));
+#endif
+	}
+}
+
+void TileEngine::drawObject(uint32_t* destination, size_t stride, const uint32_t* tile,
+	int firstColumn, int lastColumn, int firstRow, int lastRow) {
+	tile += firstRow * TILE_SIZE;
+	for (int row = firstRow; row < lastRow; row++, destination += stride, tile += TILE_SIZE) {
+#ifdef TILE_ENGINE_SSE2
+		if (firstColumn == 0 && lastColumn == TILE_SIZE) {
+			// Select per pixel: keep the destination where the object's alpha is zero
+			const __m128i alpha = _mm_set1_epi32(0xFF);
+			const __m128i zero = _mm_setzero_si128( );
+			for (int half = 0; half < TILE_SIZE; half += 4) {
+				__m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + half));
+				__m128i behind = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + half));
+				__m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(source, alpha), zero);
+				__m128i blended = _mm_or_si128(_mm_and_si128(transparent, behind), _mm_andnot_si128(transparent, source));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + half), blended);
+			}
+			continue;
+		}
+#endif
+		for (int column = firstColumn; column < lastColumn; column++)
+			if (tile[column] & 0xFF) destination[column - firstColumn] = tile[column];
+	}
+}
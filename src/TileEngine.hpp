@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Software compositor in the style of the Game Boy PPU: a grid of 8x8 background tiles plus a few
+// objects at pixel positions, composed into a 32 bit pixel buffer. Only tiles whose id changed or
+// that an object entered or left are redrawn, so an idle frame costs a compare per tile.
+// Pixels are RGBA8888 packed into one uint32_t (alpha in the low byte); an object pixel with zero
+// alpha is transparent, any other alpha draws it opaque.
+class TileEngine {
+public:
+	static constexpr int TILE_SIZE = 8;
+	static constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+	// Pixel rectangle, w == 0 when empty
+	struct Rect {
+		int x, y, w, h;
+	};
+
+	struct Stats {
+		uint64_t frames = 0;
+		uint64_t tilesDrawn = 0;
+		uint64_t objectsDrawn = 0;
+	};
+
+private:
+	struct Object {
+		uint16_t tile;
+		int x, y;
+
+		bool operator==(const Object& other) const { return tile == other.tile && x == other.x && y == other.y; }
+	};
+
+	void objectCells(const Object& object, int& firstColumn, int& lastColumn, int& firstRow, int& lastRow) const;
+	void markObject(const Object& object);
+	bool touchesDirty(const Object& object) const;
+
+	int columns, rows;
+	vector<uint32_t> atlas;     // TILE_PIXELS per tile
+	vector<uint16_t> map;
+	vector<uint16_t> drawn;     // what the pixel buffer shows per cell
+	vector<uint8_t> dirty;
+	vector<Object> objects;
+	vector<Object> previousObjects;
+	vector<uint32_t> pixels;
+	Stats stats;
+
+public:
+	TileEngine(int columns, int rows);
+
+	// Copies TILE_PIXELS row major pixels into the atlas and returns the new tile's id
+	uint16_t addTile(const uint32_t* tilePixels);
+	size_t getTileCount( ) const;
+
+	// Out of range cells are ignored
+	void setTile(int column, int row, uint16_t tile);
+	uint16_t getTile(int column, int row) const;
+	// Redraws everything on the next compose( ), e.g. after the target texture was lost
+	void invalidate( );
+
+	// Objects are given again every frame, in the same order; later ones draw on top
+	void clearObjects( );
+	void addObject(uint16_t tile, int x, int y);
+
+	// Brings the pixel buffer up to date and returns the area that changed
+	Rect compose( );
+
+	const uint32_t* getPixels( ) const;
+	// Bytes per row
+	int getPitch( ) const;
+	int getWidth( ) const;
+	int getHeight( ) const;
+	const Stats& getStats( ) const;
+
+	// The blit kernels, exposed for the benchmark. stride is in pixels.
+	static void copyTile(uint32_t* destination, size_t stride, const uint32_t* tile);
+	// Draws columns [firstColumn, lastColumn) and rows [firstRow, lastRow) of the tile, destination
+	// points at where its pixel (firstColumn, firstRow) goes
+	static void drawObject(uint32_t* destination, size_t stride, const uint32_t* tile,
+		int firstColumn = 0, int lastColumn = TILE_SIZE, int firstRow = 0, int lastRow = TILE_SIZE);
+};
@@ -0,0 +1,203 @@
+#include "TileRenderer.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include <cstdio>
+
+extern "C" {
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+}
+
+namespace {
+	Metrics::Counter& assetLoads = Metrics::counter("tetris_asset_loads_total", "Images, fonts and sounds loaded from disk");
+	Metrics::Counter& tilesDrawn = Metrics::counter("tetris_tiles_drawn_total", "Background tiles redrawn by the tile renderer");
+	Metrics::Counter& drawCalls = Metrics::counter("tetris_draw_calls_total", "SDL copy and fill calls");
+
+	// The clear color of the game screens
+	constexpr SDL_Color BACKGROUND{ 248, 248, 248, 255 };
+	constexpr SDL_Color WALL{ 165, 42, 42, 255 };
+	constexpr SDL_Color WHITE{ 255, 255, 255, 255 };
+	// Width of the black bar at the left edge, see Renderer::drawScoreboard
+	constexpr int EDGE_WIDTH = 7;
+
+	uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) { return r << 24 | g << 16 | b << 8 | a; }
+}
+
+TileRenderer::TileRenderer(Renderer& owner)
+	: owner(owner), engine(COLUMNS, ROWS), texture(nullptr, AssetManager::destroyTexture) { }
+
+SDL_Surface* TileRenderer::loadRgba(const string& path) {
+	TRACE_ZONE("asset load");
+	assetLoads.add( );
+	auto surface = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>(IMG_Load(path.c_str( )), SDL_FreeSurface);
+	if (!surface) {
+		SDL_Log("Failed to load %s: %s", path.c_str( ), IMG_GetError( ));
+		return nullptr;
+	}
+	return SDL_ConvertSurfaceFormat(surface.get( ), SDL_PIXELFORMAT_RGBA8888, 0);
+}
+
+TileRenderer::Tile TileRenderer::bake(const SDL_Surface* surface, int originX, int originY, SDL_Color tint, bool opaque) {
+	Tile tile;
+	for (int y = 0; y < TileEngine::TILE_SIZE; y++) {
+		for (int x = 0; x < TileEngine::TILE_SIZE; x++) {
+			int sourceX = originX + x, sourceY = originY + y;
+			uint32_t pixel = 0;
+			if (surface && sourceX >= 0 && sourceY >= 0 && sourceX < surface->w && sourceY < surface->h)
+				pixel = static_cast<const uint32_t*>(surface->pixels)[sourceY * (surface->pitch / 4) + sourceX];
+
+			uint32_t alpha = pixel & 0xFF;
+			uint32_t r = (pixel >> 24) * tint.r / 255, g = (pixel >> 16 & 0xFF) * tint.g / 255, b = (pixel >> 8 & 0xFF) * tint.b / 255;
+			if (opaque) {
+				r = (r * alpha + BACKGROUND.r * (255 - alpha)) / 255;
+				g = (g * alpha + BACKGROUND.g * (255 - alpha)) / 255;
+				b = (b * alpha + BACKGROUND.b * (255 - alpha)) / 255;
+				tile[y * TileEngine::TILE_SIZE + x] = pack(r, g, b, 255);
+			} else {
+				tile[y * TileEngine::TILE_SIZE + x] = alpha >= 128 ? pack(r, g, b, 255) : 0;
+			}
+		}
+	}
+	return tile;
+}
+
+bool TileRenderer::init( ) {
+	TRACE_ZONE("TileRenderer::init");
+	using Surface = unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+
+	blankTile = engine.addTile(bake(nullptr, 0, 0, WHITE, true).data( ));
+
+	Tile edge = bake(nullptr, 0, 0, WHITE, true);
+	for (int y = 0; y < TileEngine::TILE_SIZE; y++)
+		for (int x = 0; x < EDGE_WIDTH; x++) edge[y * TileEngine::TILE_SIZE + x] = pack(0, 0, 0, 255);
+	uint16_t edgeTile = engine.addTile(edge.data( ));
+
+	Surface border(loadRgba(owner.textures[TetrisAssets::BORDER]), SDL_FreeSurface);
+	if (!border) return false;
+	uint16_t wallTile = engine.addTile(bake(border.get( ), 0, 0, WALL, true).data( ));
+
+	for (int asset = 0; asset < ASSET_COUNT; asset++) {
+		Surface sprite(loadRgba(owner.textures[static_cast<TetrisAssets>(asset)]), SDL_FreeSurface);
+		if (!sprite) return false;
+		for (int color = 0; color < PALETTE_SIZE; color++) {
+			cellTiles[asset][color] = engine.addTile(bake(sprite.get( ), 0, 0, owner.paletteColor(color), true).data( ));
+			pieceTiles[asset][color] = engine.addTile(bake(sprite.get( ), 0, 0, owner.paletteColor(color), false).data( ));
+		}
+	}
+
+	Surface scoreboard(loadRgba("assets/sprites/scoreboard.png"), SDL_FreeSurface);
+	if (!scoreboard) return false;
+	// Right aligned like the sprite path, so the image need not start on a tile boundary
+	int scoreboardX = COLUMNS * TileEngine::TILE_SIZE - scoreboard->w;
+	for (int row = 0; row < ROWS; row++) {
+		engine.setTile(0, row, edgeTile);
+		engine.setTile(1, row, wallTile);
+		engine.setTile(RIGHT_WALL_COLUMN, row, wallTile);
+		for (int column = RIGHT_WALL_COLUMN + 1; column < COLUMNS; column++) {
+			Tile tile = bake(scoreboard.get( ), column * TileEngine::TILE_SIZE - scoreboardX, row * TileEngine::TILE_SIZE, WHITE, true);
+			engine.setTile(column, row, engine.addTile(tile.data( )));
+		}
+	}
+
+	// Digits in the same font and size as Renderer::drawScoreboard, cut to one tile each
+	shared_ptr<TTF_Font> font = owner.assets->font("assets/font/tetris-gb.ttf", 8);
+	if (!font) return false;
+	for (int digit = 0; digit < 10; digit++) {
+		char text[2] = { static_cast<char>('0' + digit), 0 };
+		Surface glyph(TTF_RenderText_Solid(font.get( ), text, SDL_Color{ 0, 0, 0, 255 }), SDL_FreeSurface);
+		Surface rgba(glyph ? SDL_ConvertSurfaceFormat(glyph.get( ), SDL_PIXELFORMAT_RGBA8888, 0) : nullptr, SDL_FreeSurface);
+		if (!rgba) return false;
+		digitWidth = min(rgba->w, TileEngine::TILE_SIZE);
+		digitTiles[digit] = engine.addTile(bake(rgba.get( ), 0, 0, WHITE, false).data( ));
+	}
+
+	texture.reset(AssetManager::trackTexture(SDL_CreateTexture(owner.renderer.get( ), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, engine.getWidth( ), engine.getHeight( ))));
+	if (!texture) {
+		SDL_Log("Failed to create the tile texture: %s", SDL_GetError( ));
+		return false;
+	}
+	return true;
+}
+
+void TileRenderer::addPieceObjects(const Tetromino& piece, int x, int y) {
+	// Colors outside the palette, e.g. from a spectator feed, would index past the tile tables
+	int color = min(max(piece.getColorIndex( ), 0), PALETTE_SIZE - 1);
+	int pieceX = piece.getX( ), pieceY = piece.getY( );
+	const int cell = TileEngine::TILE_SIZE;
+
+	if (piece.getShapeEnumn( ) == TetrominoShape::I) {
+		double angle = piece.getRotationAngle( );
+		bool horizontal = angle == 90 || angle == 270;
+		for (int i = 0; i < 4; ++i) {
+			TetrisAssets asset;
+			if (horizontal)
+				asset = i == 0 ? TetrisAssets::I_ENDR : (i == 3 ? TetrisAssets::I_STARTR : TetrisAssets::I_MIDR);
+			else
+				asset = i == 0 ? TetrisAssets::I_END : (i == 3 ? TetrisAssets::I_START : TetrisAssets::I_MID);
+			int column = pieceX + (horizontal ? i : 0), row = pieceY + (horizontal ? 0 : i);
+			engine.addObject(pieceTiles[static_cast<int>(asset)][color], x + column * cell, y + row * cell);
+		}
+		return;
+	}
+
+	uint16_t tile = pieceTiles[static_cast<int>(owner.shapeToAsset(piece.getShapeEnumn( )))][color];
+	const auto& shape = piece.getShape( );
+	for (int row = 0; row < shape.size( ); ++row)
+		for (int column = 0; column < shape[row].size( ); ++column)
+			if (shape[row][column] != 0) engine.addObject(tile, x + (pieceX + column) * cell, y + (pieceY + row) * cell);
+}
+
+void TileRenderer::addNumber(int value, int right, int y) {
+	char text[16];
+	int length = snprintf(text, sizeof(text), "%d", max(0, value));
+	for (int i = 0; i < length; i++) engine.addObject(digitTiles[text[i] - '0'], right - (length - i) * digitWidth, y);
+}
+
+void TileRenderer::render(const BoardView& board) {
+	TRACE_ZONE("TileRenderer::render");
+	// Screen row 0 shows board row firstRow, negative when the board is shorter than the screen
+	const int firstRow = board.getHeight( ) - ROWS;
+	const int columns = min(board.getWidth( ), GameBoard::width);
+	// Rows above a short board never change and rows past the mask are not tracked, both are only
+	// set when everything is dirty
+	const uint64_t dirtyRows = owner.takeDirtyRows( );
+	for (int row = 0; row < ROWS; row++) {
+		int boardRow = firstRow + row;
+		bool dirty = boardRow >= 0 && boardRow < 64 ? ((dirtyRows >> boardRow) & 1) != 0 : dirtyRows == ~0ull;
+		if (!dirty) continue;
+		for (int column = 0; column < GameBoard::width; column++) {
+			int blockType = boardRow >= 0 && column < columns ? board.getCell(boardRow, column) : 0;
+			uint16_t tile = blankTile;
+			if (blockType != 0)
+				tile = cellTiles[static_cast<int>(owner.shapeToAsset(static_cast<TetrominoShape>(blockType - 1)))][min<int>(board.getColor(boardRow, column), PALETTE_SIZE - 1)];
+			engine.setTile(BOARD_COLUMN + column, row, tile);
+		}
+	}
+
+	// Same places as the sprite path: Renderer::drawTetromino, renderTetrominoPreview and drawScoreboard
+	const int width = engine.getWidth( ), height = engine.getHeight( );
+	engine.clearObjects( );
+	if (board.getCurrentTetromino( )) addPieceObjects(*board.getCurrentTetromino( ), BOARD_COLUMN * TileEngine::TILE_SIZE, -firstRow * TileEngine::TILE_SIZE);
+	if (auto next = board.getNextTetromino( )) {
+		if (next->getShapeEnumn( ) == TetrominoShape::I) addPieceObjects(*next, width - 31, height - 24);
+		else addPieceObjects(*next, width - 28, height - 26);
+	}
+	addNumber(board.getScore( ), width - 7, 23);
+	addNumber(board.getLevel( ), width - 15, 55);
+	addNumber(board.getLines( ), width - 15, 79);
+
+	uint64_t drawnBefore = engine.getStats( ).tilesDrawn;
+	TileEngine::Rect changed = engine.compose( );
+	tilesDrawn.add(engine.getStats( ).tilesDrawn - drawnBefore);
+	if (changed.w > 0) {
+		SDL_Rect area{ changed.x, changed.y, changed.w, changed.h };
+		const uint32_t* first = engine.getPixels( ) + changed.y * width + changed.x;
+		SDL_UpdateTexture(texture.get( ), &area, first, engine.getPitch( ));
+	}
+
+	SDL_Rect destination{ 0, 0, width, height };
+	SDL_RenderCopy(owner.renderer.get( ), texture.get( ), nullptr, &destination);
+	drawCalls.add( );
+}
+
+const TileEngine::Stats& TileRenderer::getStats( ) const { return engine.getStats( ); }
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <SDL2/SDL.h>
+}
+
+#include "Renderer.hpp"
+#include "GameBoard.hpp"
+#include "TileEngine.hpp"
+
+using namespace std;
+
+// CPU backend for the single player screen, for hosts where SDL renders in software anyway.
+// The edge, walls, locked cells and scoreboard are background tiles, the falling piece, the preview
+// and the numbers are objects; every sprite is baked once per palette color. The composed frame is
+// uploaded to a streaming texture, only the area that changed, and copied onto the canvas in one call.
+class TileRenderer {
+public:
+	static constexpr int COLUMNS = 20;
+	static constexpr int ROWS = 18;
+
+private:
+	static constexpr int PALETTE_SIZE = Tetromino::GARBAGE_COLOR + 1;
+	static constexpr int ASSET_COUNT = static_cast<int>(TetrisAssets::T) + 1;
+	// Board cells start right of the edge and the left wall
+	static constexpr int BOARD_COLUMN = 2;
+	// The layout is cut for the Game Boy board; other sizes are aligned to its bottom left corner
+	static constexpr int RIGHT_WALL_COLUMN = BOARD_COLUMN + GameBoard::width;
+	static_assert(GameBoard::height == ROWS, "the board fills the screen's height");
+
+	void addPieceObjects(const Tetromino& piece, int x, int y);
+	void addNumber(int value, int right, int y);
+
+	Renderer& owner;
+	TileEngine engine;
+	unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture;
+
+	uint16_t blankTile = 0;
+	array<array<uint16_t, PALETTE_SIZE>, ASSET_COUNT> cellTiles{ };
+	array<array<uint16_t, PALETTE_SIZE>, ASSET_COUNT> pieceTiles{ };
+	array<uint16_t, 10> digitTiles{ };
+	int digitWidth = TileEngine::TILE_SIZE;
+
+public:
+	using Tile = array<uint32_t, TileEngine::TILE_PIXELS>;
+
+	// Tile of surface (RGBA8888) whose top left pixel is at originX, originY. Tinted like
+	// SDL_SetTextureColorMod; opaque tiles are blended over the background, object tiles keep
+	// alpha 0 or 255. Pixels outside the surface are background or transparent.
+	static Tile bake(const SDL_Surface* surface, int originX, int originY, SDL_Color tint, bool opaque);
+	static SDL_Surface* loadRgba(const string& path);
+
+	explicit TileRenderer(Renderer& owner);
+
+	// Bakes the tiles and creates the texture, false when an asset is missing
+	bool init( );
+	// Draws the board, its preview and the scoreboard onto the current render target
+	void render(const BoardView& board);
+
+	const TileEngine::Stats& getStats( ) const;
+};
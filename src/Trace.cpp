@@ -0,0 +1,122 @@
+#include "Trace.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	struct Event {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Written by its thread only, read by stop( ) after recording is off
+	struct ThreadRing {
+		uint32_t id;
+		string name;
+		array<Event, Trace::RING_EVENTS> events;
+		atomic<uint64_t> written{ 0 };
+	};
+
+	struct Rings {
+		mutex lock;
+		vector<unique_ptr<ThreadRing>> rings;   // never shrinks, a thread's ring outlives it
+	};
+
+	Rings& rings( ) {
+		static Rings instance;
+		return instance;
+	}
+
+	ThreadRing& threadRing( ) {
+		thread_local ThreadRing* ring = nullptr;
+		if (!ring) {
+			Rings& all = rings( );
+			lock_guard<mutex> guard(all.lock);
+			all.rings.push_back(make_unique<ThreadRing>( ));
+			ring = all.rings.back( ).get( );
+			ring->id = static_cast<uint32_t>(all.rings.size( ));
+		}
+		return *ring;
+	}
+
+	const auto epoch = chrono::steady_clock::now( );
+
+	void writeString(FILE* file, const char* text) {
+		fputc('"', file);
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\') fputc('\\', file);
+			if (static_cast<unsigned char>(*text) >= 0x20) fputc(*text, file);
+		}
+		fputc('"', file);
+	}
+}
+
+namespace Trace {
+	atomic<bool> recording{ false };
+
+	uint64_t now( ) {
+		// Never 0, Zone uses that for "not recording"
+		return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now( ) - epoch).count( )) + 1;
+	}
+
+	void record(const char* name, uint64_t start, uint64_t end) {
+		ThreadRing& ring = threadRing( );
+		uint64_t index = ring.written.load(memory_order_relaxed);
+		ring.events[index % RING_EVENTS] = { name, start, end };
+		ring.written.store(index + 1, memory_order_release);
+	}
+
+	void setThreadName(const char* name) {
+		ThreadRing& ring = threadRing( );
+		lock_guard<mutex> guard(rings( ).lock);
+		ring.name = name;
+	}
+
+	void start( ) {
+		{
+			Rings& all = rings( );
+			lock_guard<mutex> guard(all.lock);
+			for (auto& ring : all.rings) ring->written.store(0, memory_order_relaxed);
+		}
+		recording.store(true, memory_order_release);
+	}
+
+	bool stop(const string& path) {
+		recording.store(false, memory_order_release);
+
+		FILE* file = fopen(path.c_str( ), "wb");
+		if (!file) return false;
+
+		Rings& all = rings( );
+		lock_guard<mutex> guard(all.lock);
+		fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+		bool first = true;
+		for (const auto& ring : all.rings) {
+			if (!ring->name.empty( )) {
+				fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", ring->id);
+				writeString(file, ring->name.c_str( ));
+				fputs("}}", file);
+				first = false;
+			}
+
+			// A zone that closed right as recording stopped may still be writing the oldest slot, skip it
+			uint64_t written = ring->written.load(memory_order_acquire);
+			uint64_t begin = written > RING_EVENTS ? written - RING_EVENTS + 1 : 0;
+			for (uint64_t index = begin; index < written; index++) {
+				const Event& event = ring->events[index % RING_EVENTS];
+				fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", first ? "" : ",\n",
+					ring->id, event.start / 1000.0, (event.end - event.start) / 1000.0);
+				writeString(file, event.name);
+				fputc('}', file);
+				first = false;
+			}
+		}
+		fputs("\n]}\n", file);
+		return fclose(file) == 0;
+	}
+}
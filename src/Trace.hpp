@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Scoped zones written as Chrome trace events (chrome://tracing, ui.perfetto.dev). Every thread
+// records into its own ring buffer, the newest events win when a session outgrows it. With
+// tracing stopped a zone is one relaxed load; building with TETRIS_NO_TRACE removes zones entirely.
+namespace Trace {
+	// Events kept per thread, about 24 bytes each
+	constexpr size_t RING_EVENTS = 1 << 16;
+
+	extern atomic<bool> recording;
+
+	inline bool isRecording( ) { return recording.load(memory_order_relaxed); }
+	uint64_t now( );
+	// name must outlive the session, zones pass string literals
+	void record(const char* name, uint64_t start, uint64_t end);
+	void setThreadName(const char* name);
+
+	// Clears what earlier sessions left in the rings
+	void start( );
+	// Stops recording and writes every ring as trace event JSON, false when the file cannot be written
+	bool stop(const string& path);
+
+	class Zone {
+	private:
+		const char* name;
+		uint64_t start;
+
+	public:
+		explicit Zone(const char* name) : name(name), start(isRecording( ) ? now( ) : 0) { }
+		~Zone( ) {
+			if (start != 0 && isRecording( )) record(name, start, now( ));
+		}
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef TETRIS_NO_TRACE
+#define TRACE_ZONE(name) do { } while (0)
+#else
+#define TRACE_ZONE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#endif
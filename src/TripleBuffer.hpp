@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+using namespace std;
+
+// Latest-value handoff from one writer thread to one reader thread. The writer never waits
+// for the reader; the reader always gets the newest complete value and skips older ones.
+template <typename T>
+class TripleBuffer {
+	static_assert(is_trivially_copyable<T>::value, "TripleBuffer values must be trivially copyable");
+
+private:
+	static constexpr uint8_t INDEX_MASK = 0x3;
+	static constexpr uint8_t FRESH = 0x4;
+
+	array<T, 3> buffers{ };
+	uint8_t back = 0;                   // writer only
+	uint8_t front = 2;                  // reader only
+	atomic<uint8_t> middle{ 1 };        // index of the spare buffer plus FRESH once written
+
+public:
+	void publish(const T& value) {
+		buffers[back] = value;
+		back = middle.exchange(static_cast<uint8_t>(back | FRESH), memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Swaps in the newest value if there is one. Returns false when nothing new was published.
+	bool update( ) {
+		if (!(middle.load(memory_order_acquire) & FRESH)) return false;
+		front = middle.exchange(front, memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	// The value taken by the last successful update( )
+	const T& read( ) const { return buffers[front]; }
+};
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
 
 extern "C" {
 #include <SDL2/SDL.h>
@@ -6,8 +9,114 @@ extern "C" {
 }
 
 #include "Game.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+
+static void printUsage( ) {
+	std::cerr << "Usage: SDL_TD [--host <port> | --join <host:port> [--port <port>]]" << std::endl
+		<< "              [--delay <frames>] [--latency <ms>] [--jitter <ms>] [--loss <percent>]" << std::endl
+		<< "              [--stream <port | file>] [--spectate <host:port | file>]" << std::endl
+		<< "              [--mosaic <source,source,... | @list file>]" << std::endl
+		<< "              [--das <ms>] [--arr <ms>] [--mixer <sdl | software>]" << std::endl
+		<< "              [--audio-buffer <frames>] [--metrics <port | file>]" << std::endl
+		<< "              [--trace <file.json>] [--scores <file>] [--renderer <sprites | tiles>]" << std::endl
+		<< "              [--asset-budget <MB>] [--soak <hours> [--soak-sample <seconds>] [--soak-warmup <samples>]]" << std::endl;
+}
+
+// Versus options, see RollbackSession. Latency, jitter and loss are injected on our outgoing packets
+static bool parseArguments(int argc, char* argv[ ], VersusConfig& versus, bool& versusConfigured, SpectatorConfig& spectator,
+	InputConfig& input, AudioConfig& audio, std::string& metrics,
+	std::string& trace, std::string& scores, bool& tileRenderer, uint64_t& assetBudget, SoakConfig& soak) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--host" && hasValue) {
+			versus.host = true;
+			versus.localPort = static_cast<uint16_t>(atoi(argv[++i]));
+			versusConfigured = true;
+		} else if (arg == "--join" && hasValue) {
+			versus.host = false;
+			versus.remote = argv[++i];
+			versusConfigured = true;
+		} else if (arg == "--port" && hasValue) {
+			versus.localPort = static_cast<uint16_t>(atoi(argv[++i]));
+		} else if (arg == "--delay" && hasValue) {
+			versus.inputDelay = atoi(argv[++i]);
+		} else if (arg == "--latency" && hasValue) {
+			versus.latencyMs = static_cast<uint32_t>(atoi(argv[++i]));
+		} else if (arg == "--jitter" && hasValue) {
+			versus.jitterMs = static_cast<uint32_t>(atoi(argv[++i]));
+		} else if (arg == "--loss" && hasValue) {
+			versus.lossPercent = static_cast<float>(atof(argv[++i]));
+		} else if (arg == "--stream" && hasValue) {
+			spectator.stream = argv[++i];
+		} else if (arg == "--spectate" && hasValue) {
+			spectator.spectate = argv[++i];
+		} else if (arg == "--mosaic" && hasValue) {
+			spectator.mosaic = argv[++i];
+		} else if (arg == "--das" && hasValue) {
+			input.dasMs = static_cast<uint32_t>(atoi(argv[++i]));
+		} else if (arg == "--arr" && hasValue) {
+			input.arrMs = static_cast<uint32_t>(atoi(argv[++i]));
+		} else if (arg == "--mixer" && hasValue && (std::string(argv[i + 1]) == "sdl" || std::string(argv[i + 1]) == "software")) {
+			audio.softwareMixer = std::string(argv[++i]) == "software";
+		} else if (arg == "--audio-buffer" && hasValue) {
+			audio.bufferFrames = std::clamp(atoi(argv[++i]), 64, Sound::MAX_BUFFER_FRAMES);
+		} else if (arg == "--metrics" && hasValue) {
+			metrics = argv[++i];
+		} else if (arg == "--trace" && hasValue) {
+			trace = argv[++i];
+		} else if (arg == "--scores" && hasValue) {
+			scores = argv[++i];
+		} else if (arg == "--renderer" && hasValue && (std::string(argv[i + 1]) == "sprites" || std::string(argv[i + 1]) == "tiles")) {
+			tileRenderer = std::string(argv[++i]) == "tiles";
+		} else if (arg == "--asset-budget" && hasValue) {
+			assetBudget = static_cast<uint64_t>(std::max(1, atoi(argv[++i]))) << 20;
+		} else if (arg == "--soak" && hasValue) {
+			soak.hours = std::max(0.0, atof(argv[++i]));
+		} else if (arg == "--soak-sample" && hasValue) {
+			soak.sampleSeconds = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+		} else if (arg == "--soak-warmup" && hasValue) {
+			soak.warmupSamples = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+		} else {
+			printUsage( );
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[ ]) {
+	VersusConfig versusConfig;
+	bool versusConfigured = false;
+	SpectatorConfig spectatorConfig;
+	InputConfig inputConfig;
+	AudioConfig audioConfig;
+	std::string metricsTarget, tracePath, scoresPath = "highscores.dat";
+	bool tileRenderer = false;
+	uint64_t assetBudget = AssetManager::DEFAULT_BUDGET;
+	SoakConfig soakConfig;
+	if (!parseArguments(argc, argv, versusConfig, versusConfigured, spectatorConfig, inputConfig, audioConfig, metricsTarget, tracePath,
+		scoresPath, tileRenderer, assetBudget, soakConfig))
+		return 1;
+
+	// A soak runs headless unless the environment picks real drivers
+	if (soakConfig.hours > 0) {
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+		SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+	}
+
+	// Recording from the first frame, the trace is written when the game exits
+	Trace::setThreadName("main");
+	if (!tracePath.empty( )) Trace::start( );
+
+	MetricsExporter metrics;
+	if (!metricsTarget.empty( ) && !metrics.open(metricsTarget)) {
+		std::cerr << "Failed to export metrics to " << metricsTarget << std::endl;
+		return 1;
+	}
 
-int main( ) {
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
 		SDL_Log("Couldn't init SDL: %s", SDL_GetError( ));
 		return 1;
@@ -25,7 +134,7 @@ int main( ) {
 		return 1;
 	}
 
-	if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
+	if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, audioConfig.bufferFrames) < 0) {
 		SDL_Log("SDL_mixer could not initialize! SDL_mixer Error: %s\n", Mix_GetError( ));
 		return 1;
 	}
@@ -36,11 +145,26 @@ int main( ) {
 		SDL_Quit( );
 		return 1;
 	}
+	if (versusConfigured)
+		game.setVersusConfig(versusConfig);
+	game.setSpectatorConfig(spectatorConfig);
+	game.setInputConfig(inputConfig);
+	game.setAudioConfig(audioConfig);
+	game.setAssetBudget(assetBudget);
+	if (!tracePath.empty( ))
+		game.setTracePath(tracePath);
+	game.openHighScores(scoresPath);
+	if (tileRenderer)
+		game.useTileRenderer( );
+	game.setSoakConfig(soakConfig);
 
 	while (!game.isGameQuit( ))
 		game.run( );
 
+	if (Trace::isRecording( ) && !Trace::stop(tracePath.empty( ) ? "trace.json" : tracePath))
+		std::cerr << "Failed to write the trace" << std::endl;
+
 	SDL_Quit( );
 
-	return 0;
+	return game.hasSoakPassed( ) ? 0 : 1;
 }